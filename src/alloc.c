@@ -21,7 +21,9 @@
 #define OTRNG_ALLOC_PRIVATE
 
 #include "alloc.h"
+#include <pthread.h>
 #include <sodium.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -90,3 +92,254 @@ INTERNAL void otrng_secure_wipe(/*@notnull@*/ /*@only@*/ void *p,
                                 size_t size) /*@modifies p@*/ {
   sodium_memzero(p, size);
 }
+
+typedef struct secure_slab_s {
+  uint8_t *mem;
+  size_t slot_size; /* a header and an object */
+  size_t object_size;
+  size_t capacity;
+  size_t next_unused;
+  size_t live;
+  void *free_list; /* stored in the freed objects themselves */
+  struct secure_slab_s *prev, *next;
+} secure_slab_s;
+
+/* Before every object, so that freeing it finds its slab without a search.
+   It is NULL for a big object, allocated on its own. */
+typedef union secure_slab_header_u {
+  secure_slab_s *slab;
+  uint64_t align;
+} secure_slab_header_u;
+
+/* The slabs of a size class, the ones with free slots first */
+typedef struct secure_slab_class_s {
+  secure_slab_s *first, *last;
+  size_t slabs;
+} secure_slab_class_s;
+
+/* size classes: 32, 64 and 128 bytes */
+#define SECURE_SLAB_CLASSES 3
+
+/* The slabs are shared by every client and global state, which can be used
+   from different threads */
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static secure_slab_class_s slab_classes[SECURE_SLAB_CLASSES];
+static otrng_secure_slab_stats_s slab_stats = {0, 0, 0};
+
+static int slab_class_for(size_t size) {
+  int c;
+
+  for (c = 0; c < SECURE_SLAB_CLASSES; c++) {
+    if (size <= ((size_t)32 << c)) {
+      return c;
+    }
+  }
+
+  return -1;
+}
+
+static void slab_out_of_memory(size_t size) {
+  if (oom_handler != NULL) {
+    oom_handler();
+  }
+  fprintf(stderr, "fatal: memory exhausted (secure slab of %lu bytes).\n",
+          size);
+  exit(EXIT_FAILURE);
+}
+
+static void slab_unlink(secure_slab_class_s *class, secure_slab_s *slab) {
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    class->first = slab->next;
+  }
+
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  } else {
+    class->last = slab->prev;
+  }
+
+  slab->prev = NULL;
+  slab->next = NULL;
+}
+
+static void slab_push_first(secure_slab_class_s *class, secure_slab_s *slab) {
+  slab->prev = NULL;
+  slab->next = class->first;
+  if (class->first) {
+    class->first->prev = slab;
+  } else {
+    class->last = slab;
+  }
+  class->first = slab;
+}
+
+static void slab_push_last(secure_slab_class_s *class, secure_slab_s *slab) {
+  slab->next = NULL;
+  slab->prev = class->last;
+  if (class->last) {
+    class->last->next = slab;
+  } else {
+    class->first = slab;
+  }
+  class->last = slab;
+}
+
+static int slab_is_full(const secure_slab_s *slab) {
+  return !slab->free_list && slab->next_unused == slab->capacity;
+}
+
+static secure_slab_s *slab_new(size_t object_size) {
+  secure_slab_s *slab = otrng_xmalloc_z(sizeof(secure_slab_s));
+
+  /* One sodium_malloc, and so one set of guard pages and one mlock, for
+     the whole slab */
+  slab->mem = sodium_malloc(OTRNG_SECURE_SLAB_BYTES);
+  if (!slab->mem) {
+    slab_out_of_memory(OTRNG_SECURE_SLAB_BYTES);
+  }
+
+  slab->object_size = object_size;
+  slab->slot_size = sizeof(secure_slab_header_u) + object_size;
+  slab->capacity = OTRNG_SECURE_SLAB_BYTES / slab->slot_size;
+
+  slab_stats.slabs++;
+  slab_stats.pages_locked +=
+      OTRNG_SECURE_SLAB_BYTES / OTRNG_SECURE_SLAB_PAGE_BYTES;
+
+  return slab;
+}
+
+static void slab_free(secure_slab_s *slab) {
+  sodium_free(slab->mem);
+  otrng_free(slab);
+
+  slab_stats.slabs--;
+  slab_stats.pages_locked -=
+      OTRNG_SECURE_SLAB_BYTES / OTRNG_SECURE_SLAB_PAGE_BYTES;
+}
+
+INTERNAL /*@only@*/ /*@notnull@*/ void *otrng_secure_slab_alloc(size_t size) {
+  int c = slab_class_for(size);
+  secure_slab_class_s *class;
+  secure_slab_header_u *header;
+  secure_slab_s *slab;
+  void *result;
+
+  if (c < 0) {
+    header = sodium_malloc(sizeof(secure_slab_header_u) + size);
+    if (!header) {
+      slab_out_of_memory(size);
+    }
+    header->slab = NULL;
+    memset(header + 1, 0, size);
+    return header + 1;
+  }
+
+  pthread_mutex_lock(&slab_lock);
+
+  class = &slab_classes[c];
+  slab = class->first;
+  if (!slab || slab_is_full(slab)) {
+    slab = slab_new((size_t)32 << c);
+    slab_push_first(class, slab);
+    class->slabs++;
+  }
+
+  if (slab->free_list) {
+    result = slab->free_list;
+    memcpy(&slab->free_list, result, sizeof(void *));
+  } else {
+    header = (secure_slab_header_u *)(slab->mem +
+                                      slab->next_unused * slab->slot_size);
+    header->slab = slab;
+    result = header + 1;
+    slab->next_unused++;
+  }
+
+  memset(result, 0, slab->object_size);
+  slab->live++;
+  slab_stats.live_objects++;
+
+  /* A full slab goes after the ones with free slots */
+  if (slab_is_full(slab) && slab != class->last) {
+    slab_unlink(class, slab);
+    slab_push_last(class, slab);
+  }
+
+  pthread_mutex_unlock(&slab_lock);
+
+  return result;
+}
+
+INTERNAL void otrng_secure_slab_free(/*@null@*/ /*@only@*/ void *ptr) {
+  secure_slab_header_u *header;
+  secure_slab_class_s *class;
+  secure_slab_s *slab;
+  int was_full;
+
+  if (!ptr) {
+    return;
+  }
+
+  header = (secure_slab_header_u *)ptr - 1;
+  slab = header->slab;
+  if (!slab) {
+    sodium_free(header);
+    return;
+  }
+
+  pthread_mutex_lock(&slab_lock);
+
+  class = &slab_classes[slab_class_for(slab->object_size)];
+  was_full = slab_is_full(slab);
+
+  sodium_memzero(ptr, slab->object_size);
+  memcpy(ptr, &slab->free_list, sizeof(void *));
+  slab->free_list = ptr;
+  slab->live--;
+  slab_stats.live_objects--;
+
+  /* Keep the last slab of each class around, to not pay for the guard pages
+     again on the next message */
+  if (slab->live == 0 && class->slabs > 1) {
+    slab_unlink(class, slab);
+    class->slabs--;
+    slab_free(slab);
+  } else if (was_full) {
+    slab_unlink(class, slab);
+    slab_push_first(class, slab);
+  }
+
+  pthread_mutex_unlock(&slab_lock);
+}
+
+INTERNAL void otrng_secure_slab_stats(otrng_secure_slab_stats_s *stats) {
+  pthread_mutex_lock(&slab_lock);
+  *stats = slab_stats;
+  pthread_mutex_unlock(&slab_lock);
+}
+
+INTERNAL void otrng_secure_slab_release(void) {
+  int c;
+
+  pthread_mutex_lock(&slab_lock);
+
+  for (c = 0; c < SECURE_SLAB_CLASSES; c++) {
+    secure_slab_class_s *class = &slab_classes[c];
+    secure_slab_s *slab = class->first;
+
+    while (slab) {
+      secure_slab_s *next = slab->next;
+      if (slab->live == 0) {
+        slab_unlink(class, slab);
+        class->slabs--;
+        slab_free(slab);
+      }
+      slab = next;
+    }
+  }
+
+  pthread_mutex_unlock(&slab_lock);
+}
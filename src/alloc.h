@@ -44,4 +44,41 @@ INTERNAL void otrng_secure_free(/*@notnull@*/ /*@only@*/ void *ptr);
 INTERNAL void otrng_secure_wipe(/*@notnull@*/ /*@only@*/ void *p,
                                 size_t size) /*@modifies p@*/;
 
+/* Counters for the secure slab allocator */
+typedef struct otrng_secure_slab_stats_s {
+  size_t live_objects;
+  size_t slabs;
+  size_t pages_locked;
+} otrng_secure_slab_stats_s;
+
+/*
+ * Allocates a zeroed object of at most OTRNG_SECURE_SLAB_MAX_OBJECT bytes from
+ * a slab of guarded and locked memory, shared with other objects of the same
+ * size class. Bigger objects are allocated with otrng_secure_alloc.
+ *
+ * This is meant for the short-lived, fixed-size key material derived on every
+ * message, where a sodium_malloc per object is too expensive. The slabs are
+ * guarded by a lock, so it can be called from any thread.
+ */
+INTERNAL /*@only@*/ /*@notnull@*/ void *otrng_secure_slab_alloc(size_t size);
+
+/*
+ * Wipes an object allocated with otrng_secure_slab_alloc and returns it to its
+ * slab.
+ */
+INTERNAL void otrng_secure_slab_free(/*@null@*/ /*@only@*/ void *ptr);
+
+INTERNAL void otrng_secure_slab_stats(otrng_secure_slab_stats_s *stats);
+
+/* Releases every slab with no live objects */
+INTERNAL void otrng_secure_slab_release(void);
+
+#ifdef OTRNG_ALLOC_PRIVATE
+
+#define OTRNG_SECURE_SLAB_BYTES 16384
+#define OTRNG_SECURE_SLAB_PAGE_BYTES 4096
+#define OTRNG_SECURE_SLAB_MAX_OBJECT 128
+
+#endif
+
 #endif // OTRNG_ALLOC_H
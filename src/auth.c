@@ -171,22 +171,18 @@ static otrng_result otrng_rsig_calculate_c_from_sigma_with_usage_and_domain(
     uint8_t usage, const char *domain_sep, goldilocks_448_scalar_p c,
     const ring_sig_s *src, const otrng_public_key A1, const otrng_public_key A2,
     const otrng_public_key A3, const uint8_t *msg, size_t msg_len) {
-  otrng_public_key gr1, gr2, gr3, A1c1, A2c2, A3c3;
+  otrng_public_key T1, T2, T3;
 
-  goldilocks_448_point_scalarmul(gr1, goldilocks_448_point_base, src->r1);
-  goldilocks_448_point_scalarmul(gr2, goldilocks_448_point_base, src->r2);
-  goldilocks_448_point_scalarmul(gr3, goldilocks_448_point_base, src->r3);
-
-  goldilocks_448_point_scalarmul(A1c1, A1, src->c1);
-  goldilocks_448_point_scalarmul(A2c2, A2, src->c2);
-  goldilocks_448_point_scalarmul(A3c3, A3, src->c3);
-
-  goldilocks_448_point_add(A1c1, A1c1, gr1);
-  goldilocks_448_point_add(A2c2, A2c2, gr2);
-  goldilocks_448_point_add(A3c3, A3c3, gr3);
+  /* Everything here is public: the ring, the proof and the message. Each
+     Ti = G * ri + Ai * ci is computed as one interleaved, variable-time
+     double scalar multiplication, which walks the precomputed table of the
+     base point instead of doing two full scalar multiplications. */
+  goldilocks_448_base_double_scalarmul_non_secret(T1, src->r1, A1, src->c1);
+  goldilocks_448_base_double_scalarmul_non_secret(T2, src->r2, A2, src->c2);
+  goldilocks_448_base_double_scalarmul_non_secret(T3, src->r3, A3, src->c3);
 
   if (!otrng_rsig_calculate_c_with_usage_and_domain(
-          usage, domain_sep, c, A1, A2, A3, A1c1, A2c2, A3c3, msg, msg_len)) {
+          usage, domain_sep, c, A1, A2, A3, T1, T2, T3, msg, msg_len)) {
     return OTRNG_ERROR;
   }
 
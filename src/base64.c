@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "base64.h"
 #include "alloc.h"
 
@@ -10,3 +12,42 @@ INTERNAL char *otrng_base64_encode(uint8_t *src, size_t src_len) {
 
   return dst;
 }
+
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+INTERNAL void otrng_base64_otr_encode_in_place(char *buffer, size_t src_len) {
+  size_t total = OTRNG_BASE64_OTR_ENCODE_LEN(src_len) + 1;
+  const uint8_t *src = (uint8_t *)buffer + total - src_len;
+  char *dst = buffer;
+  size_t remaining = src_len;
+
+  memcpy(dst, "?OTR:", 5);
+  dst += 5;
+
+  while (remaining >= 3) {
+    uint8_t a = src[0], b = src[1], c = src[2];
+    src += 3;
+    remaining -= 3;
+
+    dst[0] = base64_alphabet[a >> 2];
+    dst[1] = base64_alphabet[((a & 0x03) << 4) | (b >> 4)];
+    dst[2] = base64_alphabet[((b & 0x0f) << 2) | (c >> 6)];
+    dst[3] = base64_alphabet[c & 0x3f];
+    dst += 4;
+  }
+
+  if (remaining > 0) {
+    uint8_t a = src[0];
+    uint8_t b = remaining > 1 ? src[1] : 0;
+
+    dst[0] = base64_alphabet[a >> 2];
+    dst[1] = base64_alphabet[((a & 0x03) << 4) | (b >> 4)];
+    dst[2] = remaining > 1 ? base64_alphabet[(b & 0x0f) << 2] : '=';
+    dst[3] = '=';
+    dst += 4;
+  }
+
+  dst[0] = '.';
+  dst[1] = '\0';
+}
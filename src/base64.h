@@ -5,6 +5,9 @@
 #define OTRNG_BASE64_ENCODE_LEN(x) (((x + 2) / 3) * 4)
 #define OTRNG_BASE64_DECODE_LEN(x) (((x + 3) / 4) * 3)
 
+/* "?OTR:" + base64 + "." */
+#define OTRNG_BASE64_OTR_ENCODE_LEN(x) (5 + OTRNG_BASE64_ENCODE_LEN(x) + 1)
+
 #ifndef S_SPLINT_S
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wstrict-prototypes"
@@ -18,4 +21,14 @@
 
 INTERNAL char *otrng_base64_encode(uint8_t *src, size_t src_len);
 
+/*
+ * Encodes the last [src_len] bytes of [buffer] as an OTR message ("?OTR:" +
+ * base64 + "."), written NUL-terminated from the start of the same [buffer].
+ *
+ * [buffer] must be OTRNG_BASE64_OTR_ENCODE_LEN(src_len) + 1 bytes long. Every
+ * input group is read before its output is written, and the output never
+ * reaches the input still to be read.
+ */
+INTERNAL void otrng_base64_otr_encode_in_place(char *buffer, size_t src_len);
+
 #endif
@@ -80,7 +80,13 @@ API otrng_client_s *otrng_client_new(const otrng_client_id_s client_id) {
   client->max_stored_msg_keys = 1000;
   client->max_published_prekey_msg = 100;
   client->minimum_stored_prekey_msg = 20;
+  client->max_instances = OTRNG_CLIENT_DEFAULT_MAX_INSTANCES;
+  client->max_fragment_contexts = OTRNG_FRAGMENT_DEFAULT_MAX_CONTEXTS;
+  client->max_fragment_bytes = OTRNG_FRAGMENT_DEFAULT_MAX_BYTES;
   client->should_heartbeat = should_heartbeat;
+  client->dh_pool = otrng_dh_keypair_pool_new();
+  client->conversation_index = otrng_hash_index_new();
+  client->instance_index = otrng_hash_index_new();
 
 #define EXTRA_CLIENT_PROFILE_EXPIRATION_SECONDS 2 * 24 * 60 * 60; /* 2 days */
   client->profiles_extra_valid_time = EXTRA_CLIENT_PROFILE_EXPIRATION_SECONDS;
@@ -114,26 +120,140 @@ API void otrng_client_free(otrng_client_s *client) {
   otrng_prekey_profile_free(client->prekey_profile);
   otrng_prekey_profile_free(client->exp_prekey_profile);
   otrng_list_free(client->conversations, conversation_free);
+  otrng_hash_index_free(client->conversation_index);
+  otrng_hash_index_free(client->instance_index);
   otrng_prekey_client_free(client->prekey_client);
+  otrng_keypair_pool_free(client->dh_pool);
 
   otrng_free(client);
 }
 
-// TODO: @instance_tag There may be multiple conversations with the same
-// recipient if they use multiple instance tags. We are not allowing this yet.
+tstatic int find_conversation_by_recipient(const void *current,
+                                           const void *wanted) {
+  const otrng_conversation_s *conv = current;
+  return strcmp(conv->recipient, wanted) == 0;
+}
+
+/* The first conversation with [recipient], the one messages are sent from */
+tstatic otrng_conversation_s *get_conversation_with(const char *recipient,
+                                                    otrng_client_s *client) {
+  uint64_t hash =
+      otrng_hash_index_hash(client->conversation_index, recipient, NULL);
+
+  return otrng_hash_index_get(client->conversation_index, hash, recipient,
+                              find_conversation_by_recipient);
+}
+
+typedef struct conversation_key_s {
+  const char *recipient;
+  uint32_t their_instance_tag;
+} conversation_key_s;
+
+tstatic int find_conversation_by_instance(const void *current,
+                                          const void *wanted) {
+  const otrng_conversation_s *conv = current;
+  const conversation_key_s *key = wanted;
+  return conv->their_instance_tag == key->their_instance_tag &&
+         strcmp(conv->recipient, key->recipient) == 0;
+}
+
 tstatic otrng_conversation_s *
-get_conversation_with(const char *recipient, list_element_s *conversations) {
-  const list_element_s *el = NULL;
-  otrng_conversation_s *conv = NULL;
+get_instance_conversation(uint32_t their_instance_tag, const char *recipient,
+                          otrng_client_s *client) {
+  conversation_key_s key;
+  uint64_t hash = otrng_hash_index_hash_tag(client->instance_index, recipient,
+                                            their_instance_tag);
 
-  for (el = conversations; el; el = el->next) {
-    conv = el->data;
-    if (!strcmp(conv->recipient, recipient)) {
-      return conv;
-    }
+  key.recipient = recipient;
+  key.their_instance_tag = their_instance_tag;
+
+  return otrng_hash_index_get(client->instance_index, hash, &key,
+                              find_conversation_by_instance);
+}
+
+/* Keeps [instance_index] up to date with the instance the connection of
+   [conv] is talking to, which the DAKE sets */
+tstatic void index_conversation_instance(otrng_conversation_s *conv,
+                                         otrng_client_s *client) {
+  uint32_t their_instance_tag = conv->conn->their_instance_tag;
+
+  if (conv->their_instance_tag == their_instance_tag) {
+    return;
   }
 
-  return NULL;
+  if (conv->their_instance_tag) {
+    otrng_hash_index_remove(client->instance_index,
+                            otrng_hash_index_hash_tag(client->instance_index,
+                                                      conv->recipient,
+                                                      conv->their_instance_tag),
+                            conv);
+  }
+
+  conv->their_instance_tag = their_instance_tag;
+  if (their_instance_tag) {
+    otrng_hash_index_add(client->instance_index,
+                         otrng_hash_index_hash_tag(client->instance_index,
+                                                   conv->recipient,
+                                                   their_instance_tag),
+                         conv);
+  }
+}
+
+/* Makes [conv] the conversation messages to its recipient are sent from */
+tstatic void make_first_conversation(otrng_conversation_s *conv,
+                                     otrng_client_s *client) {
+  uint64_t hash =
+      otrng_hash_index_hash(client->conversation_index, conv->recipient, NULL);
+  otrng_conversation_s *first = otrng_hash_index_get(
+      client->conversation_index, hash, conv->recipient,
+      find_conversation_by_recipient);
+
+  if (first == conv) {
+    return;
+  }
+
+  if (first) {
+    otrng_hash_index_remove(client->conversation_index, hash, first);
+  }
+  otrng_hash_index_add(client->conversation_index, hash, conv);
+}
+
+tstatic void destroy_client_conversation(const otrng_conversation_s *conv,
+                                         otrng_client_s *client) {
+  list_element_s *elem = otrng_list_get_by_value(conv, client->conversations);
+  const list_element_s *el;
+
+  if (conv->their_instance_tag) {
+    otrng_hash_index_remove(client->instance_index,
+                            otrng_hash_index_hash_tag(client->instance_index,
+                                                      conv->recipient,
+                                                      conv->their_instance_tag),
+                            conv);
+  }
+  otrng_hash_index_remove(
+      client->conversation_index,
+      otrng_hash_index_hash(client->conversation_index, conv->recipient, NULL),
+      conv);
+  if (elem == client->last_conversation) {
+    client->last_conversation = NULL;
+  }
+
+  client->conversations =
+      otrng_list_remove_element(elem, client->conversations);
+  otrng_list_free_nodes(elem);
+
+  /* Another instance of the recipient takes its place, if there is one */
+  if (get_conversation_with(conv->recipient, client)) {
+    return;
+  }
+
+  for (el = client->conversations; el; el = el->next) {
+    otrng_conversation_s *other = el->data;
+    if (strcmp(other->recipient, conv->recipient) == 0) {
+      make_first_conversation(other, client);
+      return;
+    }
+  }
 }
 
 tstatic otrng_policy_s get_policy_for(const char *recipient) {
@@ -145,6 +265,13 @@ tstatic otrng_policy_s get_policy_for(const char *recipient) {
   return policy;
 }
 
+API otrng_conversation_s *
+otrng_client_get_instance_conversation(uint32_t their_instance_tag,
+                                       const char *recipient,
+                                       otrng_client_s *client) {
+  return get_instance_conversation(their_instance_tag, recipient, client);
+}
+
 API otrng_bool otrng_conversation_is_encrypted(otrng_conversation_s *conv) {
   if (!conv) {
     return otrng_false;
@@ -204,15 +331,10 @@ tstatic /*@temp@*/ otrng_s *create_connection_for(const char *recipient,
 }
 
 tstatic otrng_conversation_s *
-get_or_create_conversation_with(const char *recipient, otrng_client_s *client) {
+create_conversation_with(const char *recipient, otrng_client_s *client) {
   otrng_conversation_s *conv = NULL;
   otrng_s *conn = NULL;
 
-  conv = get_conversation_with(recipient, client->conversations);
-  if (conv) {
-    return conv;
-  }
-
   conn = create_connection_for(recipient, client);
   if (!conn) {
     return NULL;
@@ -224,7 +346,157 @@ get_or_create_conversation_with(const char *recipient, otrng_client_s *client) {
     return NULL;
   }
 
-  client->conversations = otrng_list_add(conv, client->conversations);
+  client->last_conversation = otrng_list_append(
+      conv, &client->conversations, client->last_conversation);
+  if (!get_conversation_with(recipient, client)) {
+    make_first_conversation(conv, client);
+  }
+
+  return conv;
+}
+
+tstatic otrng_conversation_s *
+get_or_create_conversation_with(const char *recipient, otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+
+  conv = get_conversation_with(recipient, client);
+  if (conv) {
+    return conv;
+  }
+
+  return create_conversation_with(recipient, client);
+}
+
+API otrng_result
+otrng_conversation_snapshot(uint8_t **dst, size_t *dst_len,
+                            const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES],
+                            const otrng_conversation_s *conv) {
+  if (!conv || !conv->conn) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_snapshot_seal(dst, dst_len, key, conv->conn);
+}
+
+API otrng_conversation_s *
+otrng_client_restore_conversation(const uint8_t *snapshot, size_t snapshot_len,
+                                  const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES],
+                                  otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  otrng_v3_conn_s *v3_conn = NULL;
+  otrng_s *conn = otrng_new(client, get_policy_for(NULL));
+
+  if (!otrng_snapshot_restore(conn, snapshot, snapshot_len, key) ||
+      !conn->peer ||
+      get_instance_conversation(conn->their_instance_tag, conn->peer,
+                                client)) {
+    otrng_conn_free(conn);
+    return NULL;
+  }
+
+  v3_conn = otrng_v3_conn_new(client, conn->peer);
+  if (!v3_conn) {
+    otrng_conn_free(conn);
+    return NULL;
+  }
+
+  v3_conn->opdata = conn; /* For use in callbacks */
+  conn->v3_conn = v3_conn;
+
+  conv = new_conversation_with(conn->peer, conn);
+  client->last_conversation = otrng_list_append(
+      conv, &client->conversations, client->last_conversation);
+  if (!get_conversation_with(conv->recipient, client)) {
+    make_first_conversation(conv, client);
+  }
+  index_conversation_instance(conv, client);
+
+  return conv;
+}
+
+/* Counts the conversations with [recipient], and finds the one whose DAKE
+   has not authenticated its instance yet, if any */
+tstatic otrng_conversation_s *
+find_unauthenticated_conversation(size_t *count, const char *recipient,
+                                  otrng_client_s *client) {
+  otrng_conversation_s *unauthenticated = NULL;
+  const list_element_s *el;
+
+  *count = 0;
+  for (el = client->conversations; el; el = el->next) {
+    otrng_conversation_s *conv = el->data;
+
+    if (strcmp(conv->recipient, recipient) != 0) {
+      continue;
+    }
+
+    (*count)++;
+    if (conv->unauthenticated) {
+      unauthenticated = conv;
+    }
+  }
+
+  return unauthenticated;
+}
+
+/*
+ * The conversation a received message belongs to. A v4 message goes to the
+ * conversation with the instance that sent it, so that each device of the
+ * recipient keeps its own DAKE and ratchet instead of taking over a single
+ * connection. v3 instances are left to libotr. NULL if the recipient already
+ * has as many instances as the client allows.
+ */
+tstatic otrng_conversation_s *
+get_or_create_conversation_for(const otrng_header_s *header,
+                               const char *recipient, otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  otrng_conversation_s *unauthenticated;
+  size_t count;
+
+  if (header->version != OTRNG_PROTOCOL_VERSION_4 ||
+      !otrng_instance_tag_valid(header->sender_instance_tag)) {
+    return get_or_create_conversation_with(recipient, client);
+  }
+
+  conv = get_instance_conversation(header->sender_instance_tag, recipient,
+                                   client);
+  if (conv) {
+    return conv;
+  }
+
+  conv = get_conversation_with(recipient, client);
+  if (!conv || !conv->conn->their_instance_tag) {
+    return conv ? conv : create_conversation_with(recipient, client);
+  }
+
+  /* A new instance only gets a conversation of its own when it starts a
+     DAKE. Until the DAKE authenticates it, that conversation takes the place
+     of any other one still waiting for its DAKE, so that made up instance
+     tags can not pile up conversations. */
+  if (header->type != IDENTITY_MSG_TYPE &&
+      header->type != NON_INT_AUTH_MSG_TYPE) {
+    return conv;
+  }
+
+  unauthenticated =
+      find_unauthenticated_conversation(&count, recipient, client);
+  if (unauthenticated) {
+    destroy_client_conversation(unauthenticated, client);
+    conversation_free(unauthenticated);
+  } else if (count >= client->max_instances) {
+    return NULL;
+  }
+
+  conv = create_conversation_with(recipient, client);
+  if (conv) {
+    conv->unauthenticated = otrng_true;
+    conv->their_instance_tag = header->sender_instance_tag;
+    otrng_hash_index_add(
+        client->instance_index,
+        otrng_hash_index_hash_tag(client->instance_index, recipient,
+                                  header->sender_instance_tag),
+        conv);
+  }
 
   return conv;
 }
@@ -236,7 +508,7 @@ otrng_client_get_conversation(int force_create, const char *recipient,
     return get_or_create_conversation_with(recipient, client);
   }
 
-  return get_conversation_with(recipient, client->conversations);
+  return get_conversation_with(recipient, client);
 }
 
 // TODO: @client this should allow TLVs to be added to the message
@@ -291,6 +563,28 @@ API otrng_result otrng_client_send(char **new_msg, const char *msg,
   return send_message(new_msg, msg, recipient, client);
 }
 
+API otrng_result otrng_client_send_batch(char **new_msgs, const char **msgs,
+                                         size_t count, const char *recipient,
+                                         otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  otrng_warning warn = OTRNG_WARN_NONE;
+  otrng_result result;
+
+  conv = get_or_create_conversation_with(recipient, client);
+  if (!conv) {
+    return OTRNG_ERROR;
+  }
+
+  result = otrng_send_messages(new_msgs, (const string_p *)msgs, count, &warn,
+                               0, conv->conn);
+
+  if (warn == OTRNG_WARN_SEND_NOT_ENCRYPTED) {
+    return OTRNG_ERROR;
+  }
+
+  return result;
+}
+
 API otrng_result otrng_client_send_non_interactive_auth(
     char **new_msg, const prekey_ensemble_s *ensemble, const char *recipient,
     otrng_client_s *client) {
@@ -331,6 +625,35 @@ API otrng_result otrng_client_send_fragment(otrng_message_to_send_s **new_msg,
   return ret;
 }
 
+API otrng_result otrng_client_send_scattered(otrng_scattered_message_s *dst,
+                                             const char *msg, int mms,
+                                             const char *recipient,
+                                             otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  string_p to_send = NULL;
+
+  conv = get_or_create_conversation_with(recipient, client);
+  if (!conv) {
+    return OTRNG_ERROR;
+  }
+
+  if (otrng_failed(send_message(&to_send, msg, recipient, client))) {
+    otrng_free(to_send);
+    return OTRNG_ERROR;
+  }
+
+  if (otrng_failed(otrng_fragment_message_scattered(
+          dst, mms, otrng_fragment_next_identifier(&conv->conn->fragment_ids),
+          otrng_client_get_instance_tag(client),
+          conv->conn->their_instance_tag, to_send))) {
+    otrng_free(to_send);
+    return OTRNG_ERROR;
+  }
+  dst->encoded = to_send;
+
+  return OTRNG_SUCCESS;
+}
+
 API otrng_result otrng_client_smp_start(char **to_send, const char *recipient,
                                         const unsigned char *question,
                                         const size_t q_len,
@@ -362,6 +685,69 @@ API otrng_result otrng_client_smp_respond(char **to_send, const char *recipient,
   return otrng_smp_continue(to_send, secret, secret_len, conv->conn);
 }
 
+/*
+ * The conversation a received [msg] belongs to, or NULL if it has none.
+ * [dropped] is set for a message to another instance of ours, which is
+ * dropped before decoding it.
+ */
+tstatic otrng_conversation_s *get_or_create_conversation_receiving(
+    otrng_header_s *header, otrng_bool *dropped, const char *msg,
+    const char *recipient, otrng_client_s *client) {
+  if (otrng_failed(otrng_peek_header(header, msg))) {
+    header->version = 0;
+  }
+
+  *dropped = header->version == OTRNG_PROTOCOL_VERSION_4 &&
+             header->receiver_instance_tag != 0 &&
+             header->receiver_instance_tag !=
+                 otrng_client_get_instance_tag(client);
+  if (*dropped) {
+    return NULL;
+  }
+
+  return get_or_create_conversation_for(header, recipient, client);
+}
+
+/* Whether [msg] is a v4 message to us from [instance] */
+tstatic otrng_bool received_from_instance(uint32_t instance, const char *msg,
+                                          otrng_client_s *client) {
+  otrng_header_s header;
+
+  if (otrng_failed(otrng_peek_header(&header, msg))) {
+    return otrng_false;
+  }
+
+  return header.version == OTRNG_PROTOCOL_VERSION_4 &&
+         header.sender_instance_tag == instance &&
+         (header.receiver_instance_tag == 0 ||
+          header.receiver_instance_tag ==
+              otrng_client_get_instance_tag(client));
+}
+
+/* Frees [conv] if it was only created for a DAKE that failed */
+tstatic void conversation_received(otrng_conversation_s *conv,
+                                   otrng_bool accepted,
+                                   otrng_client_s *client) {
+  index_conversation_instance(conv, client);
+
+  if (conv->unauthenticated) {
+    if (!accepted) {
+      destroy_client_conversation(conv, client);
+      conversation_free(conv);
+      return;
+    }
+
+    if (otrng_conversation_is_encrypted(conv)) {
+      conv->unauthenticated = otrng_false;
+    }
+  }
+
+  /* Replies go to the instance we last heard from in private */
+  if (accepted && otrng_conversation_is_encrypted(conv)) {
+    make_first_conversation(conv, client);
+  }
+}
+
 API otrng_result otrng_client_receive(char **new_msg, char **to_display,
                                       const char *msg, const char *recipient,
                                       otrng_client_s *client,
@@ -369,6 +755,8 @@ API otrng_result otrng_client_receive(char **new_msg, char **to_display,
   otrng_result result = OTRNG_ERROR;
   otrng_response_s *response = NULL;
   otrng_conversation_s *conv = NULL;
+  otrng_header_s header;
+  otrng_bool dropped;
   otrng_warning warn;
 
   *should_ignore = otrng_false;
@@ -383,7 +771,13 @@ API otrng_result otrng_client_receive(char **new_msg, char **to_display,
 
   *new_msg = NULL;
 
-  conv = get_or_create_conversation_with(recipient, client);
+  conv = get_or_create_conversation_receiving(&header, &dropped, msg,
+                                              recipient, client);
+  if (dropped) {
+    *to_display = NULL;
+    return OTRNG_SUCCESS;
+  }
+
   if (!conv) {
     *should_ignore = otrng_true;
     return OTRNG_SUCCESS;
@@ -394,6 +788,8 @@ API otrng_result otrng_client_receive(char **new_msg, char **to_display,
 
   result = otrng_receive_message(response, &warn, msg, conv->conn);
 
+  conversation_received(conv, otrng_succeeded(result), client);
+
   if (warn == OTRNG_WARN_RECEIVED_NOT_VALID) {
     //    return OTRNG_CLIENT_RESULT_ERROR_NOT_VALID;
     // TODO: fix this
@@ -418,19 +814,88 @@ API otrng_result otrng_client_receive(char **new_msg, char **to_display,
   return result;
 }
 
-tstatic void destroy_client_conversation(const otrng_conversation_s *conv,
-                                         otrng_client_s *client) {
-  list_element_s *elem = otrng_list_get_by_value(conv, client->conversations);
-  client->conversations =
-      otrng_list_remove_element(elem, client->conversations);
-  otrng_list_free_nodes(elem);
+API otrng_result otrng_client_receive_batch(char **new_msgs, char **to_display,
+                                            otrng_result *results,
+                                            const char **msgs, size_t count,
+                                            const char *recipient,
+                                            otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  otrng_response_s **responses;
+  otrng_result result = OTRNG_SUCCESS;
+  otrng_header_s header;
+  otrng_bool dropped, accepted;
+  size_t n, start, end;
+
+  if (!client || !new_msgs || !to_display || !results) {
+    return OTRNG_ERROR;
+  }
+
+  responses = otrng_xmalloc((count ? count : 1) * sizeof(otrng_response_s *));
+  for (n = 0; n < count; n++) {
+    responses[n] = otrng_response_new();
+    results[n] = OTRNG_SUCCESS;
+  }
+
+  /* Each run of messages from the same instance goes through the ratchet of
+     its conversation at once */
+  for (start = 0; start < count; start = end) {
+    end = start + 1;
+
+    conv = get_or_create_conversation_receiving(&header, &dropped, msgs[start],
+                                                recipient, client);
+    if (!conv) {
+      continue;
+    }
+
+    while (end < count && conv->their_instance_tag &&
+           received_from_instance(conv->their_instance_tag, msgs[end],
+                                  client)) {
+      end++;
+    }
+
+    if (otrng_failed(otrng_receive_messages(
+            responses + start, results + start,
+            (const string_p *)msgs + start, end - start, conv->conn))) {
+      result = OTRNG_ERROR;
+    }
+
+    accepted = otrng_false;
+    for (n = start; n < end; n++) {
+      accepted = accepted || otrng_succeeded(results[n]);
+    }
+    conversation_received(conv, accepted, client);
+  }
+
+  for (n = 0; n < count; n++) {
+    new_msgs[n] = NULL;
+    to_display[n] = NULL;
+
+    if (responses[n]->to_send) {
+      new_msgs[n] = otrng_xstrdup(responses[n]->to_send);
+    }
+
+    if (responses[n]->to_display) {
+      to_display[n] = otrng_xstrdup(responses[n]->to_display);
+    }
+
+    if (responses[n]->warning == OTRNG_WARN_RECEIVED_NOT_VALID) {
+      results[n] = OTRNG_ERROR;
+      result = OTRNG_ERROR;
+    }
+
+    otrng_response_free(responses[n]);
+  }
+
+  otrng_free(responses);
+
+  return result;
 }
 
 API otrng_result otrng_client_disconnect(char **new_msg, const char *recipient,
                                          otrng_client_s *client) {
   otrng_conversation_s *conv = NULL;
 
-  conv = get_conversation_with(recipient, client->conversations);
+  conv = get_conversation_with(recipient, client);
   if (!conv) {
     return OTRNG_ERROR;
   }
@@ -455,7 +920,7 @@ API otrng_result otrng_expire_encrypted_session(char **new_msg,
   otrng_conversation_s *conv = NULL;
   time_t now;
 
-  conv = get_conversation_with(recipient, client->conversations);
+  conv = get_conversation_with(recipient, client);
   if (!conv) {
     return OTRNG_ERROR;
   }
@@ -483,7 +948,7 @@ API otrng_result otrng_client_expire_fragments(int expiration_time,
   for (el = client->conversations; el; el = el->next) {
     conv = el->data;
     if (otrng_failed(otrng_expire_fragments(now, expiration_time,
-                                            &conv->conn->pending_fragments))) {
+                                            conv->conn->pending_fragments))) {
       return OTRNG_ERROR;
     }
   }
@@ -555,6 +1020,10 @@ INTERNAL void otrng_client_store_my_prekey_message(prekey_message_s *msg,
   }
 
   client->our_prekeys = otrng_list_add(msg, client->our_prekeys);
+
+  if (otrng_client_prekey_journal(client)) {
+    otrng_prekey_journal_add(otrng_client_prekey_journal(client), client, msg);
+  }
 }
 
 API prekey_message_s **
@@ -576,7 +1045,8 @@ otrng_client_build_prekey_messages(uint8_t num_messages,
   for (i = 0; i < num_messages; i++) {
     ecdh_keypair_s ecdh;
     dh_keypair_s dh;
-    if (!otrng_generate_ephemeral_keys(&ecdh, &dh)) {
+    if (!otrng_ephemeral_pool_take(&ecdh, &dh,
+                                   otrng_client_ephemeral_pool(client))) {
       otrng_free(messages);
       return NULL;
     }
@@ -995,6 +1465,11 @@ otrng_client_delete_my_prekey_message_by_id(uint32_t id,
 
   client->our_prekeys = otrng_list_remove_element(node, client->our_prekeys);
   otrng_list_free(node, prekey_message_free_from_list);
+
+  if (otrng_client_prekey_journal(client)) {
+    otrng_prekey_journal_delete(otrng_client_prekey_journal(client), client,
+                                id);
+  }
 }
 
 API void otrng_client_set_padding(size_t granularity, otrng_client_s *client) {
@@ -1009,6 +1484,133 @@ API void otrng_client_set_max_stored_msg_keys(unsigned int max_stored_msg_keys,
   client->max_stored_msg_keys = max_stored_msg_keys;
 }
 
+API void otrng_client_set_lookahead_depth(unsigned int lookahead_depth,
+                                          otrng_client_s *client) {
+  assert(client != NULL);
+
+  client->lookahead_depth = lookahead_depth;
+}
+
+API size_t otrng_client_do_background_work(size_t budget,
+                                           otrng_client_s *client) {
+  const list_element_s *el;
+  size_t derived;
+
+  assert(client != NULL);
+
+  derived = otrng_keypair_pool_fill(client->dh_pool, budget);
+
+  for (el = client->conversations; el; el = el->next) {
+    const otrng_conversation_s *conv = el->data;
+
+    if (!conv->conn || !conv->conn->keys) {
+      continue;
+    }
+
+    /* Also frees what was derived if the depth went down to zero */
+    derived += otrng_key_manager_lookahead(
+        conv->conn->keys, client->lookahead_depth, budget - derived);
+  }
+
+  return derived;
+}
+
+API size_t otrng_client_fill_dh_pool(size_t budget, otrng_client_s *client) {
+  assert(client != NULL);
+
+  return otrng_keypair_pool_fill(client->dh_pool, budget);
+}
+
+API void otrng_client_set_dh_pool_depth(unsigned int dh_pool_depth,
+                                        otrng_client_s *client) {
+  assert(client != NULL);
+
+  otrng_keypair_pool_set_depth(client->dh_pool, dh_pool_depth);
+}
+
+API void otrng_client_get_dh_pool_stats(otrng_keypair_pool_stats_s *dst,
+                                        const otrng_client_s *client) {
+  assert(client != NULL);
+
+  otrng_keypair_pool_get_stats(dst, client->dh_pool);
+}
+
+API void otrng_client_set_max_instances(unsigned int max_instances,
+                                        otrng_client_s *client) {
+  assert(client != NULL);
+
+  client->max_instances = max_instances;
+}
+
+API void otrng_client_set_fragment_limits(size_t max_contexts, size_t max_bytes,
+                                          otrng_client_s *client) {
+  const list_element_s *el;
+
+  assert(client != NULL);
+
+  client->max_fragment_contexts = max_contexts;
+  client->max_fragment_bytes = max_bytes;
+
+  /* Takes effect on the next fragment of the existing conversations */
+  for (el = client->conversations; el; el = el->next) {
+    const otrng_conversation_s *conv = el->data;
+
+    if (!conv->conn || !conv->conn->pending_fragments) {
+      continue;
+    }
+
+    conv->conn->pending_fragments->max_contexts = max_contexts;
+    conv->conn->pending_fragments->max_bytes = max_bytes;
+  }
+}
+
+API void otrng_client_get_fragment_stats(otrng_fragment_stats_s *dst,
+                                         const otrng_client_s *client) {
+  const list_element_s *el;
+
+  assert(client != NULL);
+
+  memset(dst, 0, sizeof(otrng_fragment_stats_s));
+  for (el = client->conversations; el; el = el->next) {
+    const otrng_conversation_s *conv = el->data;
+
+    if (!conv->conn || !conv->conn->pending_fragments) {
+      continue;
+    }
+
+    otrng_fragment_reassembly_add_stats(dst, conv->conn->pending_fragments);
+  }
+}
+
+API void otrng_client_get_receive_latency(otrng_latency_histogram_s *dst,
+                                          const otrng_client_s *client) {
+  assert(client != NULL);
+
+  memcpy(dst, &client->receive_latency, sizeof(otrng_latency_histogram_s));
+}
+
+API void otrng_client_reset_receive_latency(otrng_client_s *client) {
+  assert(client != NULL);
+
+  memset(&client->receive_latency, 0, sizeof(otrng_latency_histogram_s));
+}
+
+INTERNAL void otrng_client_record_receive_latency(otrng_client_s *client,
+                                                  uint64_t us) {
+  otrng_latency_histogram_s *histogram = &client->receive_latency;
+  int bucket = 0;
+
+  while (bucket < OTRNG_LATENCY_BUCKETS - 1 && (us >> bucket) != 0) {
+    bucket++;
+  }
+
+  histogram->buckets[bucket]++;
+  histogram->count++;
+  if (us > histogram->max_us) {
+    histogram->max_us = us;
+  }
+}
+
 API void
 otrng_client_set_max_published_prekey_msg(unsigned int max_published_prekey_msg,
                                           otrng_client_s *client) {
@@ -1100,6 +1702,11 @@ API void otrng_client_published(otrng_client_s *client) {
       has_any_pms = otrng_true;
       pm->should_publish = otrng_false;
       pm->is_publishing = otrng_false;
+
+      if (otrng_client_prekey_journal(client)) {
+        otrng_prekey_journal_add(otrng_client_prekey_journal(client), client,
+                                 pm);
+      }
     }
   }
   if (has_any_pms) {
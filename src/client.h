@@ -28,10 +28,14 @@
 #pragma clang diagnostic pop
 #endif
 
+#include <time.h>
+
+#include "hash_index.h"
 #include "list.h"
 #include "otrng.h"
 #include "prekey_client.h"
 #include "shared.h"
+#include "snapshot.h"
 
 // TODO: @client REMOVE
 typedef struct otrng_conversation_s {
@@ -41,17 +45,46 @@ typedef struct otrng_conversation_s {
                           Pidgin) this could be a PurpleConversation */
 
   char *recipient;
+  /* The instance of the recipient this conversation is bound to, or 0 until
+     it is known */
+  uint32_t their_instance_tag;
+  /* Set while the DAKE a new instance started this conversation with has not
+     authenticated it. The conversation is freed if that DAKE fails. */
+  otrng_bool unauthenticated;
   otrng_s *conn;
 } otrng_conversation_s;
 
+/* How many instances of a recipient can each have their own conversation */
+#define OTRNG_CLIENT_DEFAULT_MAX_INSTANCES 8
+
 typedef struct otrng_client_id_s {
   const char *protocol;
   const char *account;
 } otrng_client_id_s;
 
+#define OTRNG_LATENCY_BUCKETS 24
+
+/* How long receiving data messages took, in elapsed time. Bucket 0 counts
+   the messages that took under a microsecond, and bucket n > 0 the ones that
+   took from 2^(n-1) up to 2^n microseconds. The last bucket also counts
+   anything slower. */
+typedef struct otrng_latency_histogram_s {
+  uint64_t buckets[OTRNG_LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t max_us;
+} otrng_latency_histogram_s;
+
 /* A client handle messages from/to a sender to/from multiple recipients. */
 typedef struct otrng_client_s {
   list_element_s *conversations;
+  /* The conversations by recipient, and the last node of [conversations] so
+     that new ones are appended without walking the list. */
+  hash_index_s *conversation_index;
+  list_element_s *last_conversation;
+  /* The conversations bound to an instance, by (recipient, instance tag).
+     The first conversation with a recipient is the one [conversation_index]
+     finds, and the one messages are sent from. */
+  hash_index_s *instance_index;
 
   otrng_prekey_client_s *prekey_client;
 
@@ -69,9 +102,19 @@ typedef struct otrng_client_s {
   list_element_s *our_prekeys; /* prekey_message_s */
 
   unsigned int max_stored_msg_keys;
+  unsigned int lookahead_depth;
+
+  /* The DH keypairs the conversations of this client rotate to */
+  otrng_keypair_pool_s *dh_pool;
   unsigned int max_published_prekey_msg;
   unsigned int minimum_stored_prekey_msg;
 
+  unsigned int max_instances;
+
+  /* The limits of the fragments reassembled in each conversation */
+  size_t max_fragment_contexts;
+  size_t max_fragment_bytes;
+
   uint64_t profiles_extra_valid_time;
   uint64_t client_profile_exp_time;
   uint64_t prekey_profile_exp_time;
@@ -86,6 +129,11 @@ typedef struct otrng_client_s {
   otrng_bool is_publishing;
   uint32_t prekey_msgs_num_to_publish;
 
+  otrng_latency_histogram_s receive_latency;
+
+  /* When the client was last got, by the use clock of its global state */
+  uint64_t last_used;
+
   // OtrlPrivKey *privkeyv3; // ???
   // otrng_instag_s *instag; // TODO: @client Store the instance tag here rather
   // than use v3 User State as a store for instance tags
@@ -99,6 +147,47 @@ API otrng_conversation_s *otrng_client_get_conversation(int force_create,
                                                         const char *recipient,
                                                         otrng_client_s *client);
 
+/**
+ * @brief Gets the conversation with one instance of [recipient], for example
+ * one of the devices they are logged in from.
+ *
+ * @return The conversation, or NULL if there is none with that instance.
+ */
+API otrng_conversation_s *
+otrng_client_get_instance_conversation(uint32_t their_instance_tag,
+                                       const char *recipient,
+                                       otrng_client_s *client);
+
+/**
+ * @brief Seals the state of an encrypted conversation, so that it can be
+ * resumed with otrng_client_restore_conversation, in this process or another,
+ * without a new DAKE. Only take it once the conversation is done sending and
+ * receiving, and restore it once: resuming from an older state would reuse
+ * its keys.
+ *
+ * @param [dst]       The snapshot, to free with otrng_free.
+ * @param [dst_len]   Its length.
+ * @param [key]       A secret key of the caller to seal it with.
+ * @param [conv]      The conversation.
+ */
+API otrng_result
+otrng_conversation_snapshot(uint8_t **dst, size_t *dst_len,
+                            const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES],
+                            const otrng_conversation_s *conv);
+
+/**
+ * @brief Resumes a conversation of [client] from a snapshot taken with
+ * otrng_conversation_snapshot.
+ *
+ * @return The conversation, or NULL if the snapshot was not sealed with [key]
+ *         for this client, or the client already has a conversation with that
+ *         instance of the recipient.
+ */
+API otrng_conversation_s *
+otrng_client_restore_conversation(const uint8_t *snapshot, size_t snapshot_len,
+                                  const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES],
+                                  otrng_client_s *client);
+
 API otrng_bool otrng_conversation_is_encrypted(otrng_conversation_s *conv);
 
 API otrng_bool otrng_conversation_is_finished(otrng_conversation_s *conv);
@@ -110,6 +199,20 @@ API otrng_result otrng_client_send(char **new_msg, const char *msg,
                                    const char *recipient,
                                    otrng_client_s *client);
 
+/**
+ * @brief Encodes [count] messages to [recipient] in one pass.
+ *
+ * @param [new_msgs]  An array of [count] elements that receives the encoded
+ *                    messages, in order. The caller frees each of them.
+ * @param [msgs]      The [count] messages to send.
+ *
+ * If it fails midway, the messages encoded before the failure are left in
+ * [new_msgs] and must still be sent. The rest are NULL.
+ */
+API otrng_result otrng_client_send_batch(char **new_msgs, const char **msgs,
+                                         size_t count, const char *recipient,
+                                         otrng_client_s *client);
+
 API otrng_result otrng_client_send_non_interactive_auth(
     char **new_msg, const prekey_ensemble_s *ensemble, const char *recipient,
     otrng_client_s *client);
@@ -119,6 +222,18 @@ API otrng_result otrng_client_send_fragment(otrng_message_to_send_s **new_msg,
                                             const char *recipient,
                                             otrng_client_s *client);
 
+/**
+ * @brief Like otrng_client_send_fragment, for transports that can write
+ * scattered buffers: the pieces of the fragments point into the encoded
+ * message, which [dst] owns, and no fragment is copied.
+ *
+ * Free what [dst] holds with otrng_scattered_message_destroy.
+ */
+API otrng_result otrng_client_send_scattered(otrng_scattered_message_s *dst,
+                                             const char *msg, int mms,
+                                             const char *recipient,
+                                             otrng_client_s *client);
+
 API otrng_result otrng_client_smp_start(char **to_send, const char *recipient,
                                         const unsigned char *question,
                                         const size_t q_len,
@@ -136,6 +251,26 @@ API otrng_result otrng_client_receive(char **new_msg, char **to_display,
                                       otrng_client_s *client,
                                       otrng_bool *should_ignore);
 
+/**
+ * @brief Receives [count] messages from [recipient] in one pass.
+ *
+ * @param [new_msgs]    An array of [count] elements that receives, for each
+ *                      message, what has to be sent back or NULL.
+ * @param [to_display]  An array of [count] elements that receives, for each
+ *                      message, what has to be displayed or NULL.
+ * @param [results]     An array of [count] elements that receives the result
+ *                      of each message.
+ * @param [msgs]        The [count] messages, in the order they arrived.
+ *
+ * A message that fails does not affect the ones around it. The caller frees
+ * every element of [new_msgs] and [to_display].
+ */
+API otrng_result otrng_client_receive_batch(char **new_msgs, char **to_display,
+                                            otrng_result *results,
+                                            const char **msgs, size_t count,
+                                            const char *recipient,
+                                            otrng_client_s *client);
+
 API otrng_result otrng_client_disconnect(char **new_msg, const char *recipient,
                                          otrng_client_s *client);
 
@@ -153,7 +288,8 @@ API otrng_result otrng_expire_encrypted_session(char **new_msg,
  *
  * @return 0 if success, 2 if any error happened.
  *
- * @details Details around this function if any
+ * @details This looks at every conversation. otrng_global_state_tick expires
+ * the fragments of every client looking only at what expired.
  **/
 API otrng_result otrng_client_expire_fragments(int expiration_time,
                                                otrng_client_s *client);
@@ -235,6 +371,88 @@ API void otrng_client_set_padding(size_t granularity, otrng_client_s *client);
 API void otrng_client_set_max_stored_msg_keys(unsigned int max_stored_msg_keys,
                                               otrng_client_s *client);
 
+/**
+ * @brief Sets how many messages ahead otrng_client_do_background_work derives
+ * the receiving keys of each conversation. Zero, the default, disables it.
+ */
+API void otrng_client_set_lookahead_depth(unsigned int lookahead_depth,
+                                          otrng_client_s *client);
+
+/**
+ * @brief Does work ahead of time, when the application is idle: fills the
+ * DH keypair pool up to its depth, then derives receiving keys up to the
+ * lookahead depth of every encrypted conversation, so that a message arriving
+ * after a gap mostly looks its keys up instead of deriving them.
+ *
+ * @param [budget]  The maximum number of DH keypairs plus messages to derive
+ *                  keys for. A DH keypair costs far more than the keys of a
+ *                  message.
+ *
+ * @return The amount of the budget used. Zero means there is nothing left to
+ * do for now.
+ */
+API size_t otrng_client_do_background_work(size_t budget,
+                                           otrng_client_s *client);
+
+/**
+ * @brief Fills only the DH keypair pool. Unlike
+ * otrng_client_do_background_work, it can be called from a worker thread of
+ * the application while the client is used from another one.
+ *
+ * @param [budget]  The maximum number of DH keypairs to generate.
+ *
+ * @return The number of keypairs generated.
+ */
+API size_t otrng_client_fill_dh_pool(size_t budget, otrng_client_s *client);
+
+/**
+ * @brief Sets how many DH keypairs otrng_client_do_background_work keeps
+ * ready for the DH ratchets of this client's conversations, so that
+ * generating them does not stall sending. Zero, the default, disables it.
+ */
+API void otrng_client_set_dh_pool_depth(unsigned int dh_pool_depth,
+                                        otrng_client_s *client);
+
+/**
+ * @brief Reports the depth and use of the DH keypair pool. A miss is a
+ * keypair generated on demand because the pool was empty.
+ */
+API void otrng_client_get_dh_pool_stats(otrng_keypair_pool_stats_s *dst,
+                                        const otrng_client_s *client);
+
+/**
+ * @brief Sets how many instances of a recipient can each have a conversation
+ * of their own. A DAKE from one more instance is ignored.
+ */
+API void otrng_client_set_max_instances(unsigned int max_instances,
+                                        otrng_client_s *client);
+
+/**
+ * @brief Sets how many fragmented messages each conversation reassembles at
+ * once, and how many bytes it buffers for them. When a new fragment does not
+ * fit, the messages that went longest without a fragment are dropped.
+ */
+API void otrng_client_set_fragment_limits(size_t max_contexts, size_t max_bytes,
+                                          otrng_client_s *client);
+
+/**
+ * @brief Adds up the fragment reassembly stats of every conversation into
+ * [dst].
+ */
+API void otrng_client_get_fragment_stats(otrng_fragment_stats_s *dst,
+                                         const otrng_client_s *client);
+
+/**
+ * @brief Copies the latency histogram of received data messages to [dst].
+ */
+API void otrng_client_get_receive_latency(otrng_latency_histogram_s *dst,
+                                          const otrng_client_s *client);
+
+API void otrng_client_reset_receive_latency(otrng_client_s *client);
+
+INTERNAL void otrng_client_record_receive_latency(otrng_client_s *client,
+                                                  uint64_t us);
+
 API void otrng_client_state_set_max_published_prekey_msg(
     unsigned int max_published_prekey_msg, otrng_client_s *client);
 
@@ -52,14 +52,16 @@ INTERNAL void otrng_data_message_free(data_message_s *data_msg) {
   otrng_free(data_msg);
 }
 
-INTERNAL otrng_result otrng_data_message_body_serialize(
-    uint8_t **body, size_t *body_len, const data_message_s *data_msg) {
-  size_t size = DATA_MSG_MAX_BYTES + data_msg->enc_msg_len;
-  uint8_t *cursor;
+INTERNAL otrng_result otrng_data_message_header_serialize(
+    uint8_t *dst, size_t dst_len, size_t *written,
+    const data_message_s *data_msg) {
+  uint8_t *cursor = dst;
   size_t len = 0;
-  uint8_t *dst = otrng_xmalloc_z(size);
 
-  cursor = dst;
+  if (dst_len < DATA_MSG_MAX_BYTES) {
+    return OTRNG_ERROR;
+  }
+
   cursor += otrng_serialize_uint16(cursor, OTRNG_PROTOCOL_VERSION_4);
   cursor += otrng_serialize_uint8(cursor, DATA_MSG_TYPE);
   cursor += otrng_serialize_uint32(cursor, data_msg->sender_instance_tag);
@@ -71,40 +73,61 @@ INTERNAL otrng_result otrng_data_message_body_serialize(
   cursor += otrng_serialize_ec_point(cursor, data_msg->ecdh);
 
   // TODO: @freeing @sanitizer This could be NULL. We need to test.
-  if (!otrng_serialize_dh_public_key(cursor, (size - (cursor - dst)), &len,
+  if (!otrng_serialize_dh_public_key(cursor, (dst_len - (cursor - dst)), &len,
                                      data_msg->dh)) {
-    otrng_free(dst);
     return OTRNG_ERROR;
   }
   cursor += len;
   cursor += otrng_serialize_bytes_array(cursor, data_msg->nonce,
                                         DATA_MSG_NONCE_BYTES);
-  cursor +=
-      otrng_serialize_data(cursor, data_msg->enc_msg, data_msg->enc_msg_len);
+  cursor += otrng_serialize_uint32(cursor, data_msg->enc_msg_len);
+
+  if (written) {
+    *written = cursor - dst;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_data_message_body_serialize(
+    uint8_t **body, size_t *body_len, const data_message_s *data_msg) {
+  size_t size = DATA_MSG_MAX_BYTES + data_msg->enc_msg_len;
+  size_t len = 0;
+  uint8_t *dst = otrng_xmalloc_z(size);
+
+  if (!otrng_data_message_header_serialize(dst, size, &len, data_msg)) {
+    otrng_free(dst);
+    return OTRNG_ERROR;
+  }
+
+  if (data_msg->enc_msg_len > 0) {
+    memcpy(dst + len, data_msg->enc_msg, data_msg->enc_msg_len);
+  }
+  len += data_msg->enc_msg_len;
 
   if (body) {
     *body = dst;
+  } else {
+    otrng_free(dst);
   }
 
   if (body_len) {
-    *body_len = cursor - dst;
+    *body_len = len;
   }
 
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
-                                                     const uint8_t *buffer,
-                                                     size_t buff_len,
-                                                     size_t *nread) {
+/* Deserializes every section up to, and including, the nonce */
+static otrng_result deserialize_header(data_message_s *dst,
+                                       const uint8_t *buffer, size_t buff_len,
+                                       size_t *nread) {
   const uint8_t *cursor = buffer;
   int64_t len = buff_len;
   size_t read = 0;
   uint16_t protocol_version = 0;
   uint8_t msg_type = 0;
 
-  (void)nread;
-
   if (!otrng_deserialize_uint16(&protocol_version, cursor, len, &read)) {
     return OTRNG_ERROR;
   }
@@ -195,18 +218,71 @@ INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
   }
 
   cursor += DATA_MSG_NONCE_BYTES;
-  len -= DATA_MSG_NONCE_BYTES;
 
-  if (!otrng_deserialize_data(&dst->enc_msg, &dst->enc_msg_len, cursor, len,
-                              &read)) {
+  *nread = cursor - buffer;
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
+                                                     const uint8_t *buffer,
+                                                     size_t buff_len,
+                                                     size_t *nread) {
+  size_t read = 0;
+  size_t w = 0;
+
+  if (!deserialize_header(dst, buffer, buff_len, &read)) {
     return OTRNG_ERROR;
   }
 
-  cursor += read;
-  len -= read;
+  if (!otrng_deserialize_data(&dst->enc_msg, &dst->enc_msg_len, buffer + read,
+                              buff_len - read, &w)) {
+    return OTRNG_ERROR;
+  }
+
+  read += w + dst->enc_msg_len;
+
+  if (!otrng_deserialize_bytes_array((uint8_t *)&dst->mac, DATA_MSG_MAC_BYTES,
+                                     buffer + read, buff_len - read)) {
+    return OTRNG_ERROR;
+  }
+
+  if (nread) {
+    *nread = read + DATA_MSG_MAC_BYTES;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_data_message_deserialize_view(
+    data_message_s *dst, uint8_t **enc_msg, size_t *body_len, uint8_t *buffer,
+    size_t buff_len) {
+  size_t read = 0;
+  size_t w = 0;
+  uint32_t enc_msg_len = 0;
+
+  if (!deserialize_header(dst, buffer, buff_len, &read)) {
+    return OTRNG_ERROR;
+  }
+
+  if (!otrng_deserialize_uint32(&enc_msg_len, buffer + read, buff_len - read,
+                                &w)) {
+    return OTRNG_ERROR;
+  }
+
+  read += w;
+
+  if (buff_len - read < enc_msg_len) {
+    return OTRNG_ERROR;
+  }
+
+  *enc_msg = buffer + read;
+  dst->enc_msg_len = enc_msg_len;
+  read += enc_msg_len;
+  *body_len = read;
 
   return otrng_deserialize_bytes_array((uint8_t *)&dst->mac, DATA_MSG_MAC_BYTES,
-                                       cursor, len);
+                                       buffer + read, buff_len - read);
 }
 
 INTERNAL static otrng_result
@@ -254,25 +330,17 @@ INTERNAL otrng_result otrng_data_message_authenticator(uint8_t *dst,
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_bool otrng_valid_data_message(k_msg_mac mac_key,
-                                             const data_message_s *data_msg) {
-  uint8_t *body = NULL;
-  size_t body_len = 0;
+INTERNAL otrng_bool otrng_valid_data_message_body(
+    k_msg_mac mac_key, const data_message_s *data_msg, const uint8_t *body,
+    size_t body_len) {
   // We don't need this tag to be in secure memory
   uint8_t mac_tag[DATA_MSG_MAC_BYTES];
 
-  if (!otrng_data_message_body_serialize(&body, &body_len, data_msg)) {
-    return otrng_false;
-  }
-
   if (!otrng_data_message_authenticator(mac_tag, DATA_MSG_MAC_BYTES, mac_key,
                                         body, body_len)) {
-    otrng_free(body);
     return otrng_false;
   }
 
-  otrng_free(body);
-
   if (otrl_mem_differ(mac_tag, data_msg->mac, DATA_MSG_MAC_BYTES) != 0) {
     otrng_secure_wipe(mac_tag, DATA_MSG_MAC_BYTES);
     return otrng_false;
@@ -288,3 +356,19 @@ INTERNAL otrng_bool otrng_valid_data_message(k_msg_mac mac_key,
 
   return otrng_dh_mpi_valid(data_msg->dh);
 }
+
+INTERNAL otrng_bool otrng_valid_data_message(k_msg_mac mac_key,
+                                             const data_message_s *data_msg) {
+  uint8_t *body = NULL;
+  size_t body_len = 0;
+  otrng_bool ret;
+
+  if (!otrng_data_message_body_serialize(&body, &body_len, data_msg)) {
+    return otrng_false;
+  }
+
+  ret = otrng_valid_data_message_body(mac_key, data_msg, body, body_len);
+  otrng_free(body);
+
+  return ret;
+}
@@ -49,6 +49,19 @@ INTERNAL data_message_s *otrng_data_message_new(void);
 
 INTERNAL void otrng_data_message_free(data_message_s *data_msg);
 
+/**
+ * @brief Serialize the data message sections that precede the ciphertext,
+ *        ending with the 4-byte length of [data_msg->enc_msg_len].
+ *
+ * @param [dst]       The destination. Must hold at least DATA_MSG_MAX_BYTES.
+ * @param [dst_len]   The length of [dst].
+ * @param [written]   The number of bytes written.
+ * @param [data_msg]  The data message.
+ */
+INTERNAL otrng_result otrng_data_message_header_serialize(
+    uint8_t *dst, size_t dst_len, size_t *written,
+    const data_message_s *data_msg);
+
 INTERNAL otrng_result otrng_data_message_body_serialize(
     uint8_t **body, size_t *bodylen, const data_message_s *data_msg);
 
@@ -57,6 +70,22 @@ INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
                                                      size_t buff_len,
                                                      size_t *nread);
 
+/**
+ * @brief Deserialize a data message without copying its ciphertext.
+ *
+ * [dst->enc_msg] is left untouched, and [dst->enc_msg_len] is set.
+ *
+ * @param [dst]       The data message.
+ * @param [enc_msg]   Points to the ciphertext, inside [buffer].
+ * @param [body_len]  The length of the authenticated sections, which start
+ *                    at [buffer].
+ * @param [buffer]    The serialized data message.
+ * @param [buff_len]  The length of [buffer].
+ */
+INTERNAL otrng_result otrng_data_message_deserialize_view(
+    data_message_s *dst, uint8_t **enc_msg, size_t *body_len, uint8_t *buffer,
+    size_t buff_len);
+
 INTERNAL otrng_result otrng_data_message_authenticator(uint8_t *dst,
                                                        size_t dst_len,
                                                        const k_msg_mac mac_key,
@@ -66,6 +95,14 @@ INTERNAL otrng_result otrng_data_message_authenticator(uint8_t *dst,
 INTERNAL otrng_bool otrng_valid_data_message(k_msg_mac mac_key,
                                              const data_message_s *data_msg);
 
+/**
+ * @brief Like otrng_valid_data_message, but authenticates the sections as
+ *        received in [body] instead of serializing them again.
+ */
+INTERNAL otrng_bool otrng_valid_data_message_body(
+    k_msg_mac mac_key, const data_message_s *data_msg, const uint8_t *body,
+    size_t body_len);
+
 #ifdef OTRNG_DATA_MESSAGE_PRIVATE
 
 #endif
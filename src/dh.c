@@ -23,6 +23,7 @@
 #define OTRNG_DH_PRIVATE
 
 #include "dh.h"
+#include "dh_mont.h"
 #include "key_management.h"
 #include "random.h"
 #include "shake.h"
@@ -71,8 +72,66 @@ static gcry_mpi_t DH3072_MODULUS_MINUS_2 = NULL;
 static const char *DH3072_GENERATOR_S = "0x02";
 static gcry_mpi_t DH3072_GENERATOR = NULL;
 
+/* The generator raised to 2 ^ (DH_FIXED_BASE_WINDOW_BITS * j), for every
+   window j of an exponent as long as the modulus */
+#define DH_FIXED_BASE_WINDOW_BITS 4
+#define DH_FIXED_BASE_WINDOWS (DH3072_MOD_LEN_BITS / DH_FIXED_BASE_WINDOW_BITS)
+static gcry_mpi_t *DH3072_GENERATOR_TABLE = NULL;
+
+/* Every base of a multi-exponentiation gets a table of its powers up to
+   2 ^ DH_MULTI_EXP_WINDOW_BITS - 1. Bases are taken in chunks, so that the
+   tables of a long product do not all live at once. */
+#define DH_MULTI_EXP_WINDOW_BITS 4
+#define DH_MULTI_EXP_POWERS ((1 << DH_MULTI_EXP_WINDOW_BITS) - 1)
+#define DH_MULTI_EXP_CHUNK 32
+
 static int dh_initialized = 0;
 
+static void gcrypt_generator_exp(dh_mpi dst, const dh_mpi exp) {
+  gcry_mpi_powm(dst, DH3072_GENERATOR, exp, DH3072_MODULUS);
+}
+
+static void gcrypt_exp(dh_mpi dst, const dh_mpi base, const dh_mpi exp) {
+  gcry_mpi_powm(dst, base, exp, DH3072_MODULUS);
+}
+
+static const otrng_dh_backend_s DH_BACKEND_GCRYPT = {
+    "libgcrypt", gcrypt_generator_exp, gcrypt_exp};
+
+static const otrng_dh_backend_s *dh_backend = &DH_BACKEND_GCRYPT;
+
+static void dh_generator_table_build(void) {
+  gcry_mpi_t entry;
+  int i, j;
+
+  DH3072_GENERATOR_TABLE =
+      otrng_xmalloc_z(DH_FIXED_BASE_WINDOWS * sizeof(gcry_mpi_t));
+  DH3072_GENERATOR_TABLE[0] = gcry_mpi_copy(DH3072_GENERATOR);
+
+  for (j = 1; j < DH_FIXED_BASE_WINDOWS; j++) {
+    entry = gcry_mpi_copy(DH3072_GENERATOR_TABLE[j - 1]);
+    for (i = 0; i < DH_FIXED_BASE_WINDOW_BITS; i++) {
+      gcry_mpi_mulm(entry, entry, entry, DH3072_MODULUS);
+    }
+    DH3072_GENERATOR_TABLE[j] = entry;
+  }
+}
+
+static void dh_generator_table_free(void) {
+  int j;
+
+  if (!DH3072_GENERATOR_TABLE) {
+    return;
+  }
+
+  for (j = 0; j < DH_FIXED_BASE_WINDOWS; j++) {
+    gcry_mpi_release(DH3072_GENERATOR_TABLE[j]);
+  }
+
+  otrng_free(DH3072_GENERATOR_TABLE);
+  DH3072_GENERATOR_TABLE = NULL;
+}
+
 INTERNAL otrng_result otrng_dh_init(otrng_bool die) {
   gcry_error_t err;
 
@@ -129,6 +188,12 @@ INTERNAL otrng_result otrng_dh_init(otrng_bool die) {
 
   gcry_mpi_sub_ui(DH3072_MODULUS_MINUS_2, DH3072_MODULUS, 2);
 
+  dh_generator_table_build();
+
+  if (otrng_dh_mont_init(DH3072_MODULUS, DH3072_GENERATOR)) {
+    dh_backend = otrng_dh_backend_mont();
+  }
+
   return OTRNG_SUCCESS;
 }
 
@@ -149,14 +214,155 @@ INTERNAL void otrng_dh_free(void) {
   gcry_mpi_release(DH3072_MODULUS_MINUS_2);
   DH3072_MODULUS_MINUS_2 = NULL;
 
+  dh_generator_table_free();
+
+  otrng_dh_mont_free();
+  dh_backend = &DH_BACKEND_GCRYPT;
+
   dh_initialized = 0;
 }
 
 INTERNAL dh_mpi otrng_dh_mpi_generator(void) { return DH3072_GENERATOR; }
 
+INTERNAL void otrng_dh_set_backend(const otrng_dh_backend_s *backend) {
+  dh_backend = backend ? backend : &DH_BACKEND_GCRYPT;
+}
+
+INTERNAL const otrng_dh_backend_s *otrng_dh_get_backend(void) {
+  return dh_backend;
+}
+
+INTERNAL const otrng_dh_backend_s *otrng_dh_backend_gcrypt(void) {
+  return &DH_BACKEND_GCRYPT;
+}
+
 INTERNAL void otrng_dh_calculate_public_key(dh_public_key pub,
                                             const dh_private_key priv) {
-  gcry_mpi_powm(pub, DH3072_GENERATOR, priv, DH3072_MODULUS);
+  dh_backend->generator_exp(pub, priv);
+}
+
+/* The [bits] bits of [exp] starting at bit [first], as a number */
+static unsigned int exp_window(const dh_mpi exp, unsigned int first,
+                               unsigned int bits) {
+  unsigned int digit = 0;
+  unsigned int i;
+
+  for (i = bits; i > 0; i--) {
+    digit = (digit << 1) | (gcry_mpi_test_bit(exp, first + i - 1) ? 1 : 0);
+  }
+
+  return digit;
+}
+
+INTERNAL void otrng_dh_generator_exp_non_secret(dh_mpi dst, const dh_mpi exp) {
+  uint8_t digits[DH_FIXED_BASE_WINDOWS];
+  unsigned int windows =
+      (gcry_mpi_get_nbits(exp) + DH_FIXED_BASE_WINDOW_BITS - 1) /
+      DH_FIXED_BASE_WINDOW_BITS;
+  otrng_bool started = otrng_false;
+  gcry_mpi_t partial;
+  unsigned int d, j;
+
+  if (!DH3072_GENERATOR_TABLE || windows > DH_FIXED_BASE_WINDOWS) {
+    gcry_mpi_powm(dst, DH3072_GENERATOR, exp, DH3072_MODULUS);
+    return;
+  }
+
+  for (j = 0; j < windows; j++) {
+    digits[j] = exp_window(exp, j * DH_FIXED_BASE_WINDOW_BITS,
+                           DH_FIXED_BASE_WINDOW_BITS);
+  }
+
+  /* Yao's method: [partial] is the product of the entries whose digit is at
+     least d, and the result multiplies it in once for every d. */
+  partial = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  gcry_mpi_set_ui(partial, 1);
+  gcry_mpi_set_ui(dst, 1);
+
+  for (d = (1 << DH_FIXED_BASE_WINDOW_BITS) - 1; d > 0; d--) {
+    for (j = 0; j < windows; j++) {
+      if (digits[j] == d) {
+        gcry_mpi_mulm(partial, partial, DH3072_GENERATOR_TABLE[j],
+                      DH3072_MODULUS);
+        started = otrng_true;
+      }
+    }
+
+    if (started) {
+      gcry_mpi_mulm(dst, dst, partial, DH3072_MODULUS);
+    }
+  }
+
+  gcry_mpi_release(partial);
+}
+
+static void multi_exp_chunk(gcry_mpi_t dst, const dh_mpi *bases,
+                            const dh_mpi *exps, size_t count) {
+  gcry_mpi_t *powers =
+      otrng_xmalloc_z(count * DH_MULTI_EXP_POWERS * sizeof(gcry_mpi_t));
+  unsigned int nbits = 0;
+  unsigned int windows, digit, i;
+  size_t n;
+
+  for (n = 0; n < count; n++) {
+    gcry_mpi_t *base_powers = powers + n * DH_MULTI_EXP_POWERS;
+
+    base_powers[0] = gcry_mpi_copy(bases[n]);
+    for (i = 1; i < DH_MULTI_EXP_POWERS; i++) {
+      base_powers[i] = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+      gcry_mpi_mulm(base_powers[i], base_powers[i - 1], bases[n],
+                    DH3072_MODULUS);
+    }
+
+    if (gcry_mpi_get_nbits(exps[n]) > nbits) {
+      nbits = gcry_mpi_get_nbits(exps[n]);
+    }
+  }
+
+  windows = (nbits + DH_MULTI_EXP_WINDOW_BITS - 1) / DH_MULTI_EXP_WINDOW_BITS;
+  gcry_mpi_set_ui(dst, 1);
+
+  /* All exponents are walked together, window by window from the top, so
+     the squarings are shared by every base */
+  for (; windows > 0; windows--) {
+    for (i = 0; i < DH_MULTI_EXP_WINDOW_BITS; i++) {
+      gcry_mpi_mulm(dst, dst, dst, DH3072_MODULUS);
+    }
+
+    for (n = 0; n < count; n++) {
+      digit = exp_window(exps[n], (windows - 1) * DH_MULTI_EXP_WINDOW_BITS,
+                         DH_MULTI_EXP_WINDOW_BITS);
+      if (digit) {
+        gcry_mpi_mulm(dst, dst, powers[n * DH_MULTI_EXP_POWERS + digit - 1],
+                      DH3072_MODULUS);
+      }
+    }
+  }
+
+  for (n = 0; n < count * DH_MULTI_EXP_POWERS; n++) {
+    gcry_mpi_release(powers[n]);
+  }
+  otrng_free(powers);
+}
+
+INTERNAL void otrng_dh_multi_exp_non_secret(dh_mpi dst, const dh_mpi *bases,
+                                            const dh_mpi *exps, size_t count) {
+  gcry_mpi_t chunk = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  size_t n, len;
+
+  gcry_mpi_set_ui(dst, 1);
+
+  for (n = 0; n < count; n += len) {
+    len = count - n;
+    if (len > DH_MULTI_EXP_CHUNK) {
+      len = DH_MULTI_EXP_CHUNK;
+    }
+
+    multi_exp_chunk(chunk, bases + n, exps + n, len);
+    gcry_mpi_mulm(dst, dst, chunk, DH3072_MODULUS);
+  }
+
+  gcry_mpi_release(chunk);
 }
 
 INTERNAL otrng_result otrng_dh_keypair_generate(dh_keypair_s *keypair) {
@@ -183,7 +389,7 @@ INTERNAL otrng_result otrng_dh_keypair_generate(dh_keypair_s *keypair) {
 
   keypair->priv = privkey;
   keypair->pub = gcry_mpi_new(DH3072_MOD_LEN_BITS);
-  gcry_mpi_powm(keypair->pub, DH3072_GENERATOR, privkey, DH3072_MODULUS);
+  dh_backend->generator_exp(keypair->pub, privkey);
 
   return OTRNG_SUCCESS;
 }
@@ -216,10 +422,10 @@ INTERNAL otrng_result otrng_dh_keypair_generate_from_shared_secret(
   if (participant == 'u') {
     keypair->priv = privkey;
     keypair->pub = gcry_mpi_new(DH3072_MOD_LEN_BITS);
-    gcry_mpi_powm(keypair->pub, DH3072_GENERATOR, privkey, DH3072_MODULUS);
+    dh_backend->generator_exp(keypair->pub, privkey);
   } else if (participant == 't') {
     keypair->pub = gcry_mpi_new(DH3072_MOD_LEN_BITS);
-    gcry_mpi_powm(keypair->pub, DH3072_GENERATOR, privkey, DH3072_MODULUS);
+    dh_backend->generator_exp(keypair->pub, privkey);
     gcry_mpi_release(privkey);
   }
 
@@ -237,6 +443,31 @@ INTERNAL void otrng_dh_keypair_destroy(dh_keypair_s *keypair) {
   keypair->pub = NULL;
 }
 
+static otrng_result generate_pooled_keypair(void *keypair) {
+  return otrng_dh_keypair_generate(keypair);
+}
+
+static void destroy_pooled_keypair(void *keypair) {
+  otrng_dh_keypair_destroy(keypair);
+}
+
+INTERNAL otrng_keypair_pool_s *otrng_dh_keypair_pool_new(void) {
+  /* The keypairs only hold references to MPIs, which libgcrypt keeps in its
+     own secure memory */
+  return otrng_keypair_pool_new(sizeof(dh_keypair_s), generate_pooled_keypair,
+                                destroy_pooled_keypair, otrng_xmalloc,
+                                otrng_free);
+}
+
+INTERNAL otrng_result otrng_dh_keypair_pool_take(dh_keypair_s *keypair,
+                                                 otrng_keypair_pool_s *pool) {
+  if (!pool) {
+    return otrng_dh_keypair_generate(keypair);
+  }
+
+  return otrng_keypair_pool_take(keypair, pool);
+}
+
 INTERNAL otrng_result otrng_dh_shared_secret(dh_shared_secret buffer,
                                              size_t *written,
                                              const dh_private_key our_priv,
@@ -247,7 +478,7 @@ INTERNAL otrng_result otrng_dh_shared_secret(dh_shared_secret buffer,
     return OTRNG_ERROR;
   }
 
-  gcry_mpi_powm(secret, their_pub, our_priv, DH3072_MODULUS);
+  dh_backend->exp(secret, their_pub, our_priv);
   err = gcry_mpi_print(GCRYMPI_FMT_USG, buffer, DH3072_MOD_LEN_BYTES, written,
                        secret);
 
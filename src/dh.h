@@ -29,6 +29,7 @@
 
 #include "constants.h"
 #include "error.h"
+#include "keypair_pool.h"
 #include "shared.h"
 
 #define DH_KEY_SIZE 80
@@ -45,12 +46,56 @@ typedef struct dh_keypair_s {
   dh_private_key priv;
 } dh_keypair_s;
 
+/*
+ * The arithmetic of the DH group. Both operations take a secret exponent and
+ * run in time that does not depend on it. otrng_dh_init picks the Montgomery
+ * backend of dh_mont.c, and libgcrypt stays as the reference one.
+ */
+typedef struct otrng_dh_backend_s {
+  const char *name;
+
+  /* [dst] = g ^ [exp] mod p */
+  void (*generator_exp)(dh_mpi dst, const dh_mpi exp);
+
+  /* [dst] = [base] ^ [exp] mod p */
+  void (*exp)(dh_mpi dst, const dh_mpi base, const dh_mpi exp);
+} otrng_dh_backend_s;
+
 INTERNAL otrng_result otrng_dh_init(otrng_bool die);
 INTERNAL void otrng_dh_free(void);
 
+/**
+ * @brief Sets the backend used by every DH operation that takes a secret.
+ *
+ * @param [backend]   The backend, or NULL for the libgcrypt one.
+ */
+INTERNAL void otrng_dh_set_backend(const otrng_dh_backend_s *backend);
+
+INTERNAL const otrng_dh_backend_s *otrng_dh_get_backend(void);
+
+/* The reference backend, which calls gcry_mpi_powm */
+INTERNAL const otrng_dh_backend_s *otrng_dh_backend_gcrypt(void);
+
 INTERNAL void otrng_dh_calculate_public_key(dh_public_key pub,
                                             const dh_private_key priv);
 
+/**
+ * @brief Sets [dst] to the generator raised to [exp], using the fixed-base
+ * table built by otrng_dh_init.
+ *
+ * It takes time that depends on [exp], so it is only for public exponents.
+ */
+INTERNAL void otrng_dh_generator_exp_non_secret(dh_mpi dst, const dh_mpi exp);
+
+/**
+ * @brief Sets [dst] to the product of bases[i] ^ exps[i] modulo the prime, as
+ * one interleaved multi-exponentiation.
+ *
+ * It takes time that depends on its inputs, so they must all be public.
+ */
+INTERNAL void otrng_dh_multi_exp_non_secret(dh_mpi dst, const dh_mpi *bases,
+                                            const dh_mpi *exps, size_t count);
+
 INTERNAL otrng_result otrng_dh_keypair_generate(dh_keypair_s *keypair);
 
 /**
@@ -65,6 +110,19 @@ INTERNAL void otrng_dh_priv_key_destroy(dh_keypair_s *keypair);
 
 INTERNAL void otrng_dh_keypair_destroy(dh_keypair_s *keypair);
 
+/**
+ * @brief Creates an empty pool of DH keypairs, for the DH ratchets of the
+ * conversations of a client.
+ */
+INTERNAL otrng_keypair_pool_s *otrng_dh_keypair_pool_new(void);
+
+/**
+ * @brief Moves a keypair from the pool to [keypair], or generates one if the
+ * pool is empty. [pool] can be NULL.
+ */
+INTERNAL otrng_result otrng_dh_keypair_pool_take(dh_keypair_s *keypair,
+                                                 otrng_keypair_pool_s *pool);
+
 INTERNAL otrng_result otrng_dh_shared_secret(dh_shared_secret buffer,
                                              size_t *written,
                                              const dh_private_key our_priv,
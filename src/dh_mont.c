@@ -0,0 +1,374 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#define OTRNG_DH_MONT_PRIVATE
+
+#include "alloc.h"
+#include "dh_mont.h"
+
+#define DH_MONT_LIMB_BYTES (DH_MONT_LIMB_BITS / 8)
+
+/* The width every exponent is walked over */
+#define DH_MONT_EXP_BITS (DH_KEY_SIZE * 8)
+
+/* A variable base is raised with fixed windows of this many bits */
+#define DH_MONT_WINDOW_BITS 4
+#define DH_MONT_WINDOW_POWERS (1 << DH_MONT_WINDOW_BITS)
+
+/* The comb of the generator has this many teeth, spaced so that they cover
+   DH_MONT_EXP_BITS */
+#define DH_MONT_COMB_TEETH 6
+#define DH_MONT_COMB_ENTRIES (1 << DH_MONT_COMB_TEETH)
+#define DH_MONT_COMB_SPACING                                                   \
+  ((DH_MONT_EXP_BITS + DH_MONT_COMB_TEETH - 1) / DH_MONT_COMB_TEETH)
+
+static dh_mont_num MODULUS;
+static dh_mont_limb MODULUS_INV; /* -p^-1 mod 2^DH_MONT_LIMB_BITS */
+static dh_mont_num R2;           /* R^2 mod p, with R = 2^3072 */
+static dh_mont_num ONE;          /* 1, not in Montgomery form */
+static dh_mont_num ONE_MONT;     /* R mod p, which is 1 in Montgomery form */
+
+/* COMB[b] is the product of g ^ (2 ^ (i * DH_MONT_COMB_SPACING)) for every
+   bit i set in b, in Montgomery form */
+static dh_mont_num COMB[DH_MONT_COMB_ENTRIES];
+
+/* Kept for what is given to gcry_mpi_powm */
+static gcry_mpi_t MODULUS_MPI = NULL;
+static gcry_mpi_t GENERATOR_MPI = NULL;
+
+/* All ones if [a] == [b], and zero otherwise */
+static dh_mont_limb ct_eq_mask(dh_mont_limb a, dh_mont_limb b) {
+  dh_mont_limb diff = a ^ b;
+  dh_mont_limb nonzero = (diff | ((dh_mont_limb)0 - diff)) >>
+                         (DH_MONT_LIMB_BITS - 1);
+
+  return (dh_mont_limb)0 - (nonzero ^ 1);
+}
+
+/* Reads every entry of [table], so that [index] does not show in which
+   memory is touched */
+static void ct_select(dh_mont_num dst, const dh_mont_num *table, size_t len,
+                      size_t index) {
+  dh_mont_limb mask;
+  size_t k;
+  int j;
+
+  memset(dst, 0, sizeof(dh_mont_num));
+
+  for (k = 0; k < len; k++) {
+    mask = ct_eq_mask((dh_mont_limb)k, (dh_mont_limb)index);
+    for (j = 0; j < DH_MONT_LIMBS; j++) {
+      dst[j] |= table[k][j] & mask;
+    }
+  }
+}
+
+/* [dst] = [a] * [b] / R mod p, for [a] and [b] below p. This is the CIOS
+   method, with a final subtraction that is always computed. */
+tstatic void dh_mont_mul(dh_mont_num dst, const dh_mont_num a,
+                         const dh_mont_num b) {
+  dh_mont_limb t[DH_MONT_LIMBS + 2];
+  dh_mont_num reduced;
+  dh_mont_limb m, carry, borrow, keep;
+  dh_mont_dlimb acc;
+  int i, j;
+
+  memset(t, 0, sizeof(t));
+
+  for (i = 0; i < DH_MONT_LIMBS; i++) {
+    carry = 0;
+    for (j = 0; j < DH_MONT_LIMBS; j++) {
+      acc = (dh_mont_dlimb)a[j] * b[i] + t[j] + carry;
+      t[j] = (dh_mont_limb)acc;
+      carry = (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS);
+    }
+    acc = (dh_mont_dlimb)t[DH_MONT_LIMBS] + carry;
+    t[DH_MONT_LIMBS] = (dh_mont_limb)acc;
+    t[DH_MONT_LIMBS + 1] = (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS);
+
+    m = t[0] * MODULUS_INV;
+    acc = (dh_mont_dlimb)m * MODULUS[0] + t[0];
+    carry = (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS);
+    for (j = 1; j < DH_MONT_LIMBS; j++) {
+      acc = (dh_mont_dlimb)m * MODULUS[j] + t[j] + carry;
+      t[j - 1] = (dh_mont_limb)acc;
+      carry = (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS);
+    }
+    acc = (dh_mont_dlimb)t[DH_MONT_LIMBS] + carry;
+    t[DH_MONT_LIMBS - 1] = (dh_mont_limb)acc;
+    t[DH_MONT_LIMBS] =
+        t[DH_MONT_LIMBS + 1] + (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS);
+  }
+
+  /* t is below 2p, so it is reduced by subtracting p once, unless that
+     borrows past its top limb */
+  borrow = 0;
+  for (j = 0; j < DH_MONT_LIMBS; j++) {
+    acc = (dh_mont_dlimb)t[j] - MODULUS[j] - borrow;
+    reduced[j] = (dh_mont_limb)acc;
+    borrow = (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS) & 1;
+  }
+
+  keep = (dh_mont_limb)0 - ((t[DH_MONT_LIMBS] ^ 1) & borrow);
+  for (j = 0; j < DH_MONT_LIMBS; j++) {
+    dst[j] = (t[j] & keep) | (reduced[j] & ~keep);
+  }
+
+  otrng_secure_wipe(t, sizeof(t));
+  otrng_secure_wipe(reduced, sizeof(dh_mont_num));
+}
+
+/* [a] < [b], in time that does not depend on them */
+static otrng_bool num_less(const dh_mont_num a, const dh_mont_num b) {
+  dh_mont_dlimb acc;
+  dh_mont_limb borrow = 0;
+  int j;
+
+  for (j = 0; j < DH_MONT_LIMBS; j++) {
+    acc = (dh_mont_dlimb)a[j] - b[j] - borrow;
+    borrow = (dh_mont_limb)(acc >> DH_MONT_LIMB_BITS) & 1;
+  }
+
+  return borrow ? otrng_true : otrng_false;
+}
+
+static void num_from_bytes(dh_mont_num dst, const uint8_t *src, size_t len) {
+  size_t k;
+
+  memset(dst, 0, sizeof(dh_mont_num));
+
+  for (k = 0; k < len; k++) {
+    dst[k / DH_MONT_LIMB_BYTES] |= (dh_mont_limb)src[len - 1 - k]
+                                   << (8 * (k % DH_MONT_LIMB_BYTES));
+  }
+}
+
+tstatic otrng_result dh_mont_from_mpi(dh_mont_num dst, const dh_mpi src) {
+  uint8_t buf[DH3072_MOD_LEN_BYTES];
+  size_t written = 0;
+
+  if (gcry_mpi_print(GCRYMPI_FMT_USG, buf, sizeof(buf), &written, src)) {
+    return OTRNG_ERROR;
+  }
+
+  num_from_bytes(dst, buf, written);
+  otrng_secure_wipe(buf, sizeof(buf));
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic void dh_mont_to_mpi(dh_mpi dst, const dh_mont_num src) {
+  uint8_t buf[DH3072_MOD_LEN_BYTES];
+  gcry_mpi_t value = NULL;
+  size_t k;
+
+  for (k = 0; k < sizeof(buf); k++) {
+    buf[sizeof(buf) - 1 - k] =
+        (uint8_t)(src[k / DH_MONT_LIMB_BYTES] >>
+                  (8 * (k % DH_MONT_LIMB_BYTES)));
+  }
+
+  /* It can only fail to allocate, which libgcrypt treats as fatal */
+  (void)gcry_mpi_scan(&value, GCRYMPI_FMT_USG, buf, sizeof(buf), NULL);
+  otrng_secure_wipe(buf, sizeof(buf));
+
+  gcry_mpi_set(dst, value);
+  gcry_mpi_release(value);
+}
+
+/* Reads a non negative exponent of at most DH_MONT_EXP_BITS bits into a
+   buffer of that fixed width, most significant byte first */
+static otrng_result exp_to_bytes(uint8_t dst[DH_KEY_SIZE], const dh_mpi exp) {
+  size_t written = 0;
+
+  if (gcry_mpi_is_neg(exp) ||
+      gcry_mpi_get_nbits(exp) > DH_MONT_EXP_BITS) {
+    return OTRNG_ERROR;
+  }
+
+  memset(dst, 0, DH_KEY_SIZE);
+  if (gcry_mpi_print(GCRYMPI_FMT_USG, dst, DH_KEY_SIZE, &written, exp)) {
+    return OTRNG_ERROR;
+  }
+
+  memmove(dst + DH_KEY_SIZE - written, dst, written);
+  memset(dst, 0, DH_KEY_SIZE - written);
+
+  return OTRNG_SUCCESS;
+}
+
+static unsigned int exp_bit(const uint8_t exp[DH_KEY_SIZE], unsigned int i) {
+  if (i >= DH_MONT_EXP_BITS) {
+    return 0;
+  }
+
+  return (exp[DH_KEY_SIZE - 1 - i / 8] >> (i % 8)) & 1;
+}
+
+static void mont_generator_exp(dh_mpi dst, const dh_mpi exp) {
+  uint8_t e[DH_KEY_SIZE];
+  dh_mont_num acc, entry;
+  unsigned int index, i;
+  int j;
+
+  if (!exp_to_bytes(e, exp)) {
+    gcry_mpi_powm(dst, GENERATOR_MPI, exp, MODULUS_MPI);
+    return;
+  }
+
+  memcpy(acc, ONE_MONT, sizeof(dh_mont_num));
+
+  /* Column j of the comb takes bit j of every tooth */
+  for (j = DH_MONT_COMB_SPACING - 1; j >= 0; j--) {
+    dh_mont_mul(acc, acc, acc);
+
+    index = 0;
+    for (i = 0; i < DH_MONT_COMB_TEETH; i++) {
+      index |= exp_bit(e, j + i * DH_MONT_COMB_SPACING) << i;
+    }
+
+    ct_select(entry, (const dh_mont_num *)COMB, DH_MONT_COMB_ENTRIES, index);
+    dh_mont_mul(acc, acc, entry);
+  }
+
+  dh_mont_mul(acc, acc, ONE);
+  dh_mont_to_mpi(dst, acc);
+
+  otrng_secure_wipe(e, sizeof(e));
+  otrng_secure_wipe(acc, sizeof(dh_mont_num));
+  otrng_secure_wipe(entry, sizeof(dh_mont_num));
+}
+
+static void mont_exp(dh_mpi dst, const dh_mpi base, const dh_mpi exp) {
+  uint8_t e[DH_KEY_SIZE];
+  dh_mont_num powers[DH_MONT_WINDOW_POWERS];
+  dh_mont_num acc, entry;
+  unsigned int digit, i;
+  int j;
+
+  if (!dh_mont_from_mpi(acc, base) || !num_less(acc, MODULUS) ||
+      !exp_to_bytes(e, exp)) {
+    gcry_mpi_powm(dst, base, exp, MODULUS_MPI);
+    return;
+  }
+
+  /* powers[k] = base ^ k */
+  memcpy(powers[0], ONE_MONT, sizeof(dh_mont_num));
+  dh_mont_mul(powers[1], acc, R2);
+  for (i = 2; i < DH_MONT_WINDOW_POWERS; i++) {
+    dh_mont_mul(powers[i], powers[i - 1], powers[1]);
+  }
+
+  memcpy(acc, ONE_MONT, sizeof(dh_mont_num));
+
+  for (j = DH_MONT_EXP_BITS / DH_MONT_WINDOW_BITS - 1; j >= 0; j--) {
+    digit = 0;
+    for (i = DH_MONT_WINDOW_BITS; i > 0; i--) {
+      dh_mont_mul(acc, acc, acc);
+      digit = (digit << 1) | exp_bit(e, j * DH_MONT_WINDOW_BITS + i - 1);
+    }
+
+    ct_select(entry, (const dh_mont_num *)powers, DH_MONT_WINDOW_POWERS,
+              digit);
+    dh_mont_mul(acc, acc, entry);
+  }
+
+  dh_mont_mul(acc, acc, ONE);
+  dh_mont_to_mpi(dst, acc);
+
+  otrng_secure_wipe(e, sizeof(e));
+  otrng_secure_wipe(powers, sizeof(powers));
+  otrng_secure_wipe(acc, sizeof(dh_mont_num));
+  otrng_secure_wipe(entry, sizeof(dh_mont_num));
+}
+
+static const otrng_dh_backend_s DH_BACKEND_MONT = {
+    "montgomery", mont_generator_exp, mont_exp};
+
+INTERNAL const otrng_dh_backend_s *otrng_dh_backend_mont(void) {
+  return &DH_BACKEND_MONT;
+}
+
+INTERNAL otrng_result otrng_dh_mont_init(const dh_mpi modulus,
+                                         const dh_mpi generator) {
+  dh_mont_num tooth;
+  gcry_mpi_t r2;
+  dh_mont_limb inv;
+  int i, j, b;
+
+  if (!dh_mont_from_mpi(MODULUS, modulus)) {
+    return OTRNG_ERROR;
+  }
+
+  /* Newton's iteration doubles the bits of p^-1 that are right, starting
+     from the 3 that p itself gets right */
+  inv = MODULUS[0];
+  for (i = 0; i < 5; i++) {
+    inv *= 2 - MODULUS[0] * inv;
+  }
+  MODULUS_INV = (dh_mont_limb)0 - inv;
+
+  r2 = gcry_mpi_new(2 * DH3072_MOD_LEN_BITS + 1);
+  gcry_mpi_set_bit(r2, 2 * DH3072_MOD_LEN_BITS);
+  gcry_mpi_mod(r2, r2, modulus);
+  if (!dh_mont_from_mpi(R2, r2)) {
+    gcry_mpi_release(r2);
+    return OTRNG_ERROR;
+  }
+  gcry_mpi_release(r2);
+
+  memset(ONE, 0, sizeof(dh_mont_num));
+  ONE[0] = 1;
+  dh_mont_mul(ONE_MONT, R2, ONE);
+
+  if (!dh_mont_from_mpi(tooth, generator) || !num_less(tooth, MODULUS)) {
+    return OTRNG_ERROR;
+  }
+  dh_mont_mul(tooth, tooth, R2);
+
+  memcpy(COMB[0], ONE_MONT, sizeof(dh_mont_num));
+  for (i = 0; i < DH_MONT_COMB_TEETH; i++) {
+    if (i > 0) {
+      for (j = 0; j < DH_MONT_COMB_SPACING; j++) {
+        dh_mont_mul(tooth, tooth, tooth);
+      }
+    }
+
+    for (b = 0; b < (1 << i); b++) {
+      dh_mont_mul(COMB[(1 << i) | b], COMB[b], tooth);
+    }
+  }
+
+  otrng_dh_mont_free();
+  MODULUS_MPI = gcry_mpi_copy(modulus);
+  GENERATOR_MPI = gcry_mpi_copy(generator);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL void otrng_dh_mont_free(void) {
+  gcry_mpi_release(MODULUS_MPI);
+  MODULUS_MPI = NULL;
+
+  gcry_mpi_release(GENERATOR_MPI);
+  GENERATOR_MPI = NULL;
+}
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_DH_MONT_H
+#define OTRNG_DH_MONT_H
+
+#include <stdint.h>
+
+#include "dh.h"
+#include "error.h"
+#include "shared.h"
+
+/*
+ * A DH backend specialized to the 3072-bit OTR group. Numbers are fixed-size
+ * arrays of limbs, kept in Montgomery form while they are multiplied, and the
+ * generator is raised with a fixed-base comb.
+ *
+ * Exponents up to DH_KEY_SIZE bytes, which is every secret exponent of the
+ * protocol, are walked over that whole width whatever their value, and table
+ * entries are read by scanning the whole table. Longer exponents, and bases
+ * that are not below the modulus, are given to gcry_mpi_powm instead.
+ */
+
+#if defined(__SIZEOF_INT128__)
+typedef uint64_t dh_mont_limb;
+__extension__ typedef unsigned __int128 dh_mont_dlimb;
+#define DH_MONT_LIMB_BITS 64
+#else
+typedef uint32_t dh_mont_limb;
+typedef uint64_t dh_mont_dlimb;
+#define DH_MONT_LIMB_BITS 32
+#endif
+
+#define DH_MONT_LIMBS (DH3072_MOD_LEN_BITS / DH_MONT_LIMB_BITS)
+
+/* A number below the modulus, least significant limb first */
+typedef dh_mont_limb dh_mont_num[DH_MONT_LIMBS];
+
+/**
+ * @brief Precomputes R^2 mod p and the comb of the generator.
+ *
+ * @param [modulus]     The prime p.
+ * @param [generator]   The generator g, below p.
+ *
+ * @return OTRNG_ERROR if either does not fit in DH3072_MOD_LEN_BYTES.
+ */
+INTERNAL otrng_result otrng_dh_mont_init(const dh_mpi modulus,
+                                         const dh_mpi generator);
+
+INTERNAL void otrng_dh_mont_free(void);
+
+/**
+ * @brief The Montgomery backend. It must not be used before
+ * otrng_dh_mont_init succeeded.
+ */
+INTERNAL const otrng_dh_backend_s *otrng_dh_backend_mont(void);
+
+#ifdef OTRNG_DH_MONT_PRIVATE
+
+tstatic void dh_mont_mul(dh_mont_num dst, const dh_mont_num a,
+                         const dh_mont_num b);
+
+tstatic otrng_result dh_mont_from_mpi(dh_mont_num dst, const dh_mpi src);
+
+tstatic void dh_mont_to_mpi(dh_mpi dst, const dh_mont_num src);
+
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "alloc.h"
+#include "ephemeral_pool.h"
+#include "keys.h"
+
+static otrng_result generate_ephemeral_keys(void *keypair) {
+  otrng_ephemeral_keys_s *keys = keypair;
+
+  return otrng_generate_ephemeral_keys(&keys->ecdh, &keys->dh);
+}
+
+static void destroy_ephemeral_keys(void *keypair) {
+  otrng_ephemeral_keys_s *keys = keypair;
+
+  otrng_ecdh_keypair_destroy(&keys->ecdh);
+  otrng_dh_keypair_destroy(&keys->dh);
+}
+
+INTERNAL otrng_keypair_pool_s *otrng_ephemeral_pool_new(void) {
+  return otrng_keypair_pool_new(
+      sizeof(otrng_ephemeral_keys_s), generate_ephemeral_keys,
+      destroy_ephemeral_keys, otrng_secure_alloc, otrng_secure_free);
+}
+
+INTERNAL otrng_result otrng_ephemeral_pool_take(ecdh_keypair_s *ecdh,
+                                                dh_keypair_s *dh,
+                                                otrng_keypair_pool_s *pool) {
+  otrng_ephemeral_keys_s keys;
+
+  if (!pool) {
+    return otrng_generate_ephemeral_keys(ecdh, dh);
+  }
+
+  if (!otrng_keypair_pool_take(&keys, pool)) {
+    return OTRNG_ERROR;
+  }
+
+  memcpy(ecdh, &keys.ecdh, sizeof(ecdh_keypair_s));
+  memcpy(dh, &keys.dh, sizeof(dh_keypair_s));
+  otrng_secure_wipe(&keys, sizeof(otrng_ephemeral_keys_s));
+
+  return OTRNG_SUCCESS;
+}
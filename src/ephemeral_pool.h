@@ -0,0 +1,49 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_EPHEMERAL_POOL_H
+#define OTRNG_EPHEMERAL_POOL_H
+
+#include "dh.h"
+#include "ed448.h"
+#include "error.h"
+#include "keypair_pool.h"
+#include "shared.h"
+
+/* an ECDH and a DH ephemeral keypair, as used by one DAKE or prekey message */
+typedef struct otrng_ephemeral_keys_s {
+  ecdh_keypair_s ecdh;
+  dh_keypair_s dh;
+} otrng_ephemeral_keys_s;
+
+/**
+ * @brief Creates an empty pool of ephemeral keypairs, kept in secure memory.
+ */
+INTERNAL otrng_keypair_pool_s *otrng_ephemeral_pool_new(void);
+
+/**
+ * @brief Moves a keypair from the pool to [ecdh] and [dh], or generates them
+ * if the pool is empty. [pool] can be NULL.
+ */
+INTERNAL otrng_result otrng_ephemeral_pool_take(ecdh_keypair_s *ecdh,
+                                                dh_keypair_s *dh,
+                                                otrng_keypair_pool_s *pool);
+
+#endif
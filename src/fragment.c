@@ -22,6 +22,7 @@
 #include <gcrypt.h>
 #endif
 
+#include <sodium.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,12 +32,12 @@
 
 #include "alloc.h"
 #include "fragment.h"
-#include "list.h"
+#include "random.h"
+#include "timing.h"
 
 /* Example:
    ?OTR|00000000|00000001|00000002,00001,00002,one , */
 #define FRAGMENT_FORMAT "?OTR|%08x|%08x|%08x,%05hu,%05hu,%.*s,"
-#define UNFRAGMENT_FORMAT "?OTR|%08x|%08x|%08x,%05hu,%05hu,%n%*[^,],%n"
 
 otrng_message_to_send_s *otrng_message_new(void) {
   otrng_message_to_send_s *msg =
@@ -60,42 +61,18 @@ tstatic void otrng_message_free(otrng_message_to_send_s *msg) {
   otrng_free(msg);
 }
 
-tstatic void initialize_fragment_context(fragment_context_s *context) {
-  context->identifier = 0;
-  context->count = 0;
-  context->total = 0;
-  context->last_fragment_received_at = 0;
-  context->total_message_len = 0;
-  context->fragments = NULL;
-}
-
-tstatic void free_fragments_in_context(fragment_context_s *context) {
-  unsigned int i;
-
-  if (!context->fragments) {
-    return;
-  }
-
-  for (i = 0; i < context->total; i++) {
-    otrng_free(context->fragments[i]);
-    context->fragments[i] = NULL;
-  }
-}
-
-tstatic void reset_fragment_context(fragment_context_s *context) {
-  free_fragments_in_context(context);
-  initialize_fragment_context(context);
-}
-
 tstatic /*@notnull@*/ fragment_context_s *otrng_fragment_context_new(void) {
   fragment_context_s *context = otrng_xmalloc_z(sizeof(fragment_context_s));
-  initialize_fragment_context(context);
   return context;
 }
 
 INTERNAL void otrng_fragment_context_free(fragment_context_s *context) {
-  free_fragments_in_context(context);
-  otrng_free(context->fragments);
+  if (!context) {
+    return;
+  }
+
+  otrng_free(context->buffer);
+  otrng_free(context->piece_lens);
   otrng_free(context);
 }
 
@@ -181,6 +158,107 @@ INTERNAL otrng_result otrng_fragment_message(int max_size,
   return OTRNG_SUCCESS;
 }
 
+INTERNAL void otrng_fragment_ids_init(otrng_fragment_ids_s *ids) {
+  random_bytes(ids->key, sizeof(ids->key));
+  ids->counter = 0;
+}
+
+INTERNAL uint32_t otrng_fragment_next_identifier(otrng_fragment_ids_s *ids) {
+  unsigned char counter[8];
+  unsigned char out[crypto_shorthash_BYTES];
+  uint32_t identifier;
+  int n;
+
+  for (n = 0; n < 8; n++) {
+    counter[n] = (ids->counter >> (8 * n)) & 0xff;
+  }
+  ids->counter++;
+
+  (void)crypto_shorthash(out, counter, sizeof(counter), ids->key);
+  memcpy(&identifier, out, sizeof(identifier));
+
+  return identifier;
+}
+
+static void write_decimal(char *dst, uint16_t value) {
+  int n;
+
+  for (n = 4; n >= 0; n--) {
+    dst[n] = '0' + value % 10;
+    value /= 10;
+  }
+}
+
+INTERNAL otrng_result otrng_fragment_message_scattered(
+    otrng_scattered_message_s *dst, int max_size, uint32_t identifier,
+    uint32_t our_instance, uint32_t their_instance, const string_p msg) {
+  /* ?OTR|identifier|sender|receiver, is the same in every header */
+  const size_t prefix_len = 5 + 3 * 9;
+  const size_t header_len = FRAGMENT_HEADER_LEN - 1;
+  size_t msg_len = strlen(msg);
+  size_t limit, total, i;
+
+  memset(dst, 0, sizeof(otrng_scattered_message_s));
+
+  if (max_size <= FRAGMENT_HEADER_LEN || msg_len == 0) {
+    return OTRNG_ERROR;
+  }
+
+  limit = max_size - FRAGMENT_HEADER_LEN;
+  total = ((msg_len - 1) / limit) + 1;
+  if (total > 65535) {
+    return OTRNG_ERROR;
+  }
+
+  dst->total = total;
+  dst->fragments = otrng_xmalloc(total * sizeof(otrng_fragment_iov_s));
+  dst->headers = otrng_xmalloc(total * header_len + 1);
+
+  (void)snprintf(dst->headers, prefix_len + 1, "?OTR|%08x|%08x|%08x,",
+                 identifier, our_instance, their_instance);
+
+  for (i = 0; i < total; i++) {
+    char *header = dst->headers + i * header_len;
+    otrng_fragment_iov_s *fragment = dst->fragments + i;
+
+    if (i > 0) {
+      memcpy(header, dst->headers, prefix_len);
+    }
+    write_decimal(header + prefix_len, i + 1);
+    header[prefix_len + 5] = ',';
+    write_decimal(header + prefix_len + 6, total);
+    header[prefix_len + 11] = ',';
+
+    fragment->header = header;
+    fragment->header_len = header_len;
+    fragment->piece = msg + i * limit;
+    fragment->piece_len = i + 1 < total ? limit : msg_len - i * limit;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL size_t
+otrng_scattered_fragment_copy(char *dst, const otrng_fragment_iov_s *fragment) {
+  memcpy(dst, fragment->header, fragment->header_len);
+  memcpy(dst + fragment->header_len, fragment->piece, fragment->piece_len);
+  dst[fragment->header_len + fragment->piece_len] = ',';
+  dst[fragment->header_len + fragment->piece_len + 1] = '\0';
+
+  return fragment->header_len + fragment->piece_len + 1;
+}
+
+API void otrng_scattered_message_destroy(otrng_scattered_message_s *msg) {
+  if (!msg) {
+    return;
+  }
+
+  otrng_free(msg->fragments);
+  otrng_free(msg->headers);
+  otrng_free(msg->encoded);
+  memset(msg, 0, sizeof(otrng_scattered_message_s));
+}
+
 tstatic otrng_bool is_fragment(const string_p msg) {
   if (msg != NULL && strstr(msg, "?OTR|") == msg) {
     return otrng_true;
@@ -189,157 +267,604 @@ tstatic otrng_bool is_fragment(const string_p msg) {
   return otrng_false;
 }
 
-tstatic otrng_result initialize_fragments(fragment_context_s *context) {
-  context->fragments = otrng_xmalloc_z(sizeof(string_p) * context->total);
+static otrng_bool parse_hex(uint32_t *dst, const char *src) {
+  uint32_t value = 0;
+  int n;
+
+  for (n = 0; n < 8; n++) {
+    char c = src[n];
+    uint32_t digit;
+
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return otrng_false;
+    }
 
-  return OTRNG_SUCCESS;
+    value = (value << 4) | digit;
+  }
+
+  *dst = value;
+  return otrng_true;
 }
 
-tstatic otrng_result join_fragments(char **unfrag_msg,
-                                    fragment_context_s *context) {
-  char *end_msg;
-  unsigned int i;
+static otrng_bool parse_decimal(uint16_t *dst, const char *src) {
+  uint32_t value = 0;
+  int n;
 
-  *unfrag_msg = otrng_xmalloc_z(context->total_message_len + 1);
+  for (n = 0; n < 5; n++) {
+    if (src[n] < '0' || src[n] > '9') {
+      return otrng_false;
+    }
+    value = value * 10 + (src[n] - '0');
+  }
 
-  end_msg = *unfrag_msg;
-  for (i = 0; i < context->total; i++) {
-    end_msg = otrng_stpcpy(end_msg, context->fragments[i]);
+  if (value > 0xFFFF) {
+    return otrng_false;
   }
 
-  return OTRNG_SUCCESS;
+  *dst = (uint16_t)value;
+  return otrng_true;
 }
 
-tstatic otrng_result copy_fragment_to_context(fragment_context_s *context,
-                                              unsigned short i,
-                                              const string_p msg,
-                                              uint32_t fragment_len) {
-  char *fragment = otrng_xmalloc(fragment_len + 1);
+/* A v3 fragment has no identifier: ?OTR|sender|receiver,index,total,piece, */
+static otrng_bool is_v3_fragment(const string_p msg) {
+  uint32_t tag;
 
-  memcpy(fragment, msg, fragment_len);
-  fragment[fragment_len] = '\0';
-  context->fragments[i - 1] = fragment;
-  context->total_message_len += fragment_len;
-  return OTRNG_SUCCESS;
+  return parse_hex(&tag, msg + 5) && msg[13] == '|' &&
+         parse_hex(&tag, msg + 14) && msg[22] == ',';
 }
 
-INTERNAL otrng_result
-otrng_unfragment_message(char **unfrag_msg, list_element_s **contexts,
-                         const string_p msg, const uint32_t our_instance_tag) {
-  int start = 0, end = 0;
-  uint32_t fragment_identifier, sender_tag, receiver_tag;
-  uint16_t i, t;
-  fragment_context_s *context = NULL;
-  list_element_s *current;
-  fragment_context_s *ctx;
-  uint32_t fragment_len;
+INTERNAL otrng_result otrng_fragment_parse(otrng_fragment_header_s *dst,
+                                           const string_p msg) {
+  const char *cursor = msg;
+  const char *end;
 
-  *unfrag_msg = NULL;
+  if (!is_fragment(msg)) {
+    return OTRNG_ERROR;
+  }
+  cursor += 5;
 
-  if (!contexts) {
+  if (!parse_hex(&dst->identifier, cursor) || cursor[8] != '|') {
     return OTRNG_ERROR;
   }
+  cursor += 9;
 
-  if (!is_fragment(msg)) {
-    *unfrag_msg = otrng_xstrdup(msg);
+  if (!parse_hex(&dst->sender_instance_tag, cursor) || cursor[8] != '|') {
+    return OTRNG_ERROR;
+  }
+  cursor += 9;
 
-    return OTRNG_SUCCESS;
+  if (!parse_hex(&dst->receiver_instance_tag, cursor) || cursor[8] != ',') {
+    return OTRNG_ERROR;
   }
+  cursor += 9;
 
-  if (sscanf(msg, UNFRAGMENT_FORMAT, &fragment_identifier, &sender_tag,
-             &receiver_tag, &i, &t, &start, &end) == EOF) {
+  if (!parse_decimal(&dst->index, cursor) || cursor[5] != ',') {
     return OTRNG_ERROR;
   }
+  cursor += 6;
 
-  if (our_instance_tag != receiver_tag && 0 != receiver_tag) {
-    return OTRNG_SUCCESS;
+  if (!parse_decimal(&dst->total, cursor) || cursor[5] != ',') {
+    return OTRNG_ERROR;
   }
+  cursor += 6;
 
-  if (end <= start) {
+  end = strchr(cursor, ',');
+  if (!end) {
     return OTRNG_ERROR;
   }
 
-  for (current = *contexts; current; current = current->next) {
-    if (!current->data) {
-      continue;
+  dst->piece = cursor;
+  dst->piece_len = end - cursor;
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL fragment_reassembly_s *
+otrng_fragment_reassembly_new(size_t max_contexts, size_t max_bytes) {
+  fragment_reassembly_s *reassembly =
+      otrng_xmalloc_z(sizeof(fragment_reassembly_s));
+
+  reassembly->index = otrng_hash_index_new();
+  reassembly->max_contexts = max_contexts;
+  reassembly->max_bytes = max_bytes;
+
+  return reassembly;
+}
+
+static size_t context_bytes(const fragment_context_s *context) {
+  if (!context->buffer) {
+    return 0;
+  }
+
+  return context->total * context->stride + 1;
+}
+
+static int find_context_by_identifier(const void *current,
+                                      const void *wanted) {
+  const fragment_context_s *context = current;
+  return context->identifier == *(const uint32_t *)wanted;
+}
+
+static fragment_context_s *get_context(const fragment_reassembly_s *reassembly,
+                                       uint32_t identifier) {
+  return otrng_hash_index_get(
+      reassembly->index,
+      otrng_hash_index_hash_tag(reassembly->index, NULL, identifier),
+      &identifier, find_context_by_identifier);
+}
+
+static void unlink_context(fragment_reassembly_s *reassembly,
+                           fragment_context_s *context) {
+  if (context->older) {
+    context->older->newer = context->newer;
+  } else {
+    reassembly->oldest = context->newer;
+  }
+
+  if (context->newer) {
+    context->newer->older = context->older;
+  } else {
+    reassembly->newest = context->older;
+  }
+
+  context->older = NULL;
+  context->newer = NULL;
+}
+
+static void link_newest(fragment_reassembly_s *reassembly,
+                        fragment_context_s *context) {
+  context->older = reassembly->newest;
+  if (reassembly->newest) {
+    reassembly->newest->newer = context;
+  } else {
+    reassembly->oldest = context;
+  }
+  reassembly->newest = context;
+}
+
+static void drop_context(fragment_reassembly_s *reassembly,
+                         fragment_context_s *context) {
+  unlink_context(reassembly, context);
+  otrng_hash_index_remove(
+      reassembly->index,
+      otrng_hash_index_hash_tag(reassembly->index, NULL, context->identifier),
+      context);
+
+  reassembly->bytes -= context_bytes(context);
+  reassembly->len--;
+  otrng_fragment_context_free(context);
+}
+
+static void expiry_place(fragment_expiry_s *expiry, size_t pos,
+                         fragment_reassembly_s *reassembly) {
+  expiry->heap[pos] = reassembly;
+  reassembly->expiry_pos = pos + 1;
+}
+
+static void expiry_sift_up(fragment_expiry_s *expiry, size_t pos) {
+  fragment_reassembly_s *moving = expiry->heap[pos];
+
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (expiry->heap[parent]->expiry_key <= moving->expiry_key) {
+      break;
     }
 
-    ctx = current->data;
-    if (ctx->identifier == fragment_identifier) {
-      context = ctx;
+    expiry_place(expiry, pos, expiry->heap[parent]);
+    pos = parent;
+  }
+
+  expiry_place(expiry, pos, moving);
+}
+
+static void expiry_sift_down(fragment_expiry_s *expiry, size_t pos) {
+  fragment_reassembly_s *moving = expiry->heap[pos];
+
+  for (;;) {
+    size_t child = 2 * pos + 1;
+    if (child >= expiry->len) {
       break;
     }
+
+    if (child + 1 < expiry->len &&
+        expiry->heap[child + 1]->expiry_key < expiry->heap[child]->expiry_key) {
+      child++;
+    }
+
+    if (moving->expiry_key <= expiry->heap[child]->expiry_key) {
+      break;
+    }
+
+    expiry_place(expiry, pos, expiry->heap[child]);
+    pos = child;
   }
 
-  if (!context) {
-    context = otrng_fragment_context_new();
-    context->identifier = fragment_identifier;
-    *contexts = otrng_list_add(context, *contexts);
+  expiry_place(expiry, pos, moving);
+}
+
+static void expiry_remove(fragment_reassembly_s *reassembly) {
+  fragment_expiry_s *expiry = reassembly->expiry;
+  size_t pos = reassembly->expiry_pos - 1;
+  fragment_reassembly_s *last = expiry->heap[--expiry->len];
+
+  reassembly->expiry = NULL;
+  reassembly->expiry_pos = 0;
+
+  if (last == reassembly) {
+    return;
   }
 
-  if (i == 0 || t == 0 || i > t) {
-    reset_fragment_context(context);
-    return OTRNG_SUCCESS;
+  expiry_place(expiry, pos, last);
+  expiry_sift_up(expiry, pos);
+  expiry_sift_down(expiry, last->expiry_pos - 1);
+}
+
+/* Moves [reassembly] in its heap, if it is in one, after its oldest message
+   changed */
+static void reschedule(fragment_reassembly_s *reassembly) {
+  time_t key;
+
+  if (!reassembly->expiry) {
+    return;
   }
 
-  if (context->total != 0 && context->total != t) {
+  if (!reassembly->oldest) {
+    expiry_remove(reassembly);
+    return;
+  }
+
+  key = reassembly->oldest->last_fragment_received_at;
+  if (key == reassembly->expiry_key) {
+    return;
+  }
+
+  reassembly->expiry_key = key;
+  expiry_sift_up(reassembly->expiry, reassembly->expiry_pos - 1);
+  expiry_sift_down(reassembly->expiry, reassembly->expiry_pos - 1);
+}
+
+INTERNAL void
+otrng_fragment_reassembly_free(fragment_reassembly_s *reassembly) {
+  if (!reassembly) {
+    return;
+  }
+
+  while (reassembly->oldest) {
+    drop_context(reassembly, reassembly->oldest);
+  }
+  reschedule(reassembly);
+
+  otrng_hash_index_free(reassembly->index);
+  otrng_free(reassembly);
+}
+
+INTERNAL size_t
+otrng_fragment_reassembly_len(const fragment_reassembly_s *reassembly) {
+  if (!reassembly) {
+    return 0;
+  }
+
+  return reassembly->len;
+}
+
+INTERNAL void
+otrng_fragment_reassembly_add_stats(otrng_fragment_stats_s *dst,
+                                    const fragment_reassembly_s *reassembly) {
+  const otrng_fragment_stats_s *stats = &reassembly->stats;
+
+  dst->messages += stats->messages;
+  dst->fragments += stats->fragments;
+  dst->rejected += stats->rejected;
+  dst->evicted += stats->evicted;
+  dst->pending_contexts += reassembly->len;
+  dst->pending_bytes += reassembly->bytes;
+  if (stats->peak_bytes > dst->peak_bytes) {
+    dst->peak_bytes = stats->peak_bytes;
+  }
+  dst->total_us += stats->total_us;
+  if (stats->max_us > dst->max_us) {
+    dst->max_us = stats->max_us;
+  }
+}
+
+static fragment_context_s *new_context(fragment_reassembly_s *reassembly,
+                                       const otrng_fragment_header_s *header) {
+  fragment_context_s *context;
+  unsigned int slot;
+
+  if (reassembly->len >= reassembly->max_contexts && reassembly->oldest) {
+    reassembly->stats.evicted++;
+    drop_context(reassembly, reassembly->oldest);
+  }
+
+  context = otrng_fragment_context_new();
+  context->identifier = header->identifier;
+  context->total = header->total;
+  context->piece_lens = otrng_xmalloc(context->total * sizeof(int32_t));
+  for (slot = 0; slot < context->total; slot++) {
+    context->piece_lens[slot] = -1;
+  }
+
+  otrng_hash_index_add(
+      reassembly->index,
+      otrng_hash_index_hash_tag(reassembly->index, NULL, header->identifier),
+      context);
+  link_newest(reassembly, context);
+  reassembly->len++;
+
+  return context;
+}
+
+/* Evicts the messages that went longest without a fragment, other than
+   [keep], until [needed] more bytes fit. Nothing is evicted if they would not
+   fit even with [keep] alone. */
+static otrng_result make_room(fragment_reassembly_s *reassembly,
+                              const fragment_context_s *keep, size_t needed) {
+  if (needed > reassembly->max_bytes ||
+      context_bytes(keep) > reassembly->max_bytes - needed) {
     return OTRNG_ERROR;
   }
 
-  context->total = t;
+  while (reassembly->bytes + needed > reassembly->max_bytes) {
+    fragment_context_s *victim = reassembly->oldest;
+    if (victim == keep) {
+      victim = victim->newer;
+    }
 
-  if (context->fragments == NULL) {
-    if (otrng_failed(initialize_fragments(context))) {
+    if (!victim) {
       return OTRNG_ERROR;
     }
+
+    reassembly->stats.evicted++;
+    drop_context(reassembly, victim);
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+/* Makes every slot of the buffer [stride] bytes long. The pieces are moved
+   from the last one down, so none is overwritten before it is moved. */
+static otrng_result grow_context(fragment_reassembly_s *reassembly,
+                                 fragment_context_s *context, size_t stride) {
+  size_t old_bytes = context_bytes(context);
+  size_t new_bytes = context->total * stride + 1;
+  unsigned int slot;
+
+  if (otrng_failed(make_room(reassembly, context, new_bytes - old_bytes))) {
+    return OTRNG_ERROR;
+  }
+
+  context->buffer = otrng_xrealloc(context->buffer, new_bytes);
+  for (slot = context->total; slot-- > 0;) {
+    if (context->piece_lens[slot] > 0) {
+      memmove(context->buffer + slot * stride,
+              context->buffer + slot * context->stride,
+              context->piece_lens[slot]);
+    }
+  }
+  context->stride = stride;
+
+  reassembly->bytes += new_bytes - old_bytes;
+  if (reassembly->bytes > reassembly->stats.peak_bytes) {
+    reassembly->stats.peak_bytes = reassembly->bytes;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+/* Moves the pieces together, and hands over the buffer */
+static char *join_fragments(fragment_context_s *context) {
+  size_t len = 0;
+  unsigned int slot;
+  char *joined;
+
+  for (slot = 0; slot < context->total; slot++) {
+    memmove(context->buffer + len, context->buffer + slot * context->stride,
+            context->piece_lens[slot]);
+    len += context->piece_lens[slot];
+  }
+  context->buffer[len] = '\0';
+
+  joined = context->buffer;
+  context->buffer = NULL;
+
+  return joined;
+}
+
+tstatic otrng_result add_fragment(char **unfrag_msg,
+                                  fragment_reassembly_s *reassembly,
+                                  const otrng_fragment_header_s *header) {
+  fragment_context_s *context = get_context(reassembly, header->identifier);
+  unsigned int slot;
+
+  if (header->index == 0 || header->total == 0 ||
+      header->index > header->total) {
+    if (context) {
+      drop_context(reassembly, context);
+    }
+    return OTRNG_SUCCESS;
   }
 
-  if (context->fragments[i - 1] != NULL) {
+  if (context && context->total != header->total) {
     return OTRNG_ERROR;
   }
 
-  fragment_len = end - start - 1;
-  if (otrng_failed(
-          copy_fragment_to_context(context, i, msg + start, fragment_len))) {
+  if (!context) {
+    context = new_context(reassembly, header);
+  }
+
+  slot = header->index - 1;
+  if (context->piece_lens[slot] >= 0) {
     return OTRNG_ERROR;
   }
 
+  if (!context->buffer || header->piece_len > context->stride) {
+    if (otrng_failed(grow_context(reassembly, context, header->piece_len))) {
+      drop_context(reassembly, context);
+      return OTRNG_ERROR;
+    }
+  }
+
+  memcpy(context->buffer + slot * context->stride, header->piece,
+         header->piece_len);
+  context->piece_lens[slot] = (int32_t)header->piece_len;
   context->count++;
+  context->total_message_len += header->piece_len;
   context->last_fragment_received_at = time(NULL);
 
-  if (context->count == t) {
-    if (otrng_succeeded(join_fragments(unfrag_msg, context))) {
-      list_element_s *to_remove = otrng_list_get_by_value(context, *contexts);
-      *contexts = otrng_list_remove_element(to_remove, *contexts);
-      otrng_fragment_context_free(context);
-      otrng_list_free_nodes(to_remove);
-      return OTRNG_SUCCESS;
-    }
-    return OTRNG_ERROR;
+  unlink_context(reassembly, context);
+  link_newest(reassembly, context);
+  reassembly->stats.fragments++;
+
+  if (context->count < context->total) {
+    return OTRNG_SUCCESS;
   }
 
+  reassembly->bytes -= context_bytes(context);
+  *unfrag_msg = join_fragments(context);
+  reassembly->stats.messages++;
+  drop_context(reassembly, context);
+
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_expire_fragments(time_t now,
-                                             uint32_t expiration_time,
-                                             list_element_s **contexts) {
-  list_element_s *current = *contexts;
+INTERNAL otrng_result otrng_unfragment_message(
+    char **unfrag_msg, fragment_reassembly_s *reassembly, const string_p msg,
+    const uint32_t our_instance_tag) {
+  otrng_fragment_header_s header;
+  otrng_result result;
+  uint64_t started, elapsed_us;
 
-  while (current) {
-    fragment_context_s *ctx = current->data;
+  *unfrag_msg = NULL;
 
-    list_element_s *to_free = NULL;
-    if ((ctx != NULL) &&
-        (difftime(now, ctx->last_fragment_received_at) < expiration_time)) {
-      *contexts = otrng_list_remove_element(current, *contexts);
-      otrng_fragment_context_free(ctx);
-      to_free = current;
-    }
+  if (!reassembly) {
+    return OTRNG_ERROR;
+  }
+
+  /* libotr reassembles v3 fragments itself */
+  if (!is_fragment(msg) || is_v3_fragment(msg)) {
+    *unfrag_msg = otrng_xstrdup(msg);
+
+    return OTRNG_SUCCESS;
+  }
+
+  started = otrng_monotonic_us();
+
+  if (otrng_failed(otrng_fragment_parse(&header, msg))) {
+    reassembly->stats.rejected++;
+    return OTRNG_ERROR;
+  }
+
+  if (our_instance_tag != header.receiver_instance_tag &&
+      0 != header.receiver_instance_tag) {
+    return OTRNG_SUCCESS;
+  }
 
-    current = current->next;
-    otrng_list_free_nodes(to_free);
+  result = add_fragment(unfrag_msg, reassembly, &header);
+  if (otrng_failed(result)) {
+    reassembly->stats.rejected++;
   }
+  reschedule(reassembly);
+
+  elapsed_us = otrng_monotonic_us() - started;
+  reassembly->stats.total_us += elapsed_us;
+  if (elapsed_us > reassembly->stats.max_us) {
+    reassembly->stats.max_us = elapsed_us;
+  }
+
+  return result;
+}
+
+INTERNAL otrng_result otrng_expire_fragments(
+    time_t now, uint32_t expiration_time, fragment_reassembly_s *reassembly) {
+  /* The oldest message is the one that went longest without a fragment */
+  while (reassembly->oldest &&
+         difftime(now, reassembly->oldest->last_fragment_received_at) >=
+             expiration_time) {
+    drop_context(reassembly, reassembly->oldest);
+  }
+  reschedule(reassembly);
 
   return OTRNG_SUCCESS;
 }
+
+INTERNAL fragment_expiry_s *
+otrng_fragment_expiry_new(uint32_t expiration_time) {
+  fragment_expiry_s *expiry = otrng_xmalloc_z(sizeof(fragment_expiry_s));
+
+  expiry->expiration_time = expiration_time;
+
+  return expiry;
+}
+
+INTERNAL void otrng_fragment_expiry_free(fragment_expiry_s *expiry) {
+  size_t pos;
+
+  if (!expiry) {
+    return;
+  }
+
+  for (pos = 0; pos < expiry->len; pos++) {
+    expiry->heap[pos]->expiry = NULL;
+    expiry->heap[pos]->expiry_pos = 0;
+  }
+
+  otrng_free(expiry->heap);
+  otrng_free(expiry);
+}
+
+INTERNAL void
+otrng_fragment_expiry_schedule(fragment_expiry_s *expiry,
+                               fragment_reassembly_s *reassembly) {
+  if (!expiry || !reassembly) {
+    return;
+  }
+
+  if (reassembly->expiry == expiry) {
+    reschedule(reassembly);
+    return;
+  }
+
+  if (reassembly->expiry) {
+    expiry_remove(reassembly);
+  }
+
+  if (!reassembly->oldest) {
+    return;
+  }
+
+  if (expiry->len == expiry->cap) {
+    expiry->cap = expiry->cap ? expiry->cap * 2 : 16;
+    expiry->heap = otrng_xrealloc(
+        expiry->heap, expiry->cap * sizeof(fragment_reassembly_s *));
+  }
+
+  reassembly->expiry = expiry;
+  reassembly->expiry_key = reassembly->oldest->last_fragment_received_at;
+  expiry_place(expiry, expiry->len++, reassembly);
+  expiry_sift_up(expiry, expiry->len - 1);
+}
+
+INTERNAL size_t otrng_fragment_expiry_tick(fragment_expiry_s *expiry,
+                                           time_t now) {
+  size_t dropped = 0;
+
+  /* Every round drops a message, or corrects the time of the top */
+  while (expiry->len > 0 &&
+         difftime(now, expiry->heap[0]->expiry_key) >=
+             expiry->expiration_time) {
+    fragment_reassembly_s *reassembly = expiry->heap[0];
+    size_t len = reassembly->len;
+
+    otrng_expire_fragments(now, expiry->expiration_time, reassembly);
+    dropped += len - reassembly->len;
+  }
+
+  return dropped;
+}
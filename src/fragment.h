@@ -21,8 +21,11 @@
 #ifndef OTRNG_FRAGMENT_H
 #define OTRNG_FRAGMENT_H
 
+#include <stdint.h>
+#include <time.h>
+
 #include "error.h"
-#include "list.h"
+#include "hash_index.h"
 #include "shared.h"
 #include "str.h"
 
@@ -30,19 +33,122 @@
  * index,total,,*/
 #define FRAGMENT_HEADER_LEN 45
 
+/* The limits of the messages being reassembled in one conversation */
+#define OTRNG_FRAGMENT_DEFAULT_MAX_CONTEXTS 16
+#define OTRNG_FRAGMENT_DEFAULT_MAX_BYTES (1024 * 1024)
+
+/* How long, in seconds, an incomplete message waits for its next fragment */
+#define OTRNG_FRAGMENT_DEFAULT_EXPIRATION_TIME 60
+
 typedef struct otrng_message_to_send_s {
   string_p *pieces;
   int total;
 } otrng_message_to_send_s;
 
+/* A fragment to write without copying: [header] then [piece] then a comma */
+typedef struct otrng_fragment_iov_s {
+  const char *header;
+  size_t header_len;
+  const char *piece; /* points into the fragmented message */
+  size_t piece_len;
+} otrng_fragment_iov_s;
+
+/* A message fragmented in place, with the headers of all its fragments in one
+   arena */
+typedef struct otrng_scattered_message_s {
+  otrng_fragment_iov_s *fragments;
+  size_t total;
+  char *headers;
+  /* The message the pieces point into, when it is owned by this one */
+  char *encoded;
+} otrng_scattered_message_s;
+
+/* Fragment identifiers of a conversation: SipHash of a counter, keyed for the
+   conversation, which is cheaper than asking the CSPRNG every time */
+typedef struct otrng_fragment_ids_s {
+  uint8_t key[16];
+  uint64_t counter;
+} otrng_fragment_ids_s;
+
+/* The header and the piece of a v4 fragment */
+typedef struct otrng_fragment_header_s {
+  uint32_t identifier;
+  uint32_t sender_instance_tag;
+  uint32_t receiver_instance_tag;
+  uint16_t index;
+  uint16_t total;
+  const char *piece; /* points into the fragment */
+  size_t piece_len;
+} otrng_fragment_header_s;
+
 typedef struct fragment_context_s {
   uint32_t identifier;
   unsigned int total, count;
   size_t total_message_len;
   time_t last_fragment_received_at;
-  string_p *fragments;
+
+  /* Pieces are written straight into one buffer of [total] slots of [stride]
+     bytes, and moved together once the last one arrives. [piece_lens] is -1
+     for the pieces still missing. */
+  char *buffer;
+  size_t stride;
+  int32_t *piece_lens;
+
+  /* the neighbours by the time of their last fragment */
+  struct fragment_context_s *older;
+  struct fragment_context_s *newer;
 } fragment_context_s;
 
+typedef struct otrng_fragment_stats_s {
+  uint64_t messages;  /* messages reassembled */
+  uint64_t fragments; /* fragments accepted */
+  uint64_t rejected;  /* fragments refused as malformed or over the limits */
+  uint64_t evicted;   /* incomplete messages dropped to stay in the limits */
+  size_t pending_contexts;
+  size_t pending_bytes;
+  size_t peak_bytes;
+  uint64_t total_us; /* elapsed time spent reassembling */
+  uint64_t max_us;   /* the longest a single fragment took */
+} otrng_fragment_stats_s;
+
+/*
+ * The messages being reassembled in a conversation, indexed by identifier.
+ *
+ * At most [max_contexts] messages and [max_bytes] of buffers are kept: the
+ * messages that went longest without a fragment make room for new ones.
+ */
+typedef struct fragment_reassembly_s {
+  hash_index_s *index;
+  size_t len;
+
+  fragment_context_s *oldest;
+  fragment_context_s *newest;
+
+  size_t max_contexts;
+  size_t max_bytes;
+  size_t bytes;
+
+  otrng_fragment_stats_s stats;
+
+  /* Set while the reassembly waits in an expiry heap, at [expiry_pos] - 1,
+     until [expiry_key] plus the expiration time */
+  struct fragment_expiry_s *expiry;
+  size_t expiry_pos;
+  time_t expiry_key;
+} fragment_reassembly_s;
+
+/*
+ * The reassemblies of many conversations that have incomplete messages, in a
+ * min-heap by the time of their oldest fragment. Expiring costs a look at the
+ * top of the heap, plus the work for each message that did expire.
+ */
+typedef struct fragment_expiry_s {
+  fragment_reassembly_s **heap;
+  size_t len;
+  size_t cap;
+  uint32_t expiration_time;
+} fragment_expiry_s;
+
 INTERNAL void otrng_fragment_context_free(fragment_context_s *context);
 
 INTERNAL otrng_result otrng_fragment_message(int max_size,
@@ -51,14 +157,116 @@ INTERNAL otrng_result otrng_fragment_message(int max_size,
                                              int their_instance,
                                              const string_p msg);
 
-INTERNAL otrng_result otrng_unfragment_message(char **unfrag_msg,
-                                               list_element_s **contexts,
-                                               const string_p msg,
-                                               const uint32_t our_instance_tag);
+INTERNAL void otrng_fragment_ids_init(otrng_fragment_ids_s *ids);
+
+INTERNAL uint32_t otrng_fragment_next_identifier(otrng_fragment_ids_s *ids);
+
+/**
+ * @brief Fragments [msg] like otrng_fragment_message, without copying it.
+ *
+ * @param [dst]        The fragments. Their pieces point into [msg], which
+ *                     must outlive them.
+ * @param [max_size]   The maximum size of a fragment.
+ * @param [msg]        The message.
+ */
+INTERNAL otrng_result otrng_fragment_message_scattered(
+    otrng_scattered_message_s *dst, int max_size, uint32_t identifier,
+    uint32_t our_instance, uint32_t their_instance, const string_p msg);
+
+/**
+ * @brief Writes [fragment] to [dst] as a string, for transports that cannot
+ *        write it scattered. [dst] needs room for its header, its piece, and
+ *        two more bytes.
+ *
+ * @return The length of the string.
+ */
+INTERNAL size_t
+otrng_scattered_fragment_copy(char *dst, const otrng_fragment_iov_s *fragment);
+
+/* Frees what [msg] holds, but not [msg] */
+API void otrng_scattered_message_destroy(otrng_scattered_message_s *msg);
+
+/**
+ * @brief Parses a v4 fragment.
+ *
+ * @param [dst]   The header and piece of the fragment.
+ * @param [msg]   The fragment.
+ *
+ * @return OTRNG_ERROR if [msg] is not a well-formed v4 fragment.
+ */
+INTERNAL otrng_result otrng_fragment_parse(otrng_fragment_header_s *dst,
+                                           const string_p msg);
 
-INTERNAL otrng_result otrng_expire_fragments(time_t now,
-                                             uint32_t expiration_time,
-                                             list_element_s **contexts);
+/**
+ * @brief Creates an empty reassembly.
+ *
+ * @param [max_contexts]   The most messages reassembled at once.
+ * @param [max_bytes]      The most bytes buffered at once.
+ */
+INTERNAL fragment_reassembly_s *
+otrng_fragment_reassembly_new(size_t max_contexts, size_t max_bytes);
+
+INTERNAL void otrng_fragment_reassembly_free(fragment_reassembly_s *reassembly);
+
+/**
+ * @brief The number of messages being reassembled.
+ */
+INTERNAL size_t
+otrng_fragment_reassembly_len(const fragment_reassembly_s *reassembly);
+
+/**
+ * @brief Adds the stats of [reassembly] to [dst]. The peak is the largest of
+ *        both.
+ */
+INTERNAL void
+otrng_fragment_reassembly_add_stats(otrng_fragment_stats_s *dst,
+                                    const fragment_reassembly_s *reassembly);
+
+/**
+ * @brief Adds a fragment to its message.
+ *
+ * @param [unfrag_msg]         The whole message, once its last fragment is
+ *                             received. A message that is not a fragment is
+ *                             copied as is.
+ * @param [reassembly]         The messages being reassembled.
+ * @param [msg]                The received message.
+ * @param [our_instance_tag]   Fragments for other instances are ignored.
+ */
+INTERNAL otrng_result otrng_unfragment_message(
+    char **unfrag_msg, fragment_reassembly_s *reassembly, const string_p msg,
+    const uint32_t our_instance_tag);
+
+/**
+ * @brief Drops the messages that got no fragment in the last
+ *        [expiration_time] seconds.
+ */
+INTERNAL otrng_result otrng_expire_fragments(
+    time_t now, uint32_t expiration_time, fragment_reassembly_s *reassembly);
+
+INTERNAL fragment_expiry_s *
+otrng_fragment_expiry_new(uint32_t expiration_time);
+
+/* The reassemblies still waiting are left out of the heap, not freed */
+INTERNAL void otrng_fragment_expiry_free(fragment_expiry_s *expiry);
+
+/**
+ * @brief Puts [reassembly] in [expiry] while it has incomplete messages. It
+ *        stays there, and moves as its messages change, until it has none.
+ *
+ * @param [expiry]       The expiry heap, or NULL for none.
+ * @param [reassembly]   The reassembly.
+ */
+INTERNAL void otrng_fragment_expiry_schedule(fragment_expiry_s *expiry,
+                                             fragment_reassembly_s *reassembly);
+
+/**
+ * @brief Drops the messages, of any reassembly in [expiry], that got no
+ *        fragment in the last expiration time.
+ *
+ * @return The number of messages dropped.
+ */
+INTERNAL size_t otrng_fragment_expiry_tick(fragment_expiry_s *expiry,
+                                           time_t now);
 
 #ifdef OTRNG_FRAGMENT_PRIVATE
 
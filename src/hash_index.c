@@ -0,0 +1,201 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sodium.h>
+#include <string.h>
+
+#define OTRNG_HASH_INDEX_PRIVATE
+
+#include "alloc.h"
+#include "hash_index.h"
+#include "random.h"
+
+#define HASH_INDEX_INITIAL_BUCKETS 16
+
+tstatic size_t hash_index_bucket(const hash_index_s *index, uint64_t hash) {
+  return (size_t)hash & (index->num_buckets - 1);
+}
+
+INTERNAL hash_index_s *otrng_hash_index_new(void) {
+  hash_index_s *index = otrng_xmalloc_z(sizeof(hash_index_s));
+
+  index->num_buckets = HASH_INDEX_INITIAL_BUCKETS;
+  index->buckets =
+      otrng_xmalloc_z(index->num_buckets * sizeof(hash_index_entry_s *));
+  random_bytes(index->key, sizeof(index->key));
+
+  return index;
+}
+
+INTERNAL void otrng_hash_index_free(hash_index_s *index) {
+  size_t b;
+
+  if (!index) {
+    return;
+  }
+
+  for (b = 0; b < index->num_buckets; b++) {
+    hash_index_entry_s *current = index->buckets[b];
+    while (current) {
+      hash_index_entry_s *next = current->bucket_next;
+      otrng_free(current);
+      current = next;
+    }
+  }
+
+  otrng_free(index->buckets);
+  otrng_free(index);
+}
+
+static uint64_t hash_string(const hash_index_s *index, const char *str) {
+  unsigned char out[crypto_shorthash_BYTES];
+  uint64_t hash;
+
+  (void)crypto_shorthash(out, (const unsigned char *)str, strlen(str),
+                         index->key);
+  memcpy(&hash, out, sizeof(hash));
+
+  return hash;
+}
+
+INTERNAL uint64_t otrng_hash_index_hash(const hash_index_s *index,
+                                        const char *first,
+                                        const char *second) {
+  uint64_t hash = hash_string(index, first);
+
+  if (second) {
+    /* Neither part can be guessed without the key, so mixing them is enough
+       to tell ("ab", "c") from ("a", "bc") */
+    hash = (hash * 0x9E3779B97F4A7C15u) ^ hash_string(index, second);
+  }
+
+  return hash;
+}
+
+INTERNAL uint64_t otrng_hash_index_hash_tag(const hash_index_s *index,
+                                            const char *str, uint32_t tag) {
+  unsigned char out[crypto_shorthash_BYTES];
+  uint8_t tag_bytes[4];
+  uint64_t hash;
+
+  tag_bytes[0] = (uint8_t)(tag >> 24);
+  tag_bytes[1] = (uint8_t)(tag >> 16);
+  tag_bytes[2] = (uint8_t)(tag >> 8);
+  tag_bytes[3] = (uint8_t)tag;
+  (void)crypto_shorthash(out, tag_bytes, sizeof(tag_bytes), index->key);
+  memcpy(&hash, out, sizeof(hash));
+
+  if (!str) {
+    return hash;
+  }
+
+  return (hash_string(index, str) * 0x9E3779B97F4A7C15u) ^ hash;
+}
+
+static void hash_index_grow(hash_index_s *index) {
+  hash_index_entry_s **old_buckets = index->buckets;
+  size_t old_num_buckets = index->num_buckets;
+  size_t b;
+
+  index->num_buckets = old_num_buckets * 2;
+  index->buckets =
+      otrng_xmalloc_z(index->num_buckets * sizeof(hash_index_entry_s *));
+
+  for (b = 0; b < old_num_buckets; b++) {
+    hash_index_entry_s *current = old_buckets[b];
+    while (current) {
+      hash_index_entry_s *next = current->bucket_next;
+      size_t nb = hash_index_bucket(index, current->hash);
+      current->bucket_next = index->buckets[nb];
+      index->buckets[nb] = current;
+      current = next;
+    }
+  }
+
+  otrng_free(old_buckets);
+}
+
+INTERNAL void otrng_hash_index_add(hash_index_s *index, uint64_t hash,
+                                   void *data) {
+  hash_index_entry_s *entry;
+  size_t b;
+
+  if (index->len >= index->num_buckets) {
+    hash_index_grow(index);
+  }
+
+  entry = otrng_xmalloc_z(sizeof(hash_index_entry_s));
+  entry->hash = hash;
+  entry->data = data;
+
+  b = hash_index_bucket(index, hash);
+  entry->bucket_next = index->buckets[b];
+  index->buckets[b] = entry;
+  index->len++;
+}
+
+INTERNAL void *
+otrng_hash_index_get(const hash_index_s *index, uint64_t hash,
+                     const void *wanted,
+                     int (*fn)(const void *current, const void *wanted)) {
+  const hash_index_entry_s *current;
+
+  if (!index || index->len == 0) {
+    return NULL;
+  }
+
+  for (current = index->buckets[hash_index_bucket(index, hash)]; current;
+       current = current->bucket_next) {
+    if (current->hash == hash && fn(current->data, wanted)) {
+      return current->data;
+    }
+  }
+
+  return NULL;
+}
+
+INTERNAL void otrng_hash_index_remove(hash_index_s *index, uint64_t hash,
+                                      const void *data) {
+  hash_index_entry_s **cursor;
+
+  if (!index) {
+    return;
+  }
+
+  cursor = &index->buckets[hash_index_bucket(index, hash)];
+  while (*cursor && (*cursor)->data != data) {
+    cursor = &(*cursor)->bucket_next;
+  }
+
+  if (*cursor) {
+    hash_index_entry_s *entry = *cursor;
+    *cursor = entry->bucket_next;
+    otrng_free(entry);
+    index->len--;
+  }
+}
+
+INTERNAL size_t otrng_hash_index_len(const hash_index_s *index) {
+  if (!index) {
+    return 0;
+  }
+
+  return index->len;
+}
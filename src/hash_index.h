@@ -0,0 +1,141 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_HASH_INDEX_H
+#define OTRNG_HASH_INDEX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "shared.h"
+
+typedef struct hash_index_entry_s {
+  uint64_t hash;
+  void *data;
+
+  /* the next entry in the same hash bucket */
+  struct hash_index_entry_s *bucket_next;
+} hash_index_entry_s;
+
+/*
+ * An index over data kept somewhere else, usually a list, by the hash of one
+ * or two strings. The index does not own the data and keeps no order: the
+ * list it indexes stays the place to iterate over.
+ *
+ * The hashes are keyed with a random key per index, so that peers choosing
+ * names can not make the entries fall in the same bucket.
+ */
+typedef struct hash_index_s {
+  hash_index_entry_s **buckets;
+  size_t num_buckets; /* always a power of two */
+  size_t len;
+
+  uint8_t key[16];
+} hash_index_s;
+
+/**
+ * @brief Creates a new empty index, with a random hashing key.
+ *
+ * @return A new index [hash_index_s].
+ */
+INTERNAL hash_index_s *otrng_hash_index_new(void);
+
+/**
+ * @brief Frees the index, but not the indexed data.
+ *
+ * @param [index]   The index.
+ */
+INTERNAL void otrng_hash_index_free(hash_index_s *index);
+
+/**
+ * @brief Hashes the key of an entry.
+ *
+ * @param [index]    The index.
+ * @param [first]    The key, or its first part.
+ * @param [second]   The second part of the key, or NULL.
+ *
+ * @return The hash of ([first], [second]).
+ */
+INTERNAL uint64_t otrng_hash_index_hash(const hash_index_s *index,
+                                        const char *first,
+                                        const char *second);
+
+/**
+ * @brief Hashes a key made of a string and a number, like an instance tag.
+ *
+ * @param [index]   The index.
+ * @param [str]     The first part of the key, or NULL.
+ * @param [tag]     The second part of the key.
+ *
+ * @return The hash of ([str], [tag]).
+ */
+INTERNAL uint64_t otrng_hash_index_hash_tag(const hash_index_s *index,
+                                            const char *str, uint32_t tag);
+
+/**
+ * @brief Indexes [data] under [hash]. It does not check for duplicates.
+ *
+ * @param [index]   The index.
+ * @param [hash]    The hash of the key of [data].
+ * @param [data]    The indexed data.
+ */
+INTERNAL void otrng_hash_index_add(hash_index_s *index, uint64_t hash,
+                                   void *data);
+
+/**
+ * @brief Finds the data indexed under [hash] that matches [wanted].
+ *
+ * @param [index]    The index.
+ * @param [hash]     The hash of the key of [wanted].
+ * @param [wanted]   What to look for.
+ * @param [fn]       Returns non-zero when [current] is [wanted], as for
+ *                   otrng_list_get.
+ *
+ * @return The data, or NULL if nothing matches.
+ */
+INTERNAL void *
+otrng_hash_index_get(const hash_index_s *index, uint64_t hash,
+                     const void *wanted,
+                     int (*fn)(const void *current, const void *wanted));
+
+/**
+ * @brief Removes [data] from the index, if it was indexed under [hash].
+ *
+ * @param [index]   The index.
+ * @param [hash]    The hash [data] was indexed under.
+ * @param [data]    The indexed data.
+ */
+INTERNAL void otrng_hash_index_remove(hash_index_s *index, uint64_t hash,
+                                      const void *data);
+
+/**
+ * @brief The number of indexed entries.
+ *
+ * @param [index]   The index.
+ */
+INTERNAL size_t otrng_hash_index_len(const hash_index_s *index);
+
+#ifdef OTRNG_HASH_INDEX_PRIVATE
+
+tstatic size_t hash_index_bucket(const hash_index_s *index, uint64_t hash);
+
+#endif
+
+#endif
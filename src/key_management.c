@@ -60,6 +60,7 @@ INTERNAL void otrng_key_manager_init(key_manager_s *manager) {
   manager->our_dh = otrng_secure_alloc(sizeof(dh_keypair_s));
   manager->our_dh->pub = NULL;
   manager->our_dh->priv = NULL;
+  manager->skipped_keys = otrng_skipped_keys_table_new();
 }
 
 INTERNAL key_manager_s *otrng_key_manager_new(void) {
@@ -94,12 +95,14 @@ INTERNAL void otrng_key_manager_destroy(key_manager_s *manager) {
   manager->ssid_half_first = otrng_false;
   otrng_secure_wipe(manager->extra_symmetric_key, EXTRA_SYMMETRIC_KEY_BYTES);
 
-  otrng_list_free(manager->skipped_keys, otrng_secure_free);
+  otrng_skipped_keys_table_free(manager->skipped_keys);
   manager->skipped_keys = NULL;
 
-  otrng_list_free(manager->old_mac_keys, otrng_secure_free);
+  otrng_list_free(manager->old_mac_keys, otrng_secure_slab_free);
   manager->old_mac_keys = NULL;
 
+  otrng_key_manager_lookahead(manager, 0, 0);
+
   otrng_secure_wipe(manager, sizeof(key_manager_s));
 }
 
@@ -139,6 +142,10 @@ otrng_receiving_ratchet_new(key_manager_s *manager) {
          EXTRA_SYMMETRIC_KEY_BYTES);
 
   ratchet->skipped_keys = manager->skipped_keys;
+  ratchet->num_added_skipped_keys = 0;
+  ratchet->used_skipped_key = NULL;
+
+  ratchet->lookahead = manager->lookahead;
 
   return ratchet;
 }
@@ -152,6 +159,60 @@ tstatic void otrng_key_manager_set_their_keys(ec_point their_ecdh,
   manager->their_dh = otrng_dh_mpi_copy(their_dh);
 }
 
+static const uint8_t *lookahead_chain_at(const chain_lookahead_s *lookahead,
+                                         size_t n) {
+  if (n == 0) {
+    return lookahead->chain;
+  }
+
+  return lookahead->entries[n - 1].next_chain;
+}
+
+/* The keys of message [k], if they were derived from [chain] */
+static const chain_lookahead_entry_s *
+lookahead_get(const chain_lookahead_s *lookahead, uint32_t k,
+              const k_receiving_chain chain) {
+  size_t n;
+
+  if (!lookahead || k < lookahead->start) {
+    return NULL;
+  }
+
+  n = k - lookahead->start;
+  if (n >= lookahead->count ||
+      sodium_memcmp(lookahead_chain_at(lookahead, n), chain,
+                    CHAIN_KEY_BYTES) != 0) {
+    return NULL;
+  }
+
+  return &lookahead->entries[n];
+}
+
+/* Moves the start of the lookahead to message [k], whose chain key is [chain],
+   dropping the keys before it. If the keys were derived from another chain
+   they are all dropped. */
+static void lookahead_rebase(chain_lookahead_s *lookahead, uint32_t k,
+                             const k_receiving_chain chain) {
+  size_t used = lookahead->count;
+
+  if (k >= lookahead->start && k - lookahead->start <= lookahead->count &&
+      sodium_memcmp(lookahead_chain_at(lookahead, k - lookahead->start), chain,
+                    CHAIN_KEY_BYTES) == 0) {
+    used = k - lookahead->start;
+  }
+
+  if (used > 0) {
+    memmove(lookahead->entries, lookahead->entries + used,
+            (lookahead->count - used) * sizeof(chain_lookahead_entry_s));
+    otrng_secure_wipe(lookahead->entries + lookahead->count - used,
+                      used * sizeof(chain_lookahead_entry_s));
+    lookahead->count -= used;
+  }
+
+  lookahead->start = k;
+  memcpy(lookahead->chain, chain, CHAIN_KEY_BYTES);
+}
+
 INTERNAL void otrng_receiving_ratchet_copy(key_manager_s *dst,
                                            receiving_ratchet_s *src) {
   if (!dst || !src) {
@@ -175,7 +236,66 @@ INTERNAL void otrng_receiving_ratchet_copy(key_manager_s *dst,
   memcpy(dst->extra_symmetric_key, src->extra_symmetric_key,
          EXTRA_SYMMETRIC_KEY_BYTES);
 
-  dst->skipped_keys = src->skipped_keys;
+  /* The keys of the messages just received must not be kept */
+  if (dst->lookahead) {
+    lookahead_rebase(dst->lookahead, dst->k, dst->current->chain_r);
+  }
+
+  otrng_receiving_ratchet_accept(src);
+}
+
+INTERNAL void otrng_receiving_ratchet_accept(receiving_ratchet_s *ratchet) {
+  /* The keys stored while receiving are already on the table: only the one
+     used to decrypt this message must go */
+  if (ratchet->used_skipped_key) {
+    otrng_skipped_keys_table_remove(ratchet->skipped_keys,
+                                    ratchet->used_skipped_key);
+    ratchet->used_skipped_key = NULL;
+  }
+  ratchet->num_added_skipped_keys = 0;
+}
+
+INTERNAL void otrng_receiving_ratchet_save(receiving_ratchet_state_s *dst,
+                                           const receiving_ratchet_s *src) {
+  otrng_ec_scalar_copy(dst->our_ecdh_priv, src->our_ecdh_priv);
+
+  memcpy(dst->brace_key, src->brace_key, BRACE_KEY_BYTES);
+  memcpy(dst->shared_secret, src->shared_secret, SHARED_SECRET_BYTES);
+
+  dst->i = src->i;
+  dst->j = src->j;
+  dst->k = src->k;
+  dst->pn = src->pn;
+
+  memcpy(dst->root_key, src->root_key, ROOT_KEY_BYTES);
+  memcpy(dst->chain_r, src->chain_r, CHAIN_KEY_BYTES);
+
+  memcpy(dst->extra_symmetric_key, src->extra_symmetric_key,
+         EXTRA_SYMMETRIC_KEY_BYTES);
+}
+
+INTERNAL void otrng_receiving_ratchet_restore(
+    receiving_ratchet_s *dst, const receiving_ratchet_state_s *src) {
+  otrng_ec_scalar_copy(dst->our_ecdh_priv, src->our_ecdh_priv);
+
+  memcpy(dst->brace_key, src->brace_key, BRACE_KEY_BYTES);
+  memcpy(dst->shared_secret, src->shared_secret, SHARED_SECRET_BYTES);
+
+  dst->i = src->i;
+  dst->j = src->j;
+  dst->k = src->k;
+  dst->pn = src->pn;
+
+  memcpy(dst->root_key, src->root_key, ROOT_KEY_BYTES);
+  memcpy(dst->chain_r, src->chain_r, CHAIN_KEY_BYTES);
+
+  memcpy(dst->extra_symmetric_key, src->extra_symmetric_key,
+         EXTRA_SYMMETRIC_KEY_BYTES);
+
+  otrng_skipped_keys_table_remove_newest(dst->skipped_keys,
+                                         dst->num_added_skipped_keys);
+  dst->num_added_skipped_keys = 0;
+  dst->used_skipped_key = NULL;
 }
 
 INTERNAL void otrng_receiving_ratchet_destroy(receiving_ratchet_s *ratchet) {
@@ -195,6 +315,12 @@ INTERNAL void otrng_receiving_ratchet_destroy(receiving_ratchet_s *ratchet) {
   otrng_secure_wipe(ratchet->chain_r, CHAIN_KEY_BYTES);
   otrng_secure_wipe(ratchet->extra_symmetric_key, EXTRA_SYMMETRIC_KEY_BYTES);
 
+  /* Roll back the keys stored for a message that was not accepted */
+  if (ratchet->skipped_keys) {
+    otrng_skipped_keys_table_remove_newest(ratchet->skipped_keys,
+                                           ratchet->num_added_skipped_keys);
+  }
+
   otrng_secure_free(ratchet);
 }
 
@@ -247,7 +373,7 @@ otrng_key_manager_generate_ephemeral_keys(key_manager_s *manager) {
        1. for the first generation: until the ratchet is initialized
        2. when receiving a new dh ratchet
     */
-    if (!otrng_dh_keypair_generate(manager->our_dh)) {
+    if (!otrng_dh_keypair_pool_take(manager->our_dh, manager->dh_pool)) {
       return OTRNG_ERROR;
     }
   }
@@ -828,119 +954,66 @@ static uint8_t usage_message_key = 0x16;
 static uint8_t usage_mac_key = 0x17;
 static uint8_t usage_extra_symm_key = 0x18;
 
-static otrng_result
-derive_next_chain_key(key_manager_s *manager,
-                      receiving_ratchet_s *tmp_receiving_ratchet,
-                      const char action) {
-  /* chain_key_s[i-1][j+1] = KDF_1(usage_next_chain_key || chain_key_s[i-1][j],
-   * 64) */
-  assert(action == 's' || action == 'r');
-  if (action == 's') {
-    if (!shake_256_kdf1(manager->current->chain_s, CHAIN_KEY_BYTES,
-                        usage_next_chain_key, manager->current->chain_s,
-                        CHAIN_KEY_BYTES)) {
-      return OTRNG_ERROR;
-    }
-
-  } else if (action == 'r') {
-    if (!shake_256_kdf1(tmp_receiving_ratchet->chain_r, CHAIN_KEY_BYTES,
-                        usage_next_chain_key, tmp_receiving_ratchet->chain_r,
-                        CHAIN_KEY_BYTES)) {
-      return OTRNG_ERROR;
-    }
-  }
-
-  return OTRNG_SUCCESS;
-}
-
-static otrng_result derive_encryption_and_mac_keys(
-    k_msg_enc enc_key, k_msg_mac mac_key, key_manager_s *manager,
-    receiving_ratchet_s *tmp_receiving_ratchet, const char action) {
-  assert(action == 's' || action == 'r');
+/*
+ * Derives every key of the message whose chain key is [chain_key]:
+ *   MKenc = KDF_1(usage_message_key || chain_key, 32)
+ *   MKmac = KDF_1(usage_mac_key || MKenc, 64)
+ *   extra_symm_key = KDF_1(usage_extra_symm_key || 0xFF || chain_key, 32)
+ *   next_chain_key = KDF_1(usage_next_chain_key || chain_key, 64)
+ * Each of them fits in a single Keccak block, so this is one permutation per
+ * key. [mac_key] can be NULL when only the keys are stored, and [next_chain]
+ * can be [chain_key].
+ */
+tstatic otrng_result derive_message_keys(k_msg_enc enc_key, uint8_t *mac_key,
+                                         k_extra_symmetric extra_key,
+                                         uint8_t *next_chain,
+                                         const uint8_t *chain_key) {
+  goldilocks_shake256_ctx_p hd;
+  uint8_t magic[1] = {0xFF};
 
-  /* MKenc, MKmac = derive_enc_mac_keys(chain_key_s[i-1][j])
-     MKenc = KDF_1(usage_message_key || chain_key, 32)
-     MKmac = KDF_1(usage_mac_key || MKenc, 64)
-  */
-  if (action == 's') {
-    if (!shake_256_kdf1(enc_key, ENC_KEY_BYTES, usage_message_key,
-                        manager->current->chain_s, CHAIN_KEY_BYTES)) {
-      return OTRNG_ERROR;
-    }
-  } else if (action == 'r') {
-    if (!shake_256_kdf1(enc_key, ENC_KEY_BYTES, usage_message_key,
-                        tmp_receiving_ratchet->chain_r, CHAIN_KEY_BYTES)) {
-      return OTRNG_ERROR;
-    }
+  if (!shake_256_kdf1(enc_key, ENC_KEY_BYTES, usage_message_key, chain_key,
+                      CHAIN_KEY_BYTES)) {
+    return OTRNG_ERROR;
   }
 
-  if (!shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key, enc_key,
-                      ENC_KEY_BYTES)) {
+  if (mac_key && !shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key,
+                                 enc_key, ENC_KEY_BYTES)) {
     return OTRNG_ERROR;
   }
 
-  return OTRNG_SUCCESS;
-}
-
-tstatic otrng_result calculate_extra_key(
-    key_manager_s *manager, receiving_ratchet_s *tmp_receiving_ratchet,
-    const char action) {
-  goldilocks_shake256_ctx_p hd;
-  uint8_t *extra_key_buffer = otrng_secure_alloc(EXTRA_SYMMETRIC_KEY_BYTES);
-  uint8_t magic[1] = {0xFF};
-
   if (!hash_init_with_usage(hd, usage_extra_symm_key)) {
-    otrng_secure_free(extra_key_buffer);
     return OTRNG_ERROR;
   }
 
-  if (hash_update(hd, magic, 1) == GOLDILOCKS_FAILURE) {
+  if (hash_update(hd, magic, 1) == GOLDILOCKS_FAILURE ||
+      hash_update(hd, chain_key, CHAIN_KEY_BYTES) == GOLDILOCKS_FAILURE) {
     hash_destroy(hd);
-    otrng_secure_free(extra_key_buffer);
     return OTRNG_ERROR;
   }
 
-  /* extra_symm_key = KDF_1(usage_extra_symm_key || 0xFF || chain_key_s[i-1][j],
-   * 32) */
-  assert(action == 's' || action == 'r');
-  if (action == 's') {
-    if (hash_update(hd, manager->current->chain_s, CHAIN_KEY_BYTES) ==
-        GOLDILOCKS_FAILURE) {
-      hash_destroy(hd);
-      otrng_secure_free(extra_key_buffer);
-      return OTRNG_ERROR;
-    }
-
-    hash_final(hd, extra_key_buffer, EXTRA_SYMMETRIC_KEY_BYTES);
-    hash_destroy(hd);
+  hash_final(hd, extra_key, EXTRA_SYMMETRIC_KEY_BYTES);
+  hash_destroy(hd);
 
-    memcpy(manager->extra_symmetric_key, extra_key_buffer,
-           EXTRA_SYMMETRIC_KEY_BYTES);
-  } else if (action == 'r') {
-    if (hash_update(hd, tmp_receiving_ratchet->chain_r, CHAIN_KEY_BYTES) ==
-        GOLDILOCKS_FAILURE) {
-      hash_destroy(hd);
-      otrng_secure_wipe(extra_key_buffer, EXTRA_SYMMETRIC_KEY_BYTES);
-      otrng_free(extra_key_buffer);
-      return OTRNG_ERROR;
-    }
+  /* @secret the chain key is replaced last, as it can be [next_chain] */
+  return shake_256_kdf1(next_chain, CHAIN_KEY_BYTES, usage_next_chain_key,
+                        chain_key, CHAIN_KEY_BYTES);
+}
 
-    hash_final(hd, extra_key_buffer, EXTRA_SYMMETRIC_KEY_BYTES);
-    hash_destroy(hd);
+static otrng_result next_receiving_keys(k_msg_enc enc_key,
+                                        k_extra_symmetric extra_key,
+                                        receiving_ratchet_s *ratchet) {
+  const chain_lookahead_entry_s *entry =
+      lookahead_get(ratchet->lookahead, ratchet->k, ratchet->chain_r);
 
-    memcpy(tmp_receiving_ratchet->extra_symmetric_key, extra_key_buffer,
-           EXTRA_SYMMETRIC_KEY_BYTES);
+  if (entry) {
+    memcpy(enc_key, entry->enc_key, ENC_KEY_BYTES);
+    memcpy(extra_key, entry->extra_symmetric_key, EXTRA_SYMMETRIC_KEY_BYTES);
+    memcpy(ratchet->chain_r, entry->next_chain, CHAIN_KEY_BYTES);
+    return OTRNG_SUCCESS;
   }
-  otrng_secure_free(extra_key_buffer);
-
-// TODO: add to tmp
-#ifdef DEBUG
-  debug_print("\n");
-  debug_print("EXTRA KEY = ");
-  otrng_memdump(manager->extra_symmetric_key, EXTRA_SYMMETRIC_KEY_BYTES);
-#endif
 
-  return OTRNG_SUCCESS;
+  return derive_message_keys(enc_key, NULL, extra_key, ratchet->chain_r,
+                             ratchet->chain_r);
 }
 
 tstatic otrng_result store_enc_keys(k_msg_enc enc_key,
@@ -950,10 +1023,8 @@ tstatic otrng_result store_enc_keys(k_msg_enc enc_key,
                                     const char ratchet_type,
                                     otrng_warning *warn) {
   uint8_t zero_buffer[CHAIN_KEY_BYTES];
-  goldilocks_shake256_ctx_p hd;
-  uint8_t *extra_key = otrng_secure_alloc(EXTRA_SYMMETRIC_KEY_BYTES);
-  uint8_t magic[1] = {0xFF};
-  skipped_keys_s *skipped_msg_enc_key;
+  uint8_t *extra_key = otrng_secure_slab_alloc(EXTRA_SYMMETRIC_KEY_BYTES);
+  uint32_t ratchet_id = 0;
 
   memset(zero_buffer, 0, CHAIN_KEY_BYTES);
 
@@ -961,7 +1032,7 @@ tstatic otrng_result store_enc_keys(k_msg_enc enc_key,
     if (warn) {
       *warn = OTRNG_WARN_STORAGE_FULL;
     }
-    otrng_secure_free(extra_key);
+    otrng_secure_slab_free(extra_key);
     // TODO: should we really return success here?
     return OTRNG_SUCCESS;
   }
@@ -969,68 +1040,28 @@ tstatic otrng_result store_enc_keys(k_msg_enc enc_key,
   if (!(memcmp(tmp_receiving_ratchet->chain_r, zero_buffer, CHAIN_KEY_BYTES) ==
         0)) {
     while (tmp_receiving_ratchet->k < until) {
-      if (!shake_256_kdf1(enc_key, ENC_KEY_BYTES, usage_message_key,
-                          tmp_receiving_ratchet->chain_r, CHAIN_KEY_BYTES)) {
-        otrng_secure_free(extra_key);
-        return OTRNG_ERROR;
-      }
-
-      if (!hash_init_with_usage(hd, usage_extra_symm_key)) {
-        otrng_secure_free(extra_key);
+      if (!next_receiving_keys(enc_key, extra_key, tmp_receiving_ratchet)) {
+        otrng_secure_slab_free(extra_key);
         return OTRNG_ERROR;
       }
 
-      if (hash_update(hd, magic, 1) == GOLDILOCKS_FAILURE) {
-        hash_destroy(hd);
-        otrng_secure_free(extra_key);
-        return OTRNG_ERROR;
-      }
-
-      if (hash_update(hd, tmp_receiving_ratchet->chain_r, CHAIN_KEY_BYTES) ==
-          GOLDILOCKS_FAILURE) {
-        hash_destroy(hd);
-        otrng_secure_free(extra_key);
-        return OTRNG_ERROR;
-      }
-
-      hash_final(hd, extra_key, EXTRA_SYMMETRIC_KEY_BYTES);
-      hash_destroy(hd);
-
-      if (!shake_256_kdf1(tmp_receiving_ratchet->chain_r, CHAIN_KEY_BYTES,
-                          usage_next_chain_key, tmp_receiving_ratchet->chain_r,
-                          CHAIN_KEY_BYTES)) {
-        otrng_secure_free(extra_key);
-        return OTRNG_ERROR;
-      }
-
-      skipped_msg_enc_key = otrng_secure_alloc(sizeof(skipped_keys_s));
-
       assert(ratchet_type == 'd' || ratchet_type == 'c');
       if (ratchet_type == 'd') {
-        skipped_msg_enc_key->i = tmp_receiving_ratchet->i -
-                                 1; /* ratchet_id - 1 for the dh ratchet */
+        /* ratchet_id - 1 for the dh ratchet */
+        ratchet_id = tmp_receiving_ratchet->i - 1;
       } else if (ratchet_type == 'c') {
-        skipped_msg_enc_key->i = tmp_receiving_ratchet->i;
+        ratchet_id = tmp_receiving_ratchet->i;
       }
 
-      skipped_msg_enc_key->j = tmp_receiving_ratchet->k;
-
-      memcpy(skipped_msg_enc_key->extra_symmetric_key, extra_key,
-             EXTRA_SYMMETRIC_KEY_BYTES);
-      memcpy(skipped_msg_enc_key->enc_key, enc_key, ENC_KEY_BYTES);
-
-      /*
-         @secret: should be deleted when:
-         1. session expired
-         2. the key is retrieved
-      */
-      tmp_receiving_ratchet->skipped_keys = otrng_list_add(
-          skipped_msg_enc_key, tmp_receiving_ratchet->skipped_keys);
+      otrng_skipped_keys_table_add(tmp_receiving_ratchet->skipped_keys,
+                                   ratchet_id, tmp_receiving_ratchet->k,
+                                   enc_key, extra_key);
+      tmp_receiving_ratchet->num_added_skipped_keys++;
       otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
       tmp_receiving_ratchet->k++;
     }
   }
-  otrng_secure_free(extra_key);
+  otrng_secure_slab_free(extra_key);
 
   return OTRNG_SUCCESS;
 }
@@ -1043,35 +1074,29 @@ INTERNAL otrng_result otrng_key_get_skipped_keys(
     k_msg_enc enc_key, k_msg_mac mac_key, unsigned int ratchet_id,
     unsigned int msg_id, key_manager_s *manager,
     receiving_ratchet_s *tmp_receiving_ratchet) {
-  list_element_s *current = tmp_receiving_ratchet->skipped_keys;
+  skipped_keys_s *skipped_keys = otrng_skipped_keys_table_get(
+      tmp_receiving_ratchet->skipped_keys, ratchet_id, msg_id);
   (void)manager;
 
-  while (current) {
-    skipped_keys_s *skipped_keys = current->data;
-
-    if (skipped_keys->i == ratchet_id && skipped_keys->j == msg_id) {
-      memcpy(enc_key, skipped_keys->enc_key, ENC_KEY_BYTES);
-      if (!shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key, enc_key,
-                          ENC_KEY_BYTES)) {
-        return OTRNG_ERROR;
-      }
-
-      memcpy(tmp_receiving_ratchet->extra_symmetric_key,
-             skipped_keys->extra_symmetric_key, EXTRA_SYMMETRIC_KEY_BYTES);
+  if (!skipped_keys) {
+    /* This is not an actual error, it is just that the key we need was not
+    skipped */
+    return OTRNG_ERROR;
+  }
 
-      tmp_receiving_ratchet->skipped_keys = otrng_list_remove_element(
-          current, tmp_receiving_ratchet->skipped_keys);
-      otrng_list_free(current, otrng_secure_free);
+  memcpy(enc_key, skipped_keys->enc_key, ENC_KEY_BYTES);
+  if (!shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key, enc_key,
+                      ENC_KEY_BYTES)) {
+    return OTRNG_ERROR;
+  }
 
-      return OTRNG_SUCCESS;
-    }
+  memcpy(tmp_receiving_ratchet->extra_symmetric_key,
+         skipped_keys->extra_symmetric_key, EXTRA_SYMMETRIC_KEY_BYTES);
 
-    current = current->next;
-  }
+  /* It is removed from the table once the ratchet is copied back */
+  tmp_receiving_ratchet->used_skipped_key = skipped_keys;
 
-  /* This is not an actual error, it is just that the key we need was not
-  skipped */
-  return OTRNG_ERROR;
+  return OTRNG_SUCCESS;
 }
 
 INTERNAL otrng_result otrng_key_manager_derive_chain_keys(
@@ -1085,21 +1110,24 @@ INTERNAL otrng_result otrng_key_manager_derive_chain_keys(
                         warn)) {
       return OTRNG_ERROR;
     }
-  }
 
-  /* @secret should be deleted after being used to encrypt and mac the message
-   */
-  if (!derive_encryption_and_mac_keys(enc_key, mac_key, manager,
-                                      tmp_receiving_ratchet, action)) {
-    return OTRNG_ERROR;
-  }
+    /* @secret should be deleted after being used to decrypt and mac the
+     * message */
+    if (!next_receiving_keys(enc_key,
+                             tmp_receiving_ratchet->extra_symmetric_key,
+                             tmp_receiving_ratchet)) {
+      return OTRNG_ERROR;
+    }
 
-  if (!calculate_extra_key(manager, tmp_receiving_ratchet, action)) {
-    return OTRNG_ERROR;
+    return shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key, enc_key,
+                          ENC_KEY_BYTES);
   }
 
-  /* @secret should be deleted when the new chain key is derived */
-  if (!derive_next_chain_key(manager, tmp_receiving_ratchet, action)) {
+  /* @secret should be deleted after being used to encrypt and mac the message,
+   * and the chain key when the new one is derived */
+  if (!derive_message_keys(enc_key, mac_key, manager->extra_symmetric_key,
+                           manager->current->chain_s,
+                           manager->current->chain_s)) {
     return OTRNG_ERROR;
   }
 
@@ -1137,9 +1165,57 @@ INTERNAL otrng_result otrng_key_manager_derive_dh_ratchet_keys(
   return OTRNG_SUCCESS;
 }
 
+INTERNAL size_t otrng_key_manager_lookahead(key_manager_s *manager,
+                                            size_t depth, size_t budget) {
+  chain_lookahead_s *lookahead = manager->lookahead;
+  uint8_t zero_buffer[CHAIN_KEY_BYTES];
+  size_t derived = 0;
+
+  if (lookahead && lookahead->capacity != depth) {
+    otrng_secure_free(lookahead->entries);
+    otrng_secure_free(lookahead);
+    manager->lookahead = lookahead = NULL;
+  }
+
+  memset(zero_buffer, 0, CHAIN_KEY_BYTES);
+  if (depth == 0 || !manager->current ||
+      memcmp(manager->current->chain_r, zero_buffer, CHAIN_KEY_BYTES) == 0) {
+    return 0;
+  }
+
+  if (!lookahead) {
+    lookahead = otrng_secure_alloc(sizeof(chain_lookahead_s));
+    lookahead->entries =
+        otrng_secure_alloc(depth * sizeof(chain_lookahead_entry_s));
+    lookahead->count = 0;
+    lookahead->start = manager->k;
+    lookahead->capacity = depth;
+    memcpy(lookahead->chain, manager->current->chain_r, CHAIN_KEY_BYTES);
+    manager->lookahead = lookahead;
+  }
+
+  lookahead_rebase(lookahead, manager->k, manager->current->chain_r);
+
+  while (lookahead->count < lookahead->capacity && derived < budget) {
+    chain_lookahead_entry_s *entry = &lookahead->entries[lookahead->count];
+
+    if (!derive_message_keys(entry->enc_key, NULL, entry->extra_symmetric_key,
+                             entry->next_chain,
+                             lookahead_chain_at(lookahead, lookahead->count))) {
+      otrng_secure_wipe(entry, sizeof(chain_lookahead_entry_s));
+      break;
+    }
+
+    lookahead->count++;
+    derived++;
+  }
+
+  return derived;
+}
+
 INTERNAL otrng_result otrng_store_old_mac_keys(key_manager_s *manager,
                                                k_msg_mac mac_key) {
-  uint8_t *to_store_mac = otrng_secure_alloc(MAC_KEY_BYTES);
+  uint8_t *to_store_mac = otrng_secure_slab_alloc(MAC_KEY_BYTES);
 
   memcpy(to_store_mac, mac_key, ENC_KEY_BYTES);
   manager->old_mac_keys = otrng_list_add(to_store_mac, manager->old_mac_keys);
@@ -1148,36 +1224,32 @@ INTERNAL otrng_result otrng_store_old_mac_keys(key_manager_s *manager,
 }
 
 INTERNAL uint8_t *otrng_reveal_mac_keys_on_tlv(key_manager_s *manager) {
-  size_t num_stored_keys = otrng_list_len(manager->skipped_keys);
+  size_t num_stored_keys = otrng_skipped_keys_table_len(manager->skipped_keys);
   size_t serlen = num_stored_keys * MAC_KEY_BYTES;
   uint8_t *ser_mac_keys;
+  skipped_keys_s *current;
   k_msg_mac mac_key;
-  k_msg_enc enc_key;
-  size_t i;
+  size_t i = 0;
 
   if (serlen != 0) {
     ser_mac_keys = otrng_secure_alloc(serlen);
 
-    memset(enc_key, 0, ENC_KEY_BYTES);
     memset(mac_key, 0, MAC_KEY_BYTES);
 
-    for (i = 0; i < num_stored_keys; i++) {
-      list_element_s *last = otrng_list_get_last(manager->skipped_keys);
-      skipped_keys_s *skipped_keys = last->data;
-      memcpy(enc_key, skipped_keys->enc_key, ENC_KEY_BYTES);
-
-      if (!shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key, enc_key,
-                          ENC_KEY_BYTES)) {
+    /* Revealed from the newest to the oldest stored key */
+    for (current = manager->skipped_keys->newest; current;
+         current = current->older) {
+      if (!shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key,
+                          current->enc_key, ENC_KEY_BYTES)) {
         otrng_secure_free(ser_mac_keys);
         return NULL; // TODO: is this the best to do in this case?
       }
 
       memcpy(ser_mac_keys + i * MAC_KEY_BYTES, mac_key, MAC_KEY_BYTES);
-      manager->skipped_keys =
-          otrng_list_remove_element(last, manager->skipped_keys);
-      otrng_list_free(last, otrng_secure_free);
+      i++;
     }
-    otrng_list_free_nodes(manager->skipped_keys);
+    otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
+    otrng_skipped_keys_table_clear(manager->skipped_keys);
 
     return ser_mac_keys;
   }
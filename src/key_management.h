@@ -27,6 +27,7 @@
 #include "keys.h"
 #include "list.h"
 #include "shared.h"
+#include "skipped_keys.h"
 #include "warn.h"
 
 /* the different kind of keys for the key management */
@@ -48,13 +49,22 @@ typedef struct ratchet_s {
   k_receiving_chain chain_r;
 } ratchet_s;
 
-/* the list of stored message and extra symmetric keys */
-typedef struct skipped_keys_s {
-  uint32_t i; /* Counter of the ratchet */
-  uint32_t j; /* Counter of the sending messages */
-  k_extra_symmetric extra_symmetric_key;
+/* the keys of one message of the receiving chain, derived ahead of time */
+typedef struct chain_lookahead_entry_s {
   k_msg_enc enc_key;
-} skipped_keys_s;
+  k_extra_symmetric extra_symmetric_key;
+  k_receiving_chain next_chain; /* the chain key of the following message */
+} chain_lookahead_entry_s;
+
+/* the keys of the next [count] messages of the receiving chain, starting at
+   message [start], whose chain key is [chain] */
+typedef struct chain_lookahead_s {
+  k_receiving_chain chain;
+  uint32_t start;
+  size_t count;
+  size_t capacity;
+  chain_lookahead_entry_s *entries;
+} chain_lookahead_s;
 
 /* a temporary structure used to hold the values of the receiving ratchet */
 typedef struct receiving_ratchet_s {
@@ -76,9 +86,33 @@ typedef struct receiving_ratchet_s {
 
   k_extra_symmetric extra_symmetric_key;
 
-  list_element_s *skipped_keys;
+  /* shared with the key manager: keys stored while receiving are added
+     directly to it, and removed again if the ratchet is not copied back */
+  skipped_keys_table_s *skipped_keys;
+  size_t num_added_skipped_keys;
+  skipped_keys_s *used_skipped_key;
+
+  /* shared with the key manager, and only read while receiving */
+  const chain_lookahead_s *lookahead;
 } receiving_ratchet_s;
 
+/* the values of a receiving ratchet that receiving one message can change */
+typedef struct receiving_ratchet_state_s {
+  ec_scalar our_ecdh_priv;
+
+  k_brace brace_key;
+  k_shared_secret shared_secret;
+
+  uint32_t i;
+  uint32_t k;
+  uint32_t j;
+  uint32_t pn;
+  k_root root_key;
+  k_receiving_chain chain_r;
+
+  k_extra_symmetric extra_symmetric_key;
+} receiving_ratchet_state_s;
+
 /* represents the different values needed for key management */
 typedef struct key_manager_s {
   /* AKE context */
@@ -110,9 +144,15 @@ typedef struct key_manager_s {
   k_extra_symmetric extra_symmetric_key;
   uint8_t tmp_key[HASH_BYTES];
 
-  list_element_s *skipped_keys;
+  skipped_keys_table_s *skipped_keys;
   list_element_s *old_mac_keys;
 
+  /* NULL unless keys are derived ahead with otrng_key_manager_lookahead */
+  chain_lookahead_s *lookahead;
+
+  /* Where new DH keypairs are taken from. Not owned by the key manager. */
+  otrng_keypair_pool_s *dh_pool;
+
   time_t last_generated;
 } key_manager_s;
 
@@ -164,7 +204,8 @@ INTERNAL receiving_ratchet_s *
 otrng_receiving_ratchet_new(key_manager_s *manager);
 
 /**
- * @brief Copy a temporary receiving ratchet into the key manager.
+ * @brief Copy a temporary receiving ratchet into the key manager. This also
+ * commits the changes done to the skipped keys while receiving.
  *
  * @param [dst]   The key manager.
  * @param [src]   The receiving ratchet.
@@ -174,12 +215,56 @@ INTERNAL void otrng_receiving_ratchet_copy(key_manager_s *dst,
 
 /**
  * @brief Destroy a temporary receiving ratchet to be used to prevent a ratchet
- * corruption.
+ * corruption. Any skipped keys stored through it that were not committed by
+ * otrng_receiving_ratchet_copy are removed.
  *
  * @param [manager]   The receiving ratchet.
  */
 INTERNAL void otrng_receiving_ratchet_destroy(receiving_ratchet_s *ratchet);
 
+/**
+ * @brief Commit the changes done to the skipped keys while receiving a message
+ * through a receiving ratchet that is kept for further messages: the skipped
+ * key it used is removed, and the keys it stored are no longer rolled back.
+ *
+ * @param [ratchet]   The receiving ratchet.
+ */
+INTERNAL void otrng_receiving_ratchet_accept(receiving_ratchet_s *ratchet);
+
+/**
+ * @brief Save the state of a receiving ratchet before receiving a message.
+ *
+ * @param [dst]   The saved state.
+ * @param [src]   The receiving ratchet.
+ */
+INTERNAL void otrng_receiving_ratchet_save(receiving_ratchet_state_s *dst,
+                                           const receiving_ratchet_s *src);
+
+/**
+ * @brief Undo a message that was not accepted: restore the state saved before
+ * receiving it, and remove the skipped keys it stored.
+ *
+ * @param [dst]   The receiving ratchet.
+ * @param [src]   The saved state.
+ */
+INTERNAL void otrng_receiving_ratchet_restore(
+    receiving_ratchet_s *dst, const receiving_ratchet_state_s *src);
+
+/**
+ * @brief Derive the keys of the next messages of the receiving chain ahead of
+ * time, so that receiving them, or a message after a gap, mostly looks them
+ * up.
+ *
+ * @param [manager]   The key manager.
+ * @param [depth]     How many messages ahead to keep keys for. Zero frees
+ *                    the keys derived so far.
+ * @param [budget]    The maximum number of messages to derive keys for.
+ *
+ * @return The number of messages keys were derived for.
+ */
+INTERNAL size_t otrng_key_manager_lookahead(key_manager_s *manager,
+                                            size_t depth, size_t budget);
+
 /**
  * @brief Securely replace their ecdh and their dh keys.
  *
@@ -358,14 +443,17 @@ tstatic otrng_result key_manager_derive_ratchet_keys(
 tstatic otrng_result calculate_ssid(key_manager_s *manager);
 
 /**
- * @brief Calculate the extra symmetric key.
+ * @brief Derive the encryption, MAC and extra symmetric keys of a message and
+ * the next chain key from its chain key.
  *
- * @param [manager]   The key manager.
- * @param [action]    's' for sending chain, 'r' for receiving
+ * @param [mac_key]      NULL if the MAC key is not needed.
+ * @param [next_chain]   Where the next chain key goes. It can be [chain_key].
+ * @param [chain_key]    The chain key of the message.
  */
-tstatic otrng_result calculate_extra_key(
-    key_manager_s *manager, receiving_ratchet_s *tmp_receiving_ratchet,
-    const char action);
+tstatic otrng_result derive_message_keys(k_msg_enc enc_key, uint8_t *mac_key,
+                                         k_extra_symmetric extra_key,
+                                         uint8_t *next_chain,
+                                         const uint8_t *chain_key);
 
 #endif
 
@@ -0,0 +1,162 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "alloc.h"
+#include "keypair_pool.h"
+
+INTERNAL otrng_keypair_pool_s *
+otrng_keypair_pool_new(size_t keypair_size,
+                       otrng_result (*generate)(void *keypair),
+                       void (*destroy)(void *keypair),
+                       void *(*alloc_keypairs)(size_t size),
+                       void (*free_keypairs)(void *ptr)) {
+  otrng_keypair_pool_s *pool = otrng_xmalloc_z(sizeof(otrng_keypair_pool_s));
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->keypair_size = keypair_size;
+  pool->generate = generate;
+  pool->destroy = destroy;
+  pool->alloc_keypairs = alloc_keypairs;
+  pool->free_keypairs = free_keypairs;
+
+  return pool;
+}
+
+INTERNAL void otrng_keypair_pool_free(otrng_keypair_pool_s *pool) {
+  if (!pool) {
+    return;
+  }
+
+  otrng_keypair_pool_set_depth(pool, 0);
+  pthread_mutex_destroy(&pool->lock);
+  otrng_free(pool);
+}
+
+static uint8_t *keypair_at(const otrng_keypair_pool_s *pool, size_t n) {
+  return pool->keypairs + n * pool->keypair_size;
+}
+
+INTERNAL void otrng_keypair_pool_set_depth(otrng_keypair_pool_s *pool,
+                                           size_t depth) {
+  uint8_t *keypairs = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (pool->count > depth) {
+    pool->count--;
+    pool->destroy(keypair_at(pool, pool->count));
+  }
+
+  if (depth > 0) {
+    keypairs = pool->alloc_keypairs(depth * pool->keypair_size);
+    if (pool->count > 0) {
+      memcpy(keypairs, pool->keypairs, pool->count * pool->keypair_size);
+      otrng_secure_wipe(pool->keypairs, pool->count * pool->keypair_size);
+    }
+  }
+
+  if (pool->keypairs) {
+    pool->free_keypairs(pool->keypairs);
+  }
+  pool->keypairs = keypairs;
+  pool->depth = depth;
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+INTERNAL size_t otrng_keypair_pool_fill(otrng_keypair_pool_s *pool,
+                                        size_t budget) {
+  uint8_t *keypair = otrng_secure_alloc(pool->keypair_size);
+  size_t added = 0;
+
+  while (added < budget) {
+    otrng_bool full;
+
+    pthread_mutex_lock(&pool->lock);
+    full = pool->count >= pool->depth;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (full) {
+      break;
+    }
+
+    if (!pool->generate(keypair)) {
+      break;
+    }
+
+    /* Another thread may have filled it in the meantime */
+    pthread_mutex_lock(&pool->lock);
+    full = pool->count >= pool->depth;
+    if (!full) {
+      memcpy(keypair_at(pool, pool->count), keypair, pool->keypair_size);
+      pool->count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (full) {
+      pool->destroy(keypair);
+      break;
+    }
+
+    otrng_secure_wipe(keypair, pool->keypair_size);
+    added++;
+  }
+
+  otrng_secure_free(keypair);
+
+  return added;
+}
+
+INTERNAL otrng_result otrng_keypair_pool_take(void *keypair,
+                                              otrng_keypair_pool_s *pool) {
+  pthread_mutex_lock(&pool->lock);
+
+  if (pool->count == 0) {
+    if (pool->depth > 0) {
+      pool->misses++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return pool->generate(keypair);
+  }
+
+  pool->hits++;
+  pool->count--;
+  memcpy(keypair, keypair_at(pool, pool->count), pool->keypair_size);
+  otrng_secure_wipe(keypair_at(pool, pool->count), pool->keypair_size);
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL void otrng_keypair_pool_get_stats(otrng_keypair_pool_stats_s *dst,
+                                           otrng_keypair_pool_s *pool) {
+  pthread_mutex_lock(&pool->lock);
+
+  dst->available = pool->count;
+  dst->depth = pool->depth;
+  dst->hits = pool->hits;
+  dst->misses = pool->misses;
+
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,104 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_KEYPAIR_POOL_H
+#define OTRNG_KEYPAIR_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "error.h"
+#include "shared.h"
+
+/*
+ * Keypairs of one kind generated ahead of need. The pool is disabled while
+ * [depth] is zero. Every function is safe to call from any thread: keypairs
+ * are generated outside of the lock, so worker threads can fill the pool
+ * while others take from it.
+ */
+typedef struct otrng_keypair_pool_s {
+  pthread_mutex_t lock;
+
+  size_t keypair_size;
+  otrng_result (*generate)(void *keypair);
+  void (*destroy)(void *keypair);
+  void *(*alloc_keypairs)(size_t size);
+  void (*free_keypairs)(void *ptr);
+
+  uint8_t *keypairs; /* [depth] keypairs of [keypair_size] bytes */
+  size_t count;
+  size_t depth;
+
+  uint64_t hits;   /* keypairs taken from the pool */
+  uint64_t misses; /* keypairs generated on demand because it was empty */
+} otrng_keypair_pool_s;
+
+typedef struct otrng_keypair_pool_stats_s {
+  size_t available;
+  size_t depth;
+  uint64_t hits;
+  uint64_t misses;
+} otrng_keypair_pool_stats_s;
+
+/**
+ * @brief Creates an empty pool. It does nothing until it has a depth.
+ *
+ * @param [keypair_size]    The size of a keypair.
+ * @param [generate]        Generates a keypair.
+ * @param [destroy]         Destroys a keypair that is not taken.
+ * @param [alloc_keypairs]  Allocates the memory the keypairs are kept in.
+ * @param [free_keypairs]   Frees it.
+ */
+INTERNAL otrng_keypair_pool_s *
+otrng_keypair_pool_new(size_t keypair_size,
+                       otrng_result (*generate)(void *keypair),
+                       void (*destroy)(void *keypair),
+                       void *(*alloc_keypairs)(size_t size),
+                       void (*free_keypairs)(void *ptr));
+
+INTERNAL void otrng_keypair_pool_free(otrng_keypair_pool_s *pool);
+
+/**
+ * @brief Sets how many keypairs the pool keeps. Keypairs beyond the new depth
+ * are destroyed.
+ */
+INTERNAL void otrng_keypair_pool_set_depth(otrng_keypair_pool_s *pool,
+                                           size_t depth);
+
+/**
+ * @brief Generates up to [budget] keypairs, until the pool is full.
+ *
+ * @return The number of keypairs added to the pool.
+ */
+INTERNAL size_t otrng_keypair_pool_fill(otrng_keypair_pool_s *pool,
+                                        size_t budget);
+
+/**
+ * @brief Moves a keypair from the pool to [keypair], or generates one if the
+ * pool is empty.
+ */
+INTERNAL otrng_result otrng_keypair_pool_take(void *keypair,
+                                              otrng_keypair_pool_s *pool);
+
+INTERNAL void otrng_keypair_pool_get_stats(otrng_keypair_pool_stats_s *dst,
+                                           otrng_keypair_pool_s *pool);
+
+#endif
@@ -114,6 +114,25 @@ INTERNAL list_element_s *otrng_list_add(void *data, list_element_s *head) {
   return head;
 }
 
+INTERNAL list_element_s *otrng_list_append(void *data, list_element_s **head,
+                                           list_element_s *last) {
+  list_element_s *n = list_new();
+
+  n->data = data;
+
+  if (!last) {
+    last = otrng_list_get_last(*head);
+  }
+
+  if (last) {
+    last->next = n;
+  } else {
+    *head = n;
+  }
+
+  return n;
+}
+
 INTERNAL list_element_s *otrng_list_get_last(list_element_s *head) {
   list_element_s *cursor;
 
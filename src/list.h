@@ -48,6 +48,12 @@ INTERNAL list_element_s *otrng_list_copy(list_element_s *head);
 
 INTERNAL list_element_s *otrng_list_add(void *data, list_element_s *head);
 
+/* Appends [data] to [*head] after [last], its last node, and returns the new
+   last node. When [last] is NULL the list is walked to find it, so callers can
+   forget a last node that may be stale. */
+INTERNAL list_element_s *otrng_list_append(void *data, list_element_s **head,
+                                           list_element_s *last);
+
 INTERNAL list_element_s *otrng_list_get_last(list_element_s *head);
 
 INTERNAL list_element_s *
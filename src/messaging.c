@@ -46,6 +46,11 @@ otrng_global_state_new(const otrng_client_callbacks_s *cb, otrng_bool die) {
   }
 
   gs->callbacks = cb;
+  gs->ephemeral_pool = otrng_ephemeral_pool_new();
+  gs->fragment_expiry =
+      otrng_fragment_expiry_new(OTRNG_FRAGMENT_DEFAULT_EXPIRATION_TIME);
+  gs->client_index = otrng_hash_index_new();
+  gs->prekey_journal_sync_batch = 1;
   gs->user_state_v3 = otrl_userstate_create();
   if (gs->user_state_v3 == NULL) {
     if (die) {
@@ -64,11 +69,245 @@ API void otrng_global_state_free(otrng_global_state_s *gs) {
   }
 
   otrng_list_free(gs->clients, free_client);
+  otrng_hash_index_free(gs->client_index);
   otrl_userstate_free(gs->user_state_v3);
+  otrng_keypair_pool_free(gs->ephemeral_pool);
+  otrng_fragment_expiry_free(gs->fragment_expiry);
+  otrng_store_close(gs->store);
+  otrng_prekey_journal_close(gs->prekey_journal);
 
   otrng_free(gs);
 }
 
+API void otrng_global_state_set_ephemeral_pool_depth(otrng_global_state_s *gs,
+                                                     size_t depth) {
+  otrng_keypair_pool_set_depth(gs->ephemeral_pool, depth);
+}
+
+API size_t otrng_global_state_refill_ephemeral_pool(otrng_global_state_s *gs,
+                                                    size_t budget) {
+  return otrng_keypair_pool_fill(gs->ephemeral_pool, budget);
+}
+
+API void
+otrng_global_state_get_ephemeral_pool_stats(otrng_keypair_pool_stats_s *dst,
+                                            otrng_global_state_s *gs) {
+  otrng_keypair_pool_get_stats(dst, gs->ephemeral_pool);
+}
+
+API void otrng_global_state_set_fragment_expiration_time(
+    otrng_global_state_s *gs, uint32_t expiration_time) {
+  gs->fragment_expiry->expiration_time = expiration_time;
+}
+
+API size_t otrng_global_state_tick(otrng_global_state_s *gs, time_t now) {
+  size_t dropped = otrng_fragment_expiry_tick(gs->fragment_expiry, now);
+
+  otrng_global_state_evict_idle_clients(gs);
+  if (gs->prekey_journal) {
+    otrng_prekey_journal_sync(gs->prekey_journal);
+  }
+
+  return dropped;
+}
+
+API void otrng_global_state_set_max_resident_clients(otrng_global_state_s *gs,
+                                                     size_t max_clients) {
+  gs->max_resident_clients = max_clients;
+}
+
+tstatic otrng_bool is_idle(const otrng_client_s *client) {
+  return !client->conversations && !client->prekey_client &&
+         !client->should_publish && !client->is_publishing;
+}
+
+tstatic int compare_last_used(const void *a, const void *b) {
+  const otrng_client_s *x = *(otrng_client_s *const *)a;
+  const otrng_client_s *y = *(otrng_client_s *const *)b;
+
+  return (x->last_used > y->last_used) - (x->last_used < y->last_used);
+}
+
+tstatic int compare_pointers(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)(*(void *const *)a);
+  uintptr_t y = (uintptr_t)(*(void *const *)b);
+
+  return (x > y) - (x < y);
+}
+
+API size_t otrng_global_state_evict_idle_clients(otrng_global_state_s *gs) {
+  size_t resident, idle = 0, evicted = 0, n;
+  otrng_client_s **victims;
+  list_element_s **node;
+
+  if (gs->max_resident_clients == 0) {
+    return 0;
+  }
+
+  resident = otrng_list_len(gs->clients);
+  if (resident <= gs->max_resident_clients) {
+    return 0;
+  }
+
+  victims = otrng_xmalloc(resident * sizeof(otrng_client_s *));
+  for (node = &gs->clients; *node; node = &(*node)->next) {
+    if (is_idle((*node)->data)) {
+      victims[idle++] = (*node)->data;
+    }
+  }
+  qsort(victims, idle, sizeof(otrng_client_s *), compare_last_used);
+
+  if (!gs->store) {
+    gs->store = otrng_store_new();
+  }
+
+  for (n = 0; n < idle && resident - evicted > gs->max_resident_clients;
+       n++) {
+    if (otrng_store_evict_client(gs->store, victims[n])) {
+      victims[evicted++] = victims[n];
+    }
+  }
+
+  /* Unlinks the evicted clients in one pass over the list */
+  qsort(victims, evicted, sizeof(otrng_client_s *), compare_pointers);
+  node = &gs->clients;
+  while (*node) {
+    list_element_s *el = *node;
+    otrng_client_s *client = el->data;
+
+    if (!bsearch(&client, victims, evicted, sizeof(otrng_client_s *),
+                 compare_pointers)) {
+      node = &el->next;
+      continue;
+    }
+
+    *node = el->next;
+    if (gs->client_index) {
+      otrng_hash_index_remove(gs->client_index,
+                              otrng_hash_index_hash(gs->client_index,
+                                                    client->client_id.protocol,
+                                                    client->client_id.account),
+                              client);
+    }
+    otrng_client_free(client);
+    otrng_free(el);
+  }
+
+  /* Found again on the next append */
+  gs->last_client = NULL;
+  otrng_free(victims);
+
+  return evicted;
+}
+
+API otrng_result otrng_global_state_store_read_from(otrng_global_state_s *gs,
+                                                    FILE *f) {
+  const list_element_s *el;
+
+  if (gs->store) {
+    return OTRNG_ERROR;
+  }
+
+  gs->store = otrng_store_open(f);
+  if (!gs->store) {
+    return OTRNG_ERROR;
+  }
+
+  /* These clients are already in memory, and newer than the store */
+  for (el = gs->clients; el; el = el->next) {
+    const otrng_client_s *client = el->data;
+    otrng_store_entry_s *entry =
+        otrng_store_find(gs->store, &client->client_id);
+    if (entry) {
+      entry->loaded = otrng_true;
+    }
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+API otrng_result otrng_global_state_store_write_to(
+    const otrng_global_state_s *gs, FILE *f) {
+  return otrng_store_write(f, gs->clients, gs->store);
+}
+
+API otrng_result
+otrng_global_state_prekey_journal_open(otrng_global_state_s *gs,
+                                       const char *path) {
+  const list_element_s *el;
+
+  if (gs->prekey_journal) {
+    return OTRNG_ERROR;
+  }
+
+  gs->prekey_journal =
+      otrng_prekey_journal_open(path, gs->prekey_journal_sync_batch);
+  if (!gs->prekey_journal) {
+    return OTRNG_ERROR;
+  }
+
+  for (el = gs->clients; el; el = el->next) {
+    if (!otrng_prekey_journal_load_client(gs->prekey_journal, el->data)) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+API void otrng_global_state_set_prekey_journal_sync_batch(
+    otrng_global_state_s *gs, size_t changes) {
+  gs->prekey_journal_sync_batch = changes;
+  if (gs->prekey_journal) {
+    gs->prekey_journal->sync_batch = changes;
+  }
+}
+
+API otrng_result
+otrng_global_state_prekey_journal_sync(otrng_global_state_s *gs) {
+  if (!gs->prekey_journal) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_prekey_journal_sync(gs->prekey_journal);
+}
+
+API otrng_result
+otrng_global_state_prekey_journal_compact(otrng_global_state_s *gs) {
+  if (!gs->prekey_journal) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_prekey_journal_compact(gs->prekey_journal);
+}
+
+INTERNAL otrng_prekey_journal_s *
+otrng_client_prekey_journal(const otrng_client_s *client) {
+  if (!client || !client->global_state) {
+    return NULL;
+  }
+
+  return client->global_state->prekey_journal;
+}
+
+INTERNAL otrng_keypair_pool_s *
+otrng_client_ephemeral_pool(const otrng_client_s *client) {
+  if (!client || !client->global_state) {
+    return NULL;
+  }
+
+  return client->global_state->ephemeral_pool;
+}
+
+INTERNAL fragment_expiry_s *
+otrng_client_fragment_expiry(const otrng_client_s *client) {
+  if (!client || !client->global_state) {
+    return NULL;
+  }
+
+  return client->global_state->fragment_expiry;
+}
+
 tstatic int find_client_by_client_id(const void *current, const void *wanted) {
   const otrng_client_s *client = current;
   const otrng_client_id_s *cid = wanted;
@@ -76,13 +315,28 @@ tstatic int find_client_by_client_id(const void *current, const void *wanted) {
          strcmp(client->client_id.account, cid->account) == 0;
 }
 
+tstatic otrng_client_s *find_client(otrng_global_state_s *gs,
+                                    const otrng_client_id_s *client_id) {
+  list_element_s *el;
+
+  /* A global state put together by hand may have no index */
+  if (gs->client_index) {
+    uint64_t hash = otrng_hash_index_hash(
+        gs->client_index, client_id->protocol, client_id->account);
+    return otrng_hash_index_get(gs->client_index, hash, client_id,
+                                find_client_by_client_id);
+  }
+
+  el = otrng_list_get(client_id, gs->clients, find_client_by_client_id);
+  return el ? el->data : NULL;
+}
+
 tstatic otrng_client_s *get_client(otrng_global_state_s *gs,
                                    const otrng_client_id_s client_id) {
-  otrng_client_s *client;
-  list_element_s *el =
-      otrng_list_get(&client_id, gs->clients, find_client_by_client_id);
-  if (el) {
-    return el->data;
+  otrng_client_s *client = find_client(gs, &client_id);
+  if (client) {
+    client->last_used = ++gs->use_clock;
+    return client;
   }
 
   client = otrng_client_new(client_id);
@@ -91,7 +345,33 @@ tstatic otrng_client_s *get_client(otrng_global_state_s *gs,
   }
 
   client->global_state = gs;
-  gs->clients = otrng_list_add(client, gs->clients);
+
+  if (gs->store) {
+    otrng_store_entry_s *entry = otrng_store_find(gs->store, &client_id);
+    if (entry && !entry->loaded) {
+      if (!otrng_store_load_client(client, entry)) {
+        otrng_client_free(client);
+        return NULL;
+      }
+      otrng_store_set_loaded(entry);
+    }
+  }
+
+  if (gs->prekey_journal &&
+      !otrng_prekey_journal_load_client(gs->prekey_journal, client)) {
+    otrng_client_free(client);
+    return NULL;
+  }
+
+  client->last_used = ++gs->use_clock;
+  gs->last_client = otrng_list_append(client, &gs->clients, gs->last_client);
+  if (gs->client_index) {
+    otrng_hash_index_add(gs->client_index,
+                         otrng_hash_index_hash(gs->client_index,
+                                               client_id.protocol,
+                                               client_id.account),
+                         client);
+  }
 
   return client;
 }
@@ -99,11 +379,6 @@ tstatic otrng_client_s *get_client(otrng_global_state_s *gs,
 API otrng_client_s *otrng_client_get(otrng_global_state_s *gs,
 
                                      const otrng_client_id_s client_id) {
-  list_element_s *el =
-      otrng_list_get(&client_id, gs->clients, find_client_by_client_id);
-  if (el) {
-    return el->data;
-  }
   return get_client(gs, client_id);
 }
 
@@ -42,14 +42,38 @@
  */
 
 #include "client.h"
+#include "ephemeral_pool.h"
+#include "fragment.h"
+#include "hash_index.h"
 #include "list.h"
+#include "prekey_journal.h"
 #include "shared.h"
+#include "store.h"
 
 typedef struct otrng_global_state_s {
   list_element_s *clients;
+  /* The clients by (protocol, account), and the last node of [clients] */
+  hash_index_s *client_index;
+  list_element_s *last_client;
 
   const otrng_client_callbacks_s *callbacks;
   OtrlUserState user_state_v3;
+
+  /* The ephemeral keypairs of DAKEs and prekey messages, for every client */
+  otrng_keypair_pool_s *ephemeral_pool;
+
+  /* The conversations of every client with incomplete fragmented messages */
+  fragment_expiry_s *fragment_expiry;
+
+  /* The binary store clients are read from when they are first got, and
+     evicted to */
+  otrng_store_s *store;
+  size_t max_resident_clients;
+  uint64_t use_clock;
+
+  /* The journal prekey messages are kept in, as they change */
+  otrng_prekey_journal_s *prekey_journal;
+  size_t prekey_journal_sync_batch;
 } otrng_global_state_s;
 
 API otrng_global_state_s *
@@ -60,6 +84,142 @@ API void otrng_global_state_free(otrng_global_state_s *gs);
 API otrng_client_s *otrng_client_get(otrng_global_state_s *gs,
                                      const otrng_client_id_s client_id);
 
+/**
+ * @brief Sets how many ephemeral keypairs are kept ready for DAKEs and prekey
+ * messages. Zero, the default, disables the pool.
+ */
+API void otrng_global_state_set_ephemeral_pool_depth(otrng_global_state_s *gs,
+                                                     size_t depth);
+
+/**
+ * @brief Generates up to [budget] ephemeral keypairs into the pool, until it
+ * is full. It is safe to call from worker threads, including several at
+ * once, while the library takes keypairs from the pool.
+ *
+ * @return The number of keypairs added.
+ */
+API size_t otrng_global_state_refill_ephemeral_pool(otrng_global_state_s *gs,
+                                                    size_t budget);
+
+/**
+ * @brief Reports the depth and use of the ephemeral pool. A miss is a
+ * keypair generated on demand because the pool was empty.
+ */
+API void
+otrng_global_state_get_ephemeral_pool_stats(otrng_keypair_pool_stats_s *dst,
+                                            otrng_global_state_s *gs);
+
+/**
+ * @brief Sets how long, in seconds, an incomplete fragmented message waits
+ * for its next fragment before otrng_global_state_tick drops it.
+ */
+API void otrng_global_state_set_fragment_expiration_time(
+    otrng_global_state_s *gs, uint32_t expiration_time);
+
+/**
+ * @brief Does the work that is due at [now], for every client: drops the
+ * fragmented messages that expired, evicts idle clients over the limit of
+ * otrng_global_state_set_max_resident_clients, and syncs the prekey journal.
+ * It only looks at what expired, and at the clients when there are too many,
+ * so it can be called often.
+ *
+ * @return The number of fragmented messages dropped.
+ */
+API size_t otrng_global_state_tick(otrng_global_state_s *gs, time_t now);
+
+/**
+ * @brief Sets how many clients are kept in memory. Once there are more, the
+ * idle clients, which have no conversations and no work with a prekey server,
+ * can be evicted, those got the longest ago first. An evicted client is kept
+ * serialized, and read back when otrng_client_get next asks for it: pointers
+ * to it are no longer valid, and what was set with otrng_client_set_* must be
+ * set again. Zero, the default, keeps every client.
+ */
+API void otrng_global_state_set_max_resident_clients(otrng_global_state_s *gs,
+                                                     size_t max_clients);
+
+/**
+ * @brief Evicts idle clients until no more than the maximum are in memory,
+ * or none of them is idle.
+ *
+ * @return The number of clients evicted.
+ */
+API size_t otrng_global_state_evict_idle_clients(otrng_global_state_s *gs);
+
+/**
+ * @brief Opens a binary store written by otrng_global_state_store_write_to.
+ * Only its index is read: a client is read from it when it is first got, so
+ * startup does not depend on the number of accounts. The state a client
+ * already has wins over the store. It must be opened before any client is
+ * evicted.
+ *
+ * @param [f]   The store. It can be closed afterwards, but the file must not
+ *              change while the global state is using it.
+ */
+API otrng_result otrng_global_state_store_read_from(otrng_global_state_s *gs,
+                                                    FILE *f);
+
+/**
+ * @brief Writes the long-term state of every client, and of the clients of
+ * the open store that were never got or were evicted, to a binary store.
+ * Write to a new file and rename it over the open store, which is still in
+ * use.
+ *
+ * @param [f]   An empty file, which must be seekable.
+ */
+API otrng_result otrng_global_state_store_write_to(
+    const otrng_global_state_s *gs, FILE *f);
+
+/**
+ * @brief Keeps the prekey messages of every client in a journal at [path],
+ * instead of writing all of them again whenever one is stored or deleted:
+ * each change is appended, and the journal is compacted once most of it is
+ * stale. It is read when it is opened, and a client got afterwards gets its
+ * prekey messages from it. The journal has the latest prekey messages of the
+ * clients it knows, and takes those of the other clients. The
+ * store_prekey_messages callback is still called, and can do nothing.
+ *
+ * @param [path]   The journal, which is created if it does not exist. It is
+ *                 compacted into [path].tmp, which is renamed over it.
+ */
+API otrng_result
+otrng_global_state_prekey_journal_open(otrng_global_state_s *gs,
+                                       const char *path);
+
+/**
+ * @brief Sets after how many changes the prekey journal is synced to the
+ * disk. Zero leaves it to otrng_global_state_prekey_journal_sync and
+ * otrng_global_state_tick. The default, one, syncs every change.
+ */
+API void otrng_global_state_set_prekey_journal_sync_batch(
+    otrng_global_state_s *gs, size_t changes);
+
+/**
+ * @brief Syncs the changes to the prekey journal that are not on the disk
+ * yet. If some could not be appended, the journal is written again instead.
+ */
+API otrng_result
+otrng_global_state_prekey_journal_sync(otrng_global_state_s *gs);
+
+/**
+ * @brief Rewrites the prekey journal with only the prekey messages that are
+ * left.
+ */
+API otrng_result
+otrng_global_state_prekey_journal_compact(otrng_global_state_s *gs);
+
+/* The prekey journal of the global state of [client], if it has one */
+INTERNAL otrng_prekey_journal_s *
+otrng_client_prekey_journal(const otrng_client_s *client);
+
+/* The ephemeral pool of the global state of [client], if it has one */
+INTERNAL otrng_keypair_pool_s *
+otrng_client_ephemeral_pool(const otrng_client_s *client);
+
+/* The fragment expiry of the global state of [client], if it has one */
+INTERNAL fragment_expiry_s *
+otrng_client_fragment_expiry(const otrng_client_s *client);
+
 API otrng_result otrng_global_state_instag_generate_into(
     otrng_global_state_s *gs, const otrng_client_id_s client_id, FILE *instag);
 
@@ -160,6 +320,9 @@ tstatic otrng_result otrng_global_state_add_forging_key(
     otrng_global_state_s *gs, const otrng_client_id_s clientop,
     otrng_public_key *fk);
 
+tstatic otrng_client_s *find_client(otrng_global_state_s *gs,
+                                    const otrng_client_id_s *client_id);
+
 tstatic otrng_client_s *get_client(otrng_global_state_s *gs,
                                    const otrng_client_id_s client_id);
 
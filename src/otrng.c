@@ -47,6 +47,7 @@
 #include "serialize.h"
 #include "shake.h"
 #include "smp.h"
+#include "timing.h"
 #include "tlv.h"
 
 #include "debug.h"
@@ -159,15 +160,23 @@ INTERNAL otrng_s *otrng_new(otrng_client_s *client, otrng_policy_s policy) {
   otr->supported_versions = policy.allows;
 
   otr->keys = otrng_key_manager_new();
+  otr->keys->dh_pool = client ? client->dh_pool : NULL;
   otr->smp = otrng_secure_alloc(sizeof(smp_protocol_s));
 
   otrng_smp_protocol_init(otr->smp);
 
+  if (client) {
+    otr->pending_fragments = otrng_fragment_reassembly_new(
+        client->max_fragment_contexts, client->max_fragment_bytes);
+  } else {
+    otr->pending_fragments = otrng_fragment_reassembly_new(
+        OTRNG_FRAGMENT_DEFAULT_MAX_CONTEXTS, OTRNG_FRAGMENT_DEFAULT_MAX_BYTES);
+  }
+  otrng_fragment_ids_init(&otr->fragment_ids);
+
   return otr;
 }
 
-static void free_fragment_context(void *p) { otrng_fragment_context_free(p); }
-
 tstatic void otrng_destroy(/*@only@ */ otrng_s *otr) {
   otrng_free(otr->peer);
 
@@ -184,7 +193,7 @@ tstatic void otrng_destroy(/*@only@ */ otrng_s *otr) {
   otrng_secure_free(otr->smp);
   otr->smp = NULL;
 
-  otrng_list_free(otr->pending_fragments, free_fragment_context);
+  otrng_fragment_reassembly_free(otr->pending_fragments);
   otr->pending_fragments = NULL;
 
   otrng_v3_conn_free(otr->v3_conn);
@@ -399,10 +408,16 @@ INTERNAL void otrng_response_free(otrng_response_s *response) {
     return;
   }
 
-  otrng_free(response->to_display);
-  otrng_free(response->to_send);
+  if (response->decoded) {
+    otrng_tlv_list_free_views(response->tlvs);
+    otrng_secure_wipe(response->decoded, response->decoded_len);
+    otrng_free(response->decoded);
+  } else {
+    otrng_free(response->to_display);
+    otrng_tlv_list_free(response->tlvs);
+  }
 
-  otrng_tlv_list_free(response->tlvs);
+  otrng_free(response->to_send);
 
   otrng_free(response);
 }
@@ -454,8 +469,26 @@ tstatic otrng_result reply_with_identity_message(otrng_response_s *response,
   return result;
 }
 
+/* The first ephemeral keys of a DAKE come from the ephemeral pool */
+static otrng_result generate_dake_ephemeral_keys(otrng_s *otr) {
+  key_manager_s *keys = otr->keys;
+
+  otrng_ecdh_keypair_destroy(keys->our_ecdh);
+  otrng_dh_keypair_destroy(keys->our_dh);
+
+  /* @secret the keypairs will last until the ratchet is initialized */
+  if (!otrng_ephemeral_pool_take(keys->our_ecdh, keys->our_dh,
+                                 otrng_client_ephemeral_pool(otr->client))) {
+    return OTRNG_ERROR;
+  }
+
+  keys->last_generated = time(NULL);
+
+  return OTRNG_SUCCESS;
+}
+
 tstatic otrng_result start_dake(otrng_response_s *response, otrng_s *otr) {
-  if (otrng_key_manager_generate_ephemeral_keys(otr->keys) == OTRNG_ERROR) {
+  if (generate_dake_ephemeral_keys(otr) == OTRNG_ERROR) {
     return OTRNG_ERROR;
   }
 
@@ -962,7 +995,8 @@ INTERNAL prekey_ensemble_s *otrng_build_prekey_ensemble(otrng_s *otr) {
   otrng_prekey_profile_copy(ensemble->prekey_profile,
                             get_my_prekey_profile(otr));
 
-  if (!otrng_generate_ephemeral_keys(&ecdh, &dh)) {
+  if (!otrng_ephemeral_pool_take(&ecdh, &dh,
+                                 otrng_client_ephemeral_pool(otr->client))) {
     otrng_prekey_ensemble_free(ensemble);
     return NULL;
   }
@@ -1063,7 +1097,7 @@ tstatic otrng_result prekey_message_received(const prekey_message_s *msg,
   otrng_key_manager_set_their_ecdh(msg->Y, otr->keys);
   otrng_key_manager_set_their_dh(msg->B, otr->keys);
 
-  if (!otrng_key_manager_generate_ephemeral_keys(otr->keys)) {
+  if (!generate_dake_ephemeral_keys(otr)) {
     return OTRNG_ERROR;
   }
 
@@ -1433,7 +1467,7 @@ tstatic otrng_result receive_identity_message_on_state_start(
 
   /* @secret the priv parts will be deleted once the mixed shared secret is
    * derived */
-  if (!otrng_key_manager_generate_ephemeral_keys(otr->keys)) {
+  if (!generate_dake_ephemeral_keys(otr)) {
     return OTRNG_ERROR;
   }
 
@@ -1453,8 +1487,11 @@ tstatic otrng_result receive_identity_message_on_state_start(
 }
 
 tstatic void forget_our_keys(otrng_s *otr) {
+  otrng_keypair_pool_s *dh_pool = otr->keys->dh_pool;
+
   otrng_key_manager_destroy(otr->keys);
   otrng_key_manager_init(otr->keys);
+  otr->keys->dh_pool = dh_pool;
 }
 
 tstatic otrng_result receive_identity_message_on_waiting_auth_r(
@@ -1467,7 +1504,7 @@ tstatic otrng_result receive_identity_message_on_waiting_auth_r(
     return OTRNG_SUCCESS;
   }
 
-  // Every time we call 'otrng_key_manager_generate_ephemeral_keys'
+  // Every time we call 'generate_dake_ephemeral_keys'
   // keys get deleted and replaced
   // forget_our_keys(otr);
   return receive_identity_message_on_state_start(dst, msg, otr);
@@ -1475,7 +1512,7 @@ tstatic otrng_result receive_identity_message_on_waiting_auth_r(
 
 tstatic otrng_result receive_identity_message_on_waiting_auth_i(
     string_p *dst, dake_identity_message_s *msg, otrng_s *otr) {
-  // Every time we call 'otrng_key_manager_generate_ephemeral_keys'
+  // Every time we call 'generate_dake_ephemeral_keys'
   // keys get deleted and replaced
   // forget_our_keys(otr);
   otrng_client_profile_free(otr->their_client_profile);
@@ -1782,14 +1819,13 @@ tstatic otrng_result receive_auth_i(char **dst, const uint8_t *buffer,
 
 // TODO: @refactoring this is the same as otrng_close
 INTERNAL otrng_result otrng_expire_session(string_p *to_send, otrng_s *otr) {
-  size_t ser_len = otrng_list_len(otr->keys->skipped_keys) * MAC_KEY_BYTES;
+  size_t ser_len =
+      otrng_skipped_keys_table_len(otr->keys->skipped_keys) * MAC_KEY_BYTES;
   uint8_t *ser_mac_keys = otrng_reveal_mac_keys_on_tlv(otr->keys);
   tlv_list_s *disconnected;
   otrng_warning warn;
   otrng_result result;
 
-  otr->keys->skipped_keys = NULL;
-
   disconnected = otrng_tlv_list_one(
       otrng_tlv_new(OTRNG_TLV_DISCONNECTED, ser_len, ser_mac_keys));
   otrng_secure_free(ser_mac_keys);
@@ -1810,7 +1846,7 @@ INTERNAL otrng_result otrng_expire_session(string_p *to_send, otrng_s *otr) {
   return result;
 }
 
-tstatic tlv_list_s *deserialize_received_tlvs(const uint8_t *src, size_t len) {
+tstatic tlv_list_s *deserialize_received_tlvs(uint8_t *src, size_t len) {
   uint8_t *tlvs_start = NULL;
   size_t tlvs_len;
 
@@ -1820,14 +1856,20 @@ tstatic tlv_list_s *deserialize_received_tlvs(const uint8_t *src, size_t len) {
   }
 
   tlvs_len = len - (tlvs_start + 1 - src);
-  return otrng_parse_tlvs(tlvs_start + 1, tlvs_len);
+  return otrng_parse_tlv_views(tlvs_start + 1, tlvs_len);
 }
 
+/*
+ * Decrypts [enc_msg], which lies inside the decoded message [buffer], in
+ * place. On success, the response takes [buffer] over: [to_display] and the
+ * TLVs point into it.
+ */
 tstatic otrng_result decrypt_data_message(otrng_response_s *response,
                                           const k_msg_enc enc_key,
-                                          const data_message_s *msg) {
-  string_p *dst = &response->to_display;
-  uint8_t *plain;
+                                          const data_message_s *msg,
+                                          uint8_t *enc_msg, uint8_t *buffer,
+                                          size_t buff_len) {
+  uint8_t *plain = enc_msg;
   int err;
 
 #ifdef DEBUG
@@ -1839,24 +1881,29 @@ tstatic otrng_result decrypt_data_message(otrng_response_s *response,
   otrng_memdump(msg->nonce, DATA_MSG_NONCE_BYTES);
 #endif
 
-  // TODO: @initialization What if message->enc_msg_len == 0?
-  plain = otrng_secure_alloc(msg->enc_msg_len);
-
-  err = crypto_stream_xor(plain, msg->enc_msg, msg->enc_msg_len, msg->nonce,
+  err = crypto_stream_xor(plain, enc_msg, msg->enc_msg_len, msg->nonce,
                           enc_key);
 
   if (err) {
-    otrng_secure_free(plain);
+    otrng_secure_wipe(plain, msg->enc_msg_len);
     return OTRNG_ERROR;
   }
 
+  response->decoded = buffer;
+  response->decoded_len = buff_len;
+
+  /* The MAC follows the ciphertext and has already been verified, so its first
+     byte can terminate a message that carries no TLVs */
+  if (!memchr(plain, 0, msg->enc_msg_len)) {
+    plain[msg->enc_msg_len] = 0;
+  }
+
   /* If plain != "" and msg->enc_msg_len != 0 */
-  if (otrng_strnlen((string_p)plain, msg->enc_msg_len)) {
-    *dst = otrng_xstrndup((char *)plain, msg->enc_msg_len);
+  if (msg->enc_msg_len > 0 && plain[0] != 0) {
+    response->to_display = (char *)plain;
   }
 
   response->tlvs = deserialize_received_tlvs(plain, msg->enc_msg_len);
-  otrng_secure_free(plain);
   return OTRNG_SUCCESS;
 }
 
@@ -1933,13 +1980,76 @@ tstatic otrng_result receive_tlvs(otrng_response_s *response, otrng_s *otr) {
   return ret;
 }
 
+/*
+ * The receiving ratchet used for data messages. A single message gets its own
+ * ratchet, committed to the key manager as soon as the message is accepted.
+ * During otrng_receive_messages the ratchet is kept across messages and only
+ * committed when something else is about to read the key manager.
+ */
+typedef struct receive_batch_s {
+  receiving_ratchet_s *ratchet;
+  /* The state before the current message, when receiving a batch */
+  receiving_ratchet_state_s *saved;
+  /* Whether the ratchet holds accepted messages not in the key manager */
+  otrng_bool uncommitted;
+} receive_batch_s;
+
+static void commit_receiving_ratchet(receive_batch_s *batch, otrng_s *otr) {
+  if (!batch->ratchet || !batch->uncommitted) {
+    return;
+  }
+
+  otrng_receiving_ratchet_copy(otr->keys, batch->ratchet);
+  batch->uncommitted = otrng_false;
+
+  /* Bound the stored keys across ratchets, dropping the oldest
+     generations first */
+  otrng_skipped_keys_table_evict(otr->keys->skipped_keys,
+                                 otr->client->max_stored_msg_keys);
+}
+
+static void release_receiving_ratchet(receive_batch_s *batch, otrng_s *otr) {
+  if (!batch || !batch->ratchet) {
+    return;
+  }
+
+  commit_receiving_ratchet(batch, otr);
+  otrng_receiving_ratchet_destroy(batch->ratchet);
+  batch->ratchet = NULL;
+}
+
+/* Undoes a message that was not accepted */
+static void reject_receiving_ratchet(receive_batch_s *batch) {
+  if (batch->saved) {
+    otrng_receiving_ratchet_restore(batch->ratchet, batch->saved);
+    return;
+  }
+
+  otrng_receiving_ratchet_destroy(batch->ratchet);
+  batch->ratchet = NULL;
+}
+
+static otrng_bool has_tlvs_to_process(const tlv_list_s *tlvs) {
+  const tlv_list_s *current;
+
+  for (current = tlvs; current; current = current->next) {
+    if (current->data->type != OTRNG_TLV_NONE &&
+        current->data->type != OTRNG_TLV_PADDING) {
+      return otrng_true;
+    }
+  }
+
+  return otrng_false;
+}
+
 tstatic otrng_result otrng_receive_data_message_after_dake(
-    otrng_response_s *response, otrng_warning *warn, const uint8_t *buffer,
-    size_t buff_len, otrng_s *otr) {
+    otrng_response_s *response, otrng_warning *warn, uint8_t *buffer,
+    size_t buff_len, receive_batch_s *batch, otrng_s *otr) {
   data_message_s *msg = otrng_data_message_new();
   k_msg_enc enc_key;
   k_msg_mac mac_key;
-  size_t read = 0;
+  uint8_t *enc_msg = NULL;
+  size_t body_len = 0;
   receiving_ratchet_s *tmp_receiving_ratchet;
 
   memset(enc_key, 0, ENC_KEY_BYTES);
@@ -1947,8 +2057,8 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
 
   response->to_display = NULL;
 
-  if (otrng_failed(
-          otrng_data_message_deserialize(msg, buffer, buff_len, &read))) {
+  if (otrng_failed(otrng_data_message_deserialize_view(
+          msg, &enc_msg, &body_len, buffer, buff_len))) {
     otrng_error_message(&response->to_send, OTRNG_ERR_MSG_MALFORMED);
     otrng_data_message_free(msg);
     return OTRNG_ERROR;
@@ -1966,16 +2076,34 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
   if (otrng_failed(
           received_sender_instance_tag(msg->sender_instance_tag, otr))) {
     otrng_error_message(&response->to_send, OTRNG_ERR_MSG_MALFORMED);
+    otrng_data_message_free(msg);
     return OTRNG_ERROR;
   }
 
   if (!valid_receiver_instance_tag(msg->receiver_instance_tag)) {
     otrng_error_message(&response->to_send, OTRNG_ERR_MSG_MALFORMED);
+    otrng_data_message_free(msg);
     return OTRNG_ERROR;
   }
 
+  if (batch->saved) {
+    /* Entering a new ratchet reads the key manager */
+    if (msg->message_id == 0) {
+      commit_receiving_ratchet(batch, otr);
+    }
+  }
+
   // TODO: we still need to persist our_dh->priv
-  tmp_receiving_ratchet = otrng_receiving_ratchet_new(otr->keys);
+  if (!batch->ratchet) {
+    batch->ratchet = otrng_receiving_ratchet_new(otr->keys);
+  }
+  tmp_receiving_ratchet = batch->ratchet;
+
+  if (batch->saved) {
+    otrng_receiving_ratchet_save(batch->saved, tmp_receiving_ratchet);
+    /* As in a ratchet made for this message only */
+    memset(tmp_receiving_ratchet->brace_key, 0, BRACE_KEY_BYTES);
+  }
 
   otrng_key_manager_set_their_tmp_keys(msg->ecdh, msg->dh,
                                        tmp_receiving_ratchet);
@@ -1990,28 +2118,27 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
               otr->keys, otr->client->max_stored_msg_keys,
               tmp_receiving_ratchet, msg->message_id, msg->previous_chain_n,
               'r', warn))) {
-        otrng_receiving_ratchet_destroy(tmp_receiving_ratchet);
-
+        reject_receiving_ratchet(batch);
+        otrng_data_message_free(msg);
         return OTRNG_ERROR;
       }
 
       if (otrng_failed(otrng_key_manager_derive_chain_keys(
               enc_key, mac_key, otr->keys, tmp_receiving_ratchet,
               otr->client->max_stored_msg_keys, msg->message_id, 'r', warn))) {
+        reject_receiving_ratchet(batch);
+        otrng_data_message_free(msg);
         return OTRNG_ERROR;
       }
 
       tmp_receiving_ratchet->k = tmp_receiving_ratchet->k + 1;
     }
-    if (!otrng_valid_data_message(mac_key, msg)) {
+    if (!otrng_valid_data_message_body(mac_key, msg, buffer, body_len)) {
       otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
       otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
       otrng_data_message_free(msg);
 
-      if (tmp_receiving_ratchet->skipped_keys) {
-        otrng_list_free(tmp_receiving_ratchet->skipped_keys, otrng_secure_free);
-      }
-      otrng_receiving_ratchet_destroy(tmp_receiving_ratchet);
+      reject_receiving_ratchet(batch);
 
       response->warning = OTRNG_WARN_RECEIVED_NOT_VALID;
       if (warn) {
@@ -2021,18 +2148,15 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
       return OTRNG_ERROR;
     }
 
-    if (otrng_failed(decrypt_data_message(response, enc_key, msg))) {
+    if (otrng_failed(decrypt_data_message(response, enc_key, msg, enc_msg,
+                                          buffer, buff_len))) {
 
       if (msg->flags != MSG_FLAGS_IGNORE_UNREADABLE) {
         otrng_error_message(&response->to_send, OTRNG_ERR_MSG_UNREADABLE);
         otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
         otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
 
-        if (tmp_receiving_ratchet->skipped_keys) {
-          otrng_list_free(tmp_receiving_ratchet->skipped_keys,
-                          otrng_secure_free);
-        }
-        otrng_receiving_ratchet_destroy(tmp_receiving_ratchet);
+        reject_receiving_ratchet(batch);
 
         otrng_data_message_free(msg);
 
@@ -2041,11 +2165,7 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
       if (msg->flags == MSG_FLAGS_IGNORE_UNREADABLE) {
         otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
         otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
-        if (tmp_receiving_ratchet->skipped_keys) {
-          otrng_list_free(tmp_receiving_ratchet->skipped_keys,
-                          otrng_secure_free);
-        }
-        otrng_receiving_ratchet_destroy(tmp_receiving_ratchet);
+        reject_receiving_ratchet(batch);
         otrng_data_message_free(msg);
 
         return OTRNG_ERROR;
@@ -2054,8 +2174,16 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
 
     otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
 
-    otrng_receiving_ratchet_copy(otr->keys, tmp_receiving_ratchet);
-    otrng_receiving_ratchet_destroy(tmp_receiving_ratchet);
+    otrng_receiving_ratchet_accept(tmp_receiving_ratchet);
+    batch->uncommitted = otrng_true;
+
+    /* Processing TLVs may read or reset the key manager */
+    if (!batch->saved || has_tlvs_to_process(response->tlvs)) {
+      release_receiving_ratchet(batch, otr);
+    } else {
+      otrng_skipped_keys_table_evict(otr->keys->skipped_keys,
+                                     otr->client->max_stored_msg_keys);
+    }
 
     if (otrng_failed(receive_tlvs(response, otr))) {
       continue;
@@ -2073,6 +2201,8 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
     }
 
     if (otr->client->should_heartbeat(otr->last_sent)) {
+      release_receiving_ratchet(batch, otr);
+
       if (!otrng_send_message(&response->to_send, "", warn, NULL,
                               MSG_FLAGS_IGNORE_UNREADABLE, otr)) {
         otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
@@ -2094,13 +2224,19 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
   return OTRNG_ERROR;
 }
 
-tstatic otrng_result otrng_receive_data_message(otrng_response_s *response,
-                                                otrng_warning *warn,
-                                                const uint8_t *buffer,
-                                                size_t buff_len, otrng_s *otr) {
+static otrng_result receive_data_message(otrng_response_s *response,
+                                         otrng_warning *warn, uint8_t *buffer,
+                                         size_t buff_len, otrng_s *otr) {
+  receive_batch_s single = {NULL, NULL, otrng_false};
+  receive_batch_s *batch = otr->receive_batch ? otr->receive_batch : &single;
+  otrng_result ret;
+
   if (otr->state == OTRNG_STATE_WAITING_DAKE_DATA_MESSAGE) {
-    if (otrng_receive_data_message_after_dake(response, warn, buffer, buff_len,
-                                              otr)) {
+    ret = otrng_receive_data_message_after_dake(response, warn, buffer,
+                                                buff_len, batch, otr);
+    release_receiving_ratchet(&single, otr);
+
+    if (ret) {
       otr->state = OTRNG_STATE_ENCRYPTED_MESSAGES;
       return OTRNG_SUCCESS;
     }
@@ -2113,10 +2249,32 @@ tstatic otrng_result otrng_receive_data_message(otrng_response_s *response,
     return OTRNG_ERROR;
   }
 
-  return otrng_receive_data_message_after_dake(response, warn, buffer, buff_len,
-                                               otr);
+  ret = otrng_receive_data_message_after_dake(response, warn, buffer, buff_len,
+                                              batch, otr);
+  release_receiving_ratchet(&single, otr);
+
+  return ret;
 }
 
+tstatic otrng_result otrng_receive_data_message(otrng_response_s *response,
+                                                otrng_warning *warn,
+                                                uint8_t *buffer,
+                                                size_t buff_len, otrng_s *otr) {
+  uint64_t started = otrng_monotonic_us();
+  otrng_result ret =
+      receive_data_message(response, warn, buffer, buff_len, otr);
+
+  otrng_client_record_receive_latency(otr->client,
+                                      otrng_monotonic_us() - started);
+
+  return ret;
+}
+
+/* version, type and both instance tags */
+#define OTRNG_HEADER_BYTES 11
+/* enough base64 to decode OTRNG_HEADER_BYTES */
+#define OTRNG_HEADER_BASE64_LEN 16
+
 static otrng_result extract_header(otrng_header_s *dst, const uint8_t *buffer,
                                    const size_t buff_len) {
   size_t read = 0;
@@ -2139,13 +2297,71 @@ static otrng_result extract_header(otrng_header_s *dst, const uint8_t *buffer,
     return OTRNG_ERROR;
   }
 
+  /* Every encoded message has the instance tags right after the type */
+  dst->sender_instance_tag = 0;
+  dst->receiver_instance_tag = 0;
+  if (buff_len >= OTRNG_HEADER_BYTES) {
+    buffer += read;
+    (void)otrng_deserialize_uint32(&dst->sender_instance_tag, buffer, 4, &read);
+    buffer += read;
+    (void)otrng_deserialize_uint32(&dst->receiver_instance_tag, buffer, 4,
+                                   &read);
+  }
+
   return OTRNG_SUCCESS;
 }
 
+INTERNAL otrng_result otrng_peek_header(otrng_header_s *dst,
+                                        const string_p msg) {
+  uint8_t buffer[OTRNG_HEADER_BASE64_LEN / 4 * 3];
+  otrng_fragment_header_s fragment;
+  const char *encoded;
+  size_t encoded_len;
+
+  memset(dst, 0, sizeof(otrng_header_s));
+
+  if (strncmp(msg, "?OTR|", 5) == 0) {
+    /* Only a v4 fragment has an identifier before the instance tags */
+    if (otrng_failed(otrng_fragment_parse(&fragment, msg))) {
+      return OTRNG_ERROR;
+    }
+
+    dst->version = OTRNG_PROTOCOL_VERSION_4;
+    dst->sender_instance_tag = fragment.sender_instance_tag;
+    dst->receiver_instance_tag = fragment.receiver_instance_tag;
+
+    encoded = fragment.piece;
+    encoded_len = fragment.piece_len;
+    if (fragment.index != 1 || encoded_len < strlen(otr_header) ||
+        strncmp(encoded, otr_header, strlen(otr_header)) != 0) {
+      return OTRNG_SUCCESS;
+    }
+  } else {
+    encoded = strstr(msg, otr_header);
+    if (!encoded) {
+      return OTRNG_ERROR;
+    }
+    encoded_len = strlen(encoded);
+  }
+
+  encoded += strlen(otr_header);
+  encoded_len -= strlen(otr_header);
+  if (encoded_len < OTRNG_HEADER_BASE64_LEN) {
+    return dst->version ? OTRNG_SUCCESS : OTRNG_ERROR;
+  }
+
+  if (otrl_base64_decode(buffer, encoded, OTRNG_HEADER_BASE64_LEN) <
+      OTRNG_HEADER_BYTES) {
+    return OTRNG_ERROR;
+  }
+
+  return extract_header(dst, buffer, sizeof(buffer));
+}
+
 tstatic otrng_result receive_decoded_message(otrng_response_s *response,
                                              otrng_warning *warn,
-                                             const uint8_t *decoded,
-                                             size_t dec_len, otrng_s *otr) {
+                                             uint8_t *decoded, size_t dec_len,
+                                             otrng_s *otr) {
   otrng_header_s header;
   int v3_allowed, v4_allowed;
 
@@ -2165,6 +2381,11 @@ tstatic otrng_result receive_decoded_message(otrng_response_s *response,
 
   response->to_send = NULL;
 
+  /* Only data messages go through the receiving ratchet of a batch */
+  if (header.type != DATA_MSG_TYPE) {
+    release_receiving_ratchet(otr->receive_batch, otr);
+  }
+
   switch (header.type) {
   case IDENTITY_MSG_TYPE:
     otr->running_version = OTRNG_PROTOCOL_VERSION_4;
@@ -2197,7 +2418,11 @@ tstatic otrng_result receive_encoded_message(otrng_response_s *response,
   }
 
   result = receive_decoded_message(response, warn, decoded, dec_len, otr);
-  otrng_free(decoded);
+
+  /* A data message is decrypted in place and kept by the response */
+  if (response->decoded != decoded) {
+    otrng_free(decoded);
+  }
 
   return result;
 }
@@ -2277,6 +2502,11 @@ static otrng_result receive_defragmented_message(otrng_response_s *response,
 
   response->to_display = NULL;
 
+  /* Only data messages go through the receiving ratchet of a batch */
+  if (get_message_type(msg) != MSG_OTR_ENCODED) {
+    release_receiving_ratchet(otr->receive_batch, otr);
+  }
+
   /* A DH-Commit sets our running version to 3 */
   if (allow_version(otr, OTRNG_ALLOW_V3) &&
       (strstr(msg, "?OTR:AAMC") != NULL)) {
@@ -2304,8 +2534,11 @@ INTERNAL otrng_result otrng_receive_message(otrng_response_s *response,
   response->warning = OTRNG_WARN_NONE;
   response->to_display = NULL;
 
-  if (otrng_failed(otrng_unfragment_message(&defrag, &otr->pending_fragments,
-                                            msg, our_instance_tag(otr)))) {
+  ret = otrng_unfragment_message(&defrag, otr->pending_fragments, msg,
+                                 our_instance_tag(otr));
+  otrng_fragment_expiry_schedule(otrng_client_fragment_expiry(otr->client),
+                                 otr->pending_fragments);
+  if (otrng_failed(ret)) {
     return OTRNG_ERROR;
   }
 
@@ -2314,6 +2547,39 @@ INTERNAL otrng_result otrng_receive_message(otrng_response_s *response,
   return ret;
 }
 
+INTERNAL otrng_result otrng_receive_messages(otrng_response_s **responses,
+                                             otrng_result *results,
+                                             const string_p *msgs,
+                                             size_t count, otrng_s *otr) {
+  receive_batch_s batch;
+  otrng_result ret = OTRNG_SUCCESS;
+  size_t n;
+
+  batch.ratchet = NULL;
+  batch.saved = otrng_secure_alloc(sizeof(receiving_ratchet_state_s));
+  batch.uncommitted = otrng_false;
+
+  otr->receive_batch = &batch;
+
+  for (n = 0; n < count; n++) {
+    otrng_warning warn = OTRNG_WARN_NONE;
+
+    results[n] = otrng_receive_message(responses[n], &warn, msgs[n], otr);
+    if (warn != OTRNG_WARN_NONE) {
+      responses[n]->warning = warn;
+    }
+    if (otrng_failed(results[n])) {
+      ret = OTRNG_ERROR;
+    }
+  }
+
+  otr->receive_batch = NULL;
+  release_receiving_ratchet(&batch, otr);
+  otrng_secure_free(batch.saved);
+
+  return ret;
+}
+
 INTERNAL otrng_result otrng_send_message(string_p *to_send, const string_p msg,
                                          otrng_warning *warn,
                                          const tlv_list_s *tlvs, uint8_t flags,
@@ -2333,6 +2599,36 @@ INTERNAL otrng_result otrng_send_message(string_p *to_send, const string_p msg,
   }
 }
 
+INTERNAL otrng_result otrng_send_messages(string_p *to_send,
+                                          const string_p *msgs, size_t count,
+                                          otrng_warning *warn, uint8_t flags,
+                                          otrng_s *otr) {
+  size_t n;
+
+  if (!otr) {
+    return OTRNG_ERROR;
+  }
+
+  switch (otr->running_version) {
+  case OTRNG_PROTOCOL_VERSION_3:
+    for (n = 0; n < count; n++) {
+      to_send[n] = NULL;
+    }
+    for (n = 0; n < count; n++) {
+      if (otrng_failed(otrng_v3_send_message(&to_send[n], msgs[n], NULL,
+                                             otr->v3_conn))) {
+        return OTRNG_ERROR;
+      }
+    }
+    return OTRNG_SUCCESS;
+  case OTRNG_PROTOCOL_VERSION_4:
+    return otrng_prepare_to_send_data_messages(to_send, msgs, count, warn, otr,
+                                               flags);
+  default:
+    return OTRNG_ERROR;
+  }
+}
+
 tstatic otrng_result otrng_close_v4(string_p *to_send, otrng_s *otr) {
   size_t ser_len;
   uint8_t *ser_mac_keys;
@@ -2344,9 +2640,9 @@ tstatic otrng_result otrng_close_v4(string_p *to_send, otrng_s *otr) {
     return OTRNG_SUCCESS;
   }
 
-  ser_len = otrng_list_len(otr->keys->skipped_keys) * MAC_KEY_BYTES;
+  ser_len =
+      otrng_skipped_keys_table_len(otr->keys->skipped_keys) * MAC_KEY_BYTES;
   ser_mac_keys = otrng_reveal_mac_keys_on_tlv(otr->keys);
-  otr->keys->skipped_keys = NULL;
 
   disconnected = otrng_tlv_list_one(
       otrng_tlv_new(OTRNG_TLV_DISCONNECTED, ser_len, ser_mac_keys));
@@ -2528,5 +2824,9 @@ API otrng_result otrng_init(otrng_bool die) {
 
   otrng_debug_init();
 
+  if (!shake_256_cache_midstates()) {
+    return OTRNG_ERROR;
+  }
+
   return otrng_dh_init(die);
 }
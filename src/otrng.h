@@ -53,11 +53,17 @@ typedef struct otrng_response_s {
   string_p to_send;
   tlv_list_s *tlvs;
   otrng_warning warning;
+  /* A received data message is decrypted where it was decoded: when this is
+     set, [to_display] and the data of [tlvs] point into it. */
+  uint8_t *decoded;
+  size_t decoded_len;
 } otrng_response_s;
 
 typedef struct otrng_header_s {
   uint16_t version;
   uint8_t type;
+  uint32_t sender_instance_tag;
+  uint32_t receiver_instance_tag;
 } otrng_header_s;
 
 INTERNAL otrng_s *otrng_new(struct otrng_client_s *client,
@@ -73,15 +79,39 @@ INTERNAL otrng_response_s *otrng_response_new(void);
 
 INTERNAL void otrng_response_free(otrng_response_s *response);
 
+/* Reads the header of an encoded v3/v4 message, or the instance tags of a v4
+   fragment, without decoding the whole message. The type of a fragment is
+   only known from its first piece, and is 0 otherwise. */
+INTERNAL otrng_result otrng_peek_header(otrng_header_s *dst,
+                                        const string_p msg);
+
 INTERNAL otrng_result otrng_receive_message(otrng_response_s *response,
                                             otrng_warning *warn,
                                             const string_p msg, otrng_s *otr);
 
+/* Receives [count] messages of the same conversation, in order, into
+   [responses]. Data messages share one receiving ratchet, which is committed
+   to the key manager once rather than after every message; a message that
+   fails only undoes its own changes. [results] gets the result of each
+   message and the warning of each ends up in its response. */
+INTERNAL otrng_result otrng_receive_messages(otrng_response_s **responses,
+                                             otrng_result *results,
+                                             const string_p *msgs,
+                                             size_t count, otrng_s *otr);
+
 INTERNAL otrng_result otrng_send_message(string_p *to_send, const string_p msg,
                                          otrng_warning *warn,
                                          const tlv_list_s *tlvs, uint8_t flags,
                                          otrng_s *otr);
 
+/* Sends [count] messages in one pass. See
+   otrng_prepare_to_send_data_messages for what is left in [to_send] on
+   failure. */
+INTERNAL otrng_result otrng_send_messages(string_p *to_send,
+                                          const string_p *msgs, size_t count,
+                                          otrng_warning *warn, uint8_t flags,
+                                          otrng_s *otr);
+
 INTERNAL otrng_result otrng_close(string_p *to_send, otrng_s *otr);
 
 INTERNAL otrng_result otrng_expire_session(string_p *to_send, otrng_s *otr);
@@ -28,7 +28,18 @@
 #include "otrng.h"
 #include "shared.h"
 
-INTERNAL otrng_result generate_padding(uint8_t **dst, size_t *dst_len,
-                                       size_t msg_len, const otrng_s *otr);
+/**
+ * @brief The length of the padding TLV (including its 4-byte header) to
+ *        append to a plaintext of [msg_len] bytes, or 0 if none is needed.
+ */
+INTERNAL size_t otrng_padding_tlv_len(size_t msg_len, const otrng_s *otr);
+
+/**
+ * @brief Write a padding TLV of [tlv_len] bytes (as returned by
+ *        otrng_padding_tlv_len) to [dst].
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_padding_tlv_serialize(uint8_t *dst, size_t tlv_len);
 
 #endif
@@ -0,0 +1,718 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fileno and fsync are POSIX */
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OTRNG_PREKEY_JOURNAL_PRIVATE
+
+#include "alloc.h"
+#include "deserialize.h"
+#include "prekey_journal.h"
+#include "serialize.h"
+
+tstatic void prekey_journal_drop_pending(otrng_prekey_journal_prekey_s *prekey) {
+  if (!prekey->pending) {
+    return;
+  }
+
+  otrng_secure_wipe(prekey->pending, prekey->len);
+  otrng_free(prekey->pending);
+  prekey->pending = NULL;
+}
+
+tstatic void prekey_journal_client_free(void *data) {
+  otrng_prekey_journal_client_s *client = data;
+  size_t n;
+
+  for (n = 0; n < client->num_prekeys; n++) {
+    prekey_journal_drop_pending(&client->prekeys[n]);
+  }
+  otrng_free(client->prekeys);
+  otrng_free((char *)client->client_id.protocol);
+  otrng_free((char *)client->client_id.account);
+  otrng_free(client);
+}
+
+tstatic int find_client_by_client_id(const void *current, const void *wanted) {
+  const otrng_prekey_journal_client_s *client = current;
+  const otrng_client_id_s *cid = wanted;
+  return strcmp(client->client_id.protocol, cid->protocol) == 0 &&
+         strcmp(client->client_id.account, cid->account) == 0;
+}
+
+tstatic otrng_prekey_journal_client_s *
+prekey_journal_find_client(const otrng_prekey_journal_s *journal,
+                           const otrng_client_id_s *client_id) {
+  uint64_t hash = otrng_hash_index_hash(journal->index, client_id->protocol,
+                                        client_id->account);
+  return otrng_hash_index_get(journal->index, hash, client_id,
+                              find_client_by_client_id);
+}
+
+tstatic otrng_prekey_journal_client_s *
+prekey_journal_get_client(otrng_prekey_journal_s *journal,
+                          const otrng_client_id_s *client_id) {
+  otrng_prekey_journal_client_s *client =
+      prekey_journal_find_client(journal, client_id);
+
+  if (client) {
+    return client;
+  }
+
+  client = otrng_xmalloc_z(sizeof(otrng_prekey_journal_client_s));
+  client->client_id.protocol = otrng_xstrdup(client_id->protocol);
+  client->client_id.account = otrng_xstrdup(client_id->account);
+  journal->clients = otrng_list_add(client, journal->clients);
+  otrng_hash_index_add(journal->index,
+                       otrng_hash_index_hash(journal->index,
+                                             client->client_id.protocol,
+                                             client->client_id.account),
+                       client);
+
+  return client;
+}
+
+tstatic otrng_prekey_journal_prekey_s *
+prekey_journal_find_prekey(const otrng_prekey_journal_client_s *client,
+                           uint32_t id) {
+  size_t n;
+
+  for (n = 0; n < client->num_prekeys; n++) {
+    if (client->prekeys[n].id == id) {
+      return &client->prekeys[n];
+    }
+  }
+
+  return NULL;
+}
+
+/* Records that the prekey message [id] is at [offset] in the file, or keeps
+   [pending] if its record could not be appended */
+tstatic void prekey_journal_apply_add(otrng_prekey_journal_s *journal,
+                                      otrng_prekey_journal_client_s *client,
+                                      uint32_t id, uint32_t len,
+                                      uint64_t offset,
+                                      const uint8_t *pending) {
+  otrng_prekey_journal_prekey_s *prekey =
+      prekey_journal_find_prekey(client, id);
+
+  if (prekey) {
+    prekey_journal_drop_pending(prekey);
+  } else {
+    if (client->num_prekeys == client->prekeys_cap) {
+      client->prekeys_cap = client->prekeys_cap ? 2 * client->prekeys_cap : 8;
+      client->prekeys = otrng_xrealloc(
+          client->prekeys,
+          client->prekeys_cap * sizeof(otrng_prekey_journal_prekey_s));
+    }
+    prekey = &client->prekeys[client->num_prekeys++];
+    prekey->id = id;
+    prekey->pending = NULL;
+    journal->live++;
+  }
+
+  prekey->len = len;
+  prekey->offset = offset;
+  if (pending) {
+    prekey->pending = otrng_xmalloc(len);
+    memcpy(prekey->pending, pending, len);
+  }
+}
+
+tstatic void prekey_journal_apply_delete(otrng_prekey_journal_s *journal,
+                                         otrng_prekey_journal_client_s *client,
+                                         uint32_t id) {
+  otrng_prekey_journal_prekey_s *prekey =
+      prekey_journal_find_prekey(client, id);
+  size_t n;
+
+  if (!prekey) {
+    return;
+  }
+
+  prekey_journal_drop_pending(prekey);
+  n = prekey - client->prekeys;
+  memmove(prekey, prekey + 1,
+          (client->num_prekeys - n - 1) *
+              sizeof(otrng_prekey_journal_prekey_s));
+  client->num_prekeys--;
+  journal->live--;
+}
+
+tstatic size_t prekey_journal_string_bytes(const char *str) {
+  return 4 + strlen(str) + 1;
+}
+
+tstatic size_t prekey_journal_serialize_string(uint8_t *dst, const char *str) {
+  size_t len = strlen(str) + 1;
+
+  otrng_serialize_uint32(dst, len);
+  memcpy(dst + 4, str, len);
+
+  return 4 + len;
+}
+
+/* What comes before the data of a record */
+tstatic size_t
+prekey_journal_record_header_bytes(uint8_t type,
+                                   const otrng_client_id_s *client_id) {
+  size_t len = 1 + prekey_journal_string_bytes(client_id->protocol) +
+               prekey_journal_string_bytes(client_id->account);
+
+  if (type == OTRNG_PREKEY_JOURNAL_ADD) {
+    len += 4 + 4;
+  } else if (type == OTRNG_PREKEY_JOURNAL_DELETE) {
+    len += 4;
+  }
+
+  return len;
+}
+
+/* Writes a whole record with one call, so that a crash can only cut short
+   the last record of the file */
+tstatic otrng_result prekey_journal_write_record(
+    FILE *f, uint8_t type, const otrng_client_id_s *client_id, uint32_t id,
+    const uint8_t *data, size_t len) {
+  size_t record_len = prekey_journal_record_header_bytes(type, client_id);
+  uint8_t *record;
+  size_t w = 0;
+  size_t written;
+
+  if (type == OTRNG_PREKEY_JOURNAL_ADD) {
+    if (len > UINT32_MAX) {
+      return OTRNG_ERROR;
+    }
+    record_len += len;
+  }
+
+  record = otrng_xmalloc(record_len);
+  w += otrng_serialize_uint8(record, type);
+  w += prekey_journal_serialize_string(record + w, client_id->protocol);
+  w += prekey_journal_serialize_string(record + w, client_id->account);
+
+  if (type == OTRNG_PREKEY_JOURNAL_ADD) {
+    w += otrng_serialize_uint32(record + w, id);
+    w += otrng_serialize_uint32(record + w, len);
+    memcpy(record + w, data, len);
+  } else if (type == OTRNG_PREKEY_JOURNAL_DELETE) {
+    otrng_serialize_uint32(record + w, id);
+  }
+
+  written = fwrite(record, 1, record_len, f);
+  otrng_secure_wipe(record, record_len);
+  otrng_free(record);
+
+  if (written != record_len) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+/* Reads the serialized prekey message into [dst], which has room for it */
+tstatic otrng_result
+prekey_journal_read_prekey(uint8_t *dst, FILE *f,
+                           const otrng_prekey_journal_prekey_s *prekey) {
+  otrng_result result = OTRNG_SUCCESS;
+
+  if (prekey->pending) {
+    memcpy(dst, prekey->pending, prekey->len);
+    return OTRNG_SUCCESS;
+  }
+
+  if (prekey->offset > LONG_MAX || fflush(f) != 0 ||
+      fseek(f, (long)prekey->offset, SEEK_SET) != 0 ||
+      fread(dst, 1, prekey->len, f) != prekey->len) {
+    result = OTRNG_ERROR;
+  }
+
+  /* Records are only appended after the last one */
+  if (fseek(f, 0, SEEK_END) != 0) {
+    result = OTRNG_ERROR;
+  }
+
+  return result;
+}
+
+tstatic otrng_bool
+prekey_journal_should_compact(const otrng_prekey_journal_s *journal) {
+  return journal->records >= OTRNG_PREKEY_JOURNAL_MIN_COMPACT_RECORDS &&
+         journal->records > 2 * journal->live;
+}
+
+/* Appends a record and returns where its data is in the file. A record that
+   can not be appended is left to the next sync, which rewrites the journal
+   from what is in memory. */
+tstatic otrng_bool prekey_journal_append(otrng_prekey_journal_s *journal,
+                                         uint8_t type,
+                                         const otrng_client_id_s *client_id,
+                                         uint32_t id, const uint8_t *data,
+                                         size_t len, uint64_t *data_offset) {
+  if (journal->failed) {
+    return otrng_false;
+  }
+
+  if (!prekey_journal_write_record(journal->f, type, client_id, id, data,
+                                   len)) {
+    journal->failed = otrng_true;
+    return otrng_false;
+  }
+
+  if (data_offset) {
+    *data_offset =
+        journal->end + prekey_journal_record_header_bytes(type, client_id);
+  }
+  journal->end += prekey_journal_record_header_bytes(type, client_id);
+  if (type == OTRNG_PREKEY_JOURNAL_ADD) {
+    journal->end += len;
+  }
+
+  journal->records++;
+  journal->unsynced++;
+
+  return otrng_true;
+}
+
+/* Called once what was appended is applied */
+tstatic void prekey_journal_appended(otrng_prekey_journal_s *journal) {
+  if (journal->failed) {
+    return;
+  }
+
+  if (prekey_journal_should_compact(journal)) {
+    otrng_prekey_journal_compact(journal);
+  } else if (journal->sync_batch > 0 &&
+             journal->unsynced >= journal->sync_batch) {
+    otrng_prekey_journal_sync(journal);
+  }
+}
+
+tstatic otrng_result prekey_journal_read_string(const char **dst,
+                                                const uint8_t *buffer,
+                                                size_t len, size_t *pos) {
+  uint32_t str_len;
+
+  if (!otrng_deserialize_uint32(&str_len, buffer + *pos, len - *pos, NULL)) {
+    return OTRNG_ERROR;
+  }
+  *pos += 4;
+
+  if (str_len == 0 || str_len > len - *pos ||
+      buffer[*pos + str_len - 1] != '\0') {
+    return OTRNG_ERROR;
+  }
+
+  *dst = (const char *)buffer + *pos;
+  *pos += str_len;
+
+  return OTRNG_SUCCESS;
+}
+
+/* Applies the records in [buffer], which is what follows the magic in the
+   file, and returns how many bytes of whole records there were */
+tstatic size_t prekey_journal_replay(otrng_prekey_journal_s *journal,
+                                     const uint8_t *buffer, size_t len) {
+  size_t pos = 0;
+
+  while (pos < len) {
+    size_t start = pos;
+    otrng_prekey_journal_client_s *client;
+    otrng_client_id_s client_id;
+    uint8_t type = buffer[pos++];
+    uint32_t id, data_len;
+
+    if (!prekey_journal_read_string(&client_id.protocol, buffer, len, &pos) ||
+        !prekey_journal_read_string(&client_id.account, buffer, len, &pos)) {
+      return start;
+    }
+
+    if (type != OTRNG_PREKEY_JOURNAL_CLIENT) {
+      if (!otrng_deserialize_uint32(&id, buffer + pos, len - pos, NULL)) {
+        return start;
+      }
+      pos += 4;
+    }
+
+    switch (type) {
+    case OTRNG_PREKEY_JOURNAL_ADD:
+      if (!otrng_deserialize_uint32(&data_len, buffer + pos, len - pos,
+                                    NULL) ||
+          data_len > len - pos - 4) {
+        return start;
+      }
+      pos += 4;
+
+      client = prekey_journal_get_client(journal, &client_id);
+      prekey_journal_apply_add(journal, client, id, data_len,
+                               OTRNG_PREKEY_JOURNAL_MAGIC_BYTES + pos, NULL);
+      pos += data_len;
+      journal->records++;
+      break;
+
+    case OTRNG_PREKEY_JOURNAL_DELETE:
+      client = prekey_journal_get_client(journal, &client_id);
+      prekey_journal_apply_delete(journal, client, id);
+      journal->records++;
+      break;
+
+    case OTRNG_PREKEY_JOURNAL_CLIENT:
+      prekey_journal_get_client(journal, &client_id);
+      break;
+
+    default:
+      return start;
+    }
+  }
+
+  return pos;
+}
+
+tstatic otrng_result prekey_journal_read_file(uint8_t **dst, size_t *dst_len,
+                                              FILE *f) {
+  long len;
+
+  if (fseek(f, 0, SEEK_END) != 0) {
+    return OTRNG_ERROR;
+  }
+
+  len = ftell(f);
+  if (len < 0 || fseek(f, 0, SEEK_SET) != 0) {
+    return OTRNG_ERROR;
+  }
+
+  *dst = otrng_xmalloc(len > 0 ? len : 1);
+  *dst_len = len;
+
+  if (fread(*dst, 1, len, f) != (size_t)len || fseek(f, 0, SEEK_END) != 0) {
+    otrng_free(*dst);
+    *dst = NULL;
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_prekey_journal_s *otrng_prekey_journal_open(const char *path,
+                                                           size_t sync_batch) {
+  otrng_prekey_journal_s *journal;
+  uint8_t *buffer = NULL;
+  size_t len = 0, records_len, replayed;
+  otrng_bool rewrite = otrng_true;
+  /* Creates the journal if it does not exist */
+  FILE *f = fopen(path, "a+b");
+
+  if (!f) {
+    return NULL;
+  }
+
+  journal = otrng_xmalloc_z(sizeof(otrng_prekey_journal_s));
+  journal->path = otrng_xstrdup(path);
+  journal->index = otrng_hash_index_new();
+  journal->sync_batch = sync_batch;
+
+  if (!prekey_journal_read_file(&buffer, &len, f)) {
+    fclose(f);
+    otrng_prekey_journal_close(journal);
+    return NULL;
+  }
+
+  if (len > 0 && (len < OTRNG_PREKEY_JOURNAL_MAGIC_BYTES ||
+                  memcmp(buffer, OTRNG_PREKEY_JOURNAL_MAGIC,
+                         OTRNG_PREKEY_JOURNAL_MAGIC_BYTES) != 0)) {
+    otrng_free(buffer);
+    fclose(f);
+    otrng_prekey_journal_close(journal);
+    return NULL;
+  }
+
+  /* Read from while it is compacted */
+  journal->f = f;
+
+  if (len > 0) {
+    records_len = len - OTRNG_PREKEY_JOURNAL_MAGIC_BYTES;
+    replayed = prekey_journal_replay(
+        journal, buffer + OTRNG_PREKEY_JOURNAL_MAGIC_BYTES, records_len);
+    journal->end = OTRNG_PREKEY_JOURNAL_MAGIC_BYTES + replayed;
+    /* A record cut short is dropped by rewriting the journal, as anything
+       appended after it would not be read */
+    rewrite =
+        replayed != records_len || prekey_journal_should_compact(journal);
+    otrng_secure_wipe(buffer, len);
+  }
+  otrng_free(buffer);
+
+  if (rewrite && !otrng_prekey_journal_compact(journal)) {
+    otrng_prekey_journal_close(journal);
+    return NULL;
+  }
+
+  return journal;
+}
+
+INTERNAL void otrng_prekey_journal_close(otrng_prekey_journal_s *journal) {
+  if (!journal) {
+    return;
+  }
+
+  if (journal->f) {
+    otrng_prekey_journal_sync(journal);
+    fclose(journal->f);
+  }
+
+  otrng_list_free(journal->clients, prekey_journal_client_free);
+  otrng_hash_index_free(journal->index);
+  otrng_free(journal->path);
+  otrng_free(journal);
+}
+
+tstatic void prekey_message_free_from_journal(void *data) {
+  otrng_prekey_message_free(data);
+}
+
+INTERNAL otrng_result otrng_prekey_journal_load_client(
+    otrng_prekey_journal_s *journal, otrng_client_s *client) {
+  const otrng_prekey_journal_client_s *known =
+      prekey_journal_find_client(journal, &client->client_id);
+  list_element_s *prekeys = NULL;
+  list_element_s *last = NULL;
+  const list_element_s *el;
+  uint8_t *buffer;
+  otrng_result result = OTRNG_SUCCESS;
+  size_t n;
+
+  if (!known) {
+    for (el = client->our_prekeys; el; el = el->next) {
+      if (!otrng_prekey_journal_add(journal, client, el->data)) {
+        return OTRNG_ERROR;
+      }
+    }
+    return OTRNG_SUCCESS;
+  }
+
+  buffer = otrng_secure_alloc(PRE_KEY_WITH_METADATA_MAX_BYTES);
+  for (n = 0; n < known->num_prekeys && result == OTRNG_SUCCESS; n++) {
+    const otrng_prekey_journal_prekey_s *stored = &known->prekeys[n];
+    prekey_message_s *prekey;
+
+    if (stored->len > PRE_KEY_WITH_METADATA_MAX_BYTES ||
+        !prekey_journal_read_prekey(buffer, journal->f, stored)) {
+      result = OTRNG_ERROR;
+      break;
+    }
+
+    prekey = otrng_xmalloc_z(sizeof(prekey_message_s));
+    if (!otrng_prekey_message_deserialize_with_metadata(prekey, buffer,
+                                                        stored->len, NULL)) {
+      otrng_free(prekey);
+      result = OTRNG_ERROR;
+      break;
+    }
+    last = otrng_list_append(prekey, &prekeys, last);
+  }
+  otrng_secure_free(buffer);
+
+  if (result == OTRNG_ERROR) {
+    otrng_list_free(prekeys, prekey_message_free_from_journal);
+    return OTRNG_ERROR;
+  }
+
+  otrng_list_free(client->our_prekeys, prekey_message_free_from_journal);
+  client->our_prekeys = prekeys;
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_prekey_journal_add(otrng_prekey_journal_s *journal,
+                                               const otrng_client_s *client,
+                                               const prekey_message_s *prekey) {
+  uint8_t *buffer = otrng_secure_alloc(PRE_KEY_WITH_METADATA_MAX_BYTES);
+  uint64_t offset = 0;
+  otrng_bool appended;
+  size_t w = 0;
+
+  if (!otrng_prekey_message_serialize_with_metadata(
+          buffer, PRE_KEY_WITH_METADATA_MAX_BYTES, &w, prekey)) {
+    otrng_secure_free(buffer);
+    return OTRNG_ERROR;
+  }
+
+  appended = prekey_journal_append(journal, OTRNG_PREKEY_JOURNAL_ADD,
+                                   &client->client_id, prekey->id, buffer, w,
+                                   &offset);
+  prekey_journal_apply_add(
+      journal, prekey_journal_get_client(journal, &client->client_id),
+      prekey->id, w, offset, appended ? NULL : buffer);
+  otrng_secure_free(buffer);
+  prekey_journal_appended(journal);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_prekey_journal_delete(
+    otrng_prekey_journal_s *journal, const otrng_client_s *client,
+    uint32_t id) {
+  otrng_prekey_journal_client_s *known =
+      prekey_journal_find_client(journal, &client->client_id);
+
+  if (!known || !prekey_journal_find_prekey(known, id)) {
+    return OTRNG_SUCCESS;
+  }
+
+  prekey_journal_apply_delete(journal, known, id);
+  prekey_journal_append(journal, OTRNG_PREKEY_JOURNAL_DELETE,
+                        &client->client_id, id, NULL, 0, NULL);
+  prekey_journal_appended(journal);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result
+otrng_prekey_journal_sync(otrng_prekey_journal_s *journal) {
+  if (journal->failed) {
+    return otrng_prekey_journal_compact(journal);
+  }
+
+  if (journal->unsynced == 0) {
+    return OTRNG_SUCCESS;
+  }
+
+  if (fflush(journal->f) != 0 || fsync(fileno(journal->f)) != 0) {
+    journal->failed = otrng_true;
+    return otrng_prekey_journal_compact(journal);
+  }
+
+  journal->unsynced = 0;
+  return OTRNG_SUCCESS;
+}
+
+/* Writes the prekey messages that are left to [f], reading them from the
+   journal, and returns in [offsets] where each one is in [f] */
+tstatic otrng_result prekey_journal_write_all(
+    FILE *f, uint64_t *end, uint64_t *offsets,
+    const otrng_prekey_journal_s *journal) {
+  uint8_t *buffer = otrng_secure_alloc(PRE_KEY_WITH_METADATA_MAX_BYTES);
+  otrng_result result = OTRNG_SUCCESS;
+  const list_element_s *el;
+  size_t n, next = 0;
+
+  *end = OTRNG_PREKEY_JOURNAL_MAGIC_BYTES;
+  if (fwrite(OTRNG_PREKEY_JOURNAL_MAGIC, 1, OTRNG_PREKEY_JOURNAL_MAGIC_BYTES,
+             f) != OTRNG_PREKEY_JOURNAL_MAGIC_BYTES) {
+    result = OTRNG_ERROR;
+  }
+
+  for (el = journal->clients; el && result == OTRNG_SUCCESS; el = el->next) {
+    const otrng_prekey_journal_client_s *client = el->data;
+
+    /* Keeps a client with no prekey messages known */
+    if (client->num_prekeys == 0) {
+      result = prekey_journal_write_record(f, OTRNG_PREKEY_JOURNAL_CLIENT,
+                                           &client->client_id, 0, NULL, 0);
+      *end += prekey_journal_record_header_bytes(OTRNG_PREKEY_JOURNAL_CLIENT,
+                                                 &client->client_id);
+    }
+
+    for (n = 0; n < client->num_prekeys && result == OTRNG_SUCCESS; n++) {
+      const otrng_prekey_journal_prekey_s *prekey = &client->prekeys[n];
+
+      if (prekey->len > PRE_KEY_WITH_METADATA_MAX_BYTES ||
+          !prekey_journal_read_prekey(buffer, journal->f, prekey) ||
+          !prekey_journal_write_record(f, OTRNG_PREKEY_JOURNAL_ADD,
+                                       &client->client_id, prekey->id, buffer,
+                                       prekey->len)) {
+        result = OTRNG_ERROR;
+        break;
+      }
+
+      *end += prekey_journal_record_header_bytes(OTRNG_PREKEY_JOURNAL_ADD,
+                                                 &client->client_id);
+      offsets[next++] = *end;
+      *end += prekey->len;
+    }
+  }
+  otrng_secure_free(buffer);
+
+  if (result == OTRNG_ERROR || fflush(f) != 0 || fsync(fileno(f)) != 0) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result
+otrng_prekey_journal_compact(otrng_prekey_journal_s *journal) {
+  size_t tmp_path_len = strlen(journal->path) + 5;
+  char *tmp_path = otrng_xmalloc(tmp_path_len);
+  uint64_t *offsets;
+  const list_element_s *el;
+  uint64_t end;
+  size_t n, next = 0;
+  FILE *f;
+
+  snprintf(tmp_path, tmp_path_len, "%s.tmp", journal->path);
+
+  f = fopen(tmp_path, "w+b");
+  if (!f) {
+    otrng_free(tmp_path);
+    journal->failed = otrng_true;
+    return OTRNG_ERROR;
+  }
+
+  offsets = otrng_xmalloc((journal->live ? journal->live : 1) *
+                          sizeof(uint64_t));
+  if (!prekey_journal_write_all(f, &end, offsets, journal) ||
+      rename(tmp_path, journal->path) != 0) {
+    fclose(f);
+    remove(tmp_path);
+    otrng_free(tmp_path);
+    otrng_free(offsets);
+    journal->failed = otrng_true;
+    return OTRNG_ERROR;
+  }
+  otrng_free(tmp_path);
+
+  /* Every prekey message is in the new file now */
+  for (el = journal->clients; el; el = el->next) {
+    otrng_prekey_journal_client_s *client = el->data;
+
+    for (n = 0; n < client->num_prekeys; n++) {
+      prekey_journal_drop_pending(&client->prekeys[n]);
+      client->prekeys[n].offset = offsets[next++];
+    }
+  }
+  otrng_free(offsets);
+
+  /* The new file is the journal now, and the next records go after it */
+  if (journal->f) {
+    fclose(journal->f);
+  }
+  journal->f = f;
+  journal->end = end;
+  journal->records = journal->live;
+  journal->unsynced = 0;
+  journal->failed = otrng_false;
+
+  return OTRNG_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_PREKEY_JOURNAL_H
+#define OTRNG_PREKEY_JOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "client.h"
+#include "error.h"
+#include "hash_index.h"
+#include "list.h"
+#include "prekey_message.h"
+#include "shared.h"
+
+/*
+ * An append-only journal of the prekey messages of many clients. Storing or
+ * deleting a prekey message appends one record, instead of writing every
+ * prekey message again, and the journal is compacted to the ones that are
+ * left once most of its records are stale.
+ *
+ * The file starts with "OTRNGPJ1", and is followed by records. A record is a
+ * type (1 byte), the protocol and account of a client, each a length (4
+ * bytes) and that many bytes ending with a NUL, and then:
+ * - for OTRNG_PREKEY_JOURNAL_ADD, the id of a prekey message (4 bytes), a
+ *   length (4 bytes) and the prekey message serialized with its metadata. It
+ *   replaces the prekey message with the same id, if there is one.
+ * - for OTRNG_PREKEY_JOURNAL_DELETE, the id of a prekey message (4 bytes).
+ * - for OTRNG_PREKEY_JOURNAL_CLIENT, nothing: the client is known to the
+ *   journal, even if it has no prekey messages left.
+ * Numbers are big-endian. A record cut short by a crash is dropped when the
+ * journal is opened.
+ *
+ * Once the journal knows a client, it has the latest prekey messages of that
+ * client: they replace the ones the client was loaded with from anywhere else.
+ *
+ * Only where each prekey message is in the file is kept in memory, and the
+ * prekey messages of a client are read from the file when it is got.
+ */
+
+#define OTRNG_PREKEY_JOURNAL_MAGIC "OTRNGPJ1"
+#define OTRNG_PREKEY_JOURNAL_MAGIC_BYTES 8
+
+/* The journal is not compacted before it has this many records */
+#define OTRNG_PREKEY_JOURNAL_MIN_COMPACT_RECORDS 256
+
+typedef enum {
+  OTRNG_PREKEY_JOURNAL_ADD = 1,
+  OTRNG_PREKEY_JOURNAL_DELETE = 2,
+  OTRNG_PREKEY_JOURNAL_CLIENT = 3
+} otrng_prekey_journal_record_type;
+
+typedef struct otrng_prekey_journal_prekey_s {
+  uint32_t id;
+  uint32_t len;    /* of the prekey message serialized with its metadata */
+  uint64_t offset; /* of the serialized prekey message in the file */
+  /* The serialized prekey message, only kept while its record could not be
+     appended to the file */
+  uint8_t *pending;
+} otrng_prekey_journal_prekey_s;
+
+typedef struct otrng_prekey_journal_client_s {
+  otrng_client_id_s client_id; /* owned by the journal */
+  otrng_prekey_journal_prekey_s *prekeys;
+  size_t num_prekeys;
+  size_t prekeys_cap;
+} otrng_prekey_journal_client_s;
+
+typedef struct otrng_prekey_journal_s {
+  char *path;
+  FILE *f;      /* read from, and appended to */
+  uint64_t end; /* of the last whole record in the file */
+
+  /* The prekey messages that are left, by client */
+  list_element_s *clients;
+  hash_index_s *index; /* the clients by (protocol, account) */
+  size_t live;
+
+  size_t records; /* additions and deletions in the file */
+  size_t unsynced;
+  /* Records are synced to the disk after this many, or only by
+     otrng_prekey_journal_sync if it is zero */
+  size_t sync_batch;
+  /* Set when a record could not be appended: the file is rewritten on the
+     next sync */
+  otrng_bool failed;
+} otrng_prekey_journal_s;
+
+/**
+ * @brief Opens the journal at [path], creating it if it does not exist, and
+ *        reads the prekey messages that are left in it.
+ *
+ * @return NULL if [path] can not be opened, or is not a journal.
+ */
+INTERNAL otrng_prekey_journal_s *otrng_prekey_journal_open(const char *path,
+                                                           size_t sync_batch);
+
+/* Syncs what was appended, and closes the journal */
+INTERNAL void otrng_prekey_journal_close(otrng_prekey_journal_s *journal);
+
+/**
+ * @brief Replaces the prekey messages of [client] with the ones in the
+ *        journal, if it knows the client. Otherwise, the journal takes the
+ *        ones [client] has.
+ */
+INTERNAL otrng_result otrng_prekey_journal_load_client(
+    otrng_prekey_journal_s *journal, otrng_client_s *client);
+
+/**
+ * @brief Appends that [prekey] of [client] was stored, or changed. It only
+ *        fails if [prekey] can not be serialized: a record that can not be
+ *        written is left to otrng_prekey_journal_sync.
+ */
+INTERNAL otrng_result otrng_prekey_journal_add(otrng_prekey_journal_s *journal,
+                                               const otrng_client_s *client,
+                                               const prekey_message_s *prekey);
+
+/* Appends that the prekey message [id] of [client] was deleted */
+INTERNAL otrng_result otrng_prekey_journal_delete(
+    otrng_prekey_journal_s *journal, const otrng_client_s *client,
+    uint32_t id);
+
+/**
+ * @brief Makes sure what was appended is on the disk. If appending failed
+ *        before, the journal is compacted instead.
+ */
+INTERNAL otrng_result
+otrng_prekey_journal_sync(otrng_prekey_journal_s *journal);
+
+/**
+ * @brief Writes the prekey messages that are left to a new file, syncs it,
+ *        and moves it over the journal.
+ */
+INTERNAL otrng_result
+otrng_prekey_journal_compact(otrng_prekey_journal_s *journal);
+
+#ifdef OTRNG_PREKEY_JOURNAL_PRIVATE
+
+tstatic otrng_result prekey_journal_write_record(
+    FILE *f, uint8_t type, const otrng_client_id_s *client_id, uint32_t id,
+    const uint8_t *data, size_t len);
+
+tstatic otrng_bool prekey_journal_append(otrng_prekey_journal_s *journal,
+                                         uint8_t type,
+                                         const otrng_client_id_s *client_id,
+                                         uint32_t id, const uint8_t *data,
+                                         size_t len, uint64_t *data_offset);
+
+tstatic size_t prekey_journal_replay(otrng_prekey_journal_s *journal,
+                                     const uint8_t *buffer, size_t len);
+
+#endif
+
+#endif
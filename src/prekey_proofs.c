@@ -224,6 +224,15 @@ tstatic void *gen_random_data(size_t n, random_generator gen) {
   return gen(n);
 }
 
+static void free_dh_mpis(dh_mpi *mpis, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    otrng_dh_mpi_release(mpis[i]);
+  }
+  otrng_free(mpis);
+}
+
 INTERNAL otrng_result otrng_dh_proof_generate(
     dh_proof_s *dst, const dh_mpi *values_priv, const dh_mpi *values_pub,
     const size_t values_len, const uint8_t *m, const uint8_t usage,
@@ -323,6 +332,7 @@ INTERNAL otrng_bool otrng_dh_proof_verify(dh_proof_s *px,
                                           const uint8_t usage) {
   uint8_t *p;
   dh_mpi mod, a, curr;
+  dh_mpi *t;
   size_t i;
   uint8_t *cbuf;
   uint8_t *cbuf_curr;
@@ -339,31 +349,31 @@ INTERNAL otrng_bool otrng_dh_proof_verify(dh_proof_s *px,
     return otrng_false;
   }
 
-  a = gcry_mpi_new(DH3072_MOD_LEN_BITS);
-  otrng_dh_calculate_public_key(a, px->v);
-
-  mod = otrng_dh_modulus_p();
-
-  curr = gcry_mpi_new(DH3072_MOD_LEN_BITS);
-  gcry_mpi_set_ui(curr, 1);
+  t = otrng_xmalloc_z(values_len * sizeof(dh_mpi));
 
   p_curr = p;
   for (i = 0; i < values_len; i++) {
-    gcry_mpi_t t;
-    if (!otrng_dh_mpi_deserialize(&t, p_curr, PREKEY_PROOF_LAMBDA, &w)) {
+    if (!otrng_dh_mpi_deserialize(&t[i], p_curr, PREKEY_PROOF_LAMBDA, &w)) {
+      free_dh_mpis(t, i);
       otrng_free(p);
-      gcry_mpi_release(a);
-      otrng_dh_mpi_release(curr);
       return otrng_false;
     }
     p_curr += w;
-
-    gcry_mpi_powm(t, values_pub[i], t, mod);
-    gcry_mpi_mulm(curr, curr, t, mod);
-    otrng_dh_mpi_release(t);
   }
 
   otrng_free(p);
+
+  /* Everything in the proof is public, so both the generator and the
+     product of the values can be raised in variable time. */
+  a = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  otrng_dh_generator_exp_non_secret(a, px->v);
+
+  mod = otrng_dh_modulus_p();
+
+  curr = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  otrng_dh_multi_exp_non_secret(curr, values_pub, t, values_len);
+  free_dh_mpis(t, values_len);
+
   gcry_mpi_invm(curr, curr, mod);
   gcry_mpi_mulm(a, a, curr, mod);
   otrng_dh_mpi_release(curr);
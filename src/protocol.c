@@ -20,6 +20,7 @@
 
 #include "protocol.h"
 
+#include "base64.h"
 #include "data_message.h"
 #include "debug.h"
 #include "messaging.h"
@@ -116,38 +117,6 @@ INTERNAL void otrng_error_message(string_p *to_send, otrng_err_code err_code) {
   }
 }
 
-tstatic otrng_result encrypt_data_message(data_message_s *data_msg,
-                                          const uint8_t *msg, size_t msg_len,
-                                          const k_msg_enc enc_key) {
-  uint8_t *c = NULL;
-  int err;
-
-  random_bytes(data_msg->nonce, DATA_MSG_NONCE_BYTES);
-
-  c = otrng_xmalloc_z(msg_len);
-
-  err = crypto_stream_xor(c, msg, msg_len, data_msg->nonce, enc_key);
-  if (err) {
-    otrng_free(c);
-    return OTRNG_ERROR;
-  }
-
-  data_msg->enc_msg_len = msg_len;
-  data_msg->enc_msg = c;
-
-#ifdef DEBUG
-  debug_print("\n");
-  debug_print("nonce = ");
-  otrng_memdump(data_msg->nonce, DATA_MSG_NONCE_BYTES);
-  debug_print("message = ");
-  otrng_memdump(msg, msg_len);
-  debug_print("cipher = ");
-  otrng_memdump(c, msg_len);
-#endif
-
-  return OTRNG_SUCCESS;
-}
-
 tstatic data_message_s *generate_data_message(const otrng_s *otr,
                                               const uint32_t ratchet_id) {
   data_message_s *data_msg = otrng_data_message_new();
@@ -166,54 +135,118 @@ tstatic data_message_s *generate_data_message(const otrng_s *otr,
   return data_msg;
 }
 
-tstatic otrng_result serialize_and_encode_data_message(
-    string_p *dst, const k_msg_mac mac_key, uint8_t *to_reveal_mac_keys,
-    size_t to_reveal_mac_keys_len, const data_message_s *data_msg) {
-  uint8_t *body = NULL;
-  size_t body_len = 0;
-  size_t ser_len;
-  uint8_t *ser;
-
-  if (!otrng_data_message_body_serialize(&body, &body_len, data_msg)) {
-    return OTRNG_ERROR;
+static void ensure_send_buffer(char **buffer, size_t *capacity, size_t len) {
+  if (*buffer && *capacity >= len) {
+    return;
   }
 
-  ser_len = body_len + MAC_KEY_BYTES + to_reveal_mac_keys_len;
+  *buffer = otrng_xrealloc(*buffer, len);
+  *capacity = len;
+}
 
-  ser = otrng_xmalloc_z(ser_len);
+static void set_error_message(char **buffer, size_t *capacity,
+                              otrng_err_code err_code) {
+  string_p err_msg = NULL;
+  size_t len;
 
-  memcpy(ser, body, body_len);
-  otrng_free(body);
+  otrng_error_message(&err_msg, err_code);
+  if (!err_msg) {
+    return;
+  }
 
-  if (otrng_failed(otrng_data_message_authenticator(
-          ser + body_len, MAC_KEY_BYTES, mac_key, ser, body_len))) {
-    otrng_free(ser);
-    return OTRNG_ERROR;
+  len = strlen(err_msg) + 1;
+  ensure_send_buffer(buffer, capacity, len);
+  memcpy(*buffer, err_msg, len);
+  otrng_free(err_msg);
+}
+
+static size_t tlvs_serialized_len(const tlv_list_s *tlvs) {
+  const tlv_list_s *current;
+  size_t len = 0;
+
+  for (current = tlvs; current; current = current->next) {
+    len += current->data->len + 4;
   }
 
-  if (to_reveal_mac_keys) {
-    if (otrng_serialize_bytes_array(ser + body_len + DATA_MSG_MAC_BYTES,
-                                    to_reveal_mac_keys,
-                                    to_reveal_mac_keys_len) == 0) {
-      otrng_free(ser);
+  return len;
+}
+
+/* Offsets of the fields that change between messages of the same ratchet */
+#define DATA_MSG_FLAGS_OFFSET DAKE_HEADER_BYTES
+#define DATA_MSG_MESSAGE_ID_OFFSET (DAKE_HEADER_BYTES + 1 + 4 + 4)
+
+/*
+ * The serialized header of the last message sent. Messages of the same
+ * ratchet only differ in their flags, message id, nonce and length, so these
+ * are patched instead of serializing the public keys again.
+ */
+typedef struct header_cache_s {
+  uint8_t header[DATA_MSG_MAX_BYTES];
+  size_t len;
+  uint32_t ratchet_id;
+} header_cache_s;
+
+tstatic otrng_result serialize_header(header_cache_s *cache, const otrng_s *otr,
+                                      uint32_t ratchet_id, unsigned char flags,
+                                      size_t enc_msg_len) {
+  if (!cache->len || cache->ratchet_id != ratchet_id) {
+    data_message_s *data_msg = generate_data_message(otr, ratchet_id);
+    otrng_result ret;
+
+    if (!data_msg) {
+      return OTRNG_ERROR;
+    }
+
+    ret = otrng_data_message_header_serialize(cache->header, DATA_MSG_MAX_BYTES,
+                                              &cache->len, data_msg);
+    otrng_data_message_free(data_msg);
+
+    if (otrng_failed(ret)) {
+      cache->len = 0;
       return OTRNG_ERROR;
     }
+
+    cache->ratchet_id = ratchet_id;
   }
 
-  *dst = otrl_base64_otr_encode(ser, ser_len);
+  cache->header[DATA_MSG_FLAGS_OFFSET] = flags;
+  otrng_serialize_uint32(cache->header + DATA_MSG_MESSAGE_ID_OFFSET,
+                         otr->keys->j);
+  random_bytes(cache->header + cache->len - 4 - DATA_MSG_NONCE_BYTES,
+               DATA_MSG_NONCE_BYTES);
+  otrng_serialize_uint32(cache->header + cache->len - 4, enc_msg_len);
 
-  otrng_free(ser);
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_result send_data_message(string_p *to_send, const uint8_t *msg,
-                                       size_t msg_len, otrng_s *otr,
+/*
+ * Builds the whole data message in [buffer]: the binary message is written at
+ * the end of the buffer, the plaintext is encrypted where it lies, and the
+ * result is base64-encoded in place towards the start of the buffer.
+ */
+tstatic otrng_result send_data_message(char **buffer, size_t *capacity,
+                                       header_cache_s *cache,
+                                       const string_p msg,
+                                       const tlv_list_s *tlvs, otrng_s *otr,
                                        unsigned char flags,
                                        otrng_warning *warn) {
-  data_message_s *data_msg = NULL;
   uint32_t ratchet_id = otr->keys->i;
   k_msg_enc enc_key;
   k_msg_mac mac_key;
+  const uint8_t *nonce;
+  size_t msg_len = strlen(msg) + 1;
+  size_t tlvs_len = tlvs_serialized_len(tlvs);
+  size_t padding_len = otrng_padding_tlv_len(msg_len + tlvs_len, otr);
+  size_t plain_len = msg_len + tlvs_len + padding_len;
+  size_t reveal_len = 0;
+  size_t bin_len, total_len;
+  const tlv_list_s *current;
+  uint8_t *bin, *cursor;
+
+  /* A new ratchet replaces our public keys */
+  if (otr->keys->j == 0) {
+    cache->len = 0;
+  }
 
   /* if j == 0 */
   if (!otrng_key_manager_derive_dh_ratchet_keys(
@@ -231,155 +264,167 @@ tstatic otrng_result send_data_message(string_p *to_send, const uint8_t *msg,
     return OTRNG_ERROR;
   }
 
-  data_msg = generate_data_message(otr, ratchet_id);
-  if (!data_msg) {
+  if (!serialize_header(cache, otr, ratchet_id, flags, plain_len)) {
     otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
     otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
     return OTRNG_ERROR;
   }
+  nonce = cache->header + cache->len - 4 - DATA_MSG_NONCE_BYTES;
 
-  data_msg->flags = flags;
-  data_msg->sender_instance_tag = our_instance_tag(otr);
-  data_msg->receiver_instance_tag = otr->their_instance_tag;
+  if (otr->keys->j == 0) {
+    reveal_len = otrng_list_len(otr->keys->old_mac_keys) * MAC_KEY_BYTES;
+  }
+
+  bin_len = cache->len + plain_len + DATA_MSG_MAC_BYTES + reveal_len;
+  total_len = OTRNG_BASE64_OTR_ENCODE_LEN(bin_len) + 1;
+  ensure_send_buffer(buffer, capacity, total_len);
+  bin = (uint8_t *)*buffer + total_len - bin_len;
+
+  memcpy(bin, cache->header, cache->len);
+  cursor = bin + cache->len;
 
-  if (!encrypt_data_message(data_msg, msg, msg_len, enc_key)) {
-    otrng_error_message(to_send, OTRNG_ERR_MSG_ENCRYPTION_ERROR);
+  cursor = (uint8_t *)otrng_stpcpy((char *)cursor, msg) + 1;
+  for (current = tlvs; current; current = current->next) {
+    cursor += otrng_tlv_serialize(cursor, current->data);
+  }
+  if (padding_len) {
+    cursor += otrng_padding_tlv_serialize(cursor, padding_len);
+  }
+
+  if (crypto_stream_xor(bin + cache->len, bin + cache->len, plain_len, nonce,
+                        enc_key) != 0) {
+    otrng_secure_wipe(bin, bin_len);
+    set_error_message(buffer, capacity, OTRNG_ERR_MSG_ENCRYPTION_ERROR);
 
     otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
     otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
-    otrng_data_message_free(data_msg);
     return OTRNG_ERROR;
   }
 
   otrng_secure_wipe(enc_key, ENC_KEY_BYTES);
 
+#ifdef DEBUG
+  debug_print("\n");
+  debug_print("nonce = ");
+  otrng_memdump(nonce, DATA_MSG_NONCE_BYTES);
+  debug_print("cipher = ");
+  otrng_memdump(bin + cache->len, plain_len);
+#endif
+
   /* Authenticator = KDF_1(0x1A || MKmac || KDF_1(usage_authenticator ||
    * data_message_sections, 64), 64) */
-  if (otr->keys->j == 0) {
-    size_t ser_mac_keys_len =
-        otrng_list_len(otr->keys->old_mac_keys) * MAC_KEY_BYTES;
-    uint8_t *ser_mac_keys =
-        otrng_serialize_old_mac_keys(otr->keys->old_mac_keys);
-    otr->keys->old_mac_keys = NULL;
+  if (otrng_failed(otrng_data_message_authenticator(
+          cursor, DATA_MSG_MAC_BYTES, mac_key, bin, cache->len + plain_len))) {
+    otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
+    return OTRNG_ERROR;
+  }
+  cursor += DATA_MSG_MAC_BYTES;
 
-    if (!serialize_and_encode_data_message(to_send, mac_key, ser_mac_keys,
-                                           ser_mac_keys_len, data_msg)) {
-      otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
-      otrng_free(ser_mac_keys);
-      otrng_data_message_free(data_msg);
+  otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
 
-      return OTRNG_ERROR;
-    }
-    otrng_free(ser_mac_keys);
-  } else {
-    if (!serialize_and_encode_data_message(to_send, mac_key, NULL, 0,
-                                           data_msg)) {
-      otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
-      otrng_data_message_free(data_msg);
-      return OTRNG_ERROR;
-    }
+  if (otr->keys->j == 0) {
+    otrng_serialize_old_mac_keys_into(cursor, otr->keys->old_mac_keys);
+    otr->keys->old_mac_keys = NULL;
   }
 
-  otr->keys->j++;
+  otrng_base64_otr_encode_in_place(*buffer, bin_len);
 
-  otrng_secure_wipe(mac_key, MAC_KEY_BYTES);
-  otrng_data_message_free(data_msg);
+  otr->keys->j++;
 
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_result serialize_tlvs(uint8_t **dst, size_t *dst_len,
-                                    const tlv_list_s *tlvs) {
-  const tlv_list_s *current = tlvs;
-  uint8_t *cursor = NULL;
-
-  *dst = NULL;
-  *dst_len = 0;
-
-  if (!tlvs) {
-    return OTRNG_SUCCESS;
-  }
-
-  for (*dst_len = 0; current; current = current->next) {
-    *dst_len += current->data->len + 4;
+static otrng_result check_can_send(otrng_s *otr, otrng_warning *warn) {
+  if (otr->state == OTRNG_STATE_FINISHED) {
+    return OTRNG_ERROR; // Should restart
   }
 
-  *dst = otrng_xmalloc_z(*dst_len);
-
-  cursor = *dst;
-  for (current = tlvs; current; current = current->next) {
-    cursor += otrng_tlv_serialize(cursor, current->data);
+  if (otr->state != OTRNG_STATE_ENCRYPTED_MESSAGES) {
+    if (warn) {
+      *warn = OTRNG_WARN_SEND_NOT_ENCRYPTED; // TODO: @queing queue message
+    }
+    return OTRNG_ERROR;
   }
 
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_result append_tlvs(uint8_t **dst, size_t *dst_len,
-                                 const string_p msg, const tlv_list_s *tlvs,
-                                 const otrng_s *otr) {
-  uint8_t *ser = NULL;
-  size_t len = 0;
-  size_t msg_len;
-  uint8_t *padding = NULL;
-  size_t padding_len = 0;
-  char *res;
+INTERNAL otrng_result otrng_prepare_to_send_data_message_into(
+    char **buffer, size_t *capacity, otrng_warning *warn, const string_p msg,
+    const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags) {
+  header_cache_s cache;
+  otrng_result result;
 
-  if (!serialize_tlvs(&ser, &len, tlvs)) {
-    return OTRNG_ERROR;
+  if (*buffer && *capacity > 0) {
+    (*buffer)[0] = '\0';
   }
 
-  // Append padding
-  msg_len = strlen(msg) + 1 + len;
-  if (!generate_padding(&padding, &padding_len, msg_len, otr)) {
-    otrng_free(ser);
+  if (!check_can_send(otr, warn)) {
     return OTRNG_ERROR;
   }
 
-  *dst_len = msg_len + padding_len;
-  *dst = otrng_xmalloc_z(*dst_len);
-
-  res = otrng_stpcpy((char *)*dst, msg);
-  if (ser) {
-    memcpy(res + 1, ser, len);
-  }
+  cache.len = 0;
+  result =
+      send_data_message(buffer, capacity, &cache, msg, tlvs, otr, flags, warn);
 
-  if (padding) {
-    memcpy(*dst + msg_len, padding, padding_len);
-  }
-
-  otrng_free(ser);
-  otrng_free(padding);
+  otr->last_sent = time(NULL);
 
-  return OTRNG_SUCCESS;
+  return result;
 }
 
 INTERNAL otrng_result otrng_prepare_to_send_data_message(
     string_p *to_send, otrng_warning *warn, const string_p msg,
     const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags) {
-  uint8_t *msg2 = NULL;
-  size_t msg_len = 0;
+  char *buffer = NULL;
+  size_t capacity = 0;
   otrng_result result;
 
-  if (otr->state == OTRNG_STATE_FINISHED) {
-    return OTRNG_ERROR; // Should restart
+  result = otrng_prepare_to_send_data_message_into(&buffer, &capacity, warn,
+                                                   msg, tlvs, otr, flags);
+
+  if (buffer && buffer[0] != '\0') {
+    *to_send = buffer;
+  } else {
+    otrng_free(buffer);
   }
 
-  if (otr->state != OTRNG_STATE_ENCRYPTED_MESSAGES) {
-    if (warn) {
-      *warn = OTRNG_WARN_SEND_NOT_ENCRYPTED; // TODO: @queing queue message
-    }
-    return OTRNG_ERROR;
+  return result;
+}
+
+INTERNAL otrng_result otrng_prepare_to_send_data_messages(
+    string_p *to_send, const string_p *msgs, size_t count, otrng_warning *warn,
+    otrng_s *otr, unsigned char flags) {
+  header_cache_s cache;
+  otrng_result result = OTRNG_SUCCESS;
+  size_t n;
+
+  for (n = 0; n < count; n++) {
+    to_send[n] = NULL;
   }
 
-  if (!append_tlvs(&msg2, &msg_len, msg, tlvs, otr)) {
+  if (!check_can_send(otr, warn)) {
     return OTRNG_ERROR;
   }
 
-  result = send_data_message(to_send, msg2, msg_len, otr, flags, warn);
+  cache.len = 0;
+  for (n = 0; n < count; n++) {
+    char *buffer = NULL;
+    size_t capacity = 0;
+
+    result = send_data_message(&buffer, &capacity, &cache, msgs[n], NULL, otr,
+                               flags, warn);
+    if (otrng_failed(result)) {
+      /* The keys of the messages already encoded have been used: they are
+         left for the caller to send */
+      otrng_free(buffer);
+      break;
+    }
 
-  otr->last_sent = time(NULL);
+    to_send[n] = buffer;
+  }
 
-  otrng_free(msg2);
+  otrng_secure_wipe(&cache, sizeof(cache));
+  otr->last_sent = time(NULL);
 
   return result;
 }
@@ -22,6 +22,7 @@
 #define OTRNG_PROTOCOL_H
 
 #include "client_profile.h"
+#include "fragment.h"
 #include "key_management.h"
 #include "prekey_profile.h"
 #include "smp_protocol.h"
@@ -67,7 +68,11 @@ typedef struct otrng_s {
   key_manager_s *keys;
   smp_protocol_s *smp;
 
-  list_element_s *pending_fragments;
+  fragment_reassembly_s *pending_fragments;
+  otrng_fragment_ids_s fragment_ids;
+
+  /* Set while otrng_receive_messages runs */
+  struct receive_batch_s *receive_batch;
 
   string_p sending_init_message;
   string_p receiving_init_message;
@@ -97,13 +102,37 @@ INTERNAL otrng_result otrng_prepare_to_send_data_message(
     string_p *to_send, otrng_warning *warn, const string_p msg,
     const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags);
 
-INTERNAL void otrng_error_message(string_p *to_send, otrng_err_code err_code);
+/**
+ * @brief Like otrng_prepare_to_send_data_message, but builds the encoded
+ *        message in a caller-owned buffer that can be reused across calls.
+ *
+ * @param [buffer]    The buffer, grown as needed. May point to NULL.
+ * @param [capacity]  The allocated size of [buffer].
+ *
+ * On success, [buffer] holds the message to send. On failure, it holds either
+ * an empty string or an error message to send to the peer.
+ */
+INTERNAL otrng_result otrng_prepare_to_send_data_message_into(
+    char **buffer, size_t *capacity, otrng_warning *warn, const string_p msg,
+    const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags);
 
-#ifdef OTRNG_PROTOCOL_PRIVATE
+/**
+ * @brief Encodes [count] messages to the same conversation, in order.
+ *
+ * The state is checked once, and the public keys are serialized once per
+ * ratchet rather than once per message.
+ *
+ * @param [to_send]  An array of [count] elements that receives the messages.
+ * @param [msgs]     The [count] messages to encode.
+ *
+ * On failure, the messages encoded before the one that failed are left in
+ * [to_send] and must still be sent, as their keys have been used. The rest
+ * are NULL.
+ */
+INTERNAL otrng_result otrng_prepare_to_send_data_messages(
+    string_p *to_send, const string_p *msgs, size_t count, otrng_warning *warn,
+    otrng_s *otr, unsigned char flags);
 
-tstatic otrng_result serialize_and_encode_data_message(
-    string_p *dst, const k_msg_mac mac_key, uint8_t *to_reveal_mac_keys,
-    size_t to_reveal_mac_keys_len, const data_message_s *data_msg);
-#endif
+INTERNAL void otrng_error_message(string_p *to_send, otrng_err_code err_code);
 
 #endif
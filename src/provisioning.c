@@ -0,0 +1,398 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#define OTRNG_PROVISIONING_PRIVATE
+
+#include "alloc.h"
+#include "provisioning.h"
+#include "random.h"
+
+/* As otrng_client_build_default_client_profile */
+#define PROVISIONING_CLIENT_PROFILE_VERSIONS "34"
+
+tstatic void provisioning_prepare_job(otrng_provisioning_job_s *job,
+                                      otrng_global_state_s *gs,
+                                      const otrng_client_id_s client_id,
+                                      size_t num_prekeys) {
+  otrng_client_s *client = otrng_client_get(gs, client_id);
+
+  job->client_id = client_id;
+  job->num_prekeys = num_prekeys;
+  job->result = OTRNG_ERROR;
+
+  if (!client) {
+    job->done = otrng_true;
+    return;
+  }
+
+  job->instance_tag = otrng_client_get_instance_tag(client);
+  if (job->instance_tag == 0) {
+    job->done = otrng_true;
+    return;
+  }
+
+  job->client_profile_exp_time = client->client_profile_exp_time;
+
+  if (client->keypair) {
+    job->sym = otrng_secure_alloc(ED448_PRIVATE_BYTES);
+    memcpy(job->sym, client->keypair->sym, ED448_PRIVATE_BYTES);
+  }
+
+  if (client->forging_key) {
+    otrng_ec_point_copy(job->forging_key, *client->forging_key);
+    job->has_forging_key = otrng_true;
+  }
+
+  job->needs_client_profile = !client->client_profile;
+  job->needs_prekey_profile = !client->prekey_profile;
+}
+
+tstatic void provisioning_job_destroy(otrng_provisioning_job_s *job) {
+  size_t n;
+
+  if (job->sym) {
+    otrng_secure_free(job->sym);
+    job->sym = NULL;
+  }
+
+  otrng_keypair_free(job->keypair);
+  job->keypair = NULL;
+
+  if (job->client_profile) {
+    otrng_client_profile_free(job->client_profile);
+    job->client_profile = NULL;
+  }
+
+  otrng_prekey_profile_free(job->prekey_profile);
+  job->prekey_profile = NULL;
+
+  if (job->prekeys) {
+    for (n = 0; n < job->num_prekeys; n++) {
+      otrng_prekey_message_free(job->prekeys[n]);
+    }
+    otrng_free(job->prekeys);
+    job->prekeys = NULL;
+  }
+}
+
+tstatic otrng_result provisioning_generate_forging_key(
+    otrng_provisioning_job_s *job) {
+  uint8_t *sym = otrng_secure_alloc(ED448_PRIVATE_BYTES);
+  otrng_keypair_s *key_pair = otrng_keypair_new();
+  otrng_result result;
+
+  /* Only the public part is kept, as in
+     otrng_global_state_generate_forging_key */
+  gcry_randomize(sym, ED448_PRIVATE_BYTES, GCRY_VERY_STRONG_RANDOM);
+  result = otrng_keypair_generate(key_pair, sym);
+  if (result == OTRNG_SUCCESS) {
+    otrng_ec_point_copy(job->forging_key, key_pair->pub);
+    job->has_forging_key = otrng_true;
+  }
+
+  otrng_secure_free(sym);
+  otrng_keypair_free(key_pair);
+
+  return result;
+}
+
+tstatic otrng_result provisioning_run_job(otrng_provisioning_job_s *job) {
+  ecdh_keypair_s ecdh;
+  dh_keypair_s dh;
+  size_t n;
+
+  if (!job->sym) {
+    job->sym = otrng_secure_alloc(ED448_PRIVATE_BYTES);
+    gcry_randomize(job->sym, ED448_PRIVATE_BYTES, GCRY_VERY_STRONG_RANDOM);
+  }
+
+  job->keypair = otrng_keypair_new();
+  if (!otrng_keypair_generate(job->keypair, job->sym)) {
+    return OTRNG_ERROR;
+  }
+  otrng_secure_free(job->sym);
+  job->sym = NULL;
+
+  if (!job->has_forging_key && !provisioning_generate_forging_key(job)) {
+    return OTRNG_ERROR;
+  }
+
+  if (job->needs_client_profile) {
+    job->client_profile = otrng_client_profile_build(
+        job->instance_tag, PROVISIONING_CLIENT_PROFILE_VERSIONS, job->keypair,
+        job->forging_key, job->client_profile_exp_time);
+    if (!job->client_profile) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  if (job->needs_prekey_profile) {
+    job->prekey_profile =
+        otrng_prekey_profile_build(job->instance_tag, job->keypair);
+    if (!job->prekey_profile) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  if (job->num_prekeys > 0) {
+    job->prekeys =
+        otrng_xmalloc_z(job->num_prekeys * sizeof(prekey_message_s *));
+  }
+
+  for (n = 0; n < job->num_prekeys; n++) {
+    if (!otrng_generate_ephemeral_keys(&ecdh, &dh)) {
+      return OTRNG_ERROR;
+    }
+
+    job->prekeys[n] = otrng_prekey_message_build(job->instance_tag, &ecdh, &dh);
+    otrng_ecdh_keypair_destroy(&ecdh);
+    otrng_dh_keypair_destroy(&dh);
+
+    if (!job->prekeys[n]) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic void *provisioning_worker(void *data) {
+  otrng_provisioning_s *provisioning = data;
+  otrng_provisioning_job_s *job;
+  otrng_result result;
+
+  for (;;) {
+    pthread_mutex_lock(&provisioning->lock);
+
+    while (provisioning->next < provisioning->count &&
+           provisioning->jobs[provisioning->next].done) {
+      provisioning->next++;
+    }
+
+    if (provisioning->stop || provisioning->next == provisioning->count) {
+      pthread_mutex_unlock(&provisioning->lock);
+      return NULL;
+    }
+
+    job = &provisioning->jobs[provisioning->next++];
+    pthread_mutex_unlock(&provisioning->lock);
+
+    result = provisioning_run_job(job);
+
+    pthread_mutex_lock(&provisioning->lock);
+    job->result = result;
+    job->done = otrng_true;
+    provisioning->finished++;
+    pthread_cond_broadcast(&provisioning->finished_one);
+    pthread_mutex_unlock(&provisioning->lock);
+  }
+}
+
+API otrng_provisioning_s *
+otrng_global_state_provision(otrng_global_state_s *gs,
+                             const otrng_client_id_s *client_ids, size_t count,
+                             const otrng_provisioning_options_s *options) {
+  otrng_provisioning_s *provisioning =
+      otrng_xmalloc_z(sizeof(otrng_provisioning_s));
+  size_t workers = options->workers > 0 ? options->workers : 1;
+  size_t n;
+
+  provisioning->gs = gs;
+  provisioning->count = count;
+  pthread_mutex_init(&provisioning->lock, NULL);
+  pthread_cond_init(&provisioning->finished_one, NULL);
+
+  if (count > 0) {
+    provisioning->jobs =
+        otrng_xmalloc_z(count * sizeof(otrng_provisioning_job_s));
+  }
+
+  /* Getting the clients and their instance tags uses the global state, so it
+     is done here */
+  for (n = 0; n < count; n++) {
+    provisioning_prepare_job(&provisioning->jobs[n], gs, client_ids[n],
+                             options->prekey_messages);
+    if (provisioning->jobs[n].done) {
+      provisioning->finished++;
+    }
+  }
+
+  if (workers > count - provisioning->finished) {
+    workers = count - provisioning->finished;
+  }
+
+  if (workers > 0) {
+    provisioning->workers = otrng_xmalloc_z(workers * sizeof(pthread_t));
+  }
+
+  for (n = 0; n < workers; n++) {
+    if (pthread_create(&provisioning->workers[n], NULL, provisioning_worker,
+                       provisioning) != 0) {
+      break;
+    }
+    provisioning->num_workers++;
+  }
+
+  if (workers > 0 && provisioning->num_workers == 0) {
+    otrng_provisioning_free(provisioning);
+    return NULL;
+  }
+
+  return provisioning;
+}
+
+tstatic otrng_result provisioning_install_job(otrng_provisioning_job_s *job,
+                                              otrng_client_s *client) {
+  size_t n;
+
+  if (!client) {
+    return OTRNG_ERROR;
+  }
+
+  /* What was signed needs the keys it was signed with */
+  if (client->keypair && memcmp(client->keypair->sym, job->keypair->sym,
+                                ED448_PRIVATE_BYTES) != 0) {
+    return OTRNG_ERROR;
+  }
+
+  if (client->forging_key &&
+      !otrng_ec_point_eq(*client->forging_key, job->forging_key)) {
+    return OTRNG_ERROR;
+  }
+
+  if (!client->keypair) {
+    client->keypair = job->keypair;
+    job->keypair = NULL;
+  }
+
+  if (!client->forging_key &&
+      !otrng_client_add_forging_key(client, job->forging_key)) {
+    return OTRNG_ERROR;
+  }
+
+  if (job->client_profile && !client->client_profile) {
+    if (!otrng_client_add_client_profile(client, job->client_profile)) {
+      return OTRNG_ERROR;
+    }
+    client->client_profile->should_publish = otrng_true;
+    client->should_publish = otrng_true;
+  }
+
+  if (job->prekey_profile && !client->prekey_profile) {
+    if (!otrng_client_add_prekey_profile(client, job->prekey_profile)) {
+      return OTRNG_ERROR;
+    }
+    client->prekey_profile->should_publish = otrng_true;
+    client->should_publish = otrng_true;
+  }
+
+  for (n = 0; n < job->num_prekeys; n++) {
+    job->prekeys[n]->should_publish = otrng_true;
+    otrng_client_store_my_prekey_message(job->prekeys[n], client);
+    job->prekeys[n] = NULL;
+    client->should_publish = otrng_true;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+API size_t otrng_provisioning_collect(otrng_provisioning_s *provisioning,
+                                      size_t budget) {
+  otrng_provisioning_job_s *job;
+  size_t collected = 0;
+  otrng_bool done;
+
+  while (collected < budget && provisioning->collected < provisioning->count) {
+    job = &provisioning->jobs[provisioning->collected];
+
+    pthread_mutex_lock(&provisioning->lock);
+    done = job->done;
+    pthread_mutex_unlock(&provisioning->lock);
+
+    if (!done) {
+      break;
+    }
+
+    if (job->result == OTRNG_SUCCESS) {
+      job->result = provisioning_install_job(
+          job, otrng_client_get(provisioning->gs, job->client_id));
+    }
+    provisioning_job_destroy(job);
+
+    provisioning->collected++;
+    collected++;
+  }
+
+  return collected;
+}
+
+API void otrng_provisioning_wait(otrng_provisioning_s *provisioning) {
+  while (provisioning->collected < provisioning->count) {
+    pthread_mutex_lock(&provisioning->lock);
+    while (!provisioning->jobs[provisioning->collected].done) {
+      pthread_cond_wait(&provisioning->finished_one, &provisioning->lock);
+    }
+    pthread_mutex_unlock(&provisioning->lock);
+
+    otrng_provisioning_collect(provisioning, provisioning->count);
+  }
+}
+
+API otrng_bool
+otrng_provisioning_is_done(const otrng_provisioning_s *provisioning) {
+  return provisioning->collected == provisioning->count;
+}
+
+API otrng_result otrng_provisioning_get_result(
+    const otrng_provisioning_s *provisioning, size_t n) {
+  if (n >= provisioning->collected) {
+    return OTRNG_ERROR;
+  }
+
+  return provisioning->jobs[n].result;
+}
+
+API void otrng_provisioning_free(otrng_provisioning_s *provisioning) {
+  size_t n;
+
+  if (!provisioning) {
+    return;
+  }
+
+  pthread_mutex_lock(&provisioning->lock);
+  provisioning->stop = otrng_true;
+  pthread_mutex_unlock(&provisioning->lock);
+
+  for (n = 0; n < provisioning->num_workers; n++) {
+    pthread_join(provisioning->workers[n], NULL);
+  }
+
+  for (n = provisioning->collected; n < provisioning->count; n++) {
+    provisioning_job_destroy(&provisioning->jobs[n]);
+  }
+
+  pthread_cond_destroy(&provisioning->finished_one);
+  pthread_mutex_destroy(&provisioning->lock);
+  otrng_free(provisioning->workers);
+  otrng_free(provisioning->jobs);
+  otrng_free(provisioning);
+}
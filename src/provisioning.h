@@ -0,0 +1,153 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_PROVISIONING_H
+#define OTRNG_PROVISIONING_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "client_profile.h"
+#include "error.h"
+#include "keys.h"
+#include "messaging.h"
+#include "prekey_message.h"
+#include "prekey_profile.h"
+#include "shared.h"
+
+typedef struct otrng_provisioning_options_s {
+  size_t workers;          /* threads doing the work, at least one */
+  uint8_t prekey_messages; /* to generate for every account */
+} otrng_provisioning_options_s;
+
+/* The long-term state of one account, generated by a worker */
+typedef struct otrng_provisioning_job_s {
+  otrng_client_id_s client_id;
+  uint32_t instance_tag;
+  unsigned int client_profile_exp_time;
+
+  /* The private key the account has, or NULL to generate one */
+  uint8_t *sym; /* secure memory */
+  /* The forging key the account has, if [has_forging_key] */
+  otrng_public_key forging_key;
+  otrng_bool has_forging_key;
+  otrng_bool needs_client_profile;
+  otrng_bool needs_prekey_profile;
+
+  otrng_keypair_s *keypair;
+  otrng_client_profile_s *client_profile;
+  otrng_prekey_profile_s *prekey_profile;
+  prekey_message_s **prekeys;
+  size_t num_prekeys;
+
+  otrng_result result;
+  otrng_bool done;
+} otrng_provisioning_job_s;
+
+/*
+ * Generates the long-term state of many accounts on a pool of worker
+ * threads. The workers only read what was copied into the jobs, and what
+ * they generate is added to the clients by otrng_provisioning_collect, on the
+ * thread that uses the global state.
+ */
+typedef struct otrng_provisioning_s {
+  otrng_global_state_s *gs;
+
+  pthread_mutex_t lock;
+  pthread_cond_t finished_one;
+  otrng_provisioning_job_s *jobs;
+  size_t count;
+  size_t next;      /* the next job for a worker */
+  size_t finished;  /* jobs done by the workers */
+  size_t collected; /* jobs added to their clients, in order */
+  otrng_bool stop;
+
+  pthread_t *workers;
+  size_t num_workers;
+} otrng_provisioning_s;
+
+/**
+ * @brief Starts generating what the accounts in [client_ids] do not have yet,
+ * on the workers: a private key, a forging key, a client profile and a prekey
+ * profile, and always the number of prekey messages of [options]. The
+ * clients are got, and their instance tags created, before it returns.
+ *
+ * Other clients can be used in the meantime. A client that gets a private or
+ * forging key in some other way before it is collected fails to be
+ * provisioned, as what was signed with the old ones would not be valid.
+ *
+ * @param [client_ids]   The accounts. They must outlive the provisioning, as
+ *                       for otrng_client_get.
+ *
+ * @return The provisioning, to collect and then free, or NULL if the workers
+ *         could not be started.
+ */
+API otrng_provisioning_s *
+otrng_global_state_provision(otrng_global_state_s *gs,
+                             const otrng_client_id_s *client_ids, size_t count,
+                             const otrng_provisioning_options_s *options);
+
+/**
+ * @brief Adds what the workers generated to the clients, for up to [budget]
+ * accounts, in the order they were given. It does not wait for the workers,
+ * so it can be called from the main loop. Nothing is written to the disk:
+ * the prekey messages go to the prekey journal, if there is one, and the
+ * rest is written with the rest of the state of the clients. What was
+ * generated is marked to be published.
+ *
+ * @return The number of accounts collected.
+ */
+API size_t otrng_provisioning_collect(otrng_provisioning_s *provisioning,
+                                      size_t budget);
+
+/* Waits for the workers, and collects every account that is left */
+API void otrng_provisioning_wait(otrng_provisioning_s *provisioning);
+
+/* Whether every account was collected */
+API otrng_bool
+otrng_provisioning_is_done(const otrng_provisioning_s *provisioning);
+
+/**
+ * @brief The result of the account [n], once it was collected. It is an
+ * error if the client could not be got, generating failed, or the client
+ * changed keys in the meantime.
+ */
+API otrng_result otrng_provisioning_get_result(
+    const otrng_provisioning_s *provisioning, size_t n);
+
+/**
+ * @brief Stops the workers after the account each is working on, and frees
+ * what was not collected.
+ */
+API void otrng_provisioning_free(otrng_provisioning_s *provisioning);
+
+#ifdef OTRNG_PROVISIONING_PRIVATE
+
+tstatic otrng_result provisioning_run_job(otrng_provisioning_job_s *job);
+
+tstatic void *provisioning_worker(void *data);
+
+tstatic otrng_result provisioning_install_job(otrng_provisioning_job_s *job,
+                                              otrng_client_s *client);
+
+#endif
+
+#endif
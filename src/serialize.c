@@ -174,26 +174,37 @@ INTERNAL size_t otrng_serialize_ring_sig(uint8_t *dst,
   return cursor - dst;
 }
 
-INTERNAL uint8_t *otrng_serialize_old_mac_keys(list_element_s *old_mac_keys) {
+INTERNAL size_t otrng_serialize_old_mac_keys_into(
+    uint8_t *dst, list_element_s *old_mac_keys) {
   size_t num_mac_keys = otrng_list_len(old_mac_keys);
-  size_t serlen = num_mac_keys * MAC_KEY_BYTES;
+  const list_element_s *current;
+  size_t i = num_mac_keys;
+
+  /* The list is oldest first, but the keys are revealed newest first */
+  for (current = old_mac_keys; current; current = current->next) {
+    if (!current->data) {
+      continue;
+    }
+    i--;
+    memcpy(dst + i * MAC_KEY_BYTES, current->data, MAC_KEY_BYTES);
+  }
+
+  otrng_list_free(old_mac_keys, otrng_secure_slab_free);
+
+  return num_mac_keys * MAC_KEY_BYTES;
+}
+
+INTERNAL uint8_t *otrng_serialize_old_mac_keys(list_element_s *old_mac_keys) {
+  size_t serlen = otrng_list_len(old_mac_keys) * MAC_KEY_BYTES;
   uint8_t *ser_mac_keys;
-  unsigned int i;
 
   if (serlen == 0) {
+    otrng_list_free_nodes(old_mac_keys);
     return NULL;
   }
 
   ser_mac_keys = otrng_xmalloc(serlen);
-
-  for (i = 0; i < num_mac_keys; i++) {
-    list_element_s *last = otrng_list_get_last(old_mac_keys);
-    memcpy(ser_mac_keys + i * MAC_KEY_BYTES, last->data, MAC_KEY_BYTES);
-    old_mac_keys = otrng_list_remove_element(last, old_mac_keys);
-    otrng_list_free(last, otrng_secure_free);
-  }
-
-  otrng_list_free_nodes(old_mac_keys);
+  otrng_serialize_old_mac_keys_into(ser_mac_keys, old_mac_keys);
 
   return ser_mac_keys;
 }
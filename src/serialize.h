@@ -90,6 +90,19 @@ INTERNAL size_t otrng_serialize_shared_prekey(
  */
 INTERNAL uint8_t *otrng_serialize_old_mac_keys(list_element_s *old_mac_keys);
 
+/**
+ * @brief Serialize the old mac keys to reveal, newest first, into [dst] and
+ *        free the list.
+ *
+ * @param [dst]            The destination. Must hold
+ *                         otrng_list_len(old_mac_keys) * MAC_KEY_BYTES.
+ * @param [old_mac_keys]   The list of old mac keys.
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_serialize_old_mac_keys_into(
+    uint8_t *dst, list_element_s *old_mac_keys);
+
 INTERNAL size_t otrng_serialize_phi(uint8_t *dst,
                                     const char *shared_session_state,
                                     const char *init_msg,
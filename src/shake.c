@@ -22,9 +22,22 @@
 
 #include "shake.h"
 
+/* Every usage ID in the protocol is below this */
+#define CACHED_USAGES 0x20
+
+/* The states after absorbing "OTRv4", and "OTRv4" || usageID */
+static goldilocks_shake256_ctx_p domain_midstate;
+static goldilocks_shake256_ctx_p usage_midstates[CACHED_USAGES];
+static otrng_bool midstates_cached = otrng_false;
+
 tstatic otrng_result hash_init_with_dom(goldilocks_shake256_ctx_p hd) {
   const char *domain = "OTRv4";
 
+  if (midstates_cached) {
+    memcpy(hd, domain_midstate, sizeof(goldilocks_shake256_ctx_p));
+    return OTRNG_SUCCESS;
+  }
+
   hash_init(hd);
   if (hash_update(hd, (const unsigned char *)domain, strlen(domain)) ==
       GOLDILOCKS_FAILURE) {
@@ -66,6 +79,11 @@ hash_init_with_usage_prekey_server(goldilocks_shake256_ctx_p hash,
 }
 
 otrng_result hash_init_with_usage(goldilocks_shake256_ctx_p hd, uint8_t usage) {
+  if (midstates_cached && usage < CACHED_USAGES) {
+    memcpy(hd, usage_midstates[usage], sizeof(goldilocks_shake256_ctx_p));
+    return OTRNG_SUCCESS;
+  }
+
   if (!hash_init_with_dom(hd)) {
     return OTRNG_ERROR;
   }
@@ -78,6 +96,28 @@ otrng_result hash_init_with_usage(goldilocks_shake256_ctx_p hd, uint8_t usage) {
   return OTRNG_SUCCESS;
 }
 
+otrng_result shake_256_cache_midstates(void) {
+  uint8_t usage;
+
+  if (midstates_cached) {
+    return OTRNG_SUCCESS;
+  }
+
+  if (!hash_init_with_dom(domain_midstate)) {
+    return OTRNG_ERROR;
+  }
+
+  for (usage = 0; usage < CACHED_USAGES; usage++) {
+    if (!hash_init_with_usage(usage_midstates[usage], usage)) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  midstates_cached = otrng_true;
+
+  return OTRNG_SUCCESS;
+}
+
 otrng_result shake_kkdf(uint8_t *dst, size_t dst_len, const uint8_t *key,
                         size_t key_len, const uint8_t *secret,
                         size_t secret_len) {
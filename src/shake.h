@@ -38,6 +38,11 @@ hash_init_with_usage_and_domain_separation(goldilocks_shake256_ctx_p hash,
 otrng_result hash_init_with_usage(goldilocks_shake256_ctx_p hash,
                                   uint8_t usage);
 
+/* Precomputes the states every "OTRv4" hash starts from, so that the
+   functions above copy them instead of absorbing the domain and usage ID each
+   time. Called by otrng_init, before any other thread can hash. */
+otrng_result shake_256_cache_midstates(void);
+
 otrng_result shake_kkdf(uint8_t *dst, size_t dst_len, const uint8_t *key,
                         size_t key_len, const uint8_t *secret,
                         size_t secret_len);
@@ -0,0 +1,224 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+
+#define OTRNG_SKIPPED_KEYS_PRIVATE
+
+#include "alloc.h"
+#include "skipped_keys.h"
+
+#define SKIPPED_KEYS_INITIAL_BUCKETS 16
+
+tstatic size_t skipped_keys_bucket(const skipped_keys_table_s *table,
+                                   uint32_t i, uint32_t j) {
+  uint32_t h = (i * 0x9E3779B1u) ^ (j * 0x85EBCA6Bu);
+  h ^= h >> 16;
+
+  return h & (table->num_buckets - 1);
+}
+
+INTERNAL skipped_keys_table_s *otrng_skipped_keys_table_new(void) {
+  skipped_keys_table_s *table = otrng_xmalloc_z(sizeof(skipped_keys_table_s));
+
+  table->num_buckets = SKIPPED_KEYS_INITIAL_BUCKETS;
+  table->buckets =
+      otrng_xmalloc_z(table->num_buckets * sizeof(skipped_keys_s *));
+
+  return table;
+}
+
+static void skipped_keys_entry_free(skipped_keys_s *entry) {
+  otrng_secure_slab_free(entry);
+}
+
+INTERNAL void otrng_skipped_keys_table_clear(skipped_keys_table_s *table) {
+  skipped_keys_s *current;
+
+  if (!table) {
+    return;
+  }
+
+  current = table->oldest;
+  while (current) {
+    skipped_keys_s *next = current->newer;
+    skipped_keys_entry_free(current);
+    current = next;
+  }
+
+  memset(table->buckets, 0, table->num_buckets * sizeof(skipped_keys_s *));
+  table->len = 0;
+  table->oldest = NULL;
+  table->newest = NULL;
+}
+
+INTERNAL void otrng_skipped_keys_table_free(skipped_keys_table_s *table) {
+  if (!table) {
+    return;
+  }
+
+  otrng_skipped_keys_table_clear(table);
+  otrng_free(table->buckets);
+  otrng_free(table);
+}
+
+static void skipped_keys_table_grow(skipped_keys_table_s *table) {
+  size_t num_buckets = table->num_buckets * 2;
+  skipped_keys_s *current;
+
+  otrng_free(table->buckets);
+  table->num_buckets = num_buckets;
+  table->buckets = otrng_xmalloc_z(num_buckets * sizeof(skipped_keys_s *));
+
+  for (current = table->oldest; current; current = current->newer) {
+    size_t b = skipped_keys_bucket(table, current->i, current->j);
+    current->bucket_next = table->buckets[b];
+    table->buckets[b] = current;
+  }
+}
+
+INTERNAL skipped_keys_s *
+otrng_skipped_keys_table_add(skipped_keys_table_s *table, uint32_t i,
+                             uint32_t j, const uint8_t *enc_key,
+                             const uint8_t *extra_key) {
+  skipped_keys_s *entry;
+  size_t b;
+
+  if (table->len >= table->num_buckets) {
+    skipped_keys_table_grow(table);
+  }
+
+  /*
+     @secret: should be deleted when:
+     1. session expired
+     2. the key is retrieved
+  */
+  entry = otrng_secure_slab_alloc(sizeof(skipped_keys_s));
+  entry->i = i;
+  entry->j = j;
+  memcpy(entry->enc_key, enc_key, ENC_KEY_BYTES);
+  memcpy(entry->extra_symmetric_key, extra_key, EXTRA_SYMMETRIC_KEY_BYTES);
+
+  b = skipped_keys_bucket(table, i, j);
+  entry->bucket_next = table->buckets[b];
+  table->buckets[b] = entry;
+
+  entry->older = table->newest;
+  entry->newer = NULL;
+  if (table->newest) {
+    table->newest->newer = entry;
+  } else {
+    table->oldest = entry;
+  }
+  table->newest = entry;
+  table->len++;
+
+  return entry;
+}
+
+INTERNAL skipped_keys_s *
+otrng_skipped_keys_table_get(const skipped_keys_table_s *table, uint32_t i,
+                             uint32_t j) {
+  skipped_keys_s *current;
+
+  if (!table || table->len == 0) {
+    return NULL;
+  }
+
+  current = table->buckets[skipped_keys_bucket(table, i, j)];
+  while (current) {
+    if (current->i == i && current->j == j) {
+      return current;
+    }
+    current = current->bucket_next;
+  }
+
+  return NULL;
+}
+
+INTERNAL void otrng_skipped_keys_table_remove(skipped_keys_table_s *table,
+                                              skipped_keys_s *entry) {
+  skipped_keys_s **cursor =
+      &table->buckets[skipped_keys_bucket(table, entry->i, entry->j)];
+
+  while (*cursor && *cursor != entry) {
+    cursor = &(*cursor)->bucket_next;
+  }
+
+  if (*cursor) {
+    *cursor = entry->bucket_next;
+  }
+
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    table->oldest = entry->newer;
+  }
+
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    table->newest = entry->older;
+  }
+
+  table->len--;
+  skipped_keys_entry_free(entry);
+}
+
+INTERNAL void
+otrng_skipped_keys_table_remove_newest(skipped_keys_table_s *table,
+                                       size_t count) {
+  while (count > 0 && table->newest) {
+    otrng_skipped_keys_table_remove(table, table->newest);
+    count--;
+  }
+}
+
+INTERNAL size_t otrng_skipped_keys_table_evict(skipped_keys_table_s *table,
+                                               size_t max_keys) {
+  size_t evicted = 0;
+
+  while (table->len > max_keys) {
+    /* Drop every key of the generation the oldest entry belongs to */
+    uint32_t generation = table->oldest->i;
+    skipped_keys_s *current = table->oldest;
+
+    while (current) {
+      skipped_keys_s *next = current->newer;
+      if (current->i == generation) {
+        otrng_skipped_keys_table_remove(table, current);
+        evicted++;
+      }
+      current = next;
+    }
+  }
+
+  return evicted;
+}
+
+INTERNAL size_t
+otrng_skipped_keys_table_len(const skipped_keys_table_s *table) {
+  if (!table) {
+    return 0;
+  }
+
+  return table->len;
+}
@@ -0,0 +1,158 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OTRNG_SKIPPED_KEYS_H
+#define OTRNG_SKIPPED_KEYS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "error.h"
+#include "shared.h"
+
+/* a stored message and extra symmetric key */
+typedef struct skipped_keys_s {
+  uint32_t i; /* Counter of the ratchet */
+  uint32_t j; /* Counter of the sending messages */
+  uint8_t extra_symmetric_key[EXTRA_SYMMETRIC_KEY_BYTES];
+  uint8_t enc_key[ENC_KEY_BYTES];
+
+  /* the next entry in the same hash bucket */
+  struct skipped_keys_s *bucket_next;
+
+  /* the neighbours in insertion order, used for eviction and iteration */
+  struct skipped_keys_s *older;
+  struct skipped_keys_s *newer;
+} skipped_keys_s;
+
+/*
+ * The skipped message keys, indexed by (ratchet_id, message_id).
+ *
+ * Lookup and removal are O(1) on average. Entries are also kept in insertion
+ * order, so the oldest ratchet generations can be evicted in bulk and the
+ * keys can be revealed in a stable order.
+ */
+typedef struct skipped_keys_table_s {
+  skipped_keys_s **buckets;
+  size_t num_buckets; /* always a power of two */
+  size_t len;
+
+  skipped_keys_s *oldest;
+  skipped_keys_s *newest;
+} skipped_keys_table_s;
+
+/**
+ * @brief Creates a new empty skipped keys table.
+ *
+ * @return A new table [skipped_keys_table_s].
+ */
+INTERNAL skipped_keys_table_s *otrng_skipped_keys_table_new(void);
+
+/**
+ * @brief Securely wipes and frees every entry, and the table itself.
+ *
+ * @param [table]   The table.
+ */
+INTERNAL void otrng_skipped_keys_table_free(skipped_keys_table_s *table);
+
+/**
+ * @brief Securely wipes and frees every entry, keeping the table.
+ *
+ * @param [table]   The table.
+ */
+INTERNAL void otrng_skipped_keys_table_clear(skipped_keys_table_s *table);
+
+/**
+ * @brief Stores a skipped message key as the newest entry of the table.
+ *
+ * @param [table]       The table.
+ * @param [i]           The ratchet id.
+ * @param [j]           The message id.
+ * @param [enc_key]     The message encryption key (ENC_KEY_BYTES).
+ * @param [extra_key]   The extra symmetric key (EXTRA_SYMMETRIC_KEY_BYTES).
+ *
+ * @return The stored entry [skipped_keys_s].
+ */
+INTERNAL skipped_keys_s *
+otrng_skipped_keys_table_add(skipped_keys_table_s *table, uint32_t i,
+                             uint32_t j, const uint8_t *enc_key,
+                             const uint8_t *extra_key);
+
+/**
+ * @brief Finds the stored keys for a (ratchet_id, message_id) pair.
+ *
+ * @param [table]   The table.
+ * @param [i]       The ratchet id.
+ * @param [j]       The message id.
+ *
+ * @return The entry [skipped_keys_s], or NULL if it was not skipped.
+ */
+INTERNAL skipped_keys_s *
+otrng_skipped_keys_table_get(const skipped_keys_table_s *table, uint32_t i,
+                             uint32_t j);
+
+/**
+ * @brief Unlinks, securely wipes and frees an entry of the table.
+ *
+ * @param [table]   The table.
+ * @param [entry]   The entry to remove.
+ */
+INTERNAL void otrng_skipped_keys_table_remove(skipped_keys_table_s *table,
+                                              skipped_keys_s *entry);
+
+/**
+ * @brief Removes the newest entries of the table.
+ *
+ * @param [table]   The table.
+ * @param [count]   The number of entries to remove.
+ */
+INTERNAL void
+otrng_skipped_keys_table_remove_newest(skipped_keys_table_s *table,
+                                       size_t count);
+
+/**
+ * @brief Evicts whole ratchet generations, oldest first, until at most
+ *        [max_keys] entries are stored.
+ *
+ * @param [table]      The table.
+ * @param [max_keys]   The maximum number of entries to keep.
+ *
+ * @return The number of evicted entries.
+ */
+INTERNAL size_t otrng_skipped_keys_table_evict(skipped_keys_table_s *table,
+                                               size_t max_keys);
+
+/**
+ * @brief The number of stored entries.
+ *
+ * @param [table]   The table.
+ */
+INTERNAL size_t otrng_skipped_keys_table_len(const skipped_keys_table_s *table);
+
+#ifdef OTRNG_SKIPPED_KEYS_PRIVATE
+
+tstatic size_t skipped_keys_bucket(const skipped_keys_table_s *table,
+                                   uint32_t i, uint32_t j);
+
+#endif
+
+#endif
@@ -39,6 +39,34 @@ INTERNAL void otrng_smp_protocol_init(smp_protocol_s *smp) {
   smp->progress = SMP_ZERO_PROGRESS;
 }
 
+/* G2 and G3 are each multiplied three times by this side of the protocol,
+   and a precomputed table makes up for itself on the second time. The size
+   of a table is a multiple of its alignment, which is what sodium_malloc
+   needs to return an aligned one. */
+static void free_session_tables(smp_protocol_s *smp) {
+  if (smp->g2_table) {
+    goldilocks_448_precomputed_destroy(smp->g2_table);
+    otrng_secure_free(smp->g2_table);
+    smp->g2_table = NULL;
+  }
+
+  if (smp->g3_table) {
+    goldilocks_448_precomputed_destroy(smp->g3_table);
+    otrng_secure_free(smp->g3_table);
+    smp->g3_table = NULL;
+  }
+}
+
+static void precompute_session_tables(smp_protocol_s *smp) {
+  free_session_tables(smp);
+
+  smp->g2_table = otrng_secure_alloc(goldilocks_448_sizeof_precomputed_s);
+  goldilocks_448_precompute(smp->g2_table, smp->g2);
+
+  smp->g3_table = otrng_secure_alloc(goldilocks_448_sizeof_precomputed_s);
+  goldilocks_448_precompute(smp->g3_table, smp->g3);
+}
+
 INTERNAL void otrng_smp_destroy(smp_protocol_s *smp) {
   otrng_secure_free(smp->secret);
   smp->secret = NULL;
@@ -59,6 +87,8 @@ INTERNAL void otrng_smp_destroy(smp_protocol_s *smp) {
   otrng_ec_point_destroy(smp->qb);
   otrng_ec_point_destroy(smp->pa_pb);
   otrng_ec_point_destroy(smp->qa_qb);
+
+  free_session_tables(smp);
 }
 
 INTERNAL otrng_result otrng_generate_smp_secret(unsigned char **secret,
@@ -301,16 +331,16 @@ tstatic otrng_bool smp_message_1_valid_points(smp_message_1_s *msg) {
 
 tstatic otrng_bool smp_message_1_valid_zkp(smp_message_1_s *msg) {
   ec_scalar temp_scalar;
-  ec_point ga_c, g_d;
+  ec_point g_d;
   uint8_t ser_point_3[ED448_POINT_BYTES];
   uint8_t usage_zkp_smp_1 = 0x01;
   uint8_t usage_zkp_smp_2 = 0x02;
   uint8_t ser_point_4[ED448_POINT_BYTES];
 
-  /* Check that c2 = hash_to_scalar(1 || G * d2 + G2a * c2). */
-  goldilocks_448_point_scalarmul(ga_c, msg->g2a, msg->c2);
-  goldilocks_448_point_scalarmul(g_d, goldilocks_448_point_base, msg->d2);
-  goldilocks_448_point_add(g_d, g_d, ga_c);
+  /* Check that c2 = hash_to_scalar(1 || G * d2 + G2a * c2). Everything in
+     this proof is public, so it can be checked in variable time. */
+  goldilocks_448_base_double_scalarmul_non_secret(g_d, msg->d2, msg->g2a,
+                                                  msg->c2);
 
   if (otrng_serialize_ec_point(ser_point_3, g_d) != ED448_POINT_BYTES) {
     return otrng_false;
@@ -328,9 +358,8 @@ tstatic otrng_bool smp_message_1_valid_zkp(smp_message_1_s *msg) {
   otrng_secure_wipe(temp_scalar, ED448_SCALAR_BYTES);
 
   /* Check that c3 = hash_to_scalar(2 || G * d3 + G3a * c3). */
-  goldilocks_448_point_scalarmul(ga_c, msg->g3a, msg->c3);
-  goldilocks_448_point_scalarmul(g_d, goldilocks_448_point_base, msg->d3);
-  goldilocks_448_point_add(g_d, g_d, ga_c);
+  goldilocks_448_base_double_scalarmul_non_secret(g_d, msg->d3, msg->g3a,
+                                                  msg->c3);
 
   if (otrng_serialize_ec_point(ser_point_4, g_d) != ED448_POINT_BYTES) {
     return otrng_false;
@@ -431,8 +460,10 @@ tstatic otrng_result generate_smp_message_2(smp_message_2_s *dst,
   goldilocks_448_point_scalarmul(smp->g3, msg_1->g3a, smp->b3);
   otrng_ec_point_copy(smp->g3a, msg_1->g3a);
 
+  precompute_session_tables(smp);
+
   /* Compute Pb = (G3 * r4). */
-  goldilocks_448_point_scalarmul(dst->pb, smp->g3, pair_r4.priv);
+  goldilocks_448_precomputed_scalarmul(dst->pb, smp->g3_table, pair_r4.priv);
   otrng_ec_point_copy(smp->pb, dst->pb);
 
   /* Compute Qb = (G * r4 + G2 * (y mod q)). */
@@ -441,17 +472,19 @@ tstatic otrng_result generate_smp_message_2(smp_message_2_s *dst,
     return OTRNG_ERROR;
   }
 
-  goldilocks_448_point_scalarmul(dst->qb, smp->g2, secret_as_scalar);
+  goldilocks_448_precomputed_scalarmul(dst->qb, smp->g2_table,
+                                       secret_as_scalar);
   goldilocks_448_point_add(dst->qb, pair_r4.pub, dst->qb);
   otrng_ec_point_copy(smp->qb, dst->qb);
 
   /* cp = HashToScalar(5 || G3 * r5 || G * r5 + G2 * r6) */
-  goldilocks_448_point_scalarmul(temp_point, smp->g3, pair_r5.priv);
+  goldilocks_448_precomputed_scalarmul(temp_point, smp->g3_table,
+                                       pair_r5.priv);
   if (otrng_serialize_ec_point(ser_point_3, temp_point) != ED448_POINT_BYTES) {
     return OTRNG_ERROR;
   }
 
-  goldilocks_448_point_scalarmul(temp_point, smp->g2, r6);
+  goldilocks_448_precomputed_scalarmul(temp_point, smp->g2_table, r6);
   goldilocks_448_point_add(temp_point, pair_r5.pub, temp_point);
 
   if (otrng_serialize_ec_point(ser_point_4, temp_point) != ED448_POINT_BYTES) {
@@ -612,7 +645,7 @@ tstatic otrng_bool smp_message_2_valid_points(smp_message_2_s *msg) {
 tstatic otrng_bool smp_message_2_valid_zkp(smp_message_2_s *msg,
                                            const smp_protocol_s *smp) {
   ec_scalar temp_scalar;
-  ec_point gb_c, g_d, point_cp;
+  ec_point g_d, point_cp;
   uint8_t ser_point_1[ED448_POINT_BYTES];
   uint8_t usage_zkp_smp_3 = 0x03;
   uint8_t ser_point_2[ED448_POINT_BYTES];
@@ -624,9 +657,8 @@ tstatic otrng_bool smp_message_2_valid_zkp(smp_message_2_s *msg,
   uint8_t usage_zkp_smp_5 = 0x05;
 
   /* Check that c2 = HashToScalar(3 || G * d2 + G2b * c2). */
-  goldilocks_448_point_scalarmul(gb_c, msg->g2b, msg->c2);
-  goldilocks_448_point_scalarmul(g_d, goldilocks_448_point_base, msg->d2);
-  goldilocks_448_point_add(g_d, g_d, gb_c);
+  goldilocks_448_base_double_scalarmul_non_secret(g_d, msg->d2, msg->g2b,
+                                                  msg->c2);
 
   if (otrng_serialize_ec_point(ser_point_1, g_d) != ED448_POINT_BYTES) {
     return otrng_false;
@@ -644,9 +676,8 @@ tstatic otrng_bool smp_message_2_valid_zkp(smp_message_2_s *msg,
   otrng_secure_wipe(temp_scalar, ED448_SCALAR_BYTES);
 
   /* c3 = HashToScalar(4 || G * d3 + G3b * c3). */
-  goldilocks_448_point_scalarmul(gb_c, msg->g3b, msg->c3);
-  goldilocks_448_point_scalarmul(g_d, goldilocks_448_point_base, msg->d3);
-  goldilocks_448_point_add(g_d, g_d, gb_c);
+  goldilocks_448_base_double_scalarmul_non_secret(g_d, msg->d3, msg->g3b,
+                                                  msg->c3);
 
   if (otrng_serialize_ec_point(ser_point_2, g_d) != ED448_POINT_BYTES) {
     return otrng_false;
@@ -664,19 +695,18 @@ tstatic otrng_bool smp_message_2_valid_zkp(smp_message_2_s *msg,
   otrng_secure_wipe(temp_scalar, ED448_SCALAR_BYTES);
 
   /* cp = HashToScalar(5 || G3 * d5 + Pb * cp || G * d5 + G2 * d6 +
-   Qb * cp) */
+   Qb * cp). G2 and G3 are secret, and only go through their tables. */
   goldilocks_448_point_scalarmul(point_cp, msg->pb, msg->cp);
-  goldilocks_448_point_scalarmul(g_d, smp->g3, msg->d5);
+  goldilocks_448_precomputed_scalarmul(g_d, smp->g3_table, msg->d5);
   goldilocks_448_point_add(g_d, g_d, point_cp);
 
   if (otrng_serialize_ec_point(ser_point_3, g_d) != ED448_POINT_BYTES) {
     return otrng_false;
   }
 
-  goldilocks_448_point_scalarmul(point_cp, msg->qb, msg->cp);
-  goldilocks_448_point_scalarmul(g_d, smp->g2, msg->d6);
-  goldilocks_448_point_add(g_d, g_d, point_cp);
-  goldilocks_448_point_scalarmul(point_cp, goldilocks_448_point_base, msg->d5);
+  goldilocks_448_base_double_scalarmul_non_secret(point_cp, msg->d5, msg->qb,
+                                                  msg->cp);
+  goldilocks_448_precomputed_scalarmul(g_d, smp->g2_table, msg->d6);
   goldilocks_448_point_add(g_d, g_d, point_cp);
 
   if (otrng_serialize_ec_point(ser_point_4, g_d) != ED448_POINT_BYTES) {
@@ -753,7 +783,7 @@ tstatic otrng_result generate_smp_message_3(smp_message_3_s *dst,
   otrng_ec_point_copy(smp->g3b, msg_2->g3b);
 
   /* Pa = (G3 * r4) */
-  goldilocks_448_point_scalarmul(dst->pa, smp->g3, pair_r4.priv);
+  goldilocks_448_precomputed_scalarmul(dst->pa, smp->g3_table, pair_r4.priv);
   goldilocks_448_point_sub(smp->pa_pb, dst->pa, msg_2->pb);
 
   /* Qa = G * r4 + G2 * (x mod q)) */
@@ -761,17 +791,19 @@ tstatic otrng_result generate_smp_message_3(smp_message_3_s *dst,
     return OTRNG_ERROR;
   }
 
-  goldilocks_448_point_scalarmul(dst->qa, smp->g2, secret_as_scalar);
+  goldilocks_448_precomputed_scalarmul(dst->qa, smp->g2_table,
+                                       secret_as_scalar);
   goldilocks_448_point_add(dst->qa, pair_r4.pub, dst->qa);
 
   /* cp = HashToScalar(6 || G3 * r5 || G * r5 + G2 * r6) */
-  goldilocks_448_point_scalarmul(temp_point, smp->g3, pair_r5.priv);
+  goldilocks_448_precomputed_scalarmul(temp_point, smp->g3_table,
+                                       pair_r5.priv);
 
   if (otrng_serialize_ec_point(ser_point_1, temp_point) != ED448_POINT_BYTES) {
     return OTRNG_ERROR;
   }
 
-  goldilocks_448_point_scalarmul(temp_point, smp->g2, r6);
+  goldilocks_448_precomputed_scalarmul(temp_point, smp->g2_table, r6);
   goldilocks_448_point_add(temp_point, pair_r5.pub, temp_point);
 
   if (otrng_serialize_ec_point(ser_point_2, temp_point) != ED448_POINT_BYTES) {
@@ -962,18 +994,16 @@ tstatic otrng_bool smp_message_3_validate_zkp(smp_message_3_s *msg,
 
   /* cp = HashToScalar(6 || G3 * d5 + Pa * cp || G * d5 + G2 * d6 + Qa * cp) */
   goldilocks_448_point_scalarmul(temp_point, msg->pa, msg->cp);
-  goldilocks_448_point_scalarmul(temp_point_2, smp->g3, msg->d5);
+  goldilocks_448_precomputed_scalarmul(temp_point_2, smp->g3_table, msg->d5);
   goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
 
   if (otrng_serialize_ec_point(ser_point_1, temp_point) != ED448_POINT_BYTES) {
     return otrng_false;
   }
 
-  goldilocks_448_point_scalarmul(temp_point, msg->qa, msg->cp);
-  goldilocks_448_point_scalarmul(temp_point_2, smp->g2, msg->d6);
-  goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
-  goldilocks_448_point_scalarmul(temp_point_2, goldilocks_448_point_base,
-                                 msg->d5);
+  goldilocks_448_base_double_scalarmul_non_secret(temp_point, msg->d5,
+                                                  msg->qa, msg->cp);
+  goldilocks_448_precomputed_scalarmul(temp_point_2, smp->g2_table, msg->d6);
   goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
 
   if (otrng_serialize_ec_point(ser_point_2, temp_point) != ED448_POINT_BYTES) {
@@ -1007,19 +1037,16 @@ tstatic otrng_bool smp_message_3_validate_zkp(smp_message_3_s *msg,
   }
 
   /* cr = Hash_to_scalar(7 || G * d7 + G3a * cr || (Qa - Qb) * d7 + Ra * cr) */
-  goldilocks_448_point_scalarmul(temp_point, smp->g3a, msg->cr);
-  goldilocks_448_point_scalarmul(temp_point_2, goldilocks_448_point_base,
-                                 msg->d7);
-  goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
+  goldilocks_448_base_double_scalarmul_non_secret(temp_point, msg->d7,
+                                                  smp->g3a, msg->cr);
 
   if (otrng_serialize_ec_point(ser_point_3, temp_point) != ED448_POINT_BYTES) {
     return otrng_false;
   }
 
-  goldilocks_448_point_scalarmul(temp_point, msg->ra, msg->cr);
   goldilocks_448_point_sub(temp_point_2, msg->qa, smp->qb);
-  goldilocks_448_point_scalarmul(temp_point_2, temp_point_2, msg->d7);
-  goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
+  goldilocks_448_point_double_scalarmul(temp_point, msg->ra, msg->cr,
+                                        temp_point_2, msg->d7);
 
   if (otrng_serialize_ec_point(ser_point_4, temp_point) != ED448_POINT_BYTES) {
     return otrng_false;
@@ -1171,7 +1198,7 @@ tstatic otrng_result smp_message_4_deserialize(smp_message_4_s *dst,
 
 tstatic otrng_bool smp_message_4_validate_zkp(smp_message_4_s *msg,
                                               const smp_protocol_s *smp) {
-  ec_point temp_point, temp_point_2;
+  ec_point temp_point;
   ec_scalar temp_scalar;
   uint8_t ser_point_1[ED448_POINT_BYTES];
   uint8_t ser_point_2[ED448_POINT_BYTES];
@@ -1179,19 +1206,17 @@ tstatic otrng_bool smp_message_4_validate_zkp(smp_message_4_s *msg,
   goldilocks_shake256_ctx_p hd;
   uint8_t usage_zkp_smp_8 = 0x08;
 
-  /* cr = HashToScalar(8 || G * d7 + G3b * cr || (Qa - Qb) * d7 + Rb * cr). */
-  goldilocks_448_point_scalarmul(temp_point, smp->g3b, msg->cr);
-  goldilocks_448_point_scalarmul(temp_point_2, goldilocks_448_point_base,
-                                 msg->d7);
-  goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
+  /* cr = HashToScalar(8 || G * d7 + G3b * cr || (Qa - Qb) * d7 + Rb * cr).
+     Everything in this proof is public. */
+  goldilocks_448_base_double_scalarmul_non_secret(temp_point, msg->d7,
+                                                  smp->g3b, msg->cr);
 
   if (otrng_serialize_ec_point(ser_point_1, temp_point) != ED448_POINT_BYTES) {
     return otrng_false;
   }
 
-  goldilocks_448_point_scalarmul(temp_point, msg->rb, msg->cr);
-  goldilocks_448_point_scalarmul(temp_point_2, smp->qa_qb, msg->d7);
-  goldilocks_448_point_add(temp_point, temp_point, temp_point_2);
+  goldilocks_448_point_double_scalarmul(temp_point, msg->rb, msg->cr,
+                                        smp->qa_qb, msg->d7);
   if (otrng_serialize_ec_point(ser_point_2, temp_point) != ED448_POINT_BYTES) {
     return otrng_false;
   }
@@ -1340,6 +1365,7 @@ tstatic otrng_smp_event receive_smp_message_2(smp_message_2_s *msg_2,
 
   goldilocks_448_point_scalarmul(smp->g2, msg_2->g2b, smp->a2);
   goldilocks_448_point_scalarmul(smp->g3, msg_2->g3b, smp->a3);
+  precompute_session_tables(smp);
 
   if (!smp_message_2_valid_zkp(msg_2, smp)) {
     return OTRNG_SMP_EVENT_ERROR;
@@ -93,6 +93,8 @@ typedef struct smp_protocol_s {
   ec_point g3a, g3b;
   ec_point pb, qb;
   ec_point pa_pb, qa_qb;
+  /* Precomputed tables of G2 and G3, once they are known */
+  goldilocks_448_precomputed_s *g2_table, *g3_table;
 
   uint8_t progress;
   smp_message_1_s *message1;
@@ -0,0 +1,452 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#define OTRNG_SNAPSHOT_PRIVATE
+
+#include "alloc.h"
+#include "deserialize.h"
+#include "random.h"
+#include "serialize.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MPI_MAX_BYTES (4 + DH3072_MOD_LEN_BYTES)
+#define SNAPSHOT_SKIPPED_KEY_BYTES                                             \
+  (4 + 4 + EXTRA_SYMMETRIC_KEY_BYTES + ENC_KEY_BYTES)
+
+/* The most the state of [otr] takes, with a client profile of [profile_len]
+   bytes */
+tstatic size_t snapshot_max_bytes(const otrng_s *otr, size_t profile_len) {
+  const key_manager_s *keys = otr->keys;
+  size_t peer_len = otr->peer ? strlen(otr->peer) : 0;
+
+  return 1 + 4 + 4 + 1 + 8 + 4 + peer_len + 4 + profile_len +
+         ED448_SCALAR_BYTES + ED448_POINT_BYTES + 2 * SNAPSHOT_MPI_MAX_BYTES +
+         ED448_POINT_BYTES + SNAPSHOT_MPI_MAX_BYTES + 4 * 4 + ROOT_KEY_BYTES +
+         2 * CHAIN_KEY_BYTES + BRACE_KEY_BYTES + SHARED_SECRET_BYTES +
+         SSID_BYTES + 1 + EXTRA_SYMMETRIC_KEY_BYTES + HASH_BYTES + 8 + 4 +
+         otrng_skipped_keys_table_len(keys->skipped_keys) *
+             SNAPSHOT_SKIPPED_KEY_BYTES +
+         4 + otrng_list_len(keys->old_mac_keys) * MAC_KEY_BYTES;
+}
+
+/* Writes [mpi] as a length and its bytes. An empty one is a NULL [mpi]. */
+tstatic size_t snapshot_serialize_mpi(uint8_t *dst, const dh_mpi mpi) {
+  size_t w = 0;
+
+  if (!otrng_dh_mpi_serialize(dst + 4, DH3072_MOD_LEN_BYTES, &w, mpi)) {
+    return 0;
+  }
+  otrng_serialize_uint32(dst, w);
+
+  return 4 + w;
+}
+
+tstatic size_t snapshot_serialize(uint8_t *dst, const otrng_s *otr,
+                                  const uint8_t *profile, size_t profile_len) {
+  const key_manager_s *keys = otr->keys;
+  const skipped_keys_s *skipped;
+  const list_element_s *el;
+  uint8_t *cursor = dst;
+  size_t w;
+
+  cursor += otrng_serialize_uint8(cursor, OTRNG_SNAPSHOT_VERSION);
+  cursor += otrng_serialize_uint32(cursor, our_instance_tag(otr));
+  cursor += otrng_serialize_uint32(cursor, otr->their_instance_tag);
+  cursor += otrng_serialize_uint8(cursor, otr->supported_versions);
+  cursor += otrng_serialize_uint64(cursor, otr->last_sent);
+  cursor += otrng_serialize_data(cursor, (const uint8_t *)otr->peer,
+                                 otr->peer ? strlen(otr->peer) : 0);
+  cursor += otrng_serialize_data(cursor, profile, profile_len);
+
+  cursor += otrng_serialize_ec_scalar(cursor, keys->our_ecdh->priv);
+  cursor += otrng_serialize_ec_point(cursor, keys->our_ecdh->pub);
+  if (!(w = snapshot_serialize_mpi(cursor, keys->our_dh->priv))) {
+    return 0;
+  }
+  cursor += w;
+  if (!(w = snapshot_serialize_mpi(cursor, keys->our_dh->pub))) {
+    return 0;
+  }
+  cursor += w;
+  cursor += otrng_serialize_ec_point(cursor, keys->their_ecdh);
+  if (!(w = snapshot_serialize_mpi(cursor, keys->their_dh))) {
+    return 0;
+  }
+  cursor += w;
+
+  cursor += otrng_serialize_uint32(cursor, keys->i);
+  cursor += otrng_serialize_uint32(cursor, keys->j);
+  cursor += otrng_serialize_uint32(cursor, keys->k);
+  cursor += otrng_serialize_uint32(cursor, keys->pn);
+  cursor += otrng_serialize_bytes_array(cursor, keys->current->root_key,
+                                        ROOT_KEY_BYTES);
+  cursor += otrng_serialize_bytes_array(cursor, keys->current->chain_s,
+                                        CHAIN_KEY_BYTES);
+  cursor += otrng_serialize_bytes_array(cursor, keys->current->chain_r,
+                                        CHAIN_KEY_BYTES);
+  cursor +=
+      otrng_serialize_bytes_array(cursor, keys->brace_key, BRACE_KEY_BYTES);
+  cursor += otrng_serialize_bytes_array(cursor, keys->shared_secret,
+                                        SHARED_SECRET_BYTES);
+  cursor += otrng_serialize_bytes_array(cursor, keys->ssid, SSID_BYTES);
+  cursor += otrng_serialize_uint8(cursor, keys->ssid_half_first);
+  cursor += otrng_serialize_bytes_array(cursor, keys->extra_symmetric_key,
+                                        EXTRA_SYMMETRIC_KEY_BYTES);
+  cursor += otrng_serialize_bytes_array(cursor, keys->tmp_key, HASH_BYTES);
+  cursor += otrng_serialize_uint64(cursor, keys->last_generated);
+
+  cursor += otrng_serialize_uint32(
+      cursor, otrng_skipped_keys_table_len(keys->skipped_keys));
+  for (skipped = keys->skipped_keys->oldest; skipped;
+       skipped = skipped->newer) {
+    cursor += otrng_serialize_uint32(cursor, skipped->i);
+    cursor += otrng_serialize_uint32(cursor, skipped->j);
+    cursor += otrng_serialize_bytes_array(cursor, skipped->extra_symmetric_key,
+                                          EXTRA_SYMMETRIC_KEY_BYTES);
+    cursor += otrng_serialize_bytes_array(cursor, skipped->enc_key,
+                                          ENC_KEY_BYTES);
+  }
+
+  cursor += otrng_serialize_uint32(
+      cursor, otrng_list_len((list_element_s *)keys->old_mac_keys));
+  for (el = keys->old_mac_keys; el; el = el->next) {
+    cursor += otrng_serialize_bytes_array(cursor, el->data, MAC_KEY_BYTES);
+  }
+
+  return cursor - dst;
+}
+
+INTERNAL otrng_result
+otrng_snapshot_seal(uint8_t **dst, size_t *dst_len,
+                    const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES],
+                    const otrng_s *otr) {
+  uint8_t *profile = NULL;
+  size_t profile_len = 0;
+  uint8_t *state, *sealed;
+  size_t state_len;
+
+  if (otr->running_version != 4 ||
+      otr->state != OTRNG_STATE_ENCRYPTED_MESSAGES) {
+    return OTRNG_ERROR;
+  }
+
+  if (otr->their_client_profile &&
+      !otrng_client_profile_serialize(&profile, &profile_len,
+                                      otr->their_client_profile)) {
+    return OTRNG_ERROR;
+  }
+
+  /* @secret_information: the state holds the keys of the conversation */
+  state = otrng_secure_alloc(snapshot_max_bytes(otr, profile_len));
+  state_len = snapshot_serialize(state, otr, profile, profile_len);
+  otrng_free(profile);
+
+  if (state_len == 0) {
+    otrng_secure_free(state);
+    return OTRNG_ERROR;
+  }
+
+  sealed = otrng_xmalloc(OTRNG_SNAPSHOT_OVERHEAD + state_len);
+  sealed[0] = OTRNG_SNAPSHOT_VERSION;
+  random_bytes(sealed + 1, crypto_secretbox_NONCEBYTES);
+  crypto_secretbox_easy(sealed + 1 + crypto_secretbox_NONCEBYTES, state,
+                        state_len, sealed + 1, key);
+  otrng_secure_free(state);
+
+  *dst = sealed;
+  *dst_len = OTRNG_SNAPSHOT_OVERHEAD + state_len;
+
+  return OTRNG_SUCCESS;
+}
+
+typedef struct snapshot_reader_s {
+  const uint8_t *cursor;
+  size_t left;
+} snapshot_reader_s;
+
+tstatic otrng_result snapshot_read_bytes(uint8_t *dst, size_t len,
+                                         snapshot_reader_s *reader) {
+  if (reader->left < len) {
+    return OTRNG_ERROR;
+  }
+
+  memcpy(dst, reader->cursor, len);
+  reader->cursor += len;
+  reader->left -= len;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result snapshot_read_uint32(uint32_t *dst,
+                                          snapshot_reader_s *reader) {
+  uint8_t ser[4];
+
+  if (!snapshot_read_bytes(ser, sizeof(ser), reader)) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_deserialize_uint32(dst, ser, sizeof(ser), NULL);
+}
+
+tstatic otrng_result snapshot_read_uint64(uint64_t *dst,
+                                          snapshot_reader_s *reader) {
+  uint8_t ser[8];
+
+  if (!snapshot_read_bytes(ser, sizeof(ser), reader)) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_deserialize_uint64(dst, ser, sizeof(ser), NULL);
+}
+
+/* Points [dst] to the next [len] bytes, read from a length first */
+tstatic otrng_result snapshot_read_data(const uint8_t **dst, size_t *len,
+                                        snapshot_reader_s *reader) {
+  uint32_t data_len;
+
+  if (!snapshot_read_uint32(&data_len, reader) || reader->left < data_len) {
+    return OTRNG_ERROR;
+  }
+
+  *dst = reader->cursor;
+  *len = data_len;
+  reader->cursor += data_len;
+  reader->left -= data_len;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result snapshot_read_mpi(dh_mpi *dst,
+                                       snapshot_reader_s *reader) {
+  const uint8_t *data;
+  size_t len;
+
+  if (!snapshot_read_data(&data, &len, reader)) {
+    return OTRNG_ERROR;
+  }
+
+  gcry_mpi_release(*dst);
+  *dst = NULL;
+  if (len == 0) {
+    return OTRNG_SUCCESS;
+  }
+
+  return otrng_dh_mpi_deserialize(dst, data, len, NULL);
+}
+
+tstatic otrng_result snapshot_read_point(ec_point dst,
+                                         snapshot_reader_s *reader) {
+  if (!otrng_deserialize_ec_point(dst, reader->cursor, reader->left)) {
+    return OTRNG_ERROR;
+  }
+
+  reader->cursor += ED448_POINT_BYTES;
+  reader->left -= ED448_POINT_BYTES;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result snapshot_read_profile(otrng_s *otr,
+                                           snapshot_reader_s *reader) {
+  const uint8_t *profile;
+  size_t profile_len;
+
+  if (!snapshot_read_data(&profile, &profile_len, reader)) {
+    return OTRNG_ERROR;
+  }
+
+  if (profile_len == 0) {
+    return OTRNG_SUCCESS;
+  }
+
+  otr->their_client_profile = otrng_xmalloc_z(sizeof(otrng_client_profile_s));
+  return otrng_client_profile_deserialize(otr->their_client_profile, profile,
+                                          profile_len, NULL);
+}
+
+tstatic otrng_result snapshot_read_skipped_keys(key_manager_s *keys,
+                                                snapshot_reader_s *reader) {
+  uint8_t extra_key[EXTRA_SYMMETRIC_KEY_BYTES];
+  uint8_t enc_key[ENC_KEY_BYTES];
+  uint32_t count, n, i, j;
+  otrng_result result = OTRNG_SUCCESS;
+
+  if (!snapshot_read_uint32(&count, reader) ||
+      count > reader->left / SNAPSHOT_SKIPPED_KEY_BYTES) {
+    return OTRNG_ERROR;
+  }
+
+  for (n = 0; n < count && result == OTRNG_SUCCESS; n++) {
+    result = snapshot_read_uint32(&i, reader);
+    if (result == OTRNG_SUCCESS) {
+      result = snapshot_read_uint32(&j, reader);
+    }
+    if (result == OTRNG_SUCCESS) {
+      result = snapshot_read_bytes(extra_key, sizeof(extra_key), reader);
+    }
+    if (result == OTRNG_SUCCESS) {
+      result = snapshot_read_bytes(enc_key, sizeof(enc_key), reader);
+    }
+    if (result == OTRNG_SUCCESS) {
+      otrng_skipped_keys_table_add(keys->skipped_keys, i, j, enc_key,
+                                   extra_key);
+    }
+  }
+
+  otrng_secure_wipe(extra_key, sizeof(extra_key));
+  otrng_secure_wipe(enc_key, sizeof(enc_key));
+
+  return result;
+}
+
+tstatic otrng_result snapshot_read_old_mac_keys(key_manager_s *keys,
+                                                snapshot_reader_s *reader) {
+  list_element_s *last = NULL;
+  uint32_t count, n;
+
+  if (!snapshot_read_uint32(&count, reader) ||
+      count > reader->left / MAC_KEY_BYTES) {
+    return OTRNG_ERROR;
+  }
+
+  for (n = 0; n < count; n++) {
+    uint8_t *mac_key = otrng_secure_slab_alloc(MAC_KEY_BYTES);
+
+    snapshot_read_bytes(mac_key, MAC_KEY_BYTES, reader);
+    last = otrng_list_append(mac_key, &keys->old_mac_keys, last);
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result snapshot_deserialize(otrng_s *otr, const uint8_t *src,
+                                          size_t src_len) {
+  key_manager_s *keys = otr->keys;
+  snapshot_reader_s reader;
+  uint8_t version, supported_versions, ssid_half_first;
+  uint32_t our_tag, their_tag, i, j, k, pn;
+  uint64_t last_sent, last_generated;
+  const uint8_t *peer;
+  size_t peer_len;
+
+  reader.cursor = src;
+  reader.left = src_len;
+
+  if (!snapshot_read_bytes(&version, 1, &reader) ||
+      version != OTRNG_SNAPSHOT_VERSION ||
+      !snapshot_read_uint32(&our_tag, &reader) ||
+      !snapshot_read_uint32(&their_tag, &reader) ||
+      !snapshot_read_bytes(&supported_versions, 1, &reader) ||
+      !snapshot_read_uint64(&last_sent, &reader) ||
+      !snapshot_read_data(&peer, &peer_len, &reader)) {
+    return OTRNG_ERROR;
+  }
+
+  /* The keys were agreed for one instance of the client */
+  if (our_tag != our_instance_tag(otr)) {
+    return OTRNG_ERROR;
+  }
+
+  otr->their_instance_tag = their_tag;
+  otr->supported_versions = supported_versions;
+  otr->last_sent = last_sent;
+  if (peer_len > 0) {
+    otr->peer = otrng_xmalloc_z(peer_len + 1);
+    memcpy(otr->peer, peer, peer_len);
+  }
+
+  if (!snapshot_read_profile(otr, &reader) ||
+      !otrng_deserialize_ec_scalar(keys->our_ecdh->priv, reader.cursor,
+                                   reader.left)) {
+    return OTRNG_ERROR;
+  }
+  reader.cursor += ED448_SCALAR_BYTES;
+  reader.left -= ED448_SCALAR_BYTES;
+
+  if (!snapshot_read_point(keys->our_ecdh->pub, &reader) ||
+      !snapshot_read_mpi(&keys->our_dh->priv, &reader) ||
+      !snapshot_read_mpi(&keys->our_dh->pub, &reader) ||
+      !snapshot_read_point(keys->their_ecdh, &reader) ||
+      !snapshot_read_mpi(&keys->their_dh, &reader) ||
+      !snapshot_read_uint32(&i, &reader) ||
+      !snapshot_read_uint32(&j, &reader) ||
+      !snapshot_read_uint32(&k, &reader) ||
+      !snapshot_read_uint32(&pn, &reader) ||
+      !snapshot_read_bytes(keys->current->root_key, ROOT_KEY_BYTES, &reader) ||
+      !snapshot_read_bytes(keys->current->chain_s, CHAIN_KEY_BYTES, &reader) ||
+      !snapshot_read_bytes(keys->current->chain_r, CHAIN_KEY_BYTES, &reader) ||
+      !snapshot_read_bytes(keys->brace_key, BRACE_KEY_BYTES, &reader) ||
+      !snapshot_read_bytes(keys->shared_secret, SHARED_SECRET_BYTES,
+                           &reader) ||
+      !snapshot_read_bytes(keys->ssid, SSID_BYTES, &reader) ||
+      !snapshot_read_bytes(&ssid_half_first, 1, &reader) ||
+      !snapshot_read_bytes(keys->extra_symmetric_key,
+                           EXTRA_SYMMETRIC_KEY_BYTES, &reader) ||
+      !snapshot_read_bytes(keys->tmp_key, HASH_BYTES, &reader) ||
+      !snapshot_read_uint64(&last_generated, &reader) ||
+      !snapshot_read_skipped_keys(keys, &reader) ||
+      !snapshot_read_old_mac_keys(keys, &reader) || reader.left != 0) {
+    return OTRNG_ERROR;
+  }
+
+  keys->i = i;
+  keys->j = j;
+  keys->k = k;
+  keys->pn = pn;
+  keys->ssid_half_first = ssid_half_first ? otrng_true : otrng_false;
+  keys->last_generated = last_generated;
+
+  otr->running_version = 4;
+  otr->state = OTRNG_STATE_ENCRYPTED_MESSAGES;
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result
+otrng_snapshot_restore(otrng_s *otr, const uint8_t *snapshot,
+                       size_t snapshot_len,
+                       const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES]) {
+  uint8_t *state;
+  size_t state_len;
+  otrng_result result;
+
+  if (snapshot_len <= OTRNG_SNAPSHOT_OVERHEAD ||
+      snapshot[0] != OTRNG_SNAPSHOT_VERSION) {
+    return OTRNG_ERROR;
+  }
+
+  state_len = snapshot_len - OTRNG_SNAPSHOT_OVERHEAD;
+  state = otrng_secure_alloc(state_len);
+
+  if (crypto_secretbox_open_easy(
+          state, snapshot + 1 + crypto_secretbox_NONCEBYTES,
+          snapshot_len - 1 - crypto_secretbox_NONCEBYTES, snapshot + 1,
+          key) != 0) {
+    otrng_secure_free(state);
+    return OTRNG_ERROR;
+  }
+
+  result = snapshot_deserialize(otr, state, state_len);
+  otrng_secure_free(state);
+
+  return result;
+}
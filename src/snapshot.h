@@ -0,0 +1,90 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_SNAPSHOT_H
+#define OTRNG_SNAPSHOT_H
+
+#include <sodium.h>
+#include <stdint.h>
+
+#include "error.h"
+#include "protocol.h"
+#include "shared.h"
+
+/*
+ * A sealed snapshot of an encrypted conversation, to resume it in another
+ * process without a new DAKE.
+ *
+ * It is a version (1 byte), a nonce, and the state sealed with XSalsa20 and
+ * Poly1305 under a key of the caller. The state is the version again, the
+ * instance tags, the peer and their client profile, and everything the key
+ * manager needs to keep ratcheting: the ephemeral keys of both sides, the
+ * counters, the ratchet and chain keys, the skipped keys, oldest first, and
+ * the MAC keys still to reveal. Keys derived ahead, a fragmented message or
+ * an SMP in progress are not kept.
+ */
+
+#define OTRNG_SNAPSHOT_VERSION 1
+#define OTRNG_SNAPSHOT_KEY_BYTES crypto_secretbox_KEYBYTES
+#define OTRNG_SNAPSHOT_OVERHEAD                                                \
+  (1 + crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES)
+
+/**
+ * @brief Seals the state of [otr], which must be encrypted with OTRv4.
+ *
+ * @param [dst]       The snapshot, to free with otrng_free.
+ * @param [dst_len]   Its length.
+ * @param [key]       The key to seal it with.
+ * @param [otr]       The connection.
+ */
+INTERNAL otrng_result
+otrng_snapshot_seal(uint8_t **dst, size_t *dst_len,
+                    const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES],
+                    const otrng_s *otr);
+
+/**
+ * @brief Restores a sealed snapshot into [otr].
+ *
+ * @param [otr]            A new connection of the client the snapshot was
+ *                         taken from, as otrng_new returns it. Free it on
+ *                         failure.
+ * @param [snapshot]       The snapshot.
+ * @param [snapshot_len]   Its length.
+ * @param [key]            The key it was sealed with.
+ *
+ * @return OTRNG_ERROR if the snapshot is not one sealed with [key], or it was
+ *         taken for another instance of the client.
+ */
+INTERNAL otrng_result
+otrng_snapshot_restore(otrng_s *otr, const uint8_t *snapshot,
+                       size_t snapshot_len,
+                       const uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES]);
+
+#ifdef OTRNG_SNAPSHOT_PRIVATE
+
+tstatic size_t snapshot_serialize(uint8_t *dst, const otrng_s *otr,
+                                  const uint8_t *profile, size_t profile_len);
+
+tstatic otrng_result snapshot_deserialize(otrng_s *otr, const uint8_t *src,
+                                          size_t src_len);
+
+#endif
+
+#endif
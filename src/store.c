@@ -0,0 +1,692 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fileno, mmap and munmap are POSIX */
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef S_SPLINT_S
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wstrict-prototypes"
+#include <libotr/instag.h>
+#pragma clang diagnostic pop
+#endif
+
+#define OTRNG_STORE_PRIVATE
+
+#include "alloc.h"
+#include "constants.h"
+#include "deserialize.h"
+#include "messaging.h"
+#include "serialize.h"
+#include "store.h"
+
+/* A string of the index is at least its length and a NUL */
+#define STORE_MIN_INDEX_ENTRY_BYTES (2 * (4 + 1) + 8 + 8)
+
+tstatic otrng_result store_read_string(const char **dst, const uint8_t *map,
+                                       size_t map_len, size_t *pos) {
+  uint32_t len;
+
+  if (!otrng_deserialize_uint32(&len, map + *pos, map_len - *pos, NULL)) {
+    return OTRNG_ERROR;
+  }
+  *pos += 4;
+
+  if (len == 0 || len > map_len - *pos || map[*pos + len - 1] != '\0') {
+    return OTRNG_ERROR;
+  }
+
+  *dst = (const char *)map + *pos;
+  *pos += len;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result store_read_index(otrng_store_s *store) {
+  const uint8_t *map = store->map;
+  size_t len = store->map_len;
+  uint64_t index_offset;
+  uint32_t count;
+  size_t pos;
+
+  if (memcmp(map, OTRNG_STORE_MAGIC, OTRNG_STORE_MAGIC_BYTES) != 0) {
+    return OTRNG_ERROR;
+  }
+
+  pos = OTRNG_STORE_MAGIC_BYTES;
+  if (!otrng_deserialize_uint64(&index_offset, map + pos, len - pos, NULL) ||
+      !otrng_deserialize_uint32(&count, map + pos + 8, len - pos - 8, NULL)) {
+    return OTRNG_ERROR;
+  }
+
+  if (index_offset < OTRNG_STORE_HEADER_BYTES || index_offset > len ||
+      count > (len - index_offset) / STORE_MIN_INDEX_ENTRY_BYTES) {
+    return OTRNG_ERROR;
+  }
+
+  store->entries = otrng_xmalloc_z(count * sizeof(otrng_store_entry_s));
+
+  pos = index_offset;
+  while (store->num_entries < count) {
+    otrng_store_entry_s *entry = &store->entries[store->num_entries];
+    uint64_t offset, records_len;
+
+    if (!store_read_string(&entry->client_id.protocol, map, len, &pos) ||
+        !store_read_string(&entry->client_id.account, map, len, &pos) ||
+        !otrng_deserialize_uint64(&offset, map + pos, len - pos, NULL) ||
+        !otrng_deserialize_uint64(&records_len, map + pos + 8, len - pos - 8,
+                                  NULL)) {
+      return OTRNG_ERROR;
+    }
+    pos += 16;
+
+    if (offset < OTRNG_STORE_HEADER_BYTES || offset > index_offset ||
+        records_len > index_offset - offset) {
+      return OTRNG_ERROR;
+    }
+
+    entry->records = map + offset;
+    entry->records_len = records_len;
+    otrng_hash_index_add(store->index,
+                         otrng_hash_index_hash(store->index,
+                                               entry->client_id.protocol,
+                                               entry->client_id.account),
+                         entry);
+    store->num_entries++;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_store_s *otrng_store_open(FILE *f) {
+  struct stat st;
+  void *map;
+  otrng_store_s *store;
+
+  if (!f || fstat(fileno(f), &st) != 0 ||
+      st.st_size < OTRNG_STORE_HEADER_BYTES) {
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  store = otrng_xmalloc_z(sizeof(otrng_store_s));
+  store->map = map;
+  store->map_len = st.st_size;
+  store->index = otrng_hash_index_new();
+
+  if (!store_read_index(store)) {
+    otrng_store_close(store);
+    return NULL;
+  }
+
+  return store;
+}
+
+INTERNAL otrng_store_s *otrng_store_new(void) {
+  otrng_store_s *store = otrng_xmalloc_z(sizeof(otrng_store_s));
+  store->index = otrng_hash_index_new();
+
+  return store;
+}
+
+tstatic void store_drop_evicted(otrng_store_entry_s *entry) {
+  if (!entry->evicted) {
+    return;
+  }
+
+  /* @secret_information: the records hold the long-term keys */
+  otrng_secure_wipe(entry->evicted, entry->records_len);
+  otrng_free(entry->evicted);
+  entry->evicted = NULL;
+  entry->records = NULL;
+  entry->records_len = 0;
+}
+
+tstatic void store_free_added_entry(void *data) {
+  otrng_store_entry_s *entry = data;
+
+  store_drop_evicted(entry);
+  otrng_free((char *)entry->client_id.protocol);
+  otrng_free((char *)entry->client_id.account);
+  otrng_free(entry);
+}
+
+INTERNAL void otrng_store_close(otrng_store_s *store) {
+  size_t n;
+
+  if (!store) {
+    return;
+  }
+
+  for (n = 0; n < store->num_entries; n++) {
+    store_drop_evicted(&store->entries[n]);
+  }
+  otrng_list_free(store->added, store_free_added_entry);
+
+  if (store->map) {
+    munmap(store->map, store->map_len);
+  }
+  otrng_hash_index_free(store->index);
+  otrng_free(store->entries);
+  otrng_free(store);
+}
+
+tstatic int find_entry_by_client_id(const void *current, const void *wanted) {
+  const otrng_store_entry_s *entry = current;
+  const otrng_client_id_s *cid = wanted;
+  return strcmp(entry->client_id.protocol, cid->protocol) == 0 &&
+         strcmp(entry->client_id.account, cid->account) == 0;
+}
+
+INTERNAL otrng_store_entry_s *
+otrng_store_find(const otrng_store_s *store,
+                 const otrng_client_id_s *client_id) {
+  uint64_t hash = otrng_hash_index_hash(store->index, client_id->protocol,
+                                        client_id->account);
+  return otrng_hash_index_get(store->index, hash, client_id,
+                              find_entry_by_client_id);
+}
+
+tstatic otrng_result store_load_client_profile(otrng_client_s *client,
+                                               const uint8_t *data, size_t len,
+                                               otrng_bool expired) {
+  otrng_client_profile_s profile;
+  otrng_result result;
+
+  memset(&profile, 0, sizeof(otrng_client_profile_s));
+  if (!otrng_client_profile_deserialize_with_metadata(&profile, data, len,
+                                                      NULL)) {
+    otrng_client_profile_destroy(&profile);
+    return OTRNG_ERROR;
+  }
+
+  if (expired) {
+    result = otrng_client_add_exp_client_profile(client, &profile);
+  } else {
+    result = otrng_client_add_client_profile(client, &profile);
+  }
+  otrng_client_profile_destroy(&profile);
+
+  return result;
+}
+
+tstatic otrng_result store_load_prekey_profile(otrng_client_s *client,
+                                               const uint8_t *data, size_t len,
+                                               otrng_bool expired) {
+  otrng_prekey_profile_s profile;
+  otrng_result result;
+
+  memset(&profile, 0, sizeof(otrng_prekey_profile_s));
+  if (!otrng_prekey_profile_deserialize_with_metadata(&profile, data, len,
+                                                      NULL)) {
+    otrng_prekey_profile_destroy(&profile);
+    return OTRNG_ERROR;
+  }
+
+  if (expired) {
+    result = otrng_client_add_exp_prekey_profile(client, &profile);
+  } else {
+    result = otrng_client_add_prekey_profile(client, &profile);
+  }
+  otrng_prekey_profile_destroy(&profile);
+
+  return result;
+}
+
+/* What the client already has, like a key read from another file before it
+   was first got, is newer than the store, so those records are skipped. */
+tstatic otrng_result store_load_record(otrng_client_s *client, uint8_t type,
+                                       const uint8_t *data, size_t len,
+                                       list_element_s **last_prekey) {
+  otrng_public_key forging_key;
+  prekey_message_s *prekey;
+  uint32_t instag;
+
+  switch (type) {
+  case OTRNG_STORE_PRIVATE_KEY_V4:
+    if (len != ED448_PRIVATE_BYTES) {
+      return OTRNG_ERROR;
+    }
+    if (client->keypair) {
+      return OTRNG_SUCCESS;
+    }
+    return otrng_client_add_private_key_v4(client, data);
+
+  case OTRNG_STORE_FORGING_KEY:
+    if (client->forging_key) {
+      return OTRNG_SUCCESS;
+    }
+    if (!otrng_deserialize_forging_key(forging_key, data, len, NULL)) {
+      return OTRNG_ERROR;
+    }
+    return otrng_client_add_forging_key(client, forging_key);
+
+  case OTRNG_STORE_INSTANCE_TAG:
+    if (!otrng_deserialize_uint32(&instag, data, len, NULL)) {
+      return OTRNG_ERROR;
+    }
+    if (otrl_instag_find(client->global_state->user_state_v3,
+                         client->client_id.account,
+                         client->client_id.protocol)) {
+      return OTRNG_SUCCESS;
+    }
+    return otrng_client_add_instance_tag(client, instag);
+
+  case OTRNG_STORE_CLIENT_PROFILE:
+  case OTRNG_STORE_EXP_CLIENT_PROFILE:
+    if ((type == OTRNG_STORE_CLIENT_PROFILE && client->client_profile) ||
+        (type == OTRNG_STORE_EXP_CLIENT_PROFILE &&
+         client->exp_client_profile)) {
+      return OTRNG_SUCCESS;
+    }
+    return store_load_client_profile(
+        client, data, len, type == OTRNG_STORE_EXP_CLIENT_PROFILE);
+
+  case OTRNG_STORE_PREKEY_PROFILE:
+  case OTRNG_STORE_EXP_PREKEY_PROFILE:
+    if ((type == OTRNG_STORE_PREKEY_PROFILE && client->prekey_profile) ||
+        (type == OTRNG_STORE_EXP_PREKEY_PROFILE &&
+         client->exp_prekey_profile)) {
+      return OTRNG_SUCCESS;
+    }
+    return store_load_prekey_profile(
+        client, data, len, type == OTRNG_STORE_EXP_PREKEY_PROFILE);
+
+  case OTRNG_STORE_PREKEY_MESSAGE:
+    prekey = otrng_xmalloc_z(sizeof(prekey_message_s));
+    if (!otrng_prekey_message_deserialize_with_metadata(prekey, data, len,
+                                                        NULL)) {
+      otrng_free(prekey);
+      return OTRNG_ERROR;
+    }
+    *last_prekey =
+        otrng_list_append(prekey, &client->our_prekeys, *last_prekey);
+    return OTRNG_SUCCESS;
+
+  default:
+    /* Written by a later version */
+    return OTRNG_SUCCESS;
+  }
+}
+
+INTERNAL otrng_result
+otrng_store_load_client(otrng_client_s *client,
+                        const otrng_store_entry_s *entry) {
+  const uint8_t *cursor = entry->records;
+  size_t left = entry->records_len;
+  list_element_s *last_prekey = NULL;
+
+  while (left > 0) {
+    uint8_t type;
+    uint32_t len;
+
+    if (left < 5) {
+      return OTRNG_ERROR;
+    }
+
+    otrng_deserialize_uint8(&type, cursor, left, NULL);
+    otrng_deserialize_uint32(&len, cursor + 1, left - 1, NULL);
+    cursor += 5;
+    left -= 5;
+
+    if (len > left) {
+      return OTRNG_ERROR;
+    }
+
+    if (!store_load_record(client, type, cursor, len, &last_prekey)) {
+      return OTRNG_ERROR;
+    }
+
+    cursor += len;
+    left -= len;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL void otrng_store_set_loaded(otrng_store_entry_s *entry) {
+  store_drop_evicted(entry);
+  entry->loaded = otrng_true;
+}
+
+INTERNAL otrng_result otrng_store_evict_client(otrng_store_s *store,
+                                               const otrng_client_s *client) {
+  otrng_store_entry_s *entry;
+  store_sink_s sink;
+
+  /* Sized first, so the records are written once into a buffer that is
+     wiped, instead of into a growing one that leaves copies of the keys */
+  memset(&sink, 0, sizeof(store_sink_s));
+  if (!store_write_client(&sink, client)) {
+    return OTRNG_ERROR;
+  }
+
+  sink.cap = sink.written;
+  sink.buffer = otrng_xmalloc(sink.cap ? sink.cap : 1);
+  sink.written = 0;
+
+  if (!store_write_client(&sink, client)) {
+    /* @secret_information: the records hold the long-term keys */
+    otrng_secure_wipe(sink.buffer, sink.cap);
+    otrng_free(sink.buffer);
+    return OTRNG_ERROR;
+  }
+
+  entry = otrng_store_find(store, &client->client_id);
+  if (!entry) {
+    entry = otrng_xmalloc_z(sizeof(otrng_store_entry_s));
+    entry->client_id.protocol = otrng_xstrdup(client->client_id.protocol);
+    entry->client_id.account = otrng_xstrdup(client->client_id.account);
+    store->added = otrng_list_add(entry, store->added);
+    otrng_hash_index_add(store->index,
+                         otrng_hash_index_hash(store->index,
+                                               entry->client_id.protocol,
+                                               entry->client_id.account),
+                         entry);
+  }
+
+  store_drop_evicted(entry);
+  entry->evicted = sink.buffer;
+  entry->records = entry->evicted;
+  entry->records_len = sink.written;
+  entry->loaded = otrng_false;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result store_write_bytes(store_sink_s *sink, const void *data,
+                                       size_t len) {
+  if (len == 0) {
+    return OTRNG_SUCCESS;
+  }
+
+  if (sink->f) {
+    if (fwrite(data, 1, len, sink->f) != len) {
+      return OTRNG_ERROR;
+    }
+  } else if (sink->buffer) {
+    if (len > sink->cap - sink->written) {
+      return OTRNG_ERROR;
+    }
+    memcpy(sink->buffer + sink->written, data, len);
+  }
+
+  sink->written += len;
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result store_write_record(store_sink_s *sink, uint8_t type,
+                                        const uint8_t *data, size_t len) {
+  uint8_t header[5];
+
+  if (len > UINT32_MAX) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_serialize_uint8(header, type);
+  otrng_serialize_uint32(header + 1, len);
+
+  if (!store_write_bytes(sink, header, sizeof(header))) {
+    return OTRNG_ERROR;
+  }
+
+  return store_write_bytes(sink, data, len);
+}
+
+/* Writes the serialized [data], which it frees */
+tstatic otrng_result store_write_owned_record(store_sink_s *sink, uint8_t type,
+                                              uint8_t *data, size_t len) {
+  otrng_result result = store_write_record(sink, type, data, len);
+
+  otrng_free(data);
+  return result;
+}
+
+tstatic otrng_result store_write_prekeys(store_sink_s *sink,
+                                         const otrng_client_s *client) {
+  const list_element_s *el;
+  uint8_t *buffer = otrng_secure_alloc(PRE_KEY_WITH_METADATA_MAX_BYTES);
+  otrng_result result = OTRNG_SUCCESS;
+
+  for (el = client->our_prekeys; el && result == OTRNG_SUCCESS; el = el->next) {
+    size_t w = 0;
+
+    result = otrng_prekey_message_serialize_with_metadata(
+        buffer, PRE_KEY_WITH_METADATA_MAX_BYTES, &w, el->data);
+    if (result == OTRNG_SUCCESS) {
+      result =
+          store_write_record(sink, OTRNG_STORE_PREKEY_MESSAGE, buffer, w);
+    }
+  }
+
+  otrng_secure_free(buffer);
+  return result;
+}
+
+tstatic otrng_result store_write_client(store_sink_s *sink,
+                                        const otrng_client_s *client) {
+  uint8_t forging_key[2 + ED448_POINT_BYTES];
+  uint8_t instag[4];
+  OtrlInsTag *tag = NULL;
+  uint8_t *buffer = NULL;
+  size_t len = 0;
+
+  if (client->keypair &&
+      !store_write_record(sink, OTRNG_STORE_PRIVATE_KEY_V4,
+                          client->keypair->sym, ED448_PRIVATE_BYTES)) {
+    return OTRNG_ERROR;
+  }
+
+  if (client->forging_key) {
+    len = otrng_serialize_forging_key(forging_key, *client->forging_key);
+    if (len == 0 || !store_write_record(sink, OTRNG_STORE_FORGING_KEY,
+                                        forging_key, len)) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  /* Looked up directly, as getting the instance tag would make one */
+  if (client->global_state && client->global_state->user_state_v3) {
+    tag = otrl_instag_find(client->global_state->user_state_v3,
+                           client->client_id.account,
+                           client->client_id.protocol);
+  }
+  if (tag) {
+    otrng_serialize_uint32(instag, tag->instag);
+    if (!store_write_record(sink, OTRNG_STORE_INSTANCE_TAG, instag,
+                            sizeof(instag))) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  if (client->client_profile &&
+      (!otrng_client_profile_serialize_with_metadata(&buffer, &len,
+                                                     client->client_profile) ||
+       !store_write_owned_record(sink, OTRNG_STORE_CLIENT_PROFILE, buffer,
+                                 len))) {
+    return OTRNG_ERROR;
+  }
+
+  if (client->exp_client_profile &&
+      (!otrng_client_profile_serialize_with_metadata(
+           &buffer, &len, client->exp_client_profile) ||
+       !store_write_owned_record(sink, OTRNG_STORE_EXP_CLIENT_PROFILE, buffer,
+                                 len))) {
+    return OTRNG_ERROR;
+  }
+
+  if (client->prekey_profile &&
+      (!otrng_prekey_profile_serialize_with_metadata(&buffer, &len,
+                                                     client->prekey_profile) ||
+       !store_write_owned_record(sink, OTRNG_STORE_PREKEY_PROFILE, buffer,
+                                 len))) {
+    return OTRNG_ERROR;
+  }
+
+  if (client->exp_prekey_profile &&
+      (!otrng_prekey_profile_serialize_with_metadata(
+           &buffer, &len, client->exp_prekey_profile) ||
+       !store_write_owned_record(sink, OTRNG_STORE_EXP_PREKEY_PROFILE, buffer,
+                                 len))) {
+    return OTRNG_ERROR;
+  }
+
+  return store_write_prekeys(sink, client);
+}
+
+typedef struct store_written_s {
+  const otrng_client_id_s *client_id;
+  uint64_t offset;
+  uint64_t len;
+} store_written_s;
+
+tstatic otrng_result store_write_string(store_sink_s *sink, const char *str) {
+  uint8_t len[4];
+  size_t str_len = strlen(str) + 1;
+
+  if (str_len > UINT32_MAX) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_serialize_uint32(len, str_len);
+  if (!store_write_bytes(sink, len, sizeof(len))) {
+    return OTRNG_ERROR;
+  }
+
+  return store_write_bytes(sink, str, str_len);
+}
+
+tstatic otrng_result store_write_index(store_sink_s *sink,
+                                       const store_written_s *clients,
+                                       size_t count) {
+  uint8_t header[OTRNG_STORE_HEADER_BYTES];
+  uint8_t location[16];
+  uint64_t index_offset = sink->written;
+  FILE *f = sink->f;
+  size_t n;
+
+  if (count > UINT32_MAX) {
+    return OTRNG_ERROR;
+  }
+
+  for (n = 0; n < count; n++) {
+    otrng_serialize_uint64(location, clients[n].offset);
+    otrng_serialize_uint64(location + 8, clients[n].len);
+
+    if (!store_write_string(sink, clients[n].client_id->protocol) ||
+        !store_write_string(sink, clients[n].client_id->account) ||
+        !store_write_bytes(sink, location, sizeof(location))) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  memcpy(header, OTRNG_STORE_MAGIC, OTRNG_STORE_MAGIC_BYTES);
+  otrng_serialize_uint64(header + OTRNG_STORE_MAGIC_BYTES, index_offset);
+  otrng_serialize_uint32(header + OTRNG_STORE_MAGIC_BYTES + 8, count);
+
+  if (fseek(f, 0, SEEK_SET) != 0 ||
+      fwrite(header, 1, sizeof(header), f) != sizeof(header) ||
+      fseek(f, 0, SEEK_END) != 0 || fflush(f) != 0) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+/* Copies the records of a client that is not in memory */
+tstatic otrng_result store_copy_entry(store_sink_s *sink,
+                                      const otrng_store_entry_s *entry,
+                                      store_written_s *written_clients,
+                                      size_t *count) {
+  if (entry->loaded) {
+    return OTRNG_SUCCESS;
+  }
+
+  written_clients[*count].client_id = &entry->client_id;
+  written_clients[*count].offset = sink->written;
+  written_clients[*count].len = entry->records_len;
+  (*count)++;
+
+  return store_write_bytes(sink, entry->records, entry->records_len);
+}
+
+INTERNAL otrng_result otrng_store_write(FILE *f, const list_element_s *clients,
+                                        const otrng_store_s *store) {
+  uint8_t header[OTRNG_STORE_HEADER_BYTES];
+  store_written_s *written_clients;
+  size_t count = 0, cap;
+  store_sink_s sink;
+  const list_element_s *el;
+  otrng_result result;
+  size_t n;
+
+  if (!f) {
+    return OTRNG_ERROR;
+  }
+
+  cap = otrng_list_len((list_element_s *)clients);
+  if (store) {
+    cap += store->num_entries + otrng_list_len(store->added);
+  }
+  written_clients = otrng_xmalloc_z((cap ? cap : 1) * sizeof(store_written_s));
+
+  memset(&sink, 0, sizeof(store_sink_s));
+  sink.f = f;
+
+  /* The header is filled in once the index is written */
+  memset(header, 0, sizeof(header));
+  result = store_write_bytes(&sink, header, sizeof(header));
+
+  for (el = clients; el && result == OTRNG_SUCCESS; el = el->next) {
+    const otrng_client_s *client = el->data;
+
+    written_clients[count].client_id = &client->client_id;
+    written_clients[count].offset = sink.written;
+    result = store_write_client(&sink, client);
+    written_clients[count].len = sink.written - written_clients[count].offset;
+    count++;
+  }
+
+  for (n = 0; store && n < store->num_entries && result == OTRNG_SUCCESS;
+       n++) {
+    result =
+        store_copy_entry(&sink, &store->entries[n], written_clients, &count);
+  }
+
+  for (el = store ? store->added : NULL; el && result == OTRNG_SUCCESS;
+       el = el->next) {
+    result = store_copy_entry(&sink, el->data, written_clients, &count);
+  }
+
+  if (result == OTRNG_SUCCESS) {
+    result = store_write_index(&sink, written_clients, count);
+  }
+
+  otrng_free(written_clients);
+  return result;
+}
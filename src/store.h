@@ -0,0 +1,147 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_STORE_H
+#define OTRNG_STORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "client.h"
+#include "error.h"
+#include "hash_index.h"
+#include "list.h"
+#include "shared.h"
+
+/*
+ * A binary store of the long-term state of many clients, made to be mapped
+ * into memory and read one client at a time.
+ *
+ * The file starts with "OTRNGST1", the offset of the index (8 bytes) and the
+ * number of clients (4 bytes). The records of every client follow, one client
+ * after the other. A record is a type (1 byte), a length (4 bytes) and that
+ * many bytes. The index is at the end: for every client, its protocol and
+ * account, each a length (4 bytes) and that many bytes ending with a NUL, then
+ * the offset and length of its records (8 bytes each). Numbers are big-endian.
+ */
+
+#define OTRNG_STORE_MAGIC "OTRNGST1"
+#define OTRNG_STORE_MAGIC_BYTES 8
+#define OTRNG_STORE_HEADER_BYTES (OTRNG_STORE_MAGIC_BYTES + 8 + 4)
+
+typedef enum {
+  OTRNG_STORE_PRIVATE_KEY_V4 = 1,
+  OTRNG_STORE_FORGING_KEY = 2,
+  OTRNG_STORE_INSTANCE_TAG = 3,
+  OTRNG_STORE_CLIENT_PROFILE = 4,
+  OTRNG_STORE_EXP_CLIENT_PROFILE = 5,
+  OTRNG_STORE_PREKEY_PROFILE = 6,
+  OTRNG_STORE_EXP_PREKEY_PROFILE = 7,
+  OTRNG_STORE_PREKEY_MESSAGE = 8
+} otrng_store_record_type;
+
+typedef struct otrng_store_entry_s {
+  otrng_client_id_s client_id; /* points into the map */
+  const uint8_t *records;
+  size_t records_len;
+  /* Set once the records are in a client, which has the latest state */
+  otrng_bool loaded;
+  /* The records of an evicted client, which [records] points to instead of
+     the map */
+  uint8_t *evicted;
+} otrng_store_entry_s;
+
+typedef struct otrng_store_s {
+  uint8_t *map;
+  size_t map_len;
+
+  otrng_store_entry_s *entries;
+  size_t num_entries;
+  /* The entries of evicted clients that are not in the map */
+  list_element_s *added;
+  hash_index_s *index; /* the entries by (protocol, account) */
+} otrng_store_s;
+
+/* An empty store, which only holds evicted clients */
+INTERNAL otrng_store_s *otrng_store_new(void);
+
+/**
+ * @brief Maps a store, and reads its index. The records are only read by
+ *        otrng_store_load_client.
+ *
+ * @param [f]   The store. It can be closed afterwards, but it must not be
+ *              written to while the store is open.
+ *
+ * @return NULL if [f] is not a well-formed store.
+ */
+INTERNAL otrng_store_s *otrng_store_open(FILE *f);
+
+INTERNAL void otrng_store_close(otrng_store_s *store);
+
+INTERNAL otrng_store_entry_s *
+otrng_store_find(const otrng_store_s *store,
+                 const otrng_client_id_s *client_id);
+
+/**
+ * @brief Deserializes the records of [entry] into [client], which must
+ *        belong to a global state.
+ */
+INTERNAL otrng_result otrng_store_load_client(otrng_client_s *client,
+                                              const otrng_store_entry_s *entry);
+
+/* Marks [entry] as loaded, and drops the records it holds for an evicted
+   client */
+INTERNAL void otrng_store_set_loaded(otrng_store_entry_s *entry);
+
+/**
+ * @brief Serializes [client] into its entry, which is added if the store has
+ *        none, so that the client can be freed and loaded again later.
+ */
+INTERNAL otrng_result otrng_store_evict_client(otrng_store_s *store,
+                                               const otrng_client_s *client);
+
+/**
+ * @brief Writes a store of [clients], followed by the entries of [store]
+ *        that are not loaded, which are copied as they are.
+ *
+ * @param [f]         The file to write to. It must be seekable.
+ * @param [clients]   The clients.
+ * @param [store]     The store they were loaded from, or NULL.
+ */
+INTERNAL otrng_result otrng_store_write(FILE *f, const list_element_s *clients,
+                                        const otrng_store_s *store);
+
+#ifdef OTRNG_STORE_PRIVATE
+
+/* Where records are written: to [f] if set, or else into the [cap] bytes of
+   [buffer] if set, or else only counted */
+typedef struct store_sink_s {
+  FILE *f;
+  uint8_t *buffer;
+  size_t cap;
+  uint64_t written;
+} store_sink_s;
+
+tstatic otrng_result store_write_client(store_sink_s *sink,
+                                        const otrng_client_s *client);
+
+#endif
+
+#endif
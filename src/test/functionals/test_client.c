@@ -323,6 +323,228 @@ static void test_conversation_with_multiple_locations() {
   otrng_client_free_all(alice, bob);
 }
 
+static void test_conversations_with_multiple_instances() {
+  otrng_client_s *alice = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_phone = otrng_client_new(BOB_IDENTITY);
+  otrng_client_s *bob_desktop = otrng_client_new(BOB_IDENTITY);
+
+  set_up_client(alice, ALICE_ACCOUNT, 1);
+  set_up_client(bob_phone, BOB_ACCOUNT, 2);
+  set_up_client(bob_desktop, BOB_ACCOUNT, 3);
+
+  otrng_bool ignore = otrng_false;
+  char *to_display = NULL;
+  char *from_phone = NULL, *from_desktop = NULL;
+  char *to_phone = NULL, *to_desktop = NULL;
+
+  // Both of Bob's devices get Alice's query message, and start a DAKE
+  char *query_message =
+      otrng_client_query_message(BOB_ACCOUNT, "Hi bob", alice);
+  otrng_client_receive(&from_phone, &to_display, query_message, ALICE_ACCOUNT,
+                       bob_phone, &ignore);
+  otrng_client_receive(&from_desktop, &to_display, query_message,
+                       ALICE_ACCOUNT, bob_desktop, &ignore);
+  otrng_free(query_message);
+
+  // Alice answers each identity message from its own conversation
+  otrng_client_receive(&to_phone, &to_display, from_phone, BOB_ACCOUNT, alice,
+                       &ignore);
+  otrng_client_receive(&to_desktop, &to_display, from_desktop, BOB_ACCOUNT,
+                       alice, &ignore);
+  otrng_free(from_phone);
+  otrng_free(from_desktop);
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 2);
+
+  // Each device receives its Auth-R, and sends an Auth-I
+  otrng_client_receive(&from_phone, &to_display, to_phone, ALICE_ACCOUNT,
+                       bob_phone, &ignore);
+  otrng_client_receive(&from_desktop, &to_display, to_desktop, ALICE_ACCOUNT,
+                       bob_desktop, &ignore);
+  otrng_free(to_phone);
+  otrng_free(to_desktop);
+
+  // Alice finishes both DAKEs without one taking over the other
+  otrng_client_receive(&to_phone, &to_display, from_phone, BOB_ACCOUNT, alice,
+                       &ignore);
+  otrng_client_receive(&to_desktop, &to_display, from_desktop, BOB_ACCOUNT,
+                       alice, &ignore);
+  otrng_free(from_phone);
+  otrng_free(from_desktop);
+  otrng_client_receive(&from_phone, &to_display, to_phone, ALICE_ACCOUNT,
+                       bob_phone, &ignore);
+  otrng_client_receive(&from_desktop, &to_display, to_desktop, ALICE_ACCOUNT,
+                       bob_desktop, &ignore);
+  otrng_free(to_phone);
+  otrng_free(to_desktop);
+  otrng_free(from_phone);
+  otrng_free(from_desktop);
+
+  otrng_conversation_s *alice_to_phone =
+      otrng_client_get_instance_conversation(0x102, BOB_ACCOUNT, alice);
+  otrng_conversation_s *alice_to_desktop =
+      otrng_client_get_instance_conversation(0x103, BOB_ACCOUNT, alice);
+  otrng_assert(alice_to_phone);
+  otrng_assert(alice_to_desktop);
+  otrng_assert(alice_to_phone != alice_to_desktop);
+  otrng_assert(otrng_conversation_is_encrypted(alice_to_phone));
+  otrng_assert(otrng_conversation_is_encrypted(alice_to_desktop));
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 2);
+
+  // Alice sends to the device she last heard from
+  otrng_assert(otrng_client_get_conversation(0, BOB_ACCOUNT, alice) ==
+               alice_to_desktop);
+
+  // The phone writes, and Alice's replies go to it
+  otrng_assert_is_success(
+      otrng_client_send(&from_phone, "from phone", ALICE_ACCOUNT, bob_phone));
+  otrng_assert_is_success(otrng_client_receive(
+      &to_phone, &to_display, from_phone, BOB_ACCOUNT, alice, &ignore));
+  otrng_free(from_phone);
+  otrng_assert(!to_phone);
+  g_assert_cmpstr(to_display, ==, "from phone");
+  otrng_free(to_display);
+  to_display = NULL;
+
+  otrng_assert(otrng_client_get_conversation(0, BOB_ACCOUNT, alice) ==
+               alice_to_phone);
+
+  otrng_assert_is_success(
+      otrng_client_send(&to_phone, "hi phone", BOB_ACCOUNT, alice));
+  otrng_assert_is_success(otrng_client_receive(
+      &from_phone, &to_display, to_phone, ALICE_ACCOUNT, bob_phone, &ignore));
+  otrng_free(to_phone);
+  otrng_assert(!from_phone);
+  g_assert_cmpstr(to_display, ==, "hi phone");
+  otrng_free(to_display);
+
+  // A batch from both devices goes through the ratchet of each one
+  char *batch[3];
+  char *batch_replies[3], *batch_display[3];
+  otrng_result batch_results[3];
+  int n;
+  otrng_assert_is_success(
+      otrng_client_send(&batch[0], "desktop 1", ALICE_ACCOUNT, bob_desktop));
+  otrng_assert_is_success(
+      otrng_client_send(&batch[1], "phone 1", ALICE_ACCOUNT, bob_phone));
+  otrng_assert_is_success(
+      otrng_client_send(&batch[2], "desktop 2", ALICE_ACCOUNT, bob_desktop));
+
+  otrng_assert_is_success(otrng_client_receive_batch(
+      batch_replies, batch_display, batch_results, (const char **)batch, 3,
+      BOB_ACCOUNT, alice));
+  g_assert_cmpstr(batch_display[0], ==, "desktop 1");
+  g_assert_cmpstr(batch_display[1], ==, "phone 1");
+  g_assert_cmpstr(batch_display[2], ==, "desktop 2");
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 2);
+  otrng_assert(otrng_client_get_conversation(0, BOB_ACCOUNT, alice) ==
+               alice_to_desktop);
+
+  for (n = 0; n < 3; n++) {
+    otrng_assert_is_success(batch_results[n]);
+    otrng_assert(!batch_replies[n]);
+    otrng_free(batch_display[n]);
+    otrng_free(batch[n]);
+  }
+
+  otrng_global_state_free(alice->global_state);
+  otrng_global_state_free(bob_phone->global_state);
+  otrng_global_state_free(bob_desktop->global_state);
+  otrng_client_free_all(alice, bob_phone, bob_desktop);
+}
+
+static void test_conversations_with_unauthenticated_instances() {
+  otrng_client_s *alice = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_phone = otrng_client_new(BOB_IDENTITY);
+  otrng_client_s *bob_desktop = otrng_client_new(BOB_IDENTITY);
+  otrng_client_s *bob_tablet = otrng_client_new(BOB_IDENTITY);
+
+  set_up_client(alice, ALICE_ACCOUNT, 1);
+  set_up_client(bob_phone, BOB_ACCOUNT, 2);
+  set_up_client(bob_desktop, BOB_ACCOUNT, 3);
+  set_up_client(bob_tablet, BOB_ACCOUNT, 4);
+
+  otrng_bool ignore = otrng_false;
+  char *to_display = NULL;
+  char *from_phone = NULL, *from_desktop = NULL, *from_tablet = NULL;
+  char *to_phone = NULL, *to_desktop = NULL, *to_tablet = NULL;
+
+  // Every device of Bob gets Alice's query message, and starts a DAKE
+  char *query_message =
+      otrng_client_query_message(BOB_ACCOUNT, "Hi bob", alice);
+  otrng_client_receive(&from_phone, &to_display, query_message, ALICE_ACCOUNT,
+                       bob_phone, &ignore);
+  otrng_client_receive(&from_desktop, &to_display, query_message,
+                       ALICE_ACCOUNT, bob_desktop, &ignore);
+  otrng_client_receive(&from_tablet, &to_display, query_message,
+                       ALICE_ACCOUNT, bob_tablet, &ignore);
+  otrng_free(query_message);
+
+  // Only the phone finishes its DAKE
+  otrng_client_receive(&to_phone, &to_display, from_phone, BOB_ACCOUNT, alice,
+                       &ignore);
+  otrng_free(from_phone);
+  otrng_client_receive(&from_phone, &to_display, to_phone, ALICE_ACCOUNT,
+                       bob_phone, &ignore);
+  otrng_free(to_phone);
+  otrng_client_receive(&to_phone, &to_display, from_phone, BOB_ACCOUNT, alice,
+                       &ignore);
+  otrng_free(from_phone);
+  otrng_free(to_phone);
+  otrng_assert(otrng_conversation_is_encrypted(
+      otrng_client_get_instance_conversation(0x102, BOB_ACCOUNT, alice)));
+
+  // No more instances than allowed get a conversation
+  otrng_client_set_max_instances(1, alice);
+  otrng_assert_is_success(otrng_client_receive(
+      &to_desktop, &to_display, from_desktop, BOB_ACCOUNT, alice, &ignore));
+  otrng_assert(ignore);
+  otrng_assert(!to_desktop);
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 1);
+  ignore = otrng_false;
+
+  otrng_client_set_max_instances(OTRNG_CLIENT_DEFAULT_MAX_INSTANCES, alice);
+  otrng_client_receive(&to_desktop, &to_display, from_desktop, BOB_ACCOUNT,
+                       alice, &ignore);
+  otrng_assert(to_desktop);
+  otrng_assert(
+      otrng_client_get_instance_conversation(0x103, BOB_ACCOUNT, alice));
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 2);
+
+  // A DAKE from another instance takes the place of the one not finished
+  otrng_client_receive(&to_tablet, &to_display, from_tablet, BOB_ACCOUNT,
+                       alice, &ignore);
+  otrng_assert(to_tablet);
+  otrng_assert(
+      !otrng_client_get_instance_conversation(0x103, BOB_ACCOUNT, alice));
+  otrng_assert(
+      otrng_client_get_instance_conversation(0x104, BOB_ACCOUNT, alice));
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 2);
+  otrng_free(from_desktop);
+  otrng_free(to_desktop);
+  otrng_free(from_tablet);
+
+  // Once authenticated, it stays
+  otrng_client_receive(&from_tablet, &to_display, to_tablet, ALICE_ACCOUNT,
+                       bob_tablet, &ignore);
+  otrng_free(to_tablet);
+  otrng_client_receive(&to_tablet, &to_display, from_tablet, BOB_ACCOUNT,
+                       alice, &ignore);
+  otrng_free(from_tablet);
+  otrng_free(to_tablet);
+
+  otrng_conversation_s *alice_to_tablet =
+      otrng_client_get_instance_conversation(0x104, BOB_ACCOUNT, alice);
+  otrng_assert(otrng_conversation_is_encrypted(alice_to_tablet));
+  otrng_assert(!alice_to_tablet->unauthenticated);
+  g_assert_cmpint(otrng_list_len(alice->conversations), ==, 2);
+
+  otrng_global_state_free(alice->global_state);
+  otrng_global_state_free(bob_phone->global_state);
+  otrng_global_state_free(bob_desktop->global_state);
+  otrng_global_state_free(bob_tablet->global_state);
+  otrng_client_free_all(alice, bob_phone, bob_desktop, bob_tablet);
+}
+
 static void test_valid_identity_message_in_waiting_auth_i() {
   otrng_client_s *alice = otrng_client_new(ALICE_IDENTITY);
   otrng_client_s *bob = otrng_client_new(BOB_IDENTITY);
@@ -999,21 +1221,26 @@ static void test_client_expires_old_fragments(void) {
   set_up_client(alice, ALICE_ACCOUNT, 1);
 
   char *to_send = NULL, *to_display = NULL;
-  time_t expiration_time;
   otrng_bool ignore = otrng_false;
 
-  expiration_time = time(NULL) - 3600;
-
   otrng_client_receive(&to_send, &to_display, fmessage->pieces[0], BOB_ACCOUNT,
                        alice, &ignore);
 
   otrng_conversation_s *conv =
       otrng_client_get_conversation(0, BOB_ACCOUNT, alice);
-  g_assert_cmpint(otrng_list_len(conv->conn->pending_fragments), ==, 1);
+  g_assert_cmpint(otrng_fragment_reassembly_len(conv->conn->pending_fragments),
+                  ==, 1);
 
-  otrng_client_expire_fragments(expiration_time, alice);
+  /* A recent fragment is kept */
+  otrng_client_expire_fragments(60, alice);
+  g_assert_cmpint(otrng_fragment_reassembly_len(conv->conn->pending_fragments),
+                  ==, 1);
 
-  g_assert_cmpint(otrng_list_len(conv->conn->pending_fragments), ==, 0);
+  conv->conn->pending_fragments->oldest->last_fragment_received_at -= 3600;
+  otrng_client_expire_fragments(60, alice);
+
+  g_assert_cmpint(otrng_fragment_reassembly_len(conv->conn->pending_fragments),
+                  ==, 0);
 
   otrng_free(to_display);
   otrng_message_free(fmessage);
@@ -1086,12 +1313,35 @@ static void test_client_sends_fragmented_message(void) {
     }
   }
 
+  otrng_free(to_display);
+  to_display = NULL;
+
+  /* Alice fragments the message again, without copying it */
+  otrng_scattered_message_s scattered;
+  char fragment[100 + 1];
+  otrng_assert_is_success(otrng_client_send_scattered(&scattered, message, 100,
+                                                      BOB_ACCOUNT, alice));
+  otrng_assert(scattered.total > 1);
+
+  for (size_t n = 0; n < scattered.total; n++) {
+    /* Bob receives the fragments */
+    otrng_scattered_fragment_copy(fragment, &scattered.fragments[n]);
+    otrng_client_receive(&from_bob, &to_display, fragment, ALICE_ACCOUNT, bob,
+                         &ignore);
+    otrng_assert(!from_bob);
+
+    if (scattered.total - 1 == n) {
+      g_assert_cmpstr(to_display, ==, message);
+    }
+  }
+
   otrng_free(from_bob);
   from_bob = NULL;
 
   otrng_free(to_display);
   to_display = NULL;
 
+  otrng_scattered_message_destroy(&scattered);
   otrng_message_free(to_send);
   otrng_global_state_free(alice->global_state);
   otrng_global_state_free(bob->global_state);
@@ -1116,5 +1366,9 @@ void functionals_client_add_tests(void) {
                   test_valid_identity_message_in_waiting_auth_r);
   g_test_add_func("/client/conversation_data_message_multiple_locations",
                   test_conversation_with_multiple_locations);
+  g_test_add_func("/client/conversations_with_multiple_instances",
+                  test_conversations_with_multiple_instances);
+  g_test_add_func("/client/conversations_with_unauthenticated_instances",
+                  test_conversations_with_unauthenticated_instances);
   g_test_add_func("/client/api", test_client_api);
 }
@@ -24,6 +24,38 @@
 
 #include "test_fixtures.h"
 
+#include "data_message.h"
+#include "protocol.h"
+
+#include <libotr/b64.h>
+
+/* Encodes a data message built by hand, such as a corrupted one */
+static otrng_result encode_data_message(string_p *dst, const k_msg_mac mac_key,
+                                        const data_message_s *data_msg) {
+  uint8_t *body = NULL;
+  size_t body_len = 0;
+  uint8_t *ser;
+
+  if (!otrng_data_message_body_serialize(&body, &body_len, data_msg)) {
+    return OTRNG_ERROR;
+  }
+
+  ser = otrng_xmalloc_z(body_len + MAC_KEY_BYTES);
+  memcpy(ser, body, body_len);
+  otrng_free(body);
+
+  if (otrng_failed(otrng_data_message_authenticator(
+          ser + body_len, MAC_KEY_BYTES, mac_key, ser, body_len))) {
+    otrng_free(ser);
+    return OTRNG_ERROR;
+  }
+
+  *dst = otrl_base64_otr_encode(ser, body_len + MAC_KEY_BYTES);
+  otrng_free(ser);
+
+  return OTRNG_SUCCESS;
+}
+
 /* Test the an in-order sending and receiving double ratchet */
 static void test_double_ratchet_new_sending_ratchet_in_order(void) {
   otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
@@ -253,7 +285,7 @@ static void test_double_ratchet_same_ratchet_out_of_order(void) {
   g_assert_cmpint(bob->keys->j, ==, 0);
   g_assert_cmpint(bob->keys->k, ==, 5);
   g_assert_cmpint(bob->keys->pn, ==, 0);
-  g_assert_cmpint(otrng_list_len(bob->keys->skipped_keys), ==, 2);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 2);
 
   response_to_alice = otrng_response_new();
   result = otrng_receive_message(response_to_alice, &warn, to_send_3, bob);
@@ -267,7 +299,7 @@ static void test_double_ratchet_same_ratchet_out_of_order(void) {
   g_assert_cmpint(bob->keys->j, ==, 0);
   g_assert_cmpint(bob->keys->k, ==, 5);
   g_assert_cmpint(bob->keys->pn, ==, 0);
-  g_assert_cmpint(otrng_list_len(bob->keys->skipped_keys), ==, 1);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 1);
 
   response_to_alice = otrng_response_new();
   result = otrng_receive_message(response_to_alice, &warn, to_send_2, bob);
@@ -360,7 +392,7 @@ static void test_double_ratchet_new_ratchet_out_of_order(void) {
   free_message_and_response(response_to_alice, &to_send_2);
 
   g_assert_cmpint(otrng_list_len(bob->keys->old_mac_keys), ==, 3);
-  g_assert_cmpint(otrng_list_len(bob->keys->skipped_keys), ==, 0);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 0);
   g_assert_cmpint(bob->keys->i, ==, 1);
   g_assert_cmpint(bob->keys->j, ==, 0);
   g_assert_cmpint(bob->keys->k, ==, 3);
@@ -413,7 +445,7 @@ static void test_double_ratchet_new_ratchet_out_of_order(void) {
   g_assert_cmpint(bob->keys->j, ==, 0);
   g_assert_cmpint(bob->keys->k, ==, 1);
   g_assert_cmpint(bob->keys->pn, ==, 1);
-  g_assert_cmpint(otrng_list_len(bob->keys->skipped_keys), ==, 1);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 1);
 
   // Bob receives the previous data message
   response_to_alice = otrng_response_new();
@@ -423,7 +455,7 @@ static void test_double_ratchet_new_ratchet_out_of_order(void) {
   free_message_and_response(response_to_alice, &to_send_3);
 
   g_assert_cmpint(otrng_list_len(bob->keys->old_mac_keys), ==, 2);
-  g_assert_cmpint(otrng_list_len(bob->keys->skipped_keys), ==, 0);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 0);
   g_assert_cmpint(bob->keys->i, ==, 3);
   g_assert_cmpint(bob->keys->j, ==, 0);
   g_assert_cmpint(bob->keys->k, ==, 1);
@@ -479,8 +511,8 @@ static void test_double_ratchet_corrupted_ratchet(void) {
   memset(corrupted_data_message->nonce, 0, DATA_MSG_NONCE_BYTES);
   k_msg_mac mac_key;
   memset(mac_key, 0, sizeof mac_key);
-  serialize_and_encode_data_message(&to_send_2, mac_key, NULL, 0,
-                                    corrupted_data_message);
+  otrng_assert_is_success(
+      encode_data_message(&to_send_2, mac_key, corrupted_data_message));
 
   // Bob receives a data message
   response_to_alice = otrng_response_new();
@@ -503,7 +535,7 @@ static void test_double_ratchet_corrupted_ratchet(void) {
   free_message_and_response(response_to_alice, &to_send_2);
 
   g_assert_cmpint(otrng_list_len(bob->keys->old_mac_keys), ==, 2);
-  g_assert_cmpint(otrng_list_len(bob->keys->skipped_keys), ==, 0);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 0);
   g_assert_cmpint(bob->keys->i, ==, 1);
   g_assert_cmpint(bob->keys->j, ==, 0);
   g_assert_cmpint(bob->keys->k, ==, 2);
@@ -517,6 +549,603 @@ static void test_double_ratchet_corrupted_ratchet(void) {
   otrng_conn_free_all(alice, bob);
 }
 
+static void test_double_ratchet_send_reusing_buffer(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+
+  const char *messages[] = {"hi", "hello again", "a somewhat longer message"};
+  char *buffer = NULL;
+  size_t capacity = 0;
+  otrng_warning warn = OTRNG_WARN_NONE;
+  int n;
+
+  for (n = 0; n < 3; n++) {
+    otrng_response_s *response = otrng_response_new();
+    otrng_result result = otrng_prepare_to_send_data_message_into(
+        &buffer, &capacity, &warn, messages[n], NULL, alice, 0);
+    assert_message_sent(result, buffer);
+    g_assert_cmpint(strlen(buffer) + 1, <=, capacity);
+
+    result = otrng_receive_message(response, &warn, buffer, bob);
+    assert_message_rec(result, messages[n], response);
+
+    /* The plaintext is read where it was decrypted */
+    otrng_assert(response->decoded);
+    if (response->to_display) {
+      otrng_assert((uint8_t *)response->to_display > response->decoded);
+      otrng_assert((uint8_t *)response->to_display <
+                   response->decoded + response->decoded_len);
+    }
+    otrng_response_free(response);
+  }
+
+  otrng_free(buffer);
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_send_batch(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+
+  const string_p msgs[] = {"one", "two", "three", "four"};
+  string_p to_send[4];
+  otrng_warning warn = OTRNG_WARN_NONE;
+  otrng_response_s *response;
+  string_p reply = NULL;
+  int round, n;
+
+  for (round = 0; round < 2; round++) {
+    otrng_assert_is_success(
+        otrng_send_messages(to_send, msgs, 4, &warn, 0, alice));
+
+    for (n = 0; n < 4; n++) {
+      response = otrng_response_new();
+      assert_message_sent(OTRNG_SUCCESS, to_send[n]);
+      otrng_assert_is_success(
+          otrng_receive_message(response, &warn, to_send[n], bob));
+      assert_message_rec(OTRNG_SUCCESS, msgs[n], response);
+      otrng_response_free(response);
+      otrng_free(to_send[n]);
+    }
+
+    /* Bob's reply makes the next batch start a new ratchet */
+    otrng_assert_is_success(
+        otrng_send_message(&reply, "ok", &warn, NULL, 0, bob));
+    response = otrng_response_new();
+    otrng_assert_is_success(
+        otrng_receive_message(response, &warn, reply, alice));
+    otrng_response_free(response);
+    otrng_free(reply);
+    reply = NULL;
+  }
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_receive_batch(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+
+  const string_p msgs[] = {"hi", "how are you?", "it's me", "ok?"};
+  string_p to_send[4];
+  string_p received[5];
+  otrng_response_s *responses[5];
+  otrng_result results[5];
+  otrng_warning warn = OTRNG_WARN_NONE;
+  size_t len;
+  int n;
+
+  otrng_assert_is_success(
+      otrng_send_messages(to_send, msgs, 4, &warn, 0, alice));
+
+  /* A copy of the third message with a broken MAC */
+  received[2] = otrng_xstrdup(to_send[2]);
+  len = strlen(received[2]);
+  received[2][len - 6] = received[2][len - 6] == 'A' ? 'B' : 'A';
+
+  received[0] = to_send[0];
+  received[1] = to_send[3];
+  received[3] = to_send[2];
+  received[4] = to_send[1];
+
+  for (n = 0; n < 5; n++) {
+    responses[n] = otrng_response_new();
+  }
+
+  otrng_assert_is_error(otrng_receive_messages(
+      responses, results, (const string_p *)received, 5, bob));
+
+  /* The broken message is rolled back without affecting the others */
+  assert_message_rec(results[0], "hi", responses[0]);
+  assert_message_rec(results[1], "ok?", responses[1]);
+  otrng_assert_is_error(results[2]);
+  otrng_assert(!responses[2]->to_display);
+  assert_message_rec(results[3], "it's me", responses[3]);
+  assert_message_rec(results[4], "how are you?", responses[4]);
+
+  /* The same state as receiving them one by one */
+  g_assert_cmpint(bob->keys->i, ==, 1);
+  g_assert_cmpint(bob->keys->j, ==, 0);
+  g_assert_cmpint(bob->keys->k, ==, 5);
+  g_assert_cmpint(bob->keys->pn, ==, 0);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 0);
+  otrng_assert(!bob->receive_batch);
+
+  for (n = 0; n < 5; n++) {
+    otrng_response_free(responses[n]);
+  }
+
+  otrng_free(received[2]);
+  for (n = 0; n < 4; n++) {
+    otrng_free(to_send[n]);
+  }
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_lookahead(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+
+  string_p to_send[41];
+  otrng_warning warn = OTRNG_WARN_NONE;
+  otrng_response_s *response;
+  otrng_latency_histogram_s latency;
+  unsigned int k;
+  int n;
+
+  for (n = 0; n < 41; n++) {
+    otrng_assert_is_success(
+        otrng_send_message(&to_send[n], "hi", &warn, NULL, 0, alice));
+  }
+
+  /* Receiving the first message starts Bob's receiving chain */
+  response = otrng_response_new();
+  otrng_assert_is_success(
+      otrng_receive_message(response, &warn, to_send[0], bob));
+  otrng_response_free(response);
+
+  otrng_client_reset_receive_latency(bob_client);
+  g_assert_cmpint(otrng_key_manager_lookahead(bob->keys, 64, 1000), ==, 64);
+  k = bob->keys->k;
+
+  /* After a gap, and the messages in it */
+  response = otrng_response_new();
+  otrng_assert_is_success(
+      otrng_receive_message(response, &warn, to_send[40], bob));
+  assert_message_rec(OTRNG_SUCCESS, "hi", response);
+  otrng_response_free(response);
+
+  response = otrng_response_new();
+  otrng_assert_is_success(
+      otrng_receive_message(response, &warn, to_send[20], bob));
+  assert_message_rec(OTRNG_SUCCESS, "hi", response);
+  otrng_response_free(response);
+
+  g_assert_cmpint(bob->keys->k, ==, bob->keys->lookahead->start);
+  /* Only the keys used are derived again */
+  g_assert_cmpint(otrng_key_manager_lookahead(bob->keys, 64, 1000), ==,
+                  bob->keys->k - k);
+
+  otrng_client_get_receive_latency(&latency, bob_client);
+  g_assert_cmpint(latency.count, ==, 2);
+
+  for (n = 0; n < 41; n++) {
+    otrng_free(to_send[n]);
+  }
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_dh_pool(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+
+  otrng_warning warn = OTRNG_WARN_NONE;
+  otrng_response_s *response;
+  string_p to_send = NULL;
+  otrng_keypair_pool_stats_s stats;
+  int round;
+
+  otrng_client_set_dh_pool_depth(4, alice_client);
+  otrng_client_set_dh_pool_depth(4, bob_client);
+  g_assert_cmpint(otrng_client_do_background_work(10, alice_client), ==, 4);
+  g_assert_cmpint(otrng_client_do_background_work(10, bob_client), ==, 4);
+
+  /* Every turn of the conversation is a new DH ratchet */
+  for (round = 0; round < 12; round++) {
+    otrng_s *sender = round % 2 ? bob : alice;
+    otrng_s *receiver = round % 2 ? alice : bob;
+
+    otrng_assert_is_success(
+        otrng_send_message(&to_send, "hi", &warn, NULL, 0, sender));
+    response = otrng_response_new();
+    otrng_assert_is_success(
+        otrng_receive_message(response, &warn, to_send, receiver));
+    assert_message_rec(OTRNG_SUCCESS, "hi", response);
+    otrng_response_free(response);
+    otrng_free(to_send);
+    to_send = NULL;
+  }
+
+  otrng_client_get_dh_pool_stats(&stats, alice_client);
+  g_assert_cmpint(stats.hits, >, 0);
+  g_assert_cmpint(stats.misses, ==, 0);
+  g_assert_cmpint(stats.hits + stats.available, ==, 4);
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_snapshot(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+  bob->peer = otrng_xstrdup(ALICE_ACCOUNT);
+
+  const string_p msgs[] = {"hi", "how are you?", "it's me"};
+  string_p to_send[3];
+  otrng_response_s *response;
+  otrng_conversation_s *restored;
+  string_p reply = NULL;
+  otrng_warning warn = OTRNG_WARN_NONE;
+  uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES] = {1};
+  uint8_t wrong_key[OTRNG_SNAPSHOT_KEY_BYTES] = {2};
+  uint8_t *snapshot = NULL;
+  size_t snapshot_len = 0;
+
+  otrng_assert_is_success(
+      otrng_send_messages(to_send, msgs, 3, &warn, 0, alice));
+
+  /* Bob skips a message before the snapshot */
+  response = otrng_response_new();
+  assert_message_rec(otrng_receive_message(response, &warn, to_send[1], bob),
+                     "how are you?", response);
+  otrng_response_free(response);
+  g_assert_cmpint(otrng_skipped_keys_table_len(bob->keys->skipped_keys), ==, 1);
+
+  otrng_conversation_s conv = {.recipient = bob->peer, .conn = bob};
+  otrng_assert_is_success(
+      otrng_conversation_snapshot(&snapshot, &snapshot_len, key, &conv));
+  otrng_conn_free(bob);
+
+  otrng_assert(!otrng_client_restore_conversation(snapshot, snapshot_len,
+                                                  wrong_key, bob_client));
+  snapshot[snapshot_len - 1] ^= 1;
+  otrng_assert(!otrng_client_restore_conversation(snapshot, snapshot_len, key,
+                                                  bob_client));
+  snapshot[snapshot_len - 1] ^= 1;
+
+  restored = otrng_client_restore_conversation(snapshot, snapshot_len, key,
+                                               bob_client);
+  otrng_assert(restored);
+  otrng_assert(otrng_conversation_is_encrypted(restored));
+  otrng_assert(otrng_client_get_instance_conversation(
+                   our_instance_tag(alice), ALICE_ACCOUNT, bob_client) ==
+               restored);
+
+  /* It can only be resumed once */
+  otrng_assert(!otrng_client_restore_conversation(snapshot, snapshot_len, key,
+                                                  bob_client));
+
+  /* The skipped key and the ratchet survived */
+  response = otrng_response_new();
+  assert_message_rec(
+      otrng_receive_message(response, &warn, to_send[0], restored->conn), "hi",
+      response);
+  otrng_response_free(response);
+
+  response = otrng_response_new();
+  assert_message_rec(
+      otrng_receive_message(response, &warn, to_send[2], restored->conn),
+      "it's me", response);
+  otrng_response_free(response);
+
+  otrng_assert_is_success(
+      otrng_send_message(&reply, "fine", &warn, NULL, 0, restored->conn));
+  response = otrng_response_new();
+  assert_message_rec(otrng_receive_message(response, &warn, reply, alice),
+                     "fine", response);
+  otrng_response_free(response);
+
+  otrng_free(reply);
+  otrng_free(snapshot);
+  for (int n = 0; n < 3; n++) {
+    otrng_free(to_send[n]);
+  }
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free(alice);
+}
+
+static void benchmark_send(otrng_s *alice, size_t msg_len, int rounds) {
+  char *msg = otrng_xmalloc(msg_len + 1);
+  char *buffer = NULL;
+  size_t capacity = 0;
+  otrng_warning warn = OTRNG_WARN_NONE;
+  double elapsed;
+  int r;
+
+  memset(msg, 'a', msg_len);
+  msg[msg_len] = '\0';
+
+  g_test_timer_start();
+  for (r = 0; r < rounds; r++) {
+    string_p to_send = NULL;
+    otrng_assert_is_success(
+        otrng_send_message(&to_send, msg, &warn, NULL, 0, alice));
+    otrng_free(to_send);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e6 / rounds,
+                          "send %zu bytes: %.1f us, %.1f MB/s", msg_len,
+                          elapsed * 1e6 / rounds,
+                          msg_len * rounds / elapsed / 1e6);
+
+  g_test_timer_start();
+  for (r = 0; r < rounds; r++) {
+    otrng_assert_is_success(otrng_prepare_to_send_data_message_into(
+        &buffer, &capacity, &warn, msg, NULL, alice, 0));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e6 / rounds,
+                          "send %zu bytes reusing the buffer: %.1f us, "
+                          "%.1f MB/s",
+                          msg_len, elapsed * 1e6 / rounds,
+                          msg_len * rounds / elapsed / 1e6);
+
+  otrng_free(buffer);
+  otrng_free(msg);
+}
+
+static void benchmark_send_batch(otrng_s *alice, size_t count) {
+  string_p *msgs = otrng_xmalloc_z(count * sizeof(string_p));
+  string_p *to_send = otrng_xmalloc_z(count * sizeof(string_p));
+  char msg[101];
+  otrng_warning warn = OTRNG_WARN_NONE;
+  double elapsed;
+  size_t n;
+
+  memset(msg, 'a', sizeof(msg) - 1);
+  msg[sizeof(msg) - 1] = '\0';
+  for (n = 0; n < count; n++) {
+    msgs[n] = msg;
+  }
+
+  g_test_timer_start();
+  for (n = 0; n < count; n++) {
+    otrng_assert_is_success(
+        otrng_send_message(&to_send[n], msg, &warn, NULL, 0, alice));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed, "%zu single sends: %.0f msg/s", count,
+                          count / elapsed);
+
+  for (n = 0; n < count; n++) {
+    otrng_free(to_send[n]);
+  }
+
+  g_test_timer_start();
+  otrng_assert_is_success(otrng_send_messages(
+      to_send, (const string_p *)msgs, count, &warn, 0, alice));
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed, "batch of %zu: %.0f msg/s", count,
+                          count / elapsed);
+
+  for (n = 0; n < count; n++) {
+    otrng_free(to_send[n]);
+  }
+
+  otrng_free(to_send);
+  otrng_free(msgs);
+}
+
+static void benchmark_receive_batch(otrng_s *alice, otrng_s *bob,
+                                    size_t count) {
+  string_p *msgs = otrng_xmalloc_z(count * sizeof(string_p));
+  string_p *to_send = otrng_xmalloc_z(count * sizeof(string_p));
+  otrng_response_s **responses =
+      otrng_xmalloc_z(count * sizeof(otrng_response_s *));
+  otrng_result *results = otrng_xmalloc_z(count * sizeof(otrng_result));
+  char msg[101];
+  otrng_warning warn = OTRNG_WARN_NONE;
+  double elapsed;
+  size_t n;
+
+  memset(msg, 'a', sizeof(msg) - 1);
+  msg[sizeof(msg) - 1] = '\0';
+  for (n = 0; n < count; n++) {
+    msgs[n] = msg;
+  }
+
+  otrng_assert_is_success(otrng_send_messages(
+      to_send, (const string_p *)msgs, count, &warn, 0, alice));
+
+  g_test_timer_start();
+  for (n = 0; n < count; n++) {
+    otrng_response_s *response = otrng_response_new();
+    otrng_assert_is_success(
+        otrng_receive_message(response, &warn, to_send[n], bob));
+    otrng_response_free(response);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed, "%zu single receives: %.0f msg/s", count,
+                          count / elapsed);
+
+  for (n = 0; n < count; n++) {
+    otrng_free(to_send[n]);
+    responses[n] = otrng_response_new();
+  }
+
+  otrng_assert_is_success(otrng_send_messages(
+      to_send, (const string_p *)msgs, count, &warn, 0, alice));
+
+  g_test_timer_start();
+  otrng_assert_is_success(otrng_receive_messages(
+      responses, results, (const string_p *)to_send, count, bob));
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed, "batch receive of %zu: %.0f msg/s", count,
+                          count / elapsed);
+
+  for (n = 0; n < count; n++) {
+    otrng_response_free(responses[n]);
+    otrng_free(to_send[n]);
+  }
+
+  otrng_free(results);
+  otrng_free(responses);
+  otrng_free(to_send);
+  otrng_free(msgs);
+}
+
+static void test_double_ratchet_benchmark_send(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  do_dake_fixture(alice, bob);
+
+  benchmark_send(alice, 100, 2000);
+  benchmark_send(alice, 4 * 1024, 1000);
+  benchmark_send(alice, 64 * 1024, 200);
+
+  benchmark_send_batch(alice, 50);
+  benchmark_send_batch(alice, 500);
+
+  benchmark_receive_batch(alice, bob, 50);
+  benchmark_receive_batch(alice, bob, 500);
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_benchmark_restore(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  otrng_policy_s policy = {.allows = OTRNG_ALLOW_V3 | OTRNG_ALLOW_V4};
+  uint8_t key[OTRNG_SNAPSHOT_KEY_BYTES] = {1};
+  uint8_t *snapshot = NULL;
+  size_t snapshot_len = 0;
+  const int rounds = 10000;
+  double elapsed;
+  otrng_s *conn;
+  int n;
+
+  g_test_timer_start();
+  do_dake_fixture(alice, bob);
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e3, "one DAKE: %.2f ms", elapsed * 1e3);
+
+  otrng_assert_is_success(
+      otrng_snapshot_seal(&snapshot, &snapshot_len, key, bob));
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    conn = otrng_new(bob_client, policy);
+    otrng_assert_is_success(
+        otrng_snapshot_restore(conn, snapshot, snapshot_len, key));
+    otrng_conn_free(conn);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e6 / rounds,
+                          "restoring %d sessions of %zu bytes: %.1f ms",
+                          rounds, snapshot_len, elapsed * 1e3);
+
+  otrng_free(snapshot);
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+  otrng_conn_free_all(alice, bob);
+}
+
+static void test_double_ratchet_benchmark_dake(void) {
+  otrng_client_s *alice_client = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_client = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_client, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_client, BOB_ACCOUNT, 2);
+
+  otrng_policy_s policy = {.allows = OTRNG_ALLOW_V3 | OTRNG_ALLOW_V4};
+  const int rounds = 100;
+  double elapsed;
+  int n;
+
+  /* The first DAKE also creates the profiles of both clients. */
+  do_dake_fixture(alice, bob);
+  otrng_conn_free_all(alice, bob);
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    alice = otrng_new(alice_client, policy);
+    bob = otrng_new(bob_client, policy);
+    do_dake_fixture(alice, bob);
+    otrng_conn_free_all(alice, bob);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e3 / rounds,
+                          "%d interactive DAKEs: %.1f ms (%.1f per second)",
+                          rounds, elapsed * 1e3, rounds / elapsed);
+
+  otrng_global_state_free(alice_client->global_state);
+  otrng_global_state_free(bob_client->global_state);
+  otrng_client_free_all(alice_client, bob_client);
+}
+
 void functionals_double_ratchet_add_tests(void) {
   g_test_add_func("/double_ratchet/in_order/new_sending_ratchet/v4",
                   test_double_ratchet_new_sending_ratchet_in_order);
@@ -526,4 +1155,23 @@ void functionals_double_ratchet_add_tests(void) {
                   test_double_ratchet_new_ratchet_out_of_order);
   g_test_add_func("/double_ratchet/corrupted_ratchet/v4",
                   test_double_ratchet_corrupted_ratchet);
+  g_test_add_func("/double_ratchet/send_reusing_buffer/v4",
+                  test_double_ratchet_send_reusing_buffer);
+  g_test_add_func("/double_ratchet/send_batch/v4",
+                  test_double_ratchet_send_batch);
+  g_test_add_func("/double_ratchet/receive_batch/v4",
+                  test_double_ratchet_receive_batch);
+  g_test_add_func("/double_ratchet/lookahead/v4",
+                  test_double_ratchet_lookahead);
+  g_test_add_func("/double_ratchet/dh_pool/v4", test_double_ratchet_dh_pool);
+  g_test_add_func("/double_ratchet/snapshot/v4", test_double_ratchet_snapshot);
+
+  if (g_test_perf()) {
+    g_test_add_func("/double_ratchet/benchmark_send",
+                    test_double_ratchet_benchmark_send);
+    g_test_add_func("/double_ratchet/benchmark_restore",
+                    test_double_ratchet_benchmark_restore);
+    g_test_add_func("/double_ratchet/benchmark_dake",
+                    test_double_ratchet_benchmark_dake);
+  }
 }
@@ -237,7 +237,7 @@ static void test_smp_state_machine_abort(void) {
 
 static void test_otrng_generate_smp_secret(void) {
   smp_protocol_s smp;
-  smp.message1 = NULL;
+  otrng_smp_protocol_init(&smp);
   otrng_fingerprint our = {
       0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
       0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
@@ -315,10 +315,72 @@ static void test_otrng_smp_message_1_serialize_null_question(void) {
   otrng_free(buff);
 }
 
+static void test_smp_benchmark(void) {
+  OTRNG_INIT;
+
+  otrng_client_s *alice_state = otrng_client_new(ALICE_IDENTITY);
+  otrng_client_s *bob_state = otrng_client_new(BOB_IDENTITY);
+
+  otrng_s *alice = set_up(alice_state, ALICE_ACCOUNT, 1);
+  otrng_s *bob = set_up(bob_state, BOB_ACCOUNT, 2);
+
+  const uint8_t *question = (const uint8_t *)"?";
+  const uint8_t *answer = (const uint8_t *)"answer";
+  const int rounds = 100;
+  otrng_smp_event event;
+  tlv_s *tlv, *reply;
+  double elapsed;
+  int n;
+
+  do_dake_fixture(alice, bob);
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    /* Alice asks, Bob answers, and both go through the four messages */
+    tlv = otrng_smp_initiate(get_my_client_profile(alice),
+                             alice->their_client_profile, question, 1, answer,
+                             strlen("answer"), alice->keys->ssid, alice->smp,
+                             alice);
+    otrng_assert(!process_tlv(tlv, bob));
+    otrng_tlv_free(tlv);
+
+    event = OTRNG_SMP_EVENT_NONE;
+    tlv = otrng_smp_provide_secret(
+        &event, bob->smp, get_my_client_profile(bob), bob->their_client_profile,
+        bob->keys->ssid, answer, strlen("answer"));
+    otrng_assert(tlv);
+
+    reply = process_tlv(tlv, alice);
+    otrng_tlv_free(tlv);
+    otrng_assert(reply);
+    tlv = process_tlv(reply, bob);
+    otrng_tlv_free(reply);
+    otrng_assert(tlv);
+    otrng_assert(!process_tlv(tlv, alice));
+    otrng_tlv_free(tlv);
+
+    g_assert_cmpint(alice->smp->progress, ==, SMP_TOTAL_PROGRESS);
+    g_assert_cmpint(bob->smp->progress, ==, SMP_TOTAL_PROGRESS);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e3 / rounds,
+                          "%d SMP runs: %.1f ms (%.2f ms each)", rounds,
+                          elapsed * 1e3, elapsed * 1e3 / rounds);
+
+  otrng_global_state_free(alice_state->global_state);
+  otrng_global_state_free(bob_state->global_state);
+  otrng_client_free_all(alice_state, bob_state);
+  otrng_conn_free_all(alice, bob);
+}
+
 void functionals_smp_add_tests(void) {
   g_test_add_func("/smp/state_machine", test_smp_state_machine);
   g_test_add_func("/smp/state_machine_abort", test_smp_state_machine_abort);
   g_test_add_func("/smp/generate_secret", test_otrng_generate_smp_secret);
   g_test_add_func("/smp/message_1_serialize_null_question",
                   test_otrng_smp_message_1_serialize_null_question);
+
+  if (g_test_perf()) {
+    g_test_add_func("/smp/benchmark", test_smp_benchmark);
+  }
 }
@@ -21,14 +21,18 @@
 #ifndef __TEST_UNIT_ALL_H__
 #define __TEST_UNIT_ALL_H__
 
+void units_alloc_add_tests(void);
 void units_auth_add_tests(void);
 void units_client_add_tests(void);
 void units_client_profile_add_tests(void);
 void units_dake_add_tests(void);
 void units_data_message_add_tests(void);
 void units_dh_add_tests(void);
+void units_dh_mont_add_tests(void);
 void units_ed448_add_tests(void);
+void units_ephemeral_pool_add_tests(void);
 void units_fragment_add_tests(void);
+void units_hash_index_add_tests(void);
 void units_identity_message_add_tests(void);
 void units_instance_tag_add_tests(void);
 void units_key_management_add_tests(void);
@@ -43,19 +47,24 @@ void units_prekey_profile_add_tests(void);
 void units_prekey_proofs_add_tests(void);
 void units_prekey_server_client_add_tests(void);
 void units_serialize_add_tests(void);
+void units_skipped_keys_add_tests(void);
 void units_standard_add_tests(void);
 void units_tlv_add_tests(void);
 
 #define REGISTER_UNITS                                                         \
   do {                                                                         \
+    units_alloc_add_tests();                                                   \
     units_auth_add_tests();                                                    \
     units_client_add_tests();                                                  \
     units_client_profile_add_tests();                                          \
     units_dake_add_tests();                                                    \
     units_data_message_add_tests();                                            \
     units_dh_add_tests();                                                      \
+    units_dh_mont_add_tests();                                                 \
     units_ed448_add_tests();                                                   \
+    units_ephemeral_pool_add_tests();                                          \
     units_fragment_add_tests();                                                \
+    units_hash_index_add_tests();                                              \
     units_identity_message_add_tests();                                        \
     units_instance_tag_add_tests();                                            \
     units_key_management_add_tests();                                          \
@@ -70,6 +79,7 @@ void units_tlv_add_tests(void);
     units_prekey_proofs_add_tests();                                           \
     units_prekey_server_client_add_tests();                                    \
     units_serialize_add_tests();                                               \
+    units_skipped_keys_add_tests();                                            \
     units_standard_add_tests();                                                \
     units_tlv_add_tests();                                                     \
   } while (0);
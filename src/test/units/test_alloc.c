@@ -0,0 +1,197 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <glib.h>
+#include <pthread.h>
+
+#include "test_helpers.h"
+
+#include "alloc.h"
+#include "constants.h"
+
+static void test_secure_slab_alloc_is_zeroed_and_reused() {
+  otrng_secure_slab_stats_s before, after;
+  uint8_t zero[MAC_KEY_BYTES] = {0};
+  uint8_t *key;
+  uint8_t *reused;
+
+  otrng_secure_slab_stats(&before);
+
+  key = otrng_secure_slab_alloc(MAC_KEY_BYTES);
+  otrng_assert_cmpmem(zero, key, MAC_KEY_BYTES);
+  memset(key, 0xAB, MAC_KEY_BYTES);
+
+  otrng_secure_slab_stats(&after);
+  g_assert_cmpint(after.live_objects, ==, before.live_objects + 1);
+  g_assert_cmpint(after.slabs, >=, 1);
+  g_assert_cmpint(after.pages_locked, >=, 1);
+
+  otrng_secure_slab_free(key);
+
+  /* The freed slot is handed out again, wiped */
+  reused = otrng_secure_slab_alloc(MAC_KEY_BYTES);
+  otrng_assert(reused == key);
+  otrng_assert_cmpmem(zero, reused, MAC_KEY_BYTES);
+  otrng_secure_slab_free(reused);
+
+  otrng_secure_slab_stats(&after);
+  g_assert_cmpint(after.live_objects, ==, before.live_objects);
+}
+
+static void test_secure_slab_grows_and_shrinks() {
+  otrng_secure_slab_stats_s before, during, after;
+  uint8_t *keys[1000];
+  int i;
+
+  otrng_secure_slab_stats(&before);
+
+  for (i = 0; i < 1000; i++) {
+    keys[i] = otrng_secure_slab_alloc(ENC_KEY_BYTES);
+    memset(keys[i], i, ENC_KEY_BYTES);
+  }
+
+  otrng_secure_slab_stats(&during);
+  g_assert_cmpint(during.live_objects, ==, before.live_objects + 1000);
+  g_assert_cmpint(during.slabs, >, before.slabs);
+
+  for (i = 0; i < 1000; i++) {
+    g_assert_cmpint(keys[i][ENC_KEY_BYTES - 1], ==, (uint8_t)i);
+    otrng_secure_slab_free(keys[i]);
+  }
+
+  otrng_secure_slab_release();
+
+  otrng_secure_slab_stats(&after);
+  g_assert_cmpint(after.live_objects, ==, before.live_objects);
+  g_assert_cmpint(after.slabs, <=, before.slabs);
+  g_assert_cmpint(after.pages_locked, <=, before.pages_locked);
+}
+
+static void test_secure_slab_falls_back_for_big_objects() {
+  otrng_secure_slab_stats_s before, after;
+  uint8_t *big;
+
+  otrng_secure_slab_stats(&before);
+  big = otrng_secure_slab_alloc(1024);
+  memset(big, 0xFF, 1024);
+
+  otrng_secure_slab_stats(&after);
+  g_assert_cmpint(after.live_objects, ==, before.live_objects);
+
+  otrng_secure_slab_free(big);
+  otrng_secure_slab_free(NULL);
+}
+
+#define SLAB_THREADS 4
+#define SLAB_THREAD_KEYS 300
+
+static void *allocate_and_free_keys(void *data) {
+  uint8_t *keys[SLAB_THREAD_KEYS];
+  int round, i;
+
+  (void)data;
+  for (round = 0; round < 50; round++) {
+    for (i = 0; i < SLAB_THREAD_KEYS; i++) {
+      keys[i] = otrng_secure_slab_alloc(i % 2 ? MAC_KEY_BYTES : ENC_KEY_BYTES);
+      memset(keys[i], i, ENC_KEY_BYTES);
+    }
+    for (i = 0; i < SLAB_THREAD_KEYS; i++) {
+      g_assert_cmpint(keys[i][ENC_KEY_BYTES - 1], ==, (uint8_t)i);
+      otrng_secure_slab_free(keys[i]);
+    }
+  }
+
+  return NULL;
+}
+
+static void test_secure_slab_is_shared_by_threads() {
+  otrng_secure_slab_stats_s before, after;
+  pthread_t threads[SLAB_THREADS];
+  int i;
+
+  otrng_secure_slab_stats(&before);
+
+  for (i = 0; i < SLAB_THREADS; i++) {
+    otrng_assert(pthread_create(&threads[i], NULL, allocate_and_free_keys,
+                                NULL) == 0);
+  }
+  for (i = 0; i < SLAB_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  otrng_secure_slab_stats(&after);
+  g_assert_cmpint(after.live_objects, ==, before.live_objects);
+}
+
+/* The keys allocated and freed while receiving one out-of-order message */
+#define PER_MESSAGE_SIZES 4
+static const size_t per_message_sizes[PER_MESSAGE_SIZES] = {
+    EXTRA_SYMMETRIC_KEY_BYTES, EXTRA_SYMMETRIC_KEY_BYTES, MAC_KEY_BYTES, 96};
+
+static void test_secure_slab_benchmark() {
+  const int messages = 10000;
+  void *keys[PER_MESSAGE_SIZES];
+  double elapsed;
+  int m, k;
+
+  g_test_timer_start();
+  for (m = 0; m < messages; m++) {
+    for (k = 0; k < PER_MESSAGE_SIZES; k++) {
+      keys[k] = otrng_secure_alloc(per_message_sizes[k]);
+    }
+    for (k = 0; k < PER_MESSAGE_SIZES; k++) {
+      otrng_secure_free(keys[k]);
+    }
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e6 / messages,
+                          "otrng_secure_alloc per message: %.2f us",
+                          elapsed * 1e6 / messages);
+
+  g_test_timer_start();
+  for (m = 0; m < messages; m++) {
+    for (k = 0; k < PER_MESSAGE_SIZES; k++) {
+      keys[k] = otrng_secure_slab_alloc(per_message_sizes[k]);
+    }
+    for (k = 0; k < PER_MESSAGE_SIZES; k++) {
+      otrng_secure_slab_free(keys[k]);
+    }
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e6 / messages,
+                          "otrng_secure_slab_alloc per message: %.2f us",
+                          elapsed * 1e6 / messages);
+}
+
+void units_alloc_add_tests(void) {
+  g_test_add_func("/alloc/secure_slab/zeroed_and_reused",
+                  test_secure_slab_alloc_is_zeroed_and_reused);
+  g_test_add_func("/alloc/secure_slab/grows_and_shrinks",
+                  test_secure_slab_grows_and_shrinks);
+  g_test_add_func("/alloc/secure_slab/big_objects",
+                  test_secure_slab_falls_back_for_big_objects);
+  g_test_add_func("/alloc/secure_slab/threads",
+                  test_secure_slab_is_shared_by_threads);
+
+  if (g_test_perf()) {
+    g_test_add_func("/alloc/secure_slab/benchmark", test_secure_slab_benchmark);
+  }
+}
@@ -96,6 +96,11 @@ static void test_rsig_auth() {
 
   otrng_assert(otrng_rsig_verify(&dst, p3.pub, p1.pub, p2.pub,
                                  (unsigned char *)msg, strlen(msg)));
+
+  otrng_assert(!otrng_rsig_verify(&dst, p1.pub, p3.pub, p2.pub,
+                                  (unsigned char *)msg, strlen(msg)));
+  otrng_assert(!otrng_rsig_verify(&dst, p3.pub, p1.pub, p2.pub,
+                                  (unsigned char *)"ho", strlen(msg)));
 }
 
 static void test_rsig_compatible_with_prekey_server() {
@@ -213,9 +218,43 @@ static void test_rsig_compatible_with_prekey_server() {
       (const uint8_t *)msg, 2));
 }
 
+static void test_rsig_benchmark_verify(void) {
+  const char *msg = "hi";
+  const int rounds = 1000;
+  otrng_keypair_s p1, p2, p3;
+  uint8_t sym1[ED448_PRIVATE_BYTES] = {1}, sym2[ED448_PRIVATE_BYTES] = {2},
+          sym3[ED448_PRIVATE_BYTES] = {3};
+  ring_sig_s dst;
+  double elapsed;
+  int n;
+
+  otrng_assert_is_success(otrng_keypair_generate(&p1, sym1));
+  otrng_assert_is_success(otrng_keypair_generate(&p2, sym2));
+  otrng_assert_is_success(otrng_keypair_generate(&p3, sym3));
+
+  otrng_assert_is_success(
+      otrng_rsig_authenticate(&dst, p2.priv, p2.pub, p1.pub, p2.pub, p3.pub,
+                              (const uint8_t *)msg, strlen(msg)));
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    otrng_assert(otrng_rsig_verify(&dst, p1.pub, p2.pub, p3.pub,
+                                   (const uint8_t *)msg, strlen(msg)));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e6 / rounds,
+                          "verifying %d ring signatures: %.1f ms", rounds,
+                          elapsed * 1e3);
+}
+
 void units_auth_add_tests(void) {
   g_test_add_func("/ring-signature/rsig_auth", test_rsig_auth);
   g_test_add_func("/ring-signature/calculate_c", test_rsig_calculate_c);
   g_test_add_func("/ring-signature/compatible_with_prekey_server",
                   test_rsig_compatible_with_prekey_server);
+
+  if (g_test_perf()) {
+    g_test_add_func("/ring-signature/benchmark/verify",
+                    test_rsig_benchmark_verify);
+  }
 }
@@ -24,6 +24,7 @@
 
 #include "test_fixtures.h"
 
+#include "base64.h"
 #include "data_message.h"
 #include "serialize.h"
 
@@ -255,9 +256,100 @@ static void test_data_message_valid() {
   otrng_data_message_free(data_msg);
 }
 
+static void test_data_message_header_serializes() {
+  data_message_s *data_msg = set_up_data_message();
+
+  uint8_t *ser = NULL;
+  size_t ser_len = 0;
+  otrng_assert_is_success(
+      otrng_data_message_body_serialize(&ser, &ser_len, data_msg));
+
+  uint8_t header[DATA_MSG_MAX_BYTES];
+  size_t header_len = 0;
+  otrng_assert_is_success(otrng_data_message_header_serialize(
+      header, DATA_MSG_MAX_BYTES, &header_len, data_msg));
+
+  g_assert_cmpint(header_len + data_msg->enc_msg_len, ==, ser_len);
+  otrng_assert_cmpmem(header, ser, header_len);
+
+  otrng_assert_is_error(otrng_data_message_header_serialize(
+      header, DATA_MSG_MAX_BYTES - 1, &header_len, data_msg));
+
+  otrng_free(ser);
+  otrng_data_message_free(data_msg);
+}
+
+static void test_data_message_deserializes_view() {
+  data_message_s *data_msg = set_up_data_message();
+
+  uint8_t *ser = NULL;
+  size_t ser_len = 0;
+  otrng_assert_is_success(
+      otrng_data_message_body_serialize(&ser, &ser_len, data_msg));
+
+  size_t wire_len = ser_len + DATA_MSG_MAC_BYTES;
+  uint8_t *wire = otrng_xmalloc_z(wire_len);
+  memcpy(wire, ser, ser_len);
+  memset(wire + ser_len, 0xD, DATA_MSG_MAC_BYTES);
+
+  data_message_s *view = otrng_data_message_new();
+  uint8_t *enc_msg = NULL;
+  size_t body_len = 0;
+  otrng_assert_is_success(otrng_data_message_deserialize_view(
+      view, &enc_msg, &body_len, wire, wire_len));
+
+  g_assert_cmpint(body_len, ==, ser_len);
+  otrng_assert(!view->enc_msg);
+  g_assert_cmpint(view->enc_msg_len, ==, 3);
+  otrng_assert(enc_msg == wire + ser_len - 3);
+  otrng_assert_cmpmem(enc_msg, data_msg->enc_msg, 3);
+  otrng_assert_cmpmem(view->nonce, data_msg->nonce, DATA_MSG_NONCE_BYTES);
+  g_assert_cmpint(view->message_id, ==, 99);
+
+  data_message_s *truncated = otrng_data_message_new();
+  otrng_assert_is_error(otrng_data_message_deserialize_view(
+      truncated, &enc_msg, &body_len, wire, wire_len - 1));
+
+  otrng_data_message_free(truncated);
+  otrng_data_message_free(view);
+  otrng_free(wire);
+  otrng_free(ser);
+  otrng_data_message_free(data_msg);
+}
+
+static void test_data_message_encodes_in_place() {
+  const size_t lens[] = {0, 1, 2, 3, 4, 5, 255, 256};
+  uint8_t msg[256];
+  size_t n;
+
+  for (n = 0; n < sizeof(msg); n++) {
+    msg[n] = (uint8_t)(n * 7);
+  }
+
+  for (n = 0; n < sizeof(lens) / sizeof(lens[0]); n++) {
+    size_t total = OTRNG_BASE64_OTR_ENCODE_LEN(lens[n]) + 1;
+    char *buffer = otrng_xmalloc_z(total);
+    char *expected = otrl_base64_otr_encode(msg, lens[n]);
+
+    memcpy(buffer + total - lens[n], msg, lens[n]);
+    otrng_base64_otr_encode_in_place(buffer, lens[n]);
+
+    g_assert_cmpstr(buffer, ==, expected);
+
+    otrng_free(buffer);
+    otrng_free(expected);
+  }
+}
+
 void units_data_message_add_tests(void) {
   g_test_add_func("/data_message/valid", test_data_message_valid);
   g_test_add_func("/data_message/serialize", test_data_message_serializes);
+  g_test_add_func("/data_message/serialize_header",
+                  test_data_message_header_serializes);
+  g_test_add_func("/data_message/deserialize_view",
+                  test_data_message_deserializes_view);
+  g_test_add_func("/data_message/encode_in_place",
+                  test_data_message_encodes_in_place);
   g_test_add_func("/data_message/serialize_absent_dh",
                   test_data_message_serializes_absent_dh);
   g_test_add_func("/data_message/deserialize",
@@ -19,6 +19,7 @@
  */
 
 #include <glib.h>
+#include <pthread.h>
 
 #include "test_helpers.h"
 
@@ -183,9 +184,157 @@ static void test_dh_keypair_destroy() {
   otrng_assert(!alice.pub);
 }
 
+static void test_dh_keypair_pool() {
+  otrng_keypair_pool_s *pool = otrng_dh_keypair_pool_new();
+  otrng_keypair_pool_stats_s stats;
+  dh_keypair_s keypair;
+  dh_public_key pub;
+  int n;
+
+  /* Disabled until it has a depth */
+  g_assert_cmpint(otrng_keypair_pool_fill(pool, 5), ==, 0);
+  otrng_assert_is_success(otrng_dh_keypair_pool_take(&keypair, pool));
+  otrng_dh_keypair_destroy(&keypair);
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.hits + stats.misses, ==, 0);
+
+  otrng_keypair_pool_set_depth(pool, 2);
+  g_assert_cmpint(otrng_keypair_pool_fill(pool, 5), ==, 2);
+  g_assert_cmpint(otrng_keypair_pool_fill(pool, 5), ==, 0);
+
+  pub = ((dh_keypair_s *)pool->keypairs)[1].pub;
+  otrng_assert_is_success(otrng_dh_keypair_pool_take(&keypair, pool));
+  otrng_assert(keypair.pub == pub);
+  otrng_assert(!((dh_keypair_s *)pool->keypairs)[1].pub);
+  otrng_assert(!((dh_keypair_s *)pool->keypairs)[1].priv);
+  otrng_dh_keypair_destroy(&keypair);
+
+  for (n = 0; n < 2; n++) {
+    otrng_assert_is_success(otrng_dh_keypair_pool_take(&keypair, pool));
+    otrng_assert(keypair.pub);
+    otrng_assert(keypair.priv);
+    otrng_dh_keypair_destroy(&keypair);
+  }
+
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.hits, ==, 2);
+  g_assert_cmpint(stats.misses, ==, 1);
+
+  g_assert_cmpint(otrng_keypair_pool_fill(pool, 1), ==, 1);
+  otrng_keypair_pool_set_depth(pool, 0);
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.available, ==, 0);
+
+  otrng_keypair_pool_free(pool);
+}
+
+static void *fill_dh_keypair_pool(void *data) {
+  otrng_keypair_pool_s *pool = data;
+  size_t *generated = otrng_xmalloc_z(sizeof(size_t));
+
+  *generated = otrng_keypair_pool_fill(pool, 8);
+
+  return generated;
+}
+
+static void test_dh_keypair_pool_filled_by_worker() {
+  otrng_keypair_pool_s *pool = otrng_dh_keypair_pool_new();
+  otrng_keypair_pool_stats_s stats;
+  dh_keypair_s keypair;
+  pthread_t worker;
+  size_t *generated;
+  int n;
+
+  otrng_keypair_pool_set_depth(pool, 4);
+  otrng_assert(pthread_create(&worker, NULL, fill_dh_keypair_pool, pool) ==
+               0);
+
+  for (n = 0; n < 4; n++) {
+    otrng_assert_is_success(otrng_dh_keypair_pool_take(&keypair, pool));
+    otrng_assert(keypair.pub);
+    otrng_assert(keypair.priv);
+    otrng_dh_keypair_destroy(&keypair);
+  }
+
+  otrng_assert(pthread_join(worker, (void **)&generated) == 0);
+
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.hits + stats.misses, ==, 4);
+  g_assert_cmpint(stats.available + stats.hits, ==, *generated);
+  otrng_assert(stats.available <= 4);
+
+  otrng_free(generated);
+  otrng_keypair_pool_free(pool);
+}
+
+static void test_dh_generator_exp() {
+  const unsigned int bits[] = {0, 8, 640, DH3072_MOD_LEN_BITS - 1};
+  dh_mpi exp, expected, got;
+  size_t n;
+
+  for (n = 0; n < sizeof(bits) / sizeof(bits[0]); n++) {
+    exp = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+    gcry_mpi_randomize(exp, bits[n], GCRY_WEAK_RANDOM);
+    if (bits[n]) {
+      gcry_mpi_set_bit(exp, bits[n] - 1);
+    }
+
+    expected = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+    got = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+    otrng_dh_calculate_public_key(expected, exp);
+    otrng_dh_generator_exp_non_secret(got, exp);
+    g_assert_cmpint(gcry_mpi_cmp(expected, got), ==, 0);
+
+    otrng_dh_mpi_release(exp);
+    otrng_dh_mpi_release(expected);
+    otrng_dh_mpi_release(got);
+  }
+}
+
+static void test_dh_multi_exp() {
+  /* 40 crosses the boundary between two chunks of bases */
+  const size_t counts[] = {0, 1, 40};
+  dh_mpi bases[40], exps[40];
+  dh_mpi expected, got, term;
+  size_t n, j;
+
+  for (n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+    expected = gcry_mpi_set_ui(NULL, 1);
+    term = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+
+    for (j = 0; j < counts[n]; j++) {
+      bases[j] = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+      exps[j] = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+      gcry_mpi_randomize(bases[j], DH3072_MOD_LEN_BITS - 1, GCRY_WEAK_RANDOM);
+      gcry_mpi_randomize(exps[j], 64 * (j % 5) + 1, GCRY_WEAK_RANDOM);
+
+      gcry_mpi_powm(term, bases[j], exps[j], otrng_dh_modulus_p());
+      gcry_mpi_mulm(expected, expected, term, otrng_dh_modulus_p());
+    }
+
+    got = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+    otrng_dh_multi_exp_non_secret(got, (const dh_mpi *)bases,
+                                  (const dh_mpi *)exps, counts[n]);
+    g_assert_cmpint(gcry_mpi_cmp(expected, got), ==, 0);
+
+    for (j = 0; j < counts[n]; j++) {
+      otrng_dh_mpi_release(bases[j]);
+      otrng_dh_mpi_release(exps[j]);
+    }
+    otrng_dh_mpi_release(expected);
+    otrng_dh_mpi_release(term);
+    otrng_dh_mpi_release(got);
+  }
+}
+
 void units_dh_add_tests(void) {
   g_test_add_func("/dh/api", test_dh_api);
   g_test_add_func("/dh/serialize", test_dh_serialize);
   g_test_add_func("/dh/shared-secret", test_dh_shared_secret);
   g_test_add_func("/dh/destroy", test_dh_keypair_destroy);
+  g_test_add_func("/dh/keypair_pool", test_dh_keypair_pool);
+  g_test_add_func("/dh/keypair_pool/worker",
+                  test_dh_keypair_pool_filled_by_worker);
+  g_test_add_func("/dh/generator_exp", test_dh_generator_exp);
+  g_test_add_func("/dh/multi_exp", test_dh_multi_exp);
 }
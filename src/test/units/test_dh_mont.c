@@ -0,0 +1,231 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#define OTRNG_DH_MONT_PRIVATE
+
+#include "test_helpers.h"
+
+#include "test_fixtures.h"
+
+#include "dh.h"
+#include "dh_mont.h"
+
+/* The Montgomery backend is checked against libgcrypt, which is the
+   reference */
+
+static void assert_mpi_eq(const dh_mpi a, const dh_mpi b) {
+  g_assert_cmpint(gcry_mpi_cmp(a, b), ==, 0);
+}
+
+static void assert_same_generator_exp(const dh_mpi exp) {
+  dh_mpi expected = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  dh_mpi got = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+
+  otrng_dh_backend_gcrypt()->generator_exp(expected, exp);
+  otrng_dh_backend_mont()->generator_exp(got, exp);
+  assert_mpi_eq(expected, got);
+
+  otrng_dh_mpi_release(expected);
+  otrng_dh_mpi_release(got);
+}
+
+static void assert_same_exp(const dh_mpi base, const dh_mpi exp) {
+  dh_mpi expected = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  dh_mpi got = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+
+  otrng_dh_backend_gcrypt()->exp(expected, base, exp);
+  otrng_dh_backend_mont()->exp(got, base, exp);
+  assert_mpi_eq(expected, got);
+
+  otrng_dh_mpi_release(expected);
+  otrng_dh_mpi_release(got);
+}
+
+static void test_dh_mont_default_backend(void) {
+  g_assert_cmpstr(otrng_dh_get_backend()->name, ==, "montgomery");
+
+  otrng_dh_set_backend(NULL);
+  g_assert_cmpstr(otrng_dh_get_backend()->name, ==, "libgcrypt");
+
+  otrng_dh_set_backend(otrng_dh_backend_mont());
+  g_assert_cmpstr(otrng_dh_get_backend()->name, ==, "montgomery");
+}
+
+static void test_dh_mont_conversion(void) {
+  dh_mont_num num;
+  dh_mpi value = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  dh_mpi back = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+
+  gcry_mpi_randomize(value, DH3072_MOD_LEN_BITS, GCRY_WEAK_RANDOM);
+  otrng_assert_is_success(dh_mont_from_mpi(num, value));
+  dh_mont_to_mpi(back, num);
+  assert_mpi_eq(value, back);
+
+  gcry_mpi_set_ui(value, 0);
+  otrng_assert_is_success(dh_mont_from_mpi(num, value));
+  dh_mont_to_mpi(back, num);
+  assert_mpi_eq(value, back);
+
+  /* One bit longer than the modulus */
+  gcry_mpi_set_bit(value, DH3072_MOD_LEN_BITS);
+  otrng_assert_is_error(dh_mont_from_mpi(num, value));
+
+  otrng_dh_mpi_release(value);
+  otrng_dh_mpi_release(back);
+}
+
+static void test_dh_mont_generator_exp(void) {
+  dh_mpi exp = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  int n;
+
+  gcry_mpi_set_ui(exp, 0);
+  assert_same_generator_exp(exp);
+
+  gcry_mpi_set_ui(exp, 1);
+  assert_same_generator_exp(exp);
+
+  /* Every bit of the widest exponent the comb takes */
+  gcry_mpi_set_ui(exp, 0);
+  gcry_mpi_set_bit(exp, DH_KEY_SIZE * 8);
+  gcry_mpi_sub_ui(exp, exp, 1);
+  assert_same_generator_exp(exp);
+
+  for (n = 0; n < 20; n++) {
+    gcry_mpi_randomize(exp, DH_KEY_SIZE * 8, GCRY_WEAK_RANDOM);
+    assert_same_generator_exp(exp);
+  }
+
+  /* Longer exponents go to libgcrypt */
+  gcry_mpi_randomize(exp, DH3072_MOD_LEN_BITS, GCRY_WEAK_RANDOM);
+  assert_same_generator_exp(exp);
+
+  otrng_dh_mpi_release(exp);
+}
+
+static void test_dh_mont_exp(void) {
+  dh_mpi base = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  dh_mpi exp = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  int n;
+
+  for (n = 0; n < 20; n++) {
+    gcry_mpi_randomize(base, DH3072_MOD_LEN_BITS, GCRY_WEAK_RANDOM);
+    gcry_mpi_mod(base, base, otrng_dh_modulus_p());
+    gcry_mpi_randomize(exp, DH_KEY_SIZE * 8, GCRY_WEAK_RANDOM);
+    assert_same_exp(base, exp);
+  }
+
+  gcry_mpi_set_ui(exp, 0);
+  assert_same_exp(base, exp);
+
+  gcry_mpi_set_ui(base, 1);
+  gcry_mpi_randomize(exp, DH_KEY_SIZE * 8, GCRY_WEAK_RANDOM);
+  assert_same_exp(base, exp);
+
+  gcry_mpi_sub_ui(base, otrng_dh_modulus_p(), 1);
+  assert_same_exp(base, exp);
+
+  /* A base that is not reduced goes to libgcrypt */
+  gcry_mpi_add_ui(base, otrng_dh_modulus_p(), 5);
+  assert_same_exp(base, exp);
+
+  otrng_dh_mpi_release(base);
+  otrng_dh_mpi_release(exp);
+}
+
+static void test_dh_mont_shared_secret(void) {
+  dh_keypair_s alice, bob;
+  dh_shared_secret expected, got;
+  size_t expected_len = 0, got_len = 0;
+  dh_mpi pub = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+
+  otrng_dh_set_backend(otrng_dh_backend_mont());
+  otrng_assert_is_success(otrng_dh_keypair_generate(&alice));
+  otrng_assert_is_success(otrng_dh_keypair_generate(&bob));
+  otrng_assert_is_success(
+      otrng_dh_shared_secret(got, &got_len, alice.priv, bob.pub));
+
+  otrng_dh_set_backend(otrng_dh_backend_gcrypt());
+  otrng_dh_calculate_public_key(pub, alice.priv);
+  assert_mpi_eq(alice.pub, pub);
+  otrng_assert_is_success(
+      otrng_dh_shared_secret(expected, &expected_len, bob.priv, alice.pub));
+
+  otrng_dh_set_backend(otrng_dh_backend_mont());
+
+  g_assert_cmpuint(expected_len, ==, got_len);
+  otrng_assert_cmpmem(expected, got, got_len);
+
+  otrng_dh_keypair_destroy(&alice);
+  otrng_dh_keypair_destroy(&bob);
+  otrng_dh_mpi_release(pub);
+}
+
+static void benchmark_backend(const otrng_dh_backend_s *backend) {
+  const int rounds = 100;
+  dh_mpi priv = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  dh_mpi pub = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  dh_mpi secret = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+  double elapsed;
+  int n;
+
+  gcry_mpi_randomize(priv, DH_KEY_SIZE * 8, GCRY_WEAK_RANDOM);
+  otrng_dh_backend_gcrypt()->generator_exp(pub, priv);
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    backend->generator_exp(pub, priv);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e3 / rounds,
+                          "%s: public key: %.2f ms", backend->name,
+                          elapsed * 1e3 / rounds);
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    backend->exp(secret, pub, priv);
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e3 / rounds,
+                          "%s: shared secret: %.2f ms", backend->name,
+                          elapsed * 1e3 / rounds);
+
+  otrng_dh_mpi_release(priv);
+  otrng_dh_mpi_release(pub);
+  otrng_dh_mpi_release(secret);
+}
+
+static void test_dh_mont_benchmark(void) {
+  benchmark_backend(otrng_dh_backend_gcrypt());
+  benchmark_backend(otrng_dh_backend_mont());
+}
+
+void units_dh_mont_add_tests(void) {
+  g_test_add_func("/dh_mont/default_backend", test_dh_mont_default_backend);
+  g_test_add_func("/dh_mont/conversion", test_dh_mont_conversion);
+  g_test_add_func("/dh_mont/generator_exp", test_dh_mont_generator_exp);
+  g_test_add_func("/dh_mont/exp", test_dh_mont_exp);
+  g_test_add_func("/dh_mont/shared_secret", test_dh_mont_shared_secret);
+
+  if (g_test_perf()) {
+    g_test_add_func("/dh_mont/benchmark", test_dh_mont_benchmark);
+  }
+}
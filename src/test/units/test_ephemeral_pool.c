@@ -0,0 +1,114 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include "test_helpers.h"
+
+#include "ephemeral_pool.h"
+
+static void test_ephemeral_pool_take() {
+  otrng_keypair_pool_s *pool = otrng_ephemeral_pool_new();
+  otrng_keypair_pool_stats_s stats;
+  ecdh_keypair_s ecdh;
+  dh_keypair_s dh;
+
+  /* Disabled until it has a depth */
+  g_assert_cmpint(otrng_keypair_pool_fill(pool, 5), ==, 0);
+  otrng_assert_is_success(otrng_ephemeral_pool_take(&ecdh, &dh, pool));
+  otrng_ecdh_keypair_destroy(&ecdh);
+  otrng_dh_keypair_destroy(&dh);
+
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.hits, ==, 0);
+  g_assert_cmpint(stats.misses, ==, 0);
+
+  otrng_keypair_pool_set_depth(pool, 2);
+  g_assert_cmpint(otrng_keypair_pool_fill(pool, 5), ==, 2);
+
+  otrng_assert_is_success(otrng_ephemeral_pool_take(&ecdh, &dh, pool));
+  otrng_assert(dh.priv);
+  otrng_assert(dh.pub);
+  otrng_assert(otrng_ec_point_valid(ecdh.pub));
+  otrng_ecdh_keypair_destroy(&ecdh);
+  otrng_dh_keypair_destroy(&dh);
+
+  /* Shrinking keeps what fits */
+  otrng_keypair_pool_set_depth(pool, 3);
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.available, ==, 1);
+  g_assert_cmpint(stats.depth, ==, 3);
+
+  otrng_assert_is_success(otrng_ephemeral_pool_take(&ecdh, &dh, pool));
+  otrng_ecdh_keypair_destroy(&ecdh);
+  otrng_dh_keypair_destroy(&dh);
+  otrng_assert_is_success(otrng_ephemeral_pool_take(&ecdh, &dh, pool));
+  otrng_ecdh_keypair_destroy(&ecdh);
+  otrng_dh_keypair_destroy(&dh);
+
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.available, ==, 0);
+  g_assert_cmpint(stats.hits, ==, 2);
+  g_assert_cmpint(stats.misses, ==, 1);
+
+  otrng_keypair_pool_free(pool);
+}
+
+static gpointer refill_pool(gpointer data) {
+  otrng_keypair_pool_fill(data, 4);
+  return NULL;
+}
+
+static void test_ephemeral_pool_concurrent_refill() {
+  otrng_keypair_pool_s *pool = otrng_ephemeral_pool_new();
+  otrng_keypair_pool_stats_s stats;
+  GThread *workers[3];
+  ecdh_keypair_s ecdh;
+  dh_keypair_s dh;
+  int n;
+
+  otrng_keypair_pool_set_depth(pool, 6);
+
+  for (n = 0; n < 3; n++) {
+    workers[n] = g_thread_new("refill", refill_pool, pool);
+  }
+
+  for (n = 0; n < 4; n++) {
+    otrng_assert_is_success(otrng_ephemeral_pool_take(&ecdh, &dh, pool));
+    otrng_ecdh_keypair_destroy(&ecdh);
+    otrng_dh_keypair_destroy(&dh);
+  }
+
+  for (n = 0; n < 3; n++) {
+    g_thread_join(workers[n]);
+  }
+
+  otrng_keypair_pool_get_stats(&stats, pool);
+  g_assert_cmpint(stats.hits + stats.misses, ==, 4);
+  g_assert_cmpint(stats.available, <=, 6);
+
+  otrng_keypair_pool_free(pool);
+}
+
+void units_ephemeral_pool_add_tests(void) {
+  g_test_add_func("/ephemeral_pool/take", test_ephemeral_pool_take);
+  g_test_add_func("/ephemeral_pool/concurrent_refill",
+                  test_ephemeral_pool_concurrent_refill);
+}
@@ -71,62 +71,140 @@ static void test_create_fragments_smaller_than_max_size(void) {
   otrng_message_free(frag_message);
 }
 
+static void test_create_scattered_fragments(void) {
+  const char *message = "one two tree";
+  otrng_message_to_send_s *frag_message =
+      otrng_xmalloc_z(sizeof(otrng_message_to_send_s));
+  otrng_scattered_message_s scattered;
+  char fragment[48 + 1];
+  size_t n;
+
+  otrng_assert_is_success(
+      otrng_fragment_message(48, frag_message, 1, 2, message));
+  otrng_assert_is_success(
+      otrng_fragment_message_scattered(&scattered, 48, 0xabc, 1, 2, message));
+
+  g_assert_cmpint(scattered.total, ==, 4);
+  for (n = 0; n < scattered.total; n++) {
+    g_assert_cmpint(otrng_scattered_fragment_copy(fragment,
+                                                  &scattered.fragments[n]),
+                    ==, strlen(frag_message->pieces[n]));
+    g_assert_cmpstr(fragment + 14, ==, frag_message->pieces[n] + 14);
+    otrng_assert(scattered.fragments[n].piece == message + 3 * n);
+  }
+  g_assert_cmpstr(fragment, ==,
+                  "?OTR|00000abc|00000001|00000002,00004,00004,ree,");
+
+  otrng_scattered_message_destroy(&scattered);
+  otrng_message_free(frag_message);
+
+  otrng_assert_is_error(
+      otrng_fragment_message_scattered(&scattered, 45, 0xabc, 1, 2, message));
+  otrng_assert_is_error(
+      otrng_fragment_message_scattered(&scattered, 48, 0xabc, 1, 2, ""));
+}
+
+static void test_fragment_identifiers(void) {
+  otrng_fragment_ids_s ids;
+  uint32_t first, second;
+
+  otrng_fragment_ids_init(&ids);
+  first = otrng_fragment_next_identifier(&ids);
+  second = otrng_fragment_next_identifier(&ids);
+
+  otrng_assert(first != second);
+  g_assert_cmpint(ids.counter, ==, 2);
+}
+
+static fragment_reassembly_s *reassembly_new(void) {
+  return otrng_fragment_reassembly_new(OTRNG_FRAGMENT_DEFAULT_MAX_CONTEXTS,
+                                       OTRNG_FRAGMENT_DEFAULT_MAX_BYTES);
+}
+
+static void test_parse_fragment(void) {
+  otrng_fragment_header_s header;
+
+  otrng_assert_is_success(otrng_fragment_parse(
+      &header, "?OTR|0000000a|00000101|000000FF,00002,00003,piece,"));
+  g_assert_cmpint(header.identifier, ==, 0x0a);
+  g_assert_cmpint(header.sender_instance_tag, ==, 0x101);
+  g_assert_cmpint(header.receiver_instance_tag, ==, 0xff);
+  g_assert_cmpint(header.index, ==, 2);
+  g_assert_cmpint(header.total, ==, 3);
+  g_assert_cmpint(header.piece_len, ==, 5);
+  otrng_assert_cmpmem(header.piece, "piece", 5);
+
+  otrng_assert_is_error(otrng_fragment_parse(
+      &header, "?OTR|0000000a|00000101|000000ff,00002,00003,piece"));
+  otrng_assert_is_error(otrng_fragment_parse(
+      &header, "?OTR|0000000a|00000101|000000ff,2,3,piece,"));
+  otrng_assert_is_error(otrng_fragment_parse(
+      &header, "?OTR|0000000g|00000101|000000ff,00002,00003,piece,"));
+  otrng_assert_is_error(otrng_fragment_parse(
+      &header, "?OTR|0000000a|00000101|000000ff,99999,00003,piece,"));
+  otrng_assert_is_error(
+      otrng_fragment_parse(&header, "?OTR|00000101|000000ff,"));
+}
+
 static void test_defragment_valid_message(void) {
   const string_p fragments[2];
   fragments[0] = "?OTR|00000000|00000001|00000002,00001,00002,one ,";
   fragments[1] = "?OTR|00000000|00000001|00000002,00002,00002,more,";
 
   fragment_context_s *context = NULL;
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
 
   char *unfrag = NULL;
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[0], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
 
-  context = list->data;
+  context = reassembly->oldest;
   g_assert_cmpint(context->total, ==, 2);
   g_assert_cmpint(context->count, ==, 1);
   otrng_assert(!unfrag);
 
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[1], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
 
-  otrng_assert(otrng_list_len(list) == 0);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
   g_assert_cmpstr(unfrag, ==, "one more");
+  g_assert_cmpint(reassembly->bytes, ==, 0);
 
   otrng_free(unfrag);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_single_fragment(void) {
   const string_p message =
       "?OTR|00000000|00000001|00000002,00001,00001,small lol,";
 
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
   char *unfrag = NULL;
 
-  otrng_assert_is_success(otrng_unfragment_message(&unfrag, &list, message, 2));
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, message, 2));
 
-  otrng_assert(otrng_list_len(list) == 0);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
   g_assert_cmpstr(unfrag, ==, "small lol");
 
   otrng_free(unfrag);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_without_comma_fails(void) {
   const string_p message = "?OTR|00000000|00000001|00000002,00001,00001,blergh";
 
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
 
   char *unfrag = NULL;
-  otrng_assert_is_error(otrng_unfragment_message(&unfrag, &list, message, 2));
+  otrng_assert_is_error(
+      otrng_unfragment_message(&unfrag, reassembly, message, 2));
 
-  otrng_assert(list == NULL);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
   g_assert_cmpstr(unfrag, ==, NULL);
 
   otrng_free(unfrag);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_with_different_total_fails(void) {
@@ -135,27 +213,26 @@ static void test_defragment_with_different_total_fails(void) {
   fragments[1] = "?OTR|00000000|00000001|00000002,00002,00002,total,";
 
   fragment_context_s *context = NULL;
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
 
   char *unfrag = NULL;
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[0], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
   otrng_assert(!unfrag);
 
-  context = list->data;
+  context = reassembly->oldest;
   g_assert_cmpint(context->total, ==, 3);
   g_assert_cmpint(context->count, ==, 1);
 
   otrng_assert_is_error(
-      otrng_unfragment_message(&unfrag, &list, fragments[1], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
 
-  context = list->data;
+  context = reassembly->oldest;
   otrng_assert(!unfrag);
   g_assert_cmpint(context->total, ==, 3);
   g_assert_cmpint(context->count, ==, 1);
 
-  otrng_fragment_context_free(context);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_fragment_twice_fails(void) {
@@ -164,26 +241,25 @@ static void test_defragment_fragment_twice_fails(void) {
   fragments[1] = "?OTR|00000000|00000001|00000002,00001,00002,same twice,";
 
   fragment_context_s *context = NULL;
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
 
   char *unfrag = NULL;
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[0], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
 
-  context = list->data;
+  context = reassembly->oldest;
   otrng_assert(!unfrag);
   g_assert_cmpint(context->total, ==, 2);
   g_assert_cmpint(context->count, ==, 1);
 
   otrng_assert_is_error(
-      otrng_unfragment_message(&unfrag, &list, fragments[1], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
 
   otrng_assert(!unfrag);
   g_assert_cmpint(context->total, ==, 2);
   g_assert_cmpint(context->count, ==, 1);
 
-  otrng_fragment_context_free(context);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_out_of_order_message(void) {
@@ -193,61 +269,79 @@ static void test_defragment_out_of_order_message(void) {
   fragments[2] = "?OTR|00000000|00000001|00000002,00001,00003,one more ,";
 
   fragment_context_s *context = NULL;
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
 
   char *unfrag = NULL;
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[0], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
 
-  context = list->data;
+  context = reassembly->oldest;
   otrng_assert(!unfrag);
   g_assert_cmpint(context->total, ==, 3);
   g_assert_cmpint(context->count, ==, 1);
 
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[1], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
   otrng_assert(!unfrag);
   g_assert_cmpint(context->total, ==, 3);
   g_assert_cmpint(context->count, ==, 2);
 
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, fragments[2], 2));
+      otrng_unfragment_message(&unfrag, reassembly, fragments[2], 2));
   g_assert_cmpstr(unfrag, ==, "one more fragment send");
 
-  otrng_assert(otrng_list_len(list) == 0);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
 
   otrng_free(unfrag);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_fails_for_another_instance(void) {
   const string_p message =
       "?OTR|00000000|00000001|00000002,00001,00001,small lol,";
 
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
   char *unfrag = NULL;
 
-  otrng_assert_is_success(otrng_unfragment_message(&unfrag, &list, message, 1));
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, message, 1));
 
-  otrng_assert(list == NULL);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
   g_assert_cmpstr(unfrag, ==, NULL);
 
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_regular_otr_message(void) {
   const string_p message = "?OTR:not a fragmented message.";
 
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
   char *unfrag = NULL;
 
-  otrng_assert_is_success(otrng_unfragment_message(&unfrag, &list, message, 1));
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, message, 1));
 
-  otrng_assert(list == NULL);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
   g_assert_cmpstr(unfrag, ==, message);
 
   otrng_free(unfrag);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
+}
+
+static void test_defragment_passes_v3_fragments(void) {
+  const string_p message = "?OTR|00000101|00000102,00001,00002,AAAA,";
+
+  fragment_reassembly_s *reassembly = reassembly_new();
+  char *unfrag = NULL;
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, message, 0x102));
+
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
+  g_assert_cmpstr(unfrag, ==, message);
+
+  otrng_free(unfrag);
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_defragment_two_messages(void) {
@@ -261,62 +355,376 @@ static void test_defragment_two_messages(void) {
   message2_fragments[1] =
       "?OTR|00000002|00000001|00000002,00002,00002,message,";
 
-  list_element_s *list = NULL;
+  fragment_reassembly_s *reassembly = reassembly_new();
 
   char *unfrag = NULL;
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, message1_fragments[0], 2));
+      otrng_unfragment_message(&unfrag, reassembly, message1_fragments[0], 2));
 
   otrng_assert(!unfrag);
-  otrng_assert(otrng_list_len(list) == 1);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 1);
 
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, message2_fragments[0], 2));
+      otrng_unfragment_message(&unfrag, reassembly, message2_fragments[0], 2));
   otrng_assert(!unfrag);
-  otrng_assert(otrng_list_len(list) == 2);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 2);
 
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, message2_fragments[1], 2));
+      otrng_unfragment_message(&unfrag, reassembly, message2_fragments[1], 2));
   g_assert_cmpstr(unfrag, ==, "second message");
-  otrng_assert(otrng_list_len(list) == 1);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 1);
 
   otrng_free(unfrag);
   unfrag = NULL;
 
   otrng_assert_is_success(
-      otrng_unfragment_message(&unfrag, &list, message1_fragments[1], 2));
+      otrng_unfragment_message(&unfrag, reassembly, message1_fragments[1], 2));
   g_assert_cmpstr(unfrag, ==, "first message");
-  otrng_assert(otrng_list_len(list) == 0);
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
+
+  otrng_free(unfrag);
+  otrng_fragment_reassembly_free(reassembly);
+}
+
+static void test_defragment_longer_later_piece(void) {
+  const string_p fragments[3];
+  fragments[0] = "?OTR|00000000|00000001|00000002,00003,00003,c,";
+  fragments[1] = "?OTR|00000000|00000001|00000002,00001,00003,a,";
+  fragments[2] = "?OTR|00000000|00000001|00000002,00002,00003,much longer ,";
+
+  fragment_reassembly_s *reassembly = reassembly_new();
+  char *unfrag = NULL;
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
+  g_assert_cmpint(reassembly->bytes, ==, 3 * 1 + 1);
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[2], 2));
+  g_assert_cmpstr(unfrag, ==, "amuch longer c");
+  g_assert_cmpint(reassembly->bytes, ==, 0);
+  g_assert_cmpint(reassembly->stats.peak_bytes, ==, 3 * 12 + 1);
 
   otrng_free(unfrag);
-  otrng_list_free_nodes(list);
+  otrng_fragment_reassembly_free(reassembly);
+}
+
+static void test_defragment_evicts_over_max_contexts(void) {
+  const string_p fragments[3];
+  fragments[0] = "?OTR|00000001|00000001|00000002,00001,00002,first,";
+  fragments[1] = "?OTR|00000002|00000001|00000002,00001,00002,second,";
+  fragments[2] = "?OTR|00000003|00000001|00000002,00001,00002,third,";
+
+  fragment_reassembly_s *reassembly = otrng_fragment_reassembly_new(2, 1024);
+  char *unfrag = NULL;
+  int n;
+
+  for (n = 0; n < 3; n++) {
+    otrng_assert_is_success(
+        otrng_unfragment_message(&unfrag, reassembly, fragments[n], 2));
+  }
+
+  g_assert_cmpint(otrng_fragment_reassembly_len(reassembly), ==, 2);
+  g_assert_cmpint(reassembly->oldest->identifier, ==, 2);
+  g_assert_cmpint(reassembly->newest->identifier, ==, 3);
+  g_assert_cmpint(reassembly->stats.evicted, ==, 1);
+
+  otrng_fragment_reassembly_free(reassembly);
+}
+
+static void test_defragment_evicts_over_max_bytes(void) {
+  const string_p fragments[4];
+  fragments[0] = "?OTR|00000001|00000001|00000002,00001,00004,0123456789,";
+  fragments[1] = "?OTR|00000002|00000001|00000002,00001,00004,0123456789,";
+  fragments[2] =
+      "?OTR|00000003|00000001|00000002,00001,00010,0123456789abcdef,";
+  fragments[3] = "?OTR|00000004|00000001|00000002,00001,00004,0123456789,";
+
+  fragment_reassembly_s *reassembly = otrng_fragment_reassembly_new(16, 82);
+  char *unfrag = NULL;
+  otrng_fragment_stats_s stats;
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
+  g_assert_cmpint(reassembly->bytes, ==, 2 * (4 * 10 + 1));
+
+  /* A message that does not fit alone is refused without dropping the
+     others */
+  otrng_assert_is_error(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[2], 2));
+  otrng_assert(!unfrag);
+
+  g_assert_cmpint(otrng_fragment_reassembly_len(reassembly), ==, 2);
+  g_assert_cmpint(reassembly->bytes, ==, 2 * (4 * 10 + 1));
+
+  /* One that fits takes the place of the oldest */
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[3], 2));
+  otrng_assert(!unfrag);
+
+  g_assert_cmpint(otrng_fragment_reassembly_len(reassembly), ==, 2);
+  g_assert_cmpint(reassembly->oldest->identifier, ==, 2);
+  g_assert_cmpint(reassembly->newest->identifier, ==, 4);
+  g_assert_cmpint(reassembly->bytes, ==, 2 * (4 * 10 + 1));
+
+  memset(&stats, 0, sizeof(stats));
+  otrng_fragment_reassembly_add_stats(&stats, reassembly);
+  g_assert_cmpint(stats.fragments, ==, 3);
+  g_assert_cmpint(stats.evicted, ==, 1);
+  g_assert_cmpint(stats.rejected, ==, 1);
+  g_assert_cmpint(stats.pending_contexts, ==, 2);
+  g_assert_cmpint(stats.peak_bytes, ==, 82);
+
+  otrng_fragment_reassembly_free(reassembly);
+}
+
+static void test_defragment_stats(void) {
+  const string_p fragments[3];
+  fragments[0] = "?OTR|00000001|00000001|00000002,00001,00002,one ,";
+  fragments[1] = "?OTR|00000001|00000001|00000002,00002,00002,more,";
+  fragments[2] = "?OTR|00000001|00000001|00000002,00001,00001,broken";
+
+  fragment_reassembly_s *reassembly = reassembly_new();
+  otrng_fragment_stats_s stats;
+  char *unfrag = NULL;
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
+
+  memset(&stats, 0, sizeof(stats));
+  otrng_fragment_reassembly_add_stats(&stats, reassembly);
+  g_assert_cmpint(stats.fragments, ==, 1);
+  g_assert_cmpint(stats.messages, ==, 0);
+  g_assert_cmpint(stats.pending_contexts, ==, 1);
+  g_assert_cmpint(stats.pending_bytes, ==, 2 * 4 + 1);
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
+  otrng_free(unfrag);
+  otrng_assert_is_error(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[2], 2));
+
+  memset(&stats, 0, sizeof(stats));
+  otrng_fragment_reassembly_add_stats(&stats, reassembly);
+  g_assert_cmpint(stats.fragments, ==, 2);
+  g_assert_cmpint(stats.messages, ==, 1);
+  g_assert_cmpint(stats.rejected, ==, 1);
+  g_assert_cmpint(stats.pending_contexts, ==, 0);
+  g_assert_cmpint(stats.pending_bytes, ==, 0);
+  g_assert_cmpint(stats.peak_bytes, ==, 2 * 4 + 1);
+  otrng_assert(stats.max_us <= stats.total_us);
+
+  otrng_fragment_reassembly_free(reassembly);
 }
 
 static void test_expiration_of_fragments(void) {
   time_t HOUR_IN_SEC = 3600;
-  list_element_s *list = NULL;
-  fragment_context_s *ctx1 = otrng_fragment_context_new();
-  fragment_context_s *ctx2 = otrng_fragment_context_new();
+  const string_p fragments[2];
+  fragments[0] = "?OTR|00000001|00000001|00000002,00001,00002,first,";
+  fragments[1] = "?OTR|00000002|00000001|00000002,00001,00002,second,";
 
-  ctx1->last_fragment_received_at = HOUR_IN_SEC;
-  ctx2->last_fragment_received_at = HOUR_IN_SEC + 2;
+  fragment_reassembly_s *reassembly = reassembly_new();
+  char *unfrag = NULL;
+
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[0], 2));
+  otrng_assert_is_success(
+      otrng_unfragment_message(&unfrag, reassembly, fragments[1], 2));
 
-  list = otrng_list_add(ctx1, list);
-  list = otrng_list_add(ctx2, list);
+  reassembly->oldest->last_fragment_received_at = HOUR_IN_SEC;
+  reassembly->newest->last_fragment_received_at = HOUR_IN_SEC + 2;
 
   time_t now = HOUR_IN_SEC + 1;
-  otrng_assert_is_success(otrng_expire_fragments(now, 5, &list));
-  otrng_assert(otrng_list_len(list) == 1);
+  otrng_assert_is_success(otrng_expire_fragments(now, 5, reassembly));
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 2);
+
+  now = HOUR_IN_SEC + 6;
+  otrng_assert_is_success(otrng_expire_fragments(now, 5, reassembly));
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 1);
+  g_assert_cmpint(reassembly->oldest->identifier, ==, 2);
+
+  now = HOUR_IN_SEC + 7;
+  otrng_assert_is_success(otrng_expire_fragments(now, 5, reassembly));
+  otrng_assert(otrng_fragment_reassembly_len(reassembly) == 0);
+  g_assert_cmpint(reassembly->bytes, ==, 0);
+
+  otrng_fragment_reassembly_free(reassembly);
+}
+
+static fragment_reassembly_s *pending_reassembly(time_t last) {
+  fragment_reassembly_s *reassembly = reassembly_new();
+  char *unfrag = NULL;
+
+  otrng_assert_is_success(otrng_unfragment_message(
+      &unfrag, reassembly, "?OTR|00000001|00000001|00000002,00001,00002,one,",
+      2));
+  reassembly->oldest->last_fragment_received_at = last;
+
+  return reassembly;
+}
+
+static void test_fragment_expiry(void) {
+  fragment_expiry_s *expiry = otrng_fragment_expiry_new(10);
+  fragment_reassembly_s *reassemblies[5];
+  time_t last[5] = {100, 50, 300, 75, 200};
+  int n;
+
+  for (n = 0; n < 5; n++) {
+    reassemblies[n] = pending_reassembly(last[n]);
+    otrng_fragment_expiry_schedule(expiry, reassemblies[n]);
+  }
+  g_assert_cmpint(expiry->len, ==, 5);
+
+  g_assert_cmpint(otrng_fragment_expiry_tick(expiry, 59), ==, 0);
+  g_assert_cmpint(otrng_fragment_expiry_tick(expiry, 60), ==, 1);
+  g_assert_cmpint(otrng_fragment_reassembly_len(reassemblies[1]), ==, 0);
+  otrng_assert(reassemblies[1]->expiry == NULL);
+
+  g_assert_cmpint(otrng_fragment_expiry_tick(expiry, 110), ==, 2);
+  g_assert_cmpint(expiry->len, ==, 2);
+  g_assert_cmpint(otrng_fragment_reassembly_len(reassemblies[2]), ==, 1);
+  g_assert_cmpint(otrng_fragment_reassembly_len(reassemblies[4]), ==, 1);
+
+  /* A reassembly leaves the heap when freed */
+  otrng_fragment_reassembly_free(reassemblies[4]);
+  reassemblies[4] = NULL;
+  g_assert_cmpint(expiry->len, ==, 1);
+  g_assert_cmpint(otrng_fragment_expiry_tick(expiry, 290), ==, 0);
+
+  /* and is left out of the heap when the heap is freed */
+  otrng_fragment_expiry_free(expiry);
+  otrng_assert(reassemblies[2]->expiry == NULL);
+
+  for (n = 0; n < 5; n++) {
+    otrng_fragment_reassembly_free(reassemblies[n]);
+  }
+}
+
+static void test_fragment_expiry_follows_new_fragments(void) {
+  fragment_expiry_s *expiry = otrng_fragment_expiry_new(10);
+  fragment_reassembly_s *reassembly = pending_reassembly(100);
+  char *unfrag = NULL;
+  time_t now;
+
+  otrng_fragment_expiry_schedule(expiry, reassembly);
+
+  /* The old message is completed, and a new one starts */
+  otrng_assert_is_success(otrng_unfragment_message(
+      &unfrag, reassembly, "?OTR|00000001|00000001|00000002,00002,00002,two,",
+      2));
+  g_assert_cmpstr(unfrag, ==, "onetwo");
+  otrng_free(unfrag);
+  unfrag = NULL;
+  otrng_assert(reassembly->expiry == NULL);
+
+  otrng_assert_is_success(otrng_unfragment_message(
+      &unfrag, reassembly, "?OTR|00000002|00000001|00000002,00001,00002,new,",
+      2));
+  otrng_fragment_expiry_schedule(expiry, reassembly);
+  g_assert_cmpint(expiry->len, ==, 1);
+
+  now = reassembly->oldest->last_fragment_received_at;
+  g_assert_cmpint(otrng_fragment_expiry_tick(expiry, now + 9), ==, 0);
+  g_assert_cmpint(otrng_fragment_expiry_tick(expiry, now + 10), ==, 1);
+  g_assert_cmpint(expiry->len, ==, 0);
+
+  otrng_fragment_reassembly_free(reassembly);
+  otrng_fragment_expiry_free(expiry);
+}
+
+static void test_defragment_benchmark(void) {
+  const size_t piece_len = 250;
+  const uint16_t total = 200;
+  char **fragments = otrng_xmalloc_z(total * sizeof(char *));
+  fragment_reassembly_s *reassembly = reassembly_new();
+  char *unfrag = NULL;
+  double elapsed;
+  uint16_t n;
+  int round;
+
+  for (n = 0; n < total; n++) {
+    fragments[n] = otrng_xmalloc_z(FRAGMENT_HEADER_LEN + piece_len + 1);
+    snprintf(fragments[n], FRAGMENT_HEADER_LEN + 1,
+             "?OTR|00000001|00000001|00000002,%05hu,%05hu,", n + 1, total);
+    memset(fragments[n] + strlen(fragments[n]), 'a' + n % 26, piece_len);
+    strcat(fragments[n], ",");
+  }
+
+  g_test_timer_start();
+  for (round = 0; round < 100; round++) {
+    /* Out of order, as the pieces of a message may arrive */
+    for (n = 0; n < total; n++) {
+      otrng_assert_is_success(otrng_unfragment_message(
+          &unfrag, reassembly, fragments[(n * 7) % total], 2));
+    }
+    otrng_assert(unfrag);
+    g_assert_cmpint(strlen(unfrag), ==, total * piece_len);
+    otrng_free(unfrag);
+    unfrag = NULL;
+  }
+  elapsed = g_test_timer_elapsed();
+
+  g_test_minimized_result(elapsed * 1e6 / round,
+                          "reassembling %d fragments: %.2f us", total,
+                          elapsed * 1e6 / round);
+
+  for (n = 0; n < total; n++) {
+    otrng_free(fragments[n]);
+  }
+  otrng_free(fragments);
+  otrng_fragment_reassembly_free(reassembly);
+}
 
-  now = HOUR_IN_SEC + 3;
-  otrng_assert_is_success(otrng_expire_fragments(now, 5, &list));
-  otrng_assert(otrng_list_len(list) == 0);
+static void test_fragment_benchmark(void) {
+  const size_t msg_len = 1024 * 1024;
+  const int max_size = 1400;
+  char *message = otrng_xmalloc(msg_len + 1);
+  otrng_fragment_ids_s ids;
+  double copied, scattered;
+  int round;
+
+  memset(message, 'a', msg_len);
+  message[msg_len] = '\0';
+  otrng_fragment_ids_init(&ids);
+
+  g_test_timer_start();
+  for (round = 0; round < 20; round++) {
+    otrng_message_to_send_s *fragments = otrng_message_new();
+    otrng_assert_is_success(
+        otrng_fragment_message(max_size, fragments, 1, 2, message));
+    otrng_message_free(fragments);
+  }
+  copied = g_test_timer_elapsed() / round;
+
+  g_test_timer_start();
+  for (round = 0; round < 20; round++) {
+    otrng_scattered_message_s fragments;
+    otrng_assert_is_success(otrng_fragment_message_scattered(
+        &fragments, max_size, otrng_fragment_next_identifier(&ids), 1, 2,
+        message));
+    otrng_scattered_message_destroy(&fragments);
+  }
+  scattered = g_test_timer_elapsed() / round;
+
+  g_test_minimized_result(scattered * 1e6,
+                          "fragmenting 1 MB: %.2f us copied, %.2f us scattered",
+                          copied * 1e6, scattered * 1e6);
+
+  otrng_free(message);
 }
 
 void units_fragment_add_tests(void) {
   g_test_add_func("/fragment/create_fragments_smaller_than_max_size",
                   test_create_fragments_smaller_than_max_size);
   g_test_add_func("/fragment/create_fragments", test_create_fragments);
+  g_test_add_func("/fragment/create_scattered_fragments",
+                  test_create_scattered_fragments);
+  g_test_add_func("/fragment/identifiers", test_fragment_identifiers);
+  g_test_add_func("/fragment/parse", test_parse_fragment);
   g_test_add_func("/fragment/defragment_message",
                   test_defragment_valid_message);
   g_test_add_func("/fragment/defragment_single_fragment",
@@ -333,8 +741,26 @@ void units_fragment_add_tests(void) {
                   test_defragment_fails_for_another_instance);
   g_test_add_func("/fragment/defragment_regular_otr_message",
                   test_defragment_regular_otr_message);
+  g_test_add_func("/fragment/defragment_passes_v3_fragments",
+                  test_defragment_passes_v3_fragments);
   g_test_add_func("/fragment/defragment_two_messages",
                   test_defragment_two_messages);
+  g_test_add_func("/fragment/defragment_longer_later_piece",
+                  test_defragment_longer_later_piece);
+  g_test_add_func("/fragment/evicts_over_max_contexts",
+                  test_defragment_evicts_over_max_contexts);
+  g_test_add_func("/fragment/evicts_over_max_bytes",
+                  test_defragment_evicts_over_max_bytes);
+  g_test_add_func("/fragment/stats", test_defragment_stats);
   g_test_add_func("/fragment/expiration_of_fragments",
                   test_expiration_of_fragments);
+  g_test_add_func("/fragment/expiry", test_fragment_expiry);
+  g_test_add_func("/fragment/expiry_follows_new_fragments",
+                  test_fragment_expiry_follows_new_fragments);
+
+  if (g_test_perf()) {
+    g_test_add_func("/fragment/benchmark/reassemble",
+                    test_defragment_benchmark);
+    g_test_add_func("/fragment/benchmark/fragment", test_fragment_benchmark);
+  }
 }
@@ -0,0 +1,186 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test_helpers.h"
+
+#include "hash_index.h"
+#include "list.h"
+
+typedef struct {
+  char protocol[16];
+  char account[32];
+} indexed_s;
+
+static int compare_indexed(const void *current, const void *wanted) {
+  const indexed_s *c = current;
+  const indexed_s *w = wanted;
+
+  return strcmp(c->protocol, w->protocol) == 0 &&
+         strcmp(c->account, w->account) == 0;
+}
+
+static indexed_s *new_indexed(size_t count) {
+  indexed_s *entries = otrng_xmalloc_z(count * sizeof(indexed_s));
+  size_t n;
+
+  for (n = 0; n < count; n++) {
+    snprintf(entries[n].protocol, sizeof(entries[n].protocol), "prpl-%zu",
+             n % 3);
+    snprintf(entries[n].account, sizeof(entries[n].account),
+             "user%zu@example.org", n);
+  }
+
+  return entries;
+}
+
+static uint64_t hash_indexed(const hash_index_s *index,
+                             const indexed_s *entry) {
+  return otrng_hash_index_hash(index, entry->protocol, entry->account);
+}
+
+static void test_hash_index_add_and_get() {
+  hash_index_s *index = otrng_hash_index_new();
+  indexed_s *entries = new_indexed(200);
+  indexed_s missing = {"prpl-0", "nobody@example.org"};
+  size_t n;
+
+  otrng_assert(!otrng_hash_index_get(index, hash_indexed(index, &missing),
+                                     &missing, compare_indexed));
+
+  /* Enough entries to grow the index a few times */
+  for (n = 0; n < 200; n++) {
+    otrng_hash_index_add(index, hash_indexed(index, &entries[n]), &entries[n]);
+  }
+  g_assert_cmpint(otrng_hash_index_len(index), ==, 200);
+
+  for (n = 0; n < 200; n++) {
+    otrng_assert(otrng_hash_index_get(index, hash_indexed(index, &entries[n]),
+                                      &entries[n],
+                                      compare_indexed) == &entries[n]);
+  }
+
+  otrng_assert(!otrng_hash_index_get(index, hash_indexed(index, &missing),
+                                     &missing, compare_indexed));
+
+  otrng_hash_index_free(index);
+  otrng_free(entries);
+}
+
+static void test_hash_index_two_part_keys() {
+  hash_index_s *index = otrng_hash_index_new();
+
+  g_assert_cmpuint(otrng_hash_index_hash(index, "ab", "c"), ==,
+                   otrng_hash_index_hash(index, "ab", "c"));
+  g_assert_cmpuint(otrng_hash_index_hash(index, "ab", "c"), !=,
+                   otrng_hash_index_hash(index, "a", "bc"));
+  g_assert_cmpuint(otrng_hash_index_hash(index, "ab", NULL), !=,
+                   otrng_hash_index_hash(index, "ab", ""));
+
+  otrng_hash_index_free(index);
+}
+
+static void test_hash_index_remove() {
+  hash_index_s *index = otrng_hash_index_new();
+  indexed_s *entries = new_indexed(3);
+  size_t n;
+
+  for (n = 0; n < 3; n++) {
+    otrng_hash_index_add(index, hash_indexed(index, &entries[n]), &entries[n]);
+  }
+
+  otrng_hash_index_remove(index, hash_indexed(index, &entries[1]),
+                          &entries[1]);
+  g_assert_cmpint(otrng_hash_index_len(index), ==, 2);
+  otrng_assert(!otrng_hash_index_get(index, hash_indexed(index, &entries[1]),
+                                     &entries[1], compare_indexed));
+  otrng_assert(otrng_hash_index_get(index, hash_indexed(index, &entries[2]),
+                                    &entries[2], compare_indexed));
+
+  /* Removing what is not indexed does nothing */
+  otrng_hash_index_remove(index, hash_indexed(index, &entries[1]),
+                          &entries[1]);
+  g_assert_cmpint(otrng_hash_index_len(index), ==, 2);
+
+  otrng_hash_index_free(index);
+  otrng_free(entries);
+}
+
+static void benchmark_lookup(size_t stored) {
+  const size_t rounds = 100000;
+  hash_index_s *index = otrng_hash_index_new();
+  list_element_s *list = NULL;
+  list_element_s *last = NULL;
+  indexed_s *entries = new_indexed(stored);
+  size_t list_rounds = stored > 1000 ? rounds / 100 : rounds;
+  double elapsed;
+  size_t n;
+
+  for (n = 0; n < stored; n++) {
+    otrng_hash_index_add(index, hash_indexed(index, &entries[n]), &entries[n]);
+    last = otrng_list_append(&entries[n], &list, last);
+  }
+
+  g_test_timer_start();
+  for (n = 0; n < rounds; n++) {
+    const indexed_s *wanted = &entries[(n * 7919) % stored];
+    otrng_assert(otrng_hash_index_get(index, hash_indexed(index, wanted),
+                                      wanted, compare_indexed));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e9 / rounds,
+                          "index lookup with %zu entries: %.1f ns", stored,
+                          elapsed * 1e9 / rounds);
+
+  /* The scan is too slow to do as many rounds over the largest list */
+  g_test_timer_start();
+  for (n = 0; n < list_rounds; n++) {
+    otrng_assert(otrng_list_get(&entries[(n * 7919) % stored], list,
+                                compare_indexed));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e9 / list_rounds,
+                          "list scan with %zu entries: %.1f ns", stored,
+                          elapsed * 1e9 / list_rounds);
+
+  otrng_list_free_nodes(list);
+  otrng_hash_index_free(index);
+  otrng_free(entries);
+}
+
+static void test_hash_index_benchmark_lookup() {
+  benchmark_lookup(10);
+  benchmark_lookup(1000);
+  benchmark_lookup(100000);
+}
+
+void units_hash_index_add_tests(void) {
+  g_test_add_func("/hash_index/add_and_get", test_hash_index_add_and_get);
+  g_test_add_func("/hash_index/two_part_keys", test_hash_index_two_part_keys);
+  g_test_add_func("/hash_index/remove", test_hash_index_remove);
+
+  if (g_test_perf()) {
+    g_test_add_func("/hash_index/benchmark_lookup",
+                    test_hash_index_benchmark_lookup);
+  }
+}
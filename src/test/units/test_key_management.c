@@ -91,9 +91,14 @@ static void test_calculate_extra_symm_key() {
       0x1e, 0xcb, 0x1e, 0x31, 0x74, 0xad, 0x9e, 0xa0, 0x23, 0xf9,
   };
 
+  k_msg_enc enc_key;
+  k_sending_chain next_chain;
+
   memcpy(s, manager.current->chain_s, sizeof(k_sending_chain));
 
-  calculate_extra_key(&manager, NULL, 's');
+  otrng_assert_is_success(
+      derive_message_keys(enc_key, NULL, manager.extra_symmetric_key,
+                          next_chain, manager.current->chain_s));
   otrng_assert_cmpmem(expected_extra_key, manager.extra_symmetric_key,
                       EXTRA_SYMMETRIC_KEY_BYTES);
 
@@ -151,6 +156,100 @@ static void test_calculate_brace_key() {
   otrng_free(manager);
 }
 
+static void receive_with_gap(k_msg_enc enc_key, k_msg_mac mac_key,
+                             key_manager_s *manager) {
+  receiving_ratchet_s *ratchet = otrng_receiving_ratchet_new(manager);
+
+  otrng_assert_is_success(otrng_key_manager_derive_chain_keys(
+      enc_key, mac_key, manager, ratchet, 100, 5, 'r', NULL));
+  ratchet->k++;
+
+  otrng_receiving_ratchet_copy(manager, ratchet);
+  otrng_receiving_ratchet_destroy(ratchet);
+}
+
+static void test_lookahead() {
+  key_manager_s *manager = otrng_key_manager_new();
+  key_manager_s *expected = otrng_key_manager_new();
+  k_msg_enc enc_key, expected_enc_key;
+  k_msg_mac mac_key, expected_mac_key;
+  skipped_keys_s *skipped, *expected_skipped;
+
+  memset(manager->current->chain_r, 0x42, CHAIN_KEY_BYTES);
+  memset(expected->current->chain_r, 0x42, CHAIN_KEY_BYTES);
+
+  g_assert_cmpint(otrng_key_manager_lookahead(manager, 8, 3), ==, 3);
+  g_assert_cmpint(otrng_key_manager_lookahead(manager, 8, 100), ==, 5);
+  g_assert_cmpint(otrng_key_manager_lookahead(manager, 8, 100), ==, 0);
+  g_assert_cmpint(manager->lookahead->count, ==, 8);
+
+  /* Looking the keys up gives what deriving them gives */
+  receive_with_gap(enc_key, mac_key, manager);
+  receive_with_gap(expected_enc_key, expected_mac_key, expected);
+
+  otrng_assert_cmpmem(expected_enc_key, enc_key, ENC_KEY_BYTES);
+  otrng_assert_cmpmem(expected_mac_key, mac_key, MAC_KEY_BYTES);
+  otrng_assert_cmpmem(expected->current->chain_r, manager->current->chain_r,
+                      CHAIN_KEY_BYTES);
+  otrng_assert_cmpmem(expected->extra_symmetric_key,
+                      manager->extra_symmetric_key,
+                      EXTRA_SYMMETRIC_KEY_BYTES);
+
+  skipped = otrng_skipped_keys_table_get(manager->skipped_keys, 0, 3);
+  expected_skipped = otrng_skipped_keys_table_get(expected->skipped_keys, 0, 3);
+  otrng_assert(skipped);
+  otrng_assert(expected_skipped);
+  otrng_assert_cmpmem(expected_skipped->enc_key, skipped->enc_key,
+                      ENC_KEY_BYTES);
+
+  /* The keys of the received messages are dropped */
+  g_assert_cmpint(manager->lookahead->start, ==, 6);
+  g_assert_cmpint(manager->lookahead->count, ==, 2);
+
+  /* A new chain makes them all stale */
+  memset(manager->current->chain_r, 0x24, CHAIN_KEY_BYTES);
+  g_assert_cmpint(otrng_key_manager_lookahead(manager, 8, 100), ==, 8);
+
+  otrng_key_manager_lookahead(manager, 0, 0);
+  otrng_assert(!manager->lookahead);
+
+  otrng_key_manager_free(manager);
+  otrng_key_manager_free(expected);
+}
+
+static void test_benchmark_message_kdf() {
+  key_manager_s *manager = otrng_key_manager_new();
+  k_msg_enc enc_key;
+  k_msg_mac mac_key;
+  uint8_t chain_key[CHAIN_KEY_BYTES];
+  const int rounds = 100000;
+  double elapsed;
+  int r;
+
+  memset(manager->current->chain_s, 0x42, CHAIN_KEY_BYTES);
+  memset(chain_key, 0x42, CHAIN_KEY_BYTES);
+
+  g_test_timer_start();
+  for (r = 0; r < rounds; r++) {
+    otrng_assert_is_success(shake_256_kdf1(chain_key, CHAIN_KEY_BYTES, 0x15,
+                                           chain_key, CHAIN_KEY_BYTES));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e9 / rounds, "KDF_1: %.0f ns",
+                          elapsed * 1e9 / rounds);
+
+  g_test_timer_start();
+  for (r = 0; r < rounds; r++) {
+    otrng_assert_is_success(otrng_key_manager_derive_chain_keys(
+        enc_key, mac_key, manager, NULL, 0, 0, 's', NULL));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e9 / rounds, "message keys: %.0f ns",
+                          elapsed * 1e9 / rounds);
+
+  otrng_key_manager_free(manager);
+}
+
 void units_key_management_add_tests(void) {
   g_test_add_func("/key_management/derive_ratchet_keys",
                   test_derive_ratchet_keys);
@@ -158,4 +257,10 @@ void units_key_management_add_tests(void) {
   g_test_add_func("/key_management/extra_symm_key",
                   test_calculate_extra_symm_key);
   g_test_add_func("/key_management/brace_key", test_calculate_brace_key);
+  g_test_add_func("/key_management/lookahead", test_lookahead);
+
+  if (g_test_perf()) {
+    g_test_add_func("/key_management/benchmark_message_kdf",
+                    test_benchmark_message_kdf);
+  }
 }
@@ -107,6 +107,29 @@ static void test_otrng_list_get_last() {
   otrng_list_free_nodes(list);
 }
 
+static void test_otrng_list_append() {
+  int one = 1, two = 2, three = 3;
+  list_element_s *list = NULL;
+  list_element_s *last = NULL;
+
+  last = otrng_list_append(&one, &list, last);
+  otrng_assert(list == last);
+
+  last = otrng_list_append(&two, &list, last);
+  g_assert_cmpint(two, ==, *((int *)last->data));
+
+  // A forgotten last node is found again
+  last = otrng_list_append(&three, &list, NULL);
+  g_assert_cmpint(three, ==, *((int *)last->data));
+  otrng_assert(!last->next);
+
+  g_assert_cmpint(one, ==, *((int *)list->data));
+  g_assert_cmpint(two, ==, *((int *)list->next->data));
+  otrng_assert(list->next->next == last);
+
+  otrng_list_free_nodes(list);
+}
+
 static void test_otrng_list_get_by_value() {
   int one = 1, two = 2;
   list_element_s *list = NULL;
@@ -158,6 +181,7 @@ static void test_list_empty_size() {
 
 void units_list_add_tests(void) {
   g_test_add_func("/list/add", test_otrng_list_add);
+  g_test_add_func("/list/append", test_otrng_list_append);
   g_test_add_func("/list/copy", test_otrng_list_copy);
   g_test_add_func("/list/get", test_otrng_list_get_last);
   g_test_add_func("/list/get_by_value", test_otrng_list_get_by_value);
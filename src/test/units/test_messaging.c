@@ -18,7 +18,11 @@
  *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* mkstemp is POSIX */
+#define _POSIX_C_SOURCE 200809L
+
 #include <glib.h>
+#include <unistd.h>
 
 #include "test_helpers.h"
 
@@ -27,6 +31,7 @@
 #include "base64.h"
 #include "messaging.h"
 #include "persistence.h"
+#include "provisioning.h"
 
 static const char *alice_account = "alice@xmpp";
 static const char *bob_account = "bob@xmpp";
@@ -380,6 +385,524 @@ static void test_instance_tag_api(void) {
   otrng_client_free(alice);
 }
 
+static void test_global_state_get_client(void) {
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_client_s *alice =
+      otrng_client_get(state, create_client_id("otr", alice_account));
+  otrng_client_s *bob =
+      otrng_client_get(state, create_client_id("otr", bob_account));
+  otrng_client_s *alice_xmpp =
+      otrng_client_get(state, create_client_id("xmpp", alice_account));
+
+  otrng_assert(alice != bob);
+  otrng_assert(alice != alice_xmpp);
+  g_assert_cmpint(otrng_hash_index_len(state->client_index), ==, 3);
+
+  otrng_assert(alice ==
+               otrng_client_get(state, create_client_id("otr", alice_account)));
+  otrng_assert(alice_xmpp == otrng_client_get(state, alice_xmpp->client_id));
+  g_assert_cmpint(otrng_list_len(state->clients), ==, 3);
+
+  /* Clients are kept in the order they were created */
+  otrng_assert(state->clients->data == alice);
+  otrng_assert(state->clients->next->data == bob);
+  otrng_assert(state->clients->next->next->data == alice_xmpp);
+
+  otrng_global_state_free(state);
+}
+
+static void test_global_state_store(void) {
+  const uint8_t alice_sym[ED448_PRIVATE_BYTES] = {1};
+  const uint8_t bob_sym[ED448_PRIVATE_BYTES] = {2};
+  const uint8_t alice_fsym[ED448_PRIVATE_BYTES] = {3};
+  const otrng_client_id_s alice_id = create_client_id("otr", alice_account);
+  const otrng_client_id_s bob_id = create_client_id("otr", bob_account);
+
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_client_s *alice = otrng_client_get(state, alice_id);
+  otrng_client_s *bob = otrng_client_get(state, bob_id);
+  otrng_public_key *forging_key = create_forging_key_from(alice_fsym);
+
+  otrng_assert_is_success(otrng_client_add_private_key_v4(alice, alice_sym));
+  otrng_assert_is_success(otrng_client_add_forging_key(alice, *forging_key));
+  otrng_assert_is_success(otrng_client_add_instance_tag(alice, 0x100));
+  otrng_assert_is_success(otrng_client_add_private_key_v4(bob, bob_sym));
+  otrng_free(forging_key);
+
+  otrng_client_profile_s *profile = otrng_client_profile_build(
+      0x100, "4", alice->keypair, *alice->forging_key, 3600);
+  otrng_assert_is_success(otrng_client_add_client_profile(alice, profile));
+  otrng_client_profile_free(profile);
+
+  prekey_message_s **prekeys = otrng_client_build_prekey_messages(2, alice);
+  otrng_assert(prekeys);
+  uint32_t prekey_id = prekeys[1]->id;
+  otrng_free(prekeys);
+
+  FILE *store = tmpfile();
+  otrng_assert_is_success(otrng_global_state_store_write_to(state, store));
+
+  otrng_global_state_s *restored =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(otrng_global_state_store_read_from(restored, store));
+  otrng_assert_is_error(otrng_global_state_store_read_from(restored, store));
+  fclose(store);
+
+  /* Nothing is read before a client is first got */
+  g_assert_cmpint(otrng_hash_index_len(restored->client_index), ==, 0);
+
+  otrng_client_s *alice2 = otrng_client_get(restored, alice_id);
+  otrng_assert(alice2);
+  g_assert_cmpint(otrng_hash_index_len(restored->client_index), ==, 1);
+  otrng_assert_cmpmem(alice->keypair->sym, alice2->keypair->sym,
+                      ED448_PRIVATE_BYTES);
+  otrng_assert(otrng_ec_point_eq(*alice->forging_key, *alice2->forging_key));
+  g_assert_cmpuint(otrng_client_get_instance_tag(alice2), ==, 0x100);
+  otrng_assert(alice2->client_profile);
+  otrng_assert(otrng_ec_point_eq(alice->client_profile->long_term_pub_key,
+                                 alice2->client_profile->long_term_pub_key));
+  g_assert_cmpint(otrng_list_len(alice2->our_prekeys), ==, 2);
+  otrng_assert(otrng_client_get_prekey_by_id(prekey_id, alice2));
+
+  /* Alice is written from memory, and Bob copied from the store */
+  FILE *rewritten = tmpfile();
+  otrng_assert_is_success(
+      otrng_global_state_store_write_to(restored, rewritten));
+  otrng_global_state_free(restored);
+
+  restored = otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(
+      otrng_global_state_store_read_from(restored, rewritten));
+  fclose(rewritten);
+
+  otrng_assert_cmpmem(
+      bob_sym, otrng_client_get(restored, bob_id)->keypair->sym,
+      ED448_PRIVATE_BYTES);
+  otrng_assert(otrng_client_get(restored, alice_id)->keypair);
+  otrng_global_state_free(restored);
+
+  otrng_global_state_free(state);
+}
+
+static void test_global_state_store_rejects_malformed(void) {
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  FILE *store = tmpfile();
+
+  /* An index past the end of the file */
+  fwrite("OTRNGST1\x00\x00\x00\x00\x00\x00\x10\x00\x00\x00\x00\x01", 1,
+         OTRNG_STORE_HEADER_BYTES, store);
+  fflush(store);
+
+  otrng_assert_is_error(otrng_global_state_store_read_from(state, store));
+  otrng_assert(!state->store);
+
+  fclose(store);
+  otrng_global_state_free(state);
+}
+
+static void test_global_state_evicts_idle_clients(void) {
+  const uint8_t alice_sym[ED448_PRIVATE_BYTES] = {1};
+  const uint8_t bob_sym[ED448_PRIVATE_BYTES] = {2};
+  const uint8_t charlie_sym[ED448_PRIVATE_BYTES] = {3};
+  const otrng_client_id_s alice_id = create_client_id("otr", alice_account);
+  const otrng_client_id_s bob_id = create_client_id("otr", bob_account);
+  const otrng_client_id_s charlie_id =
+      create_client_id("otr", charlie_account);
+
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_global_state_set_max_resident_clients(state, 2);
+
+  otrng_client_s *alice = otrng_client_get(state, alice_id);
+  otrng_client_s *bob = otrng_client_get(state, bob_id);
+  otrng_client_s *charlie = otrng_client_get(state, charlie_id);
+  otrng_assert_is_success(otrng_client_add_private_key_v4(alice, alice_sym));
+  otrng_assert_is_success(otrng_client_add_private_key_v4(bob, bob_sym));
+  otrng_assert_is_success(
+      otrng_client_add_private_key_v4(charlie, charlie_sym));
+
+  /* Bob is busy, and Charlie was got the longest ago */
+  bob->should_publish = otrng_true;
+  otrng_assert(alice == otrng_client_get(state, alice_id));
+
+  g_assert_cmpint(otrng_global_state_evict_idle_clients(state), ==, 1);
+  g_assert_cmpint(otrng_list_len(state->clients), ==, 2);
+  g_assert_cmpint(otrng_hash_index_len(state->client_index), ==, 2);
+  otrng_assert(state->clients->data == alice);
+  otrng_assert(state->clients->next->data == bob);
+  g_assert_cmpint(otrng_global_state_evict_idle_clients(state), ==, 0);
+
+  /* An evicted client is read back when it is got */
+  charlie = otrng_client_get(state, charlie_id);
+  otrng_assert_cmpmem(charlie_sym, charlie->keypair->sym,
+                      ED448_PRIVATE_BYTES);
+  otrng_assert(state->clients->next->next->data == charlie);
+
+  /* The tick evicts what is over the limit */
+  g_assert_cmpint(otrng_global_state_tick(state, time(NULL)), ==, 0);
+  g_assert_cmpint(otrng_list_len(state->clients), ==, 2);
+  otrng_assert(state->clients->data == bob);
+
+  /* Evicted clients are written with the others */
+  FILE *store = tmpfile();
+  otrng_assert_is_success(otrng_global_state_store_write_to(state, store));
+  otrng_global_state_free(state);
+
+  state = otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(otrng_global_state_store_read_from(state, store));
+  fclose(store);
+
+  otrng_assert_cmpmem(alice_sym,
+                      otrng_client_get(state, alice_id)->keypair->sym,
+                      ED448_PRIVATE_BYTES);
+  otrng_assert_cmpmem(bob_sym, otrng_client_get(state, bob_id)->keypair->sym,
+                      ED448_PRIVATE_BYTES);
+  otrng_global_state_free(state);
+}
+
+static void test_global_state_prekey_journal(void) {
+  const uint8_t alice_sym[ED448_PRIVATE_BYTES] = {1};
+  const otrng_client_id_s alice_id = create_client_id("otr", alice_account);
+  char path[] = "/tmp/otrng-prekey-journal-XXXXXX";
+  char tmp_path[sizeof(path) + 4];
+  uint32_t ids[4];
+  int n;
+
+  int fd = mkstemp(path);
+  otrng_assert(fd >= 0);
+  close(fd);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_client_s *alice = otrng_client_get(state, alice_id);
+  otrng_assert_is_success(otrng_client_add_private_key_v4(alice, alice_sym));
+  otrng_assert_is_success(otrng_client_add_instance_tag(alice, 0x100));
+
+  /* The journal takes the prekey messages Alice already has */
+  prekey_message_s **prekeys = otrng_client_build_prekey_messages(2, alice);
+  ids[0] = prekeys[0]->id;
+  ids[1] = prekeys[1]->id;
+  otrng_free(prekeys);
+
+  otrng_assert_is_success(otrng_global_state_prekey_journal_open(state, path));
+  otrng_assert_is_error(otrng_global_state_prekey_journal_open(state, path));
+  g_assert_cmpint(state->prekey_journal->live, ==, 2);
+
+  otrng_global_state_set_prekey_journal_sync_batch(state, 0);
+  prekeys = otrng_client_build_prekey_messages(2, alice);
+  ids[2] = prekeys[0]->id;
+  ids[3] = prekeys[1]->id;
+  otrng_free(prekeys);
+
+  otrng_client_delete_my_prekey_message_by_id(ids[1], alice);
+  g_assert_cmpint(state->prekey_journal->records, ==, 5);
+  g_assert_cmpint(state->prekey_journal->unsynced, ==, 3);
+  otrng_assert_is_success(otrng_global_state_prekey_journal_sync(state));
+  g_assert_cmpint(state->prekey_journal->unsynced, ==, 0);
+  otrng_global_state_free(state);
+
+  /* A client got later reads what is left from the journal */
+  state = otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(otrng_global_state_prekey_journal_open(state, path));
+  alice = otrng_client_get(state, alice_id);
+  g_assert_cmpint(otrng_list_len(alice->our_prekeys), ==, 3);
+  otrng_assert(!otrng_client_get_prekey_by_id(ids[1], alice));
+  for (n = 0; n < 4; n++) {
+    otrng_assert(n == 1 || otrng_client_get_prekey_by_id(ids[n], alice));
+  }
+
+  /* Compacting leaves only the prekey messages */
+  otrng_assert_is_success(otrng_global_state_prekey_journal_compact(state));
+  g_assert_cmpint(state->prekey_journal->records, ==, 3);
+  otrng_assert(access(tmp_path, F_OK) != 0);
+  otrng_global_state_free(state);
+
+  state = otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(otrng_global_state_prekey_journal_open(state, path));
+  g_assert_cmpint(
+      otrng_list_len(otrng_client_get(state, alice_id)->our_prekeys), ==, 3);
+  otrng_global_state_free(state);
+
+  unlink(path);
+}
+
+static void test_global_state_provision(void) {
+  const uint8_t bob_sym[ED448_PRIVATE_BYTES] = {2};
+  const uint8_t charlie_sym[ED448_PRIVATE_BYTES] = {3};
+  const otrng_client_id_s ids[] = {
+      create_client_id("otr", alice_account),
+      create_client_id("otr", bob_account),
+      create_client_id("otr", charlie_account),
+  };
+  const otrng_provisioning_options_s options = {.workers = 2,
+                                                .prekey_messages = 3};
+  otrng_provisioning_s *provisioning;
+  otrng_client_s *client;
+  int n;
+
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  for (n = 0; n < 3; n++) {
+    otrng_assert_is_success(otrng_client_add_instance_tag(
+        otrng_client_get(state, ids[n]), 0x100 + n));
+  }
+  otrng_assert_is_success(
+      otrng_client_add_private_key_v4(otrng_client_get(state, ids[1]),
+                                      bob_sym));
+
+  provisioning = otrng_global_state_provision(state, ids, 2, &options);
+  otrng_assert(provisioning);
+  otrng_provisioning_wait(provisioning);
+  otrng_assert(otrng_provisioning_is_done(provisioning));
+  g_assert_cmpint(otrng_provisioning_collect(provisioning, 10), ==, 0);
+
+  for (n = 0; n < 2; n++) {
+    otrng_assert_is_success(otrng_provisioning_get_result(provisioning, n));
+
+    client = otrng_client_get(state, ids[n]);
+    otrng_assert(client->keypair);
+    otrng_assert(client->forging_key);
+    otrng_assert(otrng_client_profile_valid(
+        client->client_profile, otrng_client_get_instance_tag(client)));
+    otrng_assert(otrng_prekey_profile_valid(
+        client->prekey_profile, otrng_client_get_instance_tag(client),
+        client->keypair->pub));
+    g_assert_cmpint(otrng_list_len(client->our_prekeys), ==, 3);
+    otrng_assert(client->should_publish);
+  }
+  otrng_provisioning_free(provisioning);
+
+  /* The key Bob had is kept */
+  otrng_assert_cmpmem(bob_sym,
+                      otrng_client_get(state, ids[1])->keypair->sym,
+                      ED448_PRIVATE_BYTES);
+
+  /* Alice only needs more prekey messages */
+  provisioning = otrng_global_state_provision(state, ids, 1, &options);
+  otrng_provisioning_wait(provisioning);
+  otrng_assert_is_success(otrng_provisioning_get_result(provisioning, 0));
+  g_assert_cmpint(
+      otrng_list_len(otrng_client_get(state, ids[0])->our_prekeys), ==, 6);
+  otrng_provisioning_free(provisioning);
+
+  /* Charlie gets another key before it is collected */
+  provisioning = otrng_global_state_provision(state, &ids[2], 1, &options);
+  client = otrng_client_get(state, ids[2]);
+  otrng_assert_is_success(otrng_client_add_private_key_v4(client, charlie_sym));
+  otrng_provisioning_wait(provisioning);
+  otrng_assert_is_error(otrng_provisioning_get_result(provisioning, 0));
+  otrng_assert(!client->client_profile);
+  otrng_assert(!client->our_prekeys);
+  otrng_provisioning_free(provisioning);
+
+  otrng_global_state_free(state);
+}
+
+#define STORE_BENCHMARK_ACCOUNTS 1000
+
+static char benchmark_accounts[STORE_BENCHMARK_ACCOUNTS][16];
+
+static otrng_client_id_s read_benchmark_client_id(FILE *privf) {
+  char line[32];
+  unsigned int account;
+  otrng_client_id_s result = {
+      .protocol = NULL,
+      .account = NULL,
+  };
+
+  if (fgets(line, sizeof(line), privf) &&
+      sscanf(line, "otr:user%u@xmpp", &account) == 1 &&
+      account < STORE_BENCHMARK_ACCOUNTS) {
+    result.protocol = "otr";
+    result.account = benchmark_accounts[account];
+  }
+
+  return result;
+}
+
+static void test_global_state_store_benchmark(void) {
+  uint8_t sym[ED448_PRIVATE_BYTES] = {0};
+  FILE *keys = tmpfile();
+  FILE *store = tmpfile();
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  double text, binary;
+  int account;
+
+  for (account = 0; account < STORE_BENCHMARK_ACCOUNTS; account++) {
+    snprintf(benchmark_accounts[account], sizeof(benchmark_accounts[account]),
+             "user%04d@xmpp", account);
+    sym[0] = account & 0xff;
+    sym[1] = account >> 8;
+    otrng_assert_is_success(otrng_client_add_private_key_v4(
+        otrng_client_get(state,
+                         create_client_id("otr", benchmark_accounts[account])),
+        sym));
+  }
+
+  otrng_assert_is_success(
+      otrng_global_state_private_key_v4_write_to(state, keys));
+  otrng_assert_is_success(otrng_global_state_store_write_to(state, store));
+  otrng_global_state_free(state);
+  rewind(keys);
+
+  /* Until the first client can be used */
+  g_test_timer_start();
+  state = otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(otrng_global_state_private_key_v4_read_from(
+      state, keys, read_benchmark_client_id));
+  otrng_assert(
+      otrng_client_get(state, create_client_id("otr", benchmark_accounts[0]))
+          ->keypair);
+  text = g_test_timer_elapsed();
+  otrng_global_state_free(state);
+
+  g_test_timer_start();
+  state = otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_assert_is_success(otrng_global_state_store_read_from(state, store));
+  otrng_assert(
+      otrng_client_get(state, create_client_id("otr", benchmark_accounts[0]))
+          ->keypair);
+  binary = g_test_timer_elapsed();
+  g_assert_cmpint(otrng_list_len(state->clients), ==, 1);
+  otrng_global_state_free(state);
+
+  g_test_minimized_result(binary * 1e6,
+                          "starting with %d accounts: %.2f us from text, "
+                          "%.2f us from the store",
+                          STORE_BENCHMARK_ACCOUNTS, text * 1e6, binary * 1e6);
+
+  fclose(keys);
+  fclose(store);
+}
+
+#define PREKEY_JOURNAL_BENCHMARK_PREKEYS 100
+
+static uint32_t *build_benchmark_prekeys(otrng_client_s *client, int count) {
+  prekey_message_s **prekeys =
+      otrng_client_build_prekey_messages(count, client);
+  uint32_t *ids = otrng_xmalloc(count * sizeof(uint32_t));
+  int n;
+
+  otrng_assert(prekeys);
+  for (n = 0; n < count; n++) {
+    ids[n] = prekeys[n]->id;
+  }
+  otrng_free(prekeys);
+
+  return ids;
+}
+
+static void test_global_state_prekey_journal_benchmark(void) {
+  const uint8_t alice_sym[ED448_PRIVATE_BYTES] = {1};
+  const int consumed = PREKEY_JOURNAL_BENCHMARK_PREKEYS / 2;
+  char path[] = "/tmp/otrng-prekey-journal-XXXXXX";
+  double text, journal;
+  uint32_t *ids;
+  int n;
+
+  int fd = mkstemp(path);
+  otrng_assert(fd >= 0);
+  close(fd);
+
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_client_s *alice =
+      otrng_client_get(state, create_client_id("otr", alice_account));
+  otrng_assert_is_success(otrng_client_add_private_key_v4(alice, alice_sym));
+  otrng_assert_is_success(otrng_client_add_instance_tag(alice, 0x100));
+
+  /* Every prekey message is written again each time one is consumed */
+  ids = build_benchmark_prekeys(alice, PREKEY_JOURNAL_BENCHMARK_PREKEYS);
+  g_test_timer_start();
+  for (n = 0; n < consumed; n++) {
+    FILE *prekeyf = tmpfile();
+
+    otrng_client_delete_my_prekey_message_by_id(ids[n], alice);
+    otrng_assert_is_success(
+        otrng_global_state_prekey_messages_write_to(state, prekeyf));
+    fclose(prekeyf);
+  }
+  text = g_test_timer_elapsed();
+  otrng_free(ids);
+
+  ids = build_benchmark_prekeys(alice, consumed);
+  otrng_free(ids);
+  g_assert_cmpint(otrng_list_len(alice->our_prekeys), ==,
+                  PREKEY_JOURNAL_BENCHMARK_PREKEYS);
+
+  otrng_global_state_set_prekey_journal_sync_batch(state, 0);
+  otrng_assert_is_success(otrng_global_state_prekey_journal_open(state, path));
+
+  g_test_timer_start();
+  for (n = 0; n < consumed; n++) {
+    const prekey_message_s *prekey = alice->our_prekeys->data;
+    otrng_client_delete_my_prekey_message_by_id(prekey->id, alice);
+  }
+  otrng_assert_is_success(otrng_global_state_prekey_journal_sync(state));
+  journal = g_test_timer_elapsed();
+
+  g_test_minimized_result(journal * 1e6 / consumed,
+                          "consuming %d of %d prekey messages: %.2f us each "
+                          "rewriting them, %.2f us each with the journal",
+                          consumed, PREKEY_JOURNAL_BENCHMARK_PREKEYS,
+                          text * 1e6 / consumed, journal * 1e6 / consumed);
+
+  otrng_global_state_free(state);
+  unlink(path);
+}
+
+#define PROVISION_BENCHMARK_ACCOUNTS 16
+
+static double benchmark_provision(size_t workers) {
+  otrng_client_id_s ids[PROVISION_BENCHMARK_ACCOUNTS];
+  const otrng_provisioning_options_s options = {.workers = workers,
+                                                .prekey_messages = 10};
+  otrng_global_state_s *state =
+      otrng_global_state_new(empty_callbacks, otrng_false);
+  otrng_provisioning_s *provisioning;
+  double elapsed;
+  int n;
+
+  for (n = 0; n < PROVISION_BENCHMARK_ACCOUNTS; n++) {
+    snprintf(benchmark_accounts[n], sizeof(benchmark_accounts[n]),
+             "user%04d@xmpp", n);
+    ids[n] = create_client_id("otr", benchmark_accounts[n]);
+    otrng_assert_is_success(otrng_client_add_instance_tag(
+        otrng_client_get(state, ids[n]), 0x100 + n));
+  }
+
+  g_test_timer_start();
+  provisioning = otrng_global_state_provision(
+      state, ids, PROVISION_BENCHMARK_ACCOUNTS, &options);
+  otrng_provisioning_wait(provisioning);
+  elapsed = g_test_timer_elapsed();
+
+  for (n = 0; n < PROVISION_BENCHMARK_ACCOUNTS; n++) {
+    otrng_assert_is_success(otrng_provisioning_get_result(provisioning, n));
+  }
+
+  otrng_provisioning_free(provisioning);
+  otrng_global_state_free(state);
+
+  return elapsed;
+}
+
+static void test_global_state_provision_benchmark(void) {
+  double serial = benchmark_provision(1);
+  double parallel = benchmark_provision(4);
+
+  g_test_minimized_result(parallel * 1e3,
+                          "provisioning %d accounts: %.0f ms with one "
+                          "worker, %.0f ms with four",
+                          PROVISION_BENCHMARK_ACCOUNTS, serial * 1e3,
+                          parallel * 1e3);
+}
+
 void units_messaging_add_tests() {
   g_test_add_func("/global_state/key_management",
                   test_global_state_key_management);
@@ -389,6 +912,24 @@ void units_messaging_add_tests() {
                   test_global_state_prekey_profile_management);
   g_test_add_func("/global_state/prekey_message_management",
                   test_global_state_prekey_message_management);
+  g_test_add_func("/global_state/get_client", test_global_state_get_client);
+  g_test_add_func("/global_state/store", test_global_state_store);
+  g_test_add_func("/global_state/store_rejects_malformed",
+                  test_global_state_store_rejects_malformed);
+  g_test_add_func("/global_state/evicts_idle_clients",
+                  test_global_state_evicts_idle_clients);
+  g_test_add_func("/global_state/prekey_journal",
+                  test_global_state_prekey_journal);
+  g_test_add_func("/global_state/provision", test_global_state_provision);
+
+  if (g_test_perf()) {
+    g_test_add_func("/global_state/benchmark/store",
+                    test_global_state_store_benchmark);
+    g_test_add_func("/global_state/benchmark/prekey_journal",
+                    test_global_state_prekey_journal_benchmark);
+    g_test_add_func("/global_state/benchmark/provision",
+                    test_global_state_provision_benchmark);
+  }
 
   g_test_add_func("/api/instance_tag", test_instance_tag_api);
 }
@@ -25,6 +25,7 @@
 
 #include "test_fixtures.h"
 
+#include "base64.h"
 #include "otrng.h"
 
 static void test_otrng_builds_query_message(otrng_fixture_s *otrng_fixture,
@@ -236,6 +237,44 @@ static void test_otrng_destroy() {
   otrng_client_free(client);
 }
 
+static void test_otrng_peeks_header() {
+  uint8_t header[40] = {0x00, 0x04, IDENTITY_MSG_TYPE, 0x00, 0x00, 0x01, 0x02,
+                        0x00, 0x00, 0x00, 0x00};
+  char *base64 = otrng_base64_encode(header, sizeof(header));
+  char *msg = g_strdup_printf("?OTR:%s.", base64);
+  otrng_message_to_send_s *fragments =
+      otrng_xmalloc_z(sizeof(otrng_message_to_send_s));
+  otrng_header_s peeked;
+
+  otrng_assert_is_success(otrng_peek_header(&peeked, msg));
+  g_assert_cmpint(peeked.version, ==, 4);
+  g_assert_cmpint(peeked.type, ==, IDENTITY_MSG_TYPE);
+  g_assert_cmpint(peeked.sender_instance_tag, ==, 0x102);
+  g_assert_cmpint(peeked.receiver_instance_tag, ==, 0);
+
+  /* Only the first fragment tells the type */
+  otrng_assert_is_success(
+      otrng_fragment_message(80, fragments, 0x102, 0x101, msg));
+  otrng_assert(fragments->total > 1);
+
+  otrng_assert_is_success(otrng_peek_header(&peeked, fragments->pieces[0]));
+  g_assert_cmpint(peeked.type, ==, IDENTITY_MSG_TYPE);
+  g_assert_cmpint(peeked.sender_instance_tag, ==, 0x102);
+  g_assert_cmpint(peeked.receiver_instance_tag, ==, 0x101);
+
+  otrng_assert_is_success(otrng_peek_header(&peeked, fragments->pieces[1]));
+  g_assert_cmpint(peeked.version, ==, 4);
+  g_assert_cmpint(peeked.type, ==, 0);
+  g_assert_cmpint(peeked.sender_instance_tag, ==, 0x102);
+
+  otrng_assert(otrng_failed(otrng_peek_header(&peeked, "?OTRv4? hi")));
+  otrng_assert(otrng_failed(otrng_peek_header(&peeked, "?OTR:AAQ1.")));
+
+  otrng_message_free(fragments);
+  g_free(msg);
+  otrng_free(base64);
+}
+
 static void test_otrng_build_prekey_ensemble() {
   uint8_t long_term_priv[ED448_PRIVATE_BYTES] = {0xA};
   uint8_t forging_priv[ED448_PRIVATE_BYTES] = {
@@ -409,6 +448,7 @@ void units_otrng_add_tests(void) {
              otrng_fixture_set_up, test_otrng_receives_query_message_v3,
              otrng_fixture_teardown);
   g_test_add_func("/otrng/destroy", test_otrng_destroy);
+  g_test_add_func("/otrng/peeks_header", test_otrng_peeks_header);
 
   g_test_add_func("/otrng/shared_session_state/serializes",
                   test_otrng_generates_shared_session_state_string);
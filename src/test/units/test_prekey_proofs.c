@@ -306,6 +306,56 @@ static void test_dh_proof_deserialization(void) {
   otrng_dh_mpi_release(expected_v);
 }
 
+static void test_dh_proof_benchmark(void) {
+  const size_t sizes[] = {10, 100, 255};
+  const int rounds = 10;
+  gcry_mpi_t privs[255];
+  gcry_mpi_t pubs[255];
+  uint8_t m[HASH_BYTES] = {0x01, 0x02, 0x03};
+  dh_proof_s res;
+  double generate, verify;
+  size_t n, j;
+  int r;
+
+  for (j = 0; j < 255; j++) {
+    privs[j] = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+    gcry_mpi_randomize(privs[j], DH_KEY_SIZE * 8, GCRY_WEAK_RANDOM);
+    pubs[j] = gcry_mpi_new(DH3072_MOD_LEN_BITS);
+    otrng_dh_calculate_public_key(pubs[j], privs[j]);
+  }
+
+  for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+    generate = 0;
+    verify = 0;
+    for (r = 0; r < rounds; r++) {
+      g_test_timer_start();
+      otrng_assert_is_success(otrng_dh_proof_generate(
+          &res, (const gcry_mpi_t *)privs, (const gcry_mpi_t *)pubs, sizes[n],
+          m, 0x13, NULL));
+      generate += g_test_timer_elapsed();
+
+      g_test_timer_start();
+      otrng_assert(otrng_dh_proof_verify(&res, (const gcry_mpi_t *)pubs,
+                                         sizes[n], m, 0x13));
+      verify += g_test_timer_elapsed();
+
+      otrng_dh_mpi_release(res.v);
+    }
+
+    g_test_minimized_result(generate * 1e3 / rounds,
+                            "generating a proof of %zu values: %.1f ms",
+                            sizes[n], generate * 1e3 / rounds);
+    g_test_minimized_result(verify * 1e3 / rounds,
+                            "verifying a proof of %zu values: %.1f ms",
+                            sizes[n], verify * 1e3 / rounds);
+  }
+
+  for (j = 0; j < 255; j++) {
+    otrng_dh_mpi_release(privs[j]);
+    otrng_dh_mpi_release(pubs[j]);
+  }
+}
+
 void units_prekey_proofs_add_tests(void) {
   g_test_add_func("/prekey_server/proofs/dh_gen_validation",
                   test_dh_proof_generation_and_validation);
@@ -321,4 +371,9 @@ void units_prekey_proofs_add_tests(void) {
                   test_ecdh_proof_deserialization);
   g_test_add_func("/prekey_server/proofs/dh/deserialization",
                   test_dh_proof_deserialization);
+
+  if (g_test_perf()) {
+    g_test_add_func("/prekey_server/proofs/dh/benchmark",
+                    test_dh_proof_benchmark);
+  }
 }
@@ -0,0 +1,182 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <glib.h>
+
+#include "test_helpers.h"
+
+#include "list.h"
+#include "skipped_keys.h"
+
+static void add_keys(skipped_keys_table_s *table, uint32_t i, uint32_t count) {
+  uint8_t enc_key[ENC_KEY_BYTES];
+  uint8_t extra_key[EXTRA_SYMMETRIC_KEY_BYTES];
+  uint32_t j;
+
+  for (j = 0; j < count; j++) {
+    memset(enc_key, (int)(i + j), ENC_KEY_BYTES);
+    memset(extra_key, (int)(i ^ j), EXTRA_SYMMETRIC_KEY_BYTES);
+    otrng_skipped_keys_table_add(table, i, j, enc_key, extra_key);
+  }
+}
+
+static void test_skipped_keys_add_and_get() {
+  skipped_keys_table_s *table = otrng_skipped_keys_table_new();
+  uint8_t expected_enc_key[ENC_KEY_BYTES];
+  uint8_t expected_extra_key[EXTRA_SYMMETRIC_KEY_BYTES];
+  skipped_keys_s *entry;
+
+  otrng_assert(!otrng_skipped_keys_table_get(table, 0, 0));
+
+  /* Enough keys to grow the table a few times */
+  add_keys(table, 1, 100);
+  add_keys(table, 2, 100);
+  g_assert_cmpint(otrng_skipped_keys_table_len(table), ==, 200);
+
+  entry = otrng_skipped_keys_table_get(table, 2, 42);
+  otrng_assert(entry);
+  g_assert_cmpint(entry->i, ==, 2);
+  g_assert_cmpint(entry->j, ==, 42);
+
+  memset(expected_enc_key, 2 + 42, ENC_KEY_BYTES);
+  memset(expected_extra_key, 2 ^ 42, EXTRA_SYMMETRIC_KEY_BYTES);
+  otrng_assert_cmpmem(expected_enc_key, entry->enc_key, ENC_KEY_BYTES);
+  otrng_assert_cmpmem(expected_extra_key, entry->extra_symmetric_key,
+                      EXTRA_SYMMETRIC_KEY_BYTES);
+
+  otrng_assert(!otrng_skipped_keys_table_get(table, 3, 42));
+  otrng_assert(!otrng_skipped_keys_table_get(table, 2, 100));
+
+  otrng_skipped_keys_table_free(table);
+}
+
+static void test_skipped_keys_remove() {
+  skipped_keys_table_s *table = otrng_skipped_keys_table_new();
+  skipped_keys_s *entry;
+
+  add_keys(table, 1, 3);
+
+  entry = otrng_skipped_keys_table_get(table, 1, 1);
+  otrng_skipped_keys_table_remove(table, entry);
+  g_assert_cmpint(otrng_skipped_keys_table_len(table), ==, 2);
+  otrng_assert(!otrng_skipped_keys_table_get(table, 1, 1));
+
+  /* Insertion order is kept around the removed entry */
+  g_assert_cmpint(table->oldest->j, ==, 0);
+  g_assert_cmpint(table->oldest->newer->j, ==, 2);
+  g_assert_cmpint(table->newest->older->j, ==, 0);
+
+  otrng_skipped_keys_table_remove_newest(table, 1);
+  g_assert_cmpint(otrng_skipped_keys_table_len(table), ==, 1);
+  otrng_assert(!otrng_skipped_keys_table_get(table, 1, 2));
+  otrng_assert(otrng_skipped_keys_table_get(table, 1, 0));
+
+  otrng_skipped_keys_table_clear(table);
+  g_assert_cmpint(otrng_skipped_keys_table_len(table), ==, 0);
+  otrng_assert(!table->oldest);
+  otrng_assert(!table->newest);
+
+  otrng_skipped_keys_table_free(table);
+}
+
+static void test_skipped_keys_evict_oldest_generations() {
+  skipped_keys_table_s *table = otrng_skipped_keys_table_new();
+
+  add_keys(table, 1, 5);
+  add_keys(table, 2, 5);
+  add_keys(table, 3, 5);
+
+  g_assert_cmpint(otrng_skipped_keys_table_evict(table, 15), ==, 0);
+
+  /* A whole generation goes, even if fewer keys would be enough */
+  g_assert_cmpint(otrng_skipped_keys_table_evict(table, 12), ==, 5);
+  g_assert_cmpint(otrng_skipped_keys_table_len(table), ==, 10);
+  otrng_assert(!otrng_skipped_keys_table_get(table, 1, 0));
+  otrng_assert(otrng_skipped_keys_table_get(table, 2, 0));
+
+  g_assert_cmpint(otrng_skipped_keys_table_evict(table, 0), ==, 10);
+  g_assert_cmpint(otrng_skipped_keys_table_len(table), ==, 0);
+
+  otrng_skipped_keys_table_free(table);
+}
+
+static int compare_skipped_keys(const void *current, const void *wanted) {
+  const skipped_keys_s *c = current;
+  const skipped_keys_s *w = wanted;
+
+  return c->i == w->i && c->j == w->j;
+}
+
+static void benchmark_lookup(uint32_t stored) {
+  const int rounds = 100000;
+  skipped_keys_table_s *table = otrng_skipped_keys_table_new();
+  list_element_s *list = NULL;
+  skipped_keys_s wanted;
+  skipped_keys_s *entry;
+  double elapsed;
+  int r;
+
+  add_keys(table, 0, stored);
+  for (entry = table->oldest; entry; entry = entry->newer) {
+    list = otrng_list_add(entry, list);
+  }
+
+  g_test_timer_start();
+  for (r = 0; r < rounds; r++) {
+    otrng_assert(otrng_skipped_keys_table_get(table, 0, (uint32_t)r % stored));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e9 / rounds,
+                          "table lookup with %u stored keys: %.1f ns", stored,
+                          elapsed * 1e9 / rounds);
+
+  wanted.i = 0;
+  g_test_timer_start();
+  for (r = 0; r < rounds; r++) {
+    wanted.j = (uint32_t)r % stored;
+    otrng_assert(otrng_list_get(&wanted, list, compare_skipped_keys));
+  }
+  elapsed = g_test_timer_elapsed();
+  g_test_minimized_result(elapsed * 1e9 / rounds,
+                          "list scan with %u stored keys: %.1f ns", stored,
+                          elapsed * 1e9 / rounds);
+
+  otrng_list_free_nodes(list);
+  otrng_skipped_keys_table_free(table);
+}
+
+static void test_skipped_keys_benchmark_lookup() {
+  benchmark_lookup(10);
+  benchmark_lookup(100);
+  benchmark_lookup(1000);
+}
+
+void units_skipped_keys_add_tests(void) {
+  g_test_add_func("/skipped_keys/add_and_get", test_skipped_keys_add_and_get);
+  g_test_add_func("/skipped_keys/remove", test_skipped_keys_remove);
+  g_test_add_func("/skipped_keys/evict_oldest_generations",
+                  test_skipped_keys_evict_oldest_generations);
+
+  if (g_test_perf()) {
+    g_test_add_func("/skipped_keys/benchmark_lookup",
+                    test_skipped_keys_benchmark_lookup);
+  }
+}
@@ -59,6 +59,29 @@ static void test_tlv_parse() {
   otrng_tlv_list_free(tlvs);
 }
 
+static void test_tlv_parse_views() {
+  uint8_t message[23] = {0x00, 0x06, 0x00, 0x03, 0x08, 0x05, 0x09, 0x00,
+                         0x02, 0x00, 0x04, 0xac, 0x04, 0x05, 0x06, 0x00,
+                         0x05, 0x00, 0x03, 0x08, 0x05, 0x09, 0x00};
+
+  uint8_t data[3] = {0x08, 0x05, 0x09};
+  uint8_t data2[4] = {0xac, 0x04, 0x05, 0x06};
+
+  tlv_list_s *tlvs = otrng_parse_tlv_views(message, sizeof(message));
+  assert_tlv_structure(tlvs, OTRNG_TLV_SMP_ABORT, sizeof(data), data,
+                       otrng_true);
+  assert_tlv_structure(tlvs->next, OTRNG_TLV_SMP_MSG_1, sizeof(data2), data2,
+                       otrng_true);
+  assert_tlv_structure(tlvs->next->next, OTRNG_TLV_SMP_MSG_4, sizeof(data),
+                       data, otrng_false);
+
+  otrng_assert(tlvs->data->data == message + 4);
+  otrng_assert(tlvs->next->data->data == message + 11);
+  otrng_assert(tlvs->next->next->data->data == message + 19);
+
+  otrng_tlv_list_free_views(tlvs);
+}
+
 static void test_otrng_append_tlv() {
   uint8_t smp2_data[2] = {0x03, 0x04};
   uint8_t smp3_data[3] = {0x05, 0x04, 0x03};
@@ -112,6 +135,7 @@ static void test_otrng_append_padding_tlv() {
 
 void units_tlv_add_tests(void) {
   g_test_add_func("/tlv/parse", test_tlv_parse);
+  g_test_add_func("/tlv/parse_views", test_tlv_parse_views);
   g_test_add_func("/tlv/append", test_otrng_append_tlv);
   g_test_add_func("/tlv/append_padding", test_otrng_append_padding_tlv);
 }
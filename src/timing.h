@@ -0,0 +1,33 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_TIMING_H
+#define OTRNG_TIMING_H
+
+#include <stdint.h>
+
+#include "shared.h"
+
+/* Microseconds from a monotonic clock, to measure elapsed wall-clock time.
+   Unlike clock(), it counts time spent blocked, and not the processor time of
+   other threads. */
+INTERNAL uint64_t otrng_monotonic_us(void);
+
+#endif
@@ -44,19 +44,14 @@ tstatic void set_tlv_type(tlv_s *tlv, uint16_t tlv_type) {
   }
 }
 
-tstatic tlv_s *parse_tlv(const uint8_t *src, size_t len, size_t *read) {
-  tlv_s *tlv = otrng_tlv_new(OTRNG_TLV_NONE, 0, NULL);
+tstatic otrng_result parse_tlv_header(tlv_s *tlv, const uint8_t *src,
+                                      size_t len, size_t *read) {
   size_t w = 0;
   uint16_t tlv_type = -1;
   const uint8_t *cursor = src;
 
-  if (!tlv) {
-    return NULL;
-  }
-
   if (!otrng_deserialize_uint16(&tlv_type, cursor, len, &w)) {
-    otrng_tlv_free(tlv);
-    return NULL;
+    return OTRNG_ERROR;
   }
 
   set_tlv_type(tlv, tlv_type);
@@ -65,25 +60,39 @@ tstatic tlv_s *parse_tlv(const uint8_t *src, size_t len, size_t *read) {
   cursor += w;
 
   if (!otrng_deserialize_uint16(&tlv->len, cursor, len, &w)) {
-    otrng_tlv_free(tlv);
-    return NULL;
+    return OTRNG_ERROR;
   }
 
   len -= w;
   cursor += w;
 
   if (len < tlv->len) {
+    return OTRNG_ERROR;
+  }
+
+  *read = cursor - src;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic tlv_s *parse_tlv(const uint8_t *src, size_t len, size_t *read) {
+  tlv_s *tlv = otrng_tlv_new(OTRNG_TLV_NONE, 0, NULL);
+  size_t w = 0;
+
+  if (!tlv) {
+    return NULL;
+  }
+
+  if (!parse_tlv_header(tlv, src, len, &w)) {
     otrng_tlv_free(tlv);
     return NULL;
   }
 
   tlv->data = otrng_xmalloc_z(tlv->len);
-
-  memcpy(tlv->data, cursor, tlv->len);
-  cursor += tlv->len;
+  memcpy(tlv->data, src + w, tlv->len);
 
   if (read) {
-    *read = cursor - src;
+    *read = w + tlv->len;
   }
 
   return tlv;
@@ -131,6 +140,51 @@ INTERNAL tlv_list_s *otrng_parse_tlvs(const uint8_t *src, size_t len) {
   return ret;
 }
 
+INTERNAL tlv_list_s *otrng_parse_tlv_views(uint8_t *src, size_t len) {
+  tlv_list_s *ret = NULL, *last = NULL;
+
+  while (len > 0) {
+    size_t read = 0;
+    tlv_list_s *node;
+    tlv_s *tlv = otrng_xmalloc_z(sizeof(tlv_s));
+
+    if (!parse_tlv_header(tlv, src, len, &read)) {
+      otrng_free(tlv);
+      break;
+    }
+
+    tlv->data = src + read;
+    read += tlv->len;
+
+    node = otrng_xmalloc_z(sizeof(tlv_list_s));
+    node->data = tlv;
+
+    if (last) {
+      last->next = node;
+    } else {
+      ret = node;
+    }
+    last = node;
+
+    src += read;
+    len -= read;
+  }
+
+  return ret;
+}
+
+INTERNAL void otrng_tlv_list_free_views(tlv_list_s *head) {
+  tlv_list_s *current = head;
+  while (current) {
+    tlv_list_s *next = current->next;
+
+    otrng_free(current->data);
+    current->data = NULL;
+    otrng_free(current);
+    current = next;
+  }
+}
+
 INTERNAL void otrng_tlv_free(tlv_s *tlv) {
   if (!tlv) {
     return;
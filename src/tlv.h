@@ -111,6 +111,28 @@ INTERNAL tlv_s *otrng_tlv_disconnected_new(void);
  **/
 INTERNAL tlv_list_s *otrng_parse_tlvs(const uint8_t *src, size_t len);
 
+/**
+ * @brief Like otrng_parse_tlvs, but the [data] of every TLV points into [src]
+ *    instead of being copied.
+ *
+ * @param [src] the pointer to where to start parsing. can't be NULL. it must
+ *    outlive the returned list.
+ * @param [len] the amount of data to parse. can be 0.
+ *
+ * @return the TLV list, if successful. it is the callers
+ *    responsibility to free it with otrng_tlv_list_free_views.
+ *    returns NULL if no TLVs can be found.
+ **/
+INTERNAL tlv_list_s *otrng_parse_tlv_views(uint8_t *src, size_t len);
+
+/**
+ * @brief Frees a list of TLVs returned by otrng_parse_tlv_views, leaving the
+ *    data they point to untouched.
+ *
+ * @param [tlvs] the first node of the list of TLVs to be freed. can be NULL.
+ **/
+INTERNAL void otrng_tlv_list_free_views(tlv_list_s *tlvs);
+
 /**
  * @brief creates a new TLV from the given data.
  *